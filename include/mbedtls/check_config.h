@@ -30,6 +30,11 @@
 #error "The NET module is not available for mbed OS - please use the network functions provided by Mbed OS"
 #endif
 
+#if defined(MBEDTLS_NET_URING_C) && \
+    ( !defined(MBEDTLS_NET_C) || !defined(MBEDTLS_SSL_TLS_C) )
+#error "MBEDTLS_NET_URING_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_HAVE_TIME_DATE) && !defined(MBEDTLS_HAVE_TIME)
 #error "MBEDTLS_HAVE_TIME_DATE without MBEDTLS_HAVE_TIME does not make sense"
 #endif
@@ -181,6 +186,12 @@
 #error "MBEDTLS_SSL_EARLY_DATA  defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_EARLY_DATA_REPLAY_C) &&                    \
+    ( !defined(MBEDTLS_SSL_EARLY_DATA) || !defined(MBEDTLS_SSL_SRV_C) || \
+      !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_EARLY_DATA_REPLAY_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C) && \
     defined(MBEDTLS_SSL_MAX_EARLY_DATA_SIZE) &&                      \
         ((MBEDTLS_SSL_MAX_EARLY_DATA_SIZE < 0) ||                    \
@@ -275,6 +286,76 @@
 #error "MBEDTLS_SSL_RENEGOTIATION defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_ADMISSION_C) &&                        \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_ADMISSION_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CERT_STORE_C) &&                      \
+    ( !defined(MBEDTLS_SSL_TLS_C) ||                            \
+      !defined(MBEDTLS_X509_CRT_PARSE_C) ||                     \
+      !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE) )
+#error "MBEDTLS_SSL_CERT_STORE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CONN_POOL_C) &&                       \
+    ( !defined(MBEDTLS_SSL_CLI_C) ||                            \
+      !defined(MBEDTLS_NET_C) ||                                \
+      !defined(MBEDTLS_HAVE_TIME) ||                            \
+      !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_CONN_POOL_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CTX_POOL_C) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_CTX_POOL_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_FULL_DUPLEX defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_GROUP_HINTS_C) &&                     \
+    ( !defined(MBEDTLS_SSL_CLI_C) ||                            \
+      !defined(MBEDTLS_SSL_PROTO_TLS1_3) ||                     \
+      !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_GROUP_HINTS_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_HANDSHAKE_TIMING defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_KTLS_C) &&                           \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_NET_C) )
+#error "MBEDTLS_SSL_KTLS_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_SCHEDULER_C) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_SCHEDULER_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C) &&                   \
+    ( !defined(MBEDTLS_SSL_CLI_C) ||                            \
+      !defined(MBEDTLS_HAVE_TIME) ||                            \
+      !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_SESSION_STORE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_SHM_CACHE_C) &&                      \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_SHM_CACHE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_SNI_STORE_C) &&                      \
+    ( !defined(MBEDTLS_SSL_SRV_C) ||                            \
+      !defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) )
+#error "MBEDTLS_SSL_SNI_STORE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_STATS) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_STATS defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_TICKET_C) && \
     !( defined(PSA_WANT_ALG_CCM) || defined(PSA_WANT_ALG_GCM) || \
     defined(PSA_WANT_ALG_CHACHA20_POLY1305) )
@@ -344,6 +425,10 @@
 #error "MBEDTLS_SSL_RECORD_SIZE_LIMIT defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_COMPACT_SESSION) && !defined(MBEDTLS_SSL_SRV_C)
+#error "MBEDTLS_SSL_COMPACT_SESSION defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION) && \
     !( defined(PSA_WANT_ALG_CCM) || defined(PSA_WANT_ALG_GCM) || \
     defined(PSA_WANT_ALG_CHACHA20_POLY1305) )
@@ -47,6 +47,25 @@
  */
 #define MBEDTLS_NET_C
 
+/**
+ * \def MBEDTLS_NET_URING_C
+ *
+ * Enable the io_uring based network transport (see mbedtls/net_uring.h).
+ *
+ * Event-driven servers can use it instead of mbedtls_net_send() and
+ * mbedtls_net_recv() to submit the reads and writes of many connections in a
+ * single system call.
+ *
+ * \note This module only works on Linux 5.6 or later.
+ *
+ * Module:  library/net_uring.c
+ *
+ * Requires: MBEDTLS_NET_C, MBEDTLS_SSL_TLS_C, Linux
+ *
+ * Uncomment this macro to enable the io_uring transport.
+ */
+//#define MBEDTLS_NET_URING_C
+
 /**
  * \def MBEDTLS_TIMING_ALT
  *
@@ -417,6 +436,24 @@
  */
 #define MBEDTLS_KEY_EXCHANGE_RSA_ENABLED
 
+/**
+ * \def MBEDTLS_SSL_ADMISSION_C
+ *
+ * Enable an implementation of the server-side admission control callback
+ * (see mbedtls_ssl_conf_admission()). It limits the rate of full handshakes
+ * with token buckets, globally and per client address prefix, lets session
+ * resumptions through in priority, and turns away clients whose address
+ * is not verified when the server is under pressure.
+ *
+ * Module:  library/ssl_admission.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_HAVE_TIME
+ *
+ * Uncomment this macro to enable the admission control module.
+ */
+//#define MBEDTLS_SSL_ADMISSION_C
+
 /**
  * \def MBEDTLS_SSL_ALL_ALERT_MESSAGES
  *
@@ -464,6 +501,26 @@
  */
 #define MBEDTLS_SSL_CACHE_C
 
+/**
+ * \def MBEDTLS_SSL_CERT_STORE_C
+ *
+ * Enable a reference-counted store of peer certificates (see
+ * mbedtls/ssl_cert_store.h). A session cache that uses it (see
+ * mbedtls_ssl_cache_set_cert_store()) keeps a single parsed copy of each
+ * distinct peer certificate, shared by all the cached sessions and the
+ * sessions loaded from the cache.
+ *
+ * Module:  library/ssl_cert_store.c
+ * Caller:  library/ssl_cache.c
+ *          library/ssl_tls.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_X509_CRT_PARSE_C,
+ *           MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
+ *
+ * Uncomment this macro to enable the certificate store.
+ */
+//#define MBEDTLS_SSL_CERT_STORE_C
+
 /**
  * \def MBEDTLS_SSL_CLI_C
  *
@@ -480,6 +537,41 @@
  */
 #define MBEDTLS_SSL_CLI_C
 
+/**
+ * \def MBEDTLS_SSL_COMPACT_SESSION
+ *
+ * Enable the compact session encoding, through use of the functions
+ * mbedtls_ssl_session_save_compact() and mbedtls_ssl_session_load_compact(),
+ * and its use for session tickets with mbedtls_ssl_ticket_set_compact().
+ *
+ * The compact encoding only holds what a server needs to resume a session,
+ * at fixed offsets, and leaves out the peer certificate unless asked to. It
+ * makes tickets smaller and cheaper to parse.
+ *
+ * Requires: MBEDTLS_SSL_SRV_C
+ *
+ * Uncomment this macro to enable the compact session encoding.
+ */
+//#define MBEDTLS_SSL_COMPACT_SESSION
+
+/**
+ * \def MBEDTLS_SSL_CONN_POOL_C
+ *
+ * Enable a pool of pre-established outbound TLS connections to an upstream
+ * server (see mbedtls_ssl_conn_pool_setup()). Connections are connected and
+ * handshaken in advance, handed out in constant time, and their SSL contexts
+ * are reused with mbedtls_ssl_session_reset().
+ *
+ * Module:  library/ssl_conn_pool.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_CLI_C, MBEDTLS_NET_C, MBEDTLS_HAVE_TIME,
+ *           MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to enable the outbound connection pool.
+ */
+//#define MBEDTLS_SSL_CONN_POOL_C
+
 /**
  * \def MBEDTLS_SSL_CONTEXT_SERIALIZATION
  *
@@ -519,6 +611,23 @@
  */
 #define MBEDTLS_SSL_COOKIE_C
 
+/**
+ * \def MBEDTLS_SSL_CTX_POOL_C
+ *
+ * Enable a pool of SSL contexts that are set up once for a configuration
+ * (see mbedtls_ssl_ctx_pool_setup()), acquired and released through a
+ * lock-free stack, and reset for reuse instead of being freed.
+ *
+ * Module:  library/ssl_ctx_pool.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, a compiler providing atomic operations
+ *           (GCC-compatible or 64-bit MSVC)
+ *
+ * Uncomment this macro to enable the SSL context pool.
+ */
+//#define MBEDTLS_SSL_CTX_POOL_C
+
 /**
  * \def MBEDTLS_SSL_DEBUG_ALL
  *
@@ -679,6 +788,22 @@
  */
 //#define MBEDTLS_SSL_EARLY_DATA
 
+/**
+ * \def MBEDTLS_SSL_EARLY_DATA_REPLAY_C
+ *
+ * Enable an implementation of the TLS 1.3 server-side callback that
+ * protects early data against replays, by recording the ClientHellos whose
+ * early data was accepted within a time window (RFC 8446 section 8).
+ *
+ * Module:  library/ssl_early_data_replay.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_EARLY_DATA, MBEDTLS_SSL_SRV_C, MBEDTLS_HAVE_TIME
+ *
+ * Uncomment this macro to enable the early data anti-replay callback.
+ */
+//#define MBEDTLS_SSL_EARLY_DATA_REPLAY_C
+
 /** \def MBEDTLS_SSL_ENCRYPT_THEN_MAC
  *
  * Enable support for Encrypt-then-MAC, RFC 7366.
@@ -711,6 +836,61 @@
  */
 #define MBEDTLS_SSL_EXTENDED_MASTER_SECRET
 
+/**
+ * \def MBEDTLS_SSL_FULL_DUPLEX
+ *
+ * Enable the full-duplex mode, where one thread may call mbedtls_ssl_read()
+ * while another thread calls mbedtls_ssl_write() on the same SSL context,
+ * once the handshake is over. See mbedtls_ssl_conf_full_duplex().
+ *
+ * This option pads the SSL context so that the incoming and outgoing record
+ * layer state are on different cache lines, see
+ * MBEDTLS_SSL_CACHE_LINE_SIZE.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, a compiler providing atomic operations
+ *           (GCC-compatible or MSVC)
+ *
+ * Uncomment this macro to enable the full-duplex mode.
+ */
+//#define MBEDTLS_SSL_FULL_DUPLEX
+
+/**
+ * \def MBEDTLS_SSL_GROUP_HINTS_C
+ *
+ * Enable a client-side store of the key exchange groups selected by TLS 1.3
+ * servers (see mbedtls_ssl_set_group_hints()). The first ClientHello sent
+ * to a known server carries a key share for the group that this server
+ * selected last time, which avoids a HelloRetryRequest round trip when the
+ * server does not prefer the first group of the configured list.
+ *
+ * Module:  library/ssl_group_hints.c
+ * Caller:  library/ssl_tls13_client.c
+ *
+ * Requires: MBEDTLS_SSL_CLI_C, MBEDTLS_SSL_PROTO_TLS1_3,
+ *           MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to enable the key share group hints store.
+ */
+//#define MBEDTLS_SSL_GROUP_HINTS_C
+
+/**
+ * \def MBEDTLS_SSL_HANDSHAKE_TIMING
+ *
+ * Enable handshake latency histograms.
+ *
+ * Each call to mbedtls_ssl_handshake_step() is timed, and the time spent
+ * in every handshake state, split between processing and waiting for the
+ * network, is aggregated into per-configuration histograms. See
+ * mbedtls_ssl_conf_handshake_timing().
+ *
+ * Module:  library/ssl_hs_timing.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment this macro to enable handshake latency histograms.
+ */
+//#define MBEDTLS_SSL_HANDSHAKE_TIMING
+
 /**
  * \def MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
  *
@@ -735,6 +915,23 @@
  */
 #define MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
 
+/**
+ * \def MBEDTLS_SSL_KTLS_C
+ *
+ * Enable offloading the record protection of established TLS connections
+ * to the Linux kernel (kernel TLS, see mbedtls_ssl_ktls_enable()). This
+ * allows sending files with sendfile() on TLS connections.
+ *
+ * Only AES-GCM and ChaCha20-Poly1305 ciphersuites can be offloaded.
+ *
+ * Module:  library/ssl_ktls.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_NET_C, Linux
+ *
+ * Uncomment this macro to enable kernel TLS offload.
+ */
+//#define MBEDTLS_SSL_KTLS_C
+
 /**
  * \def MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
  *
@@ -818,6 +1015,27 @@
  */
 #define MBEDTLS_SSL_RENEGOTIATION
 
+/**
+ * \def MBEDTLS_SSL_SCHEDULER_C
+ *
+ * Enable a cooperative scheduler (see mbedtls/ssl_scheduler.h) that drives
+ * many connections from a single-threaded event loop. Handshakes are run
+ * one step at a time in round robin, and established connections are
+ * served before handshakes.
+ *
+ * Enable MBEDTLS_ECP_RESTARTABLE to also split the EC operations that
+ * support it, and MBEDTLS_SSL_ASYNC_PRIVATE to offload the private key
+ * operations of a server.
+ *
+ * Module:  library/ssl_scheduler.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment this macro to enable the handshake scheduler.
+ */
+//#define MBEDTLS_SSL_SCHEDULER_C
+
 /**
  * \def MBEDTLS_SSL_SERVER_NAME_INDICATION
  *
@@ -843,6 +1061,62 @@
  */
 #define MBEDTLS_SSL_SESSION_TICKETS
 
+/**
+ * \def MBEDTLS_SSL_SESSION_STORE_C
+ *
+ * Enable a client-side session store (see mbedtls_ssl_conf_session_store()).
+ * Client contexts then resume sessions from the store and add the sessions
+ * and TLS 1.3 tickets they obtain to it automatically. Sessions are indexed
+ * by host name, port and ALPN protocols, and TLS 1.3 tickets are used only
+ * once.
+ *
+ * Module:  library/ssl_session_store.c
+ * Caller:  library/ssl_client.c
+ *          library/ssl_tls.c
+ *          library/ssl_tls13_client.c
+ *
+ * Requires: MBEDTLS_SSL_CLI_C, MBEDTLS_HAVE_TIME, MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to enable the client session store.
+ */
+//#define MBEDTLS_SSL_SESSION_STORE_C
+
+/**
+ * \def MBEDTLS_SSL_SHM_CACHE_C
+ *
+ * Enable a server session cache in shared memory (see
+ * mbedtls/ssl_shm_cache.h), to be used with mbedtls_ssl_conf_session_cache()
+ * by servers that fork worker processes, so that a session established by
+ * one worker can be resumed by all the others.
+ *
+ * \note This module only works on Unix-like systems.
+ *
+ * Module:  library/ssl_shm_cache.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_HAVE_TIME, Unix
+ *
+ * Uncomment this macro to enable the shared session cache.
+ */
+//#define MBEDTLS_SSL_SHM_CACHE_C
+
+/**
+ * \def MBEDTLS_SSL_SNI_STORE_C
+ *
+ * Enable a server certificate store indexed by host name, usable as the
+ * SNI callback (see mbedtls_ssl_conf_sni()). Exact names and wildcard
+ * names are looked up in hash tables, and the TLS 1.3 signature
+ * algorithms supported by each certificate are computed when it is added.
+ *
+ * Module:  library/ssl_sni_store.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_SSL_SERVER_NAME_INDICATION
+ *
+ * Uncomment this macro to enable the SNI certificate store.
+ */
+//#define MBEDTLS_SSL_SNI_STORE_C
+
 /**
  * \def MBEDTLS_SSL_SRV_C
  *
@@ -859,6 +1133,22 @@
  */
 #define MBEDTLS_SSL_SRV_C
 
+/**
+ * \def MBEDTLS_SSL_STATS
+ *
+ * Enable record layer statistics.
+ *
+ * Each SSL context counts records, bytes, decryption failures,
+ * retransmissions, renegotiations, WANT_READ/WANT_WRITE returns and buffer
+ * resizes. The counters can be aggregated per configuration, see
+ * mbedtls_ssl_conf_stats().
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment this macro to enable record layer statistics.
+ */
+//#define MBEDTLS_SSL_STATS
+
 /**
  * \def MBEDTLS_SSL_TICKET_C
  *
@@ -964,8 +1254,24 @@
 //#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
 
 //#define MBEDTLS_PSK_MAX_LEN               32 /**< Max size of TLS pre-shared keys, in bytes (default 256 or 384 bits) */
+//#define MBEDTLS_SSL_ADMISSION_DEFAULT_COOKIE_THRESHOLD 50 /**< Percentage of the global burst below which DTLS cookies are required */
+//#define MBEDTLS_SSL_ADMISSION_DEFAULT_PREFIX_RATE   20 /**< Full handshakes per second and per client address prefix */
+//#define MBEDTLS_SSL_ADMISSION_DEFAULT_RATE         200 /**< Full handshakes per second */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_MAX_ENTRIES      50 /**< Maximum entries in cache */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_TIMEOUT       86400 /**< 1 day  */
+//#define MBEDTLS_SSL_CACHE_LINE_SIZE             64 /**< Cache line size assumed by MBEDTLS_SSL_FULL_DUPLEX, in bytes */
+//#define MBEDTLS_SSL_CERT_STORE_BUCKETS          64 /**< Size of the certificate store hash table */
+//#define MBEDTLS_SSL_CONN_POOL_DEFAULT_MAX_IDLE 30000 /**< Time a pooled connection may stay idle, in milliseconds */
+//#define MBEDTLS_SSL_EARLY_DATA_REPLAY_WINDOW    10000 /**< Default early data anti-replay window, in milliseconds */
+//#define MBEDTLS_SSL_GROUP_HINTS_DEFAULT_MAX_ENTRIES 64 /**< Maximum number of servers in a group hints store */
+//#define MBEDTLS_SSL_SESSION_STORE_DEFAULT_MAX_ENTRIES 256 /**< Maximum number of servers in a client session store */
+//#define MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT 86400 /**< Lifetime of TLS 1.2 sessions in a client session store, in seconds */
+//#define MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS         4 /**< Maximum number of TLS 1.3 tickets kept per server */
+//#define MBEDTLS_SSL_SHM_CACHE_DEFAULT_MAX_ENTRIES 1024 /**< Maximum entries in a shared session cache */
+//#define MBEDTLS_SSL_SHM_CACHE_DEFAULT_SESSION_LEN 2048 /**< Maximum size of a session in a shared session cache, in bytes */
+//#define MBEDTLS_SSL_SHM_CACHE_DEFAULT_TIMEOUT  86400 /**< Lifetime of the entries of a shared session cache, in seconds */
+//#define MBEDTLS_SSL_SHM_CACHE_WAYS                 4 /**< Number of slots of a shared session cache a session ID may map to */
+//#define MBEDTLS_SSL_SNI_STORE_INITIAL_BUCKETS      64 /**< Initial size of the SNI store hash tables, power of 2 */
 
 /** \def MBEDTLS_SSL_CID_IN_LEN_MAX
  *
@@ -1030,6 +1336,26 @@
  */
 //#define MBEDTLS_SSL_DTLS_MAX_BUFFERING             32768
 
+/** \def MBEDTLS_SSL_DTLS_PMTUD_MAX_PROBES
+ *
+ * Number of consecutive lost probes after which DTLS path MTU discovery
+ * gives up a datagram size, see mbedtls_ssl_conf_dtls_pmtud().
+ * RFC 8899 uses 3.
+ */
+//#define MBEDTLS_SSL_DTLS_PMTUD_MAX_PROBES          3
+
+/** \def MBEDTLS_SSL_DTLS_RTO_MIN
+ *
+ * Lower bound, in milliseconds, of the DTLS handshake retransmission timeout
+ * computed from the measured round-trip time, see
+ * mbedtls_ssl_conf_dtls_rto().
+ *
+ * RFC 6298 recommends 1 second for TCP. Lower values allow faster recovery
+ * from losses on low-latency links, at the risk of spurious retransmissions
+ * when the peer is slow to compute its next flight.
+ */
+//#define MBEDTLS_SSL_DTLS_RTO_MIN                   200
+
 /** \def MBEDTLS_SSL_IN_CONTENT_LEN
  *
  * Maximum length (in bytes) of incoming plaintext fragments.
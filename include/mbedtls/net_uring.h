@@ -0,0 +1,273 @@
+/**
+ * \file net_uring.h
+ *
+ * \brief   io_uring based network transport for event-driven servers.
+ *
+ *          The receive and send callbacks of this module do not perform
+ *          any system call. They queue the operation on an io_uring
+ *          submission queue and return #MBEDTLS_ERR_SSL_WANT_READ or
+ *          #MBEDTLS_ERR_SSL_WANT_WRITE. The event loop then submits the
+ *          operations of all its connections and collects their completions
+ *          with a single call to mbedtls_net_uring_run(), and retries the
+ *          SSL functions of the connections that have completions. The retry
+ *          returns the result of the completed operation.
+ *
+ *          Operations on the input and output buffers of an SSL context
+ *          registered with mbedtls_net_uring_register_ssl() use the
+ *          io_uring fixed buffers, so the kernel accesses the record
+ *          buffers directly without mapping them for every operation.
+ *
+ *          This module only works on Linux 5.6 or later (5.19 or later for
+ *          registered buffers).
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_NET_URING_H
+#define MBEDTLS_NET_URING_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * io_uring instance shared by many connections.
+ */
+typedef struct mbedtls_net_uring {
+    int MBEDTLS_PRIVATE(fd);                 /*!< io_uring file descriptor        */
+    unsigned MBEDTLS_PRIVATE(features);      /*!< IORING_FEAT_xxx                 */
+
+    void *MBEDTLS_PRIVATE(sq_map);           /*!< submission ring mapping         */
+    size_t MBEDTLS_PRIVATE(sq_map_len);
+    void *MBEDTLS_PRIVATE(cq_map);           /*!< completion ring mapping, may be
+                                                  the same as sq_map             */
+    size_t MBEDTLS_PRIVATE(cq_map_len);
+    void *MBEDTLS_PRIVATE(sqes);             /*!< submission queue entries        */
+    size_t MBEDTLS_PRIVATE(sqes_len);
+
+    unsigned *MBEDTLS_PRIVATE(sq_head);      /*!< shared with the kernel          */
+    unsigned *MBEDTLS_PRIVATE(sq_tail);
+    unsigned *MBEDTLS_PRIVATE(sq_array);
+    unsigned MBEDTLS_PRIVATE(sq_mask);
+    unsigned MBEDTLS_PRIVATE(sq_entries);
+    unsigned *MBEDTLS_PRIVATE(cq_head);
+    unsigned *MBEDTLS_PRIVATE(cq_tail);
+    void *MBEDTLS_PRIVATE(cqes);
+    unsigned MBEDTLS_PRIVATE(cq_mask);
+    unsigned MBEDTLS_PRIVATE(cq_entries);
+
+    unsigned MBEDTLS_PRIVATE(queued);        /*!< entries not submitted yet       */
+    unsigned MBEDTLS_PRIVATE(inflight);      /*!< operations without completion   */
+
+    unsigned MBEDTLS_PRIVATE(nr_bufs);       /*!< size of the fixed buffer table,
+                                                  0 if not supported             */
+    unsigned char *MBEDTLS_PRIVATE(buf_used); /*!< used slots of the table       */
+
+    /** Connections that could not queue an operation because the queues
+     *  were full, reported as ready by the next mbedtls_net_uring_run(). */
+    struct mbedtls_net_uring_conn *MBEDTLS_PRIVATE(deferred);
+} mbedtls_net_uring;
+
+/**
+ * State of one direction of a connection.
+ */
+typedef struct mbedtls_net_uring_op {
+    unsigned char *MBEDTLS_PRIVATE(buf);     /*!< buffer of the queued operation  */
+    size_t MBEDTLS_PRIVATE(len);             /*!< length of the queued operation  */
+    int MBEDTLS_PRIVATE(state);              /*!< idle, in flight or completed    */
+    int MBEDTLS_PRIVATE(res);                /*!< result of the completion        */
+} mbedtls_net_uring_op;
+
+/**
+ * Connection using an io_uring instance. This is the context of the
+ * mbedtls_net_uring_send() and mbedtls_net_uring_recv() callbacks.
+ */
+typedef struct mbedtls_net_uring_conn {
+    mbedtls_net_uring *MBEDTLS_PRIVATE(ring);
+    int MBEDTLS_PRIVATE(fd);                 /*!< connected socket                */
+    mbedtls_net_uring_op MBEDTLS_PRIVATE(rx);
+    mbedtls_net_uring_op MBEDTLS_PRIVATE(tx);
+    int MBEDTLS_PRIVATE(ready);              /*!< already reported as ready       */
+    int MBEDTLS_PRIVATE(is_deferred);        /*!< in the deferred list            */
+    struct mbedtls_net_uring_conn *MBEDTLS_PRIVATE(next_deferred);
+
+    /* Fixed buffers, see mbedtls_net_uring_register_ssl() */
+    int MBEDTLS_PRIVATE(in_index);           /*!< table slot, or -1               */
+    unsigned char *MBEDTLS_PRIVATE(in_buf);
+    size_t MBEDTLS_PRIVATE(in_len);
+    int MBEDTLS_PRIVATE(out_index);          /*!< table slot, or -1               */
+    unsigned char *MBEDTLS_PRIVATE(out_buf);
+    size_t MBEDTLS_PRIVATE(out_len);
+} mbedtls_net_uring_conn;
+
+/**
+ * \brief          Initialize an io_uring instance context.
+ *
+ * \param ring     Context to initialize.
+ */
+void mbedtls_net_uring_init(mbedtls_net_uring *ring);
+
+/**
+ * \brief          Create the io_uring instance.
+ *
+ * \param ring     Context initialized with mbedtls_net_uring_init().
+ * \param entries  Size of the submission queue, at least twice the number
+ *                 of connections that submit in each batch. The completion
+ *                 queue is twice as large.
+ * \param max_conns  Number of connections that may have their SSL buffers
+ *                 registered with mbedtls_net_uring_register_ssl(), or \c 0.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_NET_SOCKET_FAILED if the kernel does not
+ *                 support io_uring or it is disabled.
+ * \return         #MBEDTLS_ERR_NET_BAD_INPUT_DATA or
+ *                 #MBEDTLS_ERR_SSL_ALLOC_FAILED on other failures.
+ *
+ * \note           If the kernel does not support sparse fixed buffer tables,
+ *                 this function succeeds, but the SSL buffers are not
+ *                 registered: all operations use plain \c recv and \c send
+ *                 requests.
+ */
+int mbedtls_net_uring_setup(mbedtls_net_uring *ring, unsigned entries,
+                            unsigned max_conns);
+
+/**
+ * \brief          Free an io_uring instance.
+ *
+ * \note           Operations still in flight are cancelled by the kernel.
+ *                 Their connections must not be used afterwards.
+ *
+ * \param ring     Context to free.
+ */
+void mbedtls_net_uring_free(mbedtls_net_uring *ring);
+
+/**
+ * \brief          Set up a connection on an io_uring instance.
+ *
+ * \param conn     Connection context.
+ * \param ring     io_uring instance.
+ * \param fd       Connected socket. It is not closed by this module.
+ */
+void mbedtls_net_uring_conn_init(mbedtls_net_uring_conn *conn,
+                                 mbedtls_net_uring *ring, int fd);
+
+/**
+ * \brief          Register the input and output buffers of an SSL context
+ *                 as io_uring fixed buffers.
+ *
+ *                 Call this function after mbedtls_ssl_setup(), and again
+ *                 after each buffer resizing if
+ *                 MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH is enabled. Until then,
+ *                 operations on other memory use plain requests.
+ *
+ * \param conn     Connection context.
+ * \param ssl      SSL context using \p conn as BIO.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the instance has no
+ *                 fixed buffer table. The connection still works.
+ * \return         #MBEDTLS_ERR_NET_BUFFER_TOO_SMALL if the table is full.
+ * \return         #MBEDTLS_ERR_NET_BAD_INPUT_DATA if an operation is in
+ *                 flight, or the kernel refused the buffers.
+ */
+int mbedtls_net_uring_register_ssl(mbedtls_net_uring_conn *conn,
+                                   const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Check whether a connection has operations in flight.
+ *
+ *                 A connection must not be freed, nor its buffers, while
+ *                 this is the case. Call \c shutdown() on the socket to
+ *                 complete them, then mbedtls_net_uring_run().
+ *
+ * \param conn     Connection context.
+ *
+ * \return         \c 1 if an operation is in flight, \c 0 otherwise.
+ */
+int mbedtls_net_uring_conn_busy(const mbedtls_net_uring_conn *conn);
+
+/**
+ * \brief          Release the fixed buffer slots of a connection.
+ *
+ * \param conn     Connection context, which must not be busy.
+ */
+void mbedtls_net_uring_conn_free(mbedtls_net_uring_conn *conn);
+
+/**
+ * \brief          Submit the queued operations and collect completions, in
+ *                 a single system call.
+ *
+ * \param ring     io_uring instance.
+ * \param wait_nr  Minimum number of completions to wait for. With \c 0, the
+ *                 function does not block.
+ * \param ready    Array receiving the connections with at least one
+ *                 completed operation. Each connection appears at most once.
+ *                 The caller retries the SSL function that returned
+ *                 #MBEDTLS_ERR_SSL_WANT_READ or #MBEDTLS_ERR_SSL_WANT_WRITE
+ *                 for each of them.
+ * \param max_ready  Size of \p ready. Completions that do not fit are kept
+ *                 for the next call.
+ *
+ * \return         The number of connections in \p ready on success.
+ * \return         #MBEDTLS_ERR_NET_POLL_FAILED if \c io_uring_enter failed.
+ */
+int mbedtls_net_uring_run(mbedtls_net_uring *ring, unsigned wait_nr,
+                          mbedtls_net_uring_conn **ready, size_t max_ready);
+
+/**
+ * \brief          Write at most 'len' characters. This is an
+ *                 #mbedtls_ssl_send_t callback.
+ *
+ *                 The first call queues a send request and returns
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE. Once mbedtls_net_uring_run()
+ *                 reported its completion, the retry with the same
+ *                 arguments returns the number of bytes sent.
+ *
+ * \param ctx      Connection context (mbedtls_net_uring_conn).
+ * \param buf      The buffer to read from. It must remain valid until
+ *                 the operation completes.
+ * \param len      The length of the buffer.
+ *
+ * \return         The number of bytes sent, or a non-zero error code:
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE while the request is queued or
+ *                 in flight, #MBEDTLS_ERR_NET_CONN_RESET or
+ *                 #MBEDTLS_ERR_NET_SEND_FAILED.
+ */
+int mbedtls_net_uring_send(void *ctx, const unsigned char *buf, size_t len);
+
+/**
+ * \brief          Read at most 'len' characters. This is an
+ *                 #mbedtls_ssl_recv_t callback.
+ *
+ *                 The first call queues a receive request and returns
+ *                 #MBEDTLS_ERR_SSL_WANT_READ. Once mbedtls_net_uring_run()
+ *                 reported its completion, the retry with the same
+ *                 arguments returns the received data.
+ *
+ * \param ctx      Connection context (mbedtls_net_uring_conn).
+ * \param buf      The buffer to write to. It must remain valid until
+ *                 the operation completes.
+ * \param len      Maximum length of the buffer.
+ *
+ * \return         The number of bytes received, \c 0 at the end of the
+ *                 stream, or a non-zero error code:
+ *                 #MBEDTLS_ERR_SSL_WANT_READ while the request is queued or
+ *                 in flight, #MBEDTLS_ERR_NET_CONN_RESET or
+ *                 #MBEDTLS_ERR_NET_RECV_FAILED.
+ */
+int mbedtls_net_uring_recv(void *ctx, unsigned char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* net_uring.h */
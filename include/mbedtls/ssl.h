@@ -102,7 +102,8 @@
 #define MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA               -0x7C00
 /** Not possible to write early data */
 #define MBEDTLS_ERR_SSL_CANNOT_WRITE_EARLY_DATA           -0x7C80
-/* Error space gap */
+/** The handshake was refused by the server's admission control. */
+#define MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED                -0x7D00
 /* Error space gap */
 /* Error space gap */
 /* Error space gap */
@@ -310,6 +311,18 @@
 #define MBEDTLS_SSL_ANTI_REPLAY_DISABLED        0
 #define MBEDTLS_SSL_ANTI_REPLAY_ENABLED         1
 
+#define MBEDTLS_SSL_DTLS_RTO_FIXED              0
+#define MBEDTLS_SSL_DTLS_RTO_ADAPTIVE           1
+
+#define MBEDTLS_SSL_READ_AHEAD_DISABLED         0
+#define MBEDTLS_SSL_READ_AHEAD_ENABLED          1
+
+#define MBEDTLS_SSL_KTLS_DISABLED               0
+#define MBEDTLS_SSL_KTLS_ENABLED                1
+
+#define MBEDTLS_SSL_FULL_DUPLEX_DISABLED        0
+#define MBEDTLS_SSL_FULL_DUPLEX_ENABLED         1
+
 #define MBEDTLS_SSL_RENEGOTIATION_NOT_ENFORCED  -1
 #define MBEDTLS_SSL_RENEGO_MAX_RECORDS_DEFAULT  16
 
@@ -408,6 +421,20 @@
 #define MBEDTLS_SSL_DTLS_MAX_BUFFERING 32768
 #endif
 
+/*
+ * Number of lost DTLS path MTU probes after which a size is given up.
+ */
+#if !defined(MBEDTLS_SSL_DTLS_PMTUD_MAX_PROBES)
+#define MBEDTLS_SSL_DTLS_PMTUD_MAX_PROBES 3
+#endif
+
+/*
+ * Lower bound of the adaptive DTLS retransmission timeout, in milliseconds.
+ */
+#if !defined(MBEDTLS_SSL_DTLS_RTO_MIN)
+#define MBEDTLS_SSL_DTLS_RTO_MIN 200
+#endif
+
 /*
  * Maximum length of CIDs for incoming and outgoing messages.
  */
@@ -439,6 +466,14 @@
 #define MBEDTLS_SSL_TLS1_3_DEFAULT_NEW_SESSION_TICKETS 1
 #endif
 
+/*
+ * Size of the padding between the incoming and outgoing state of an SSL
+ * context in full-duplex mode.
+ */
+#if !defined(MBEDTLS_SSL_CACHE_LINE_SIZE)
+#define MBEDTLS_SSL_CACHE_LINE_SIZE 64
+#endif
+
 /** \} name SECTION: Module settings */
 
 /*
@@ -867,6 +902,15 @@ typedef struct mbedtls_ssl_key_cert mbedtls_ssl_key_cert;
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 typedef struct mbedtls_ssl_flight_item mbedtls_ssl_flight_item;
 #endif
+typedef struct mbedtls_ssl_conf_tables mbedtls_ssl_conf_tables;
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+/* Defined in mbedtls/ssl_hs_timing.h */
+typedef struct mbedtls_ssl_hs_timing mbedtls_ssl_hs_timing;
+#endif
+
+/* Defined in mbedtls/ssl_session_store.h */
+typedef struct mbedtls_ssl_session_store mbedtls_ssl_session_store;
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
 #define MBEDTLS_SSL_TLS1_3_TICKET_ALLOW_PSK_RESUMPTION                          \
@@ -1219,6 +1263,7 @@ typedef enum {
  *  - in library/ssl_tls.c:
  *      mbedtls_ssl_session_init() and mbedtls_ssl_session_free()
  *      mbedtls_ssl_session_save() and ssl_session_load()
+ *      mbedtls_ssl_session_save_compact() and ssl_session_load_compact()
  *      ssl_session_copy()
  */
 struct mbedtls_ssl_session {
@@ -1250,6 +1295,10 @@ struct mbedtls_ssl_session {
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
     mbedtls_x509_crt *MBEDTLS_PRIVATE(peer_cert);       /*!< peer X.509 cert chain */
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    unsigned char MBEDTLS_PRIVATE(peer_cert_shared);    /*!< peer_cert belongs to a
+                                                             certificate store */
+#endif
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
     /*! The digest of the peer's end-CRT. This must be kept to detect CRT
      *  changes during renegotiation, mitigating the triple handshake attack. */
@@ -1306,6 +1355,15 @@ struct mbedtls_ssl_session {
     /*! Time in milliseconds when the last ticket was received. */
     mbedtls_ms_time_t MBEDTLS_PRIVATE(ticket_reception_time);
 #endif
+
+#if defined(MBEDTLS_SSL_CLI_C)
+    /*! Early secret and binder key of the ticket PSK, derived once from
+     *  resumption_key and not serialized. A length of 0 means that they
+     *  have not been derived yet. */
+    uint8_t MBEDTLS_PRIVATE(psk_secrets_len);
+    unsigned char MBEDTLS_PRIVATE(psk_early_secret)[MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN];
+    unsigned char MBEDTLS_PRIVATE(psk_binder_key)[MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN];
+#endif
 #endif /*  MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_SESSION_TICKETS */
 
 #if defined(MBEDTLS_SSL_EARLY_DATA)
@@ -1398,6 +1456,67 @@ typedef union {
     void *p;                    /* typically a pointer to extra data */
 } mbedtls_ssl_user_data_t;
 
+#if defined(MBEDTLS_SSL_PROTO_DTLS) && defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Round-trip time estimate of a DTLS peer, used to compute
+ *                 the handshake retransmission timeout.
+ *                 See mbedtls_ssl_conf_dtls_rto().
+ */
+typedef struct mbedtls_ssl_dtls_rtt {
+    uint32_t MBEDTLS_PRIVATE(srtt);      /*!< smoothed RTT, in 1/8 ms, or 0 if
+                                              nothing was measured yet      */
+    uint32_t MBEDTLS_PRIVATE(rttvar);    /*!< RTT variation, in 1/4 ms      */
+} mbedtls_ssl_dtls_rtt;
+#endif /* MBEDTLS_SSL_PROTO_DTLS && MBEDTLS_HAVE_TIME */
+
+#if defined(MBEDTLS_SSL_STATS)
+/**
+ * \brief          Record layer statistics.
+ *
+ *                 One instance lives in every SSL context and counts the
+ *                 events seen by that connection. Another instance can be
+ *                 attached to an SSL configuration with
+ *                 mbedtls_ssl_conf_stats() to aggregate the counters of all
+ *                 contexts using that configuration.
+ *
+ * \note           The fields of this structure are public so that a
+ *                 snapshot obtained with mbedtls_ssl_get_stats() or
+ *                 mbedtls_ssl_stats_read() can be inspected directly.
+ *                 Do not read a shared (per-configuration) instance directly
+ *                 while contexts may update it: use mbedtls_ssl_stats_read().
+ */
+typedef struct mbedtls_ssl_stats {
+    uint64_t records_in;        /*!< records received and decrypted        */
+    uint64_t records_out;       /*!< records written                       */
+    uint64_t bytes_in;          /*!< bytes read from the transport         */
+    uint64_t bytes_out;         /*!< bytes written to the transport        */
+    uint64_t decrypt_failures;  /*!< records whose decryption failed       */
+    uint64_t retransmissions;   /*!< DTLS handshake flight retransmissions */
+    uint64_t renegotiations;    /*!< renegotiations started                */
+    uint64_t want_read;         /*!< receive callback returned WANT_READ   */
+    uint64_t want_write;        /*!< send callback returned WANT_WRITE     */
+    uint64_t buffer_resizes;    /*!< I/O buffer reallocations              */
+} mbedtls_ssl_stats;
+#endif /* MBEDTLS_SSL_STATS */
+
+/**
+ * \brief          Bulk write operation: a large buffer of application data
+ *                 protected into consecutive TLS records in a buffer provided
+ *                 by the caller. See mbedtls_ssl_bulk_write_setup().
+ */
+typedef struct mbedtls_ssl_bulk_write {
+    mbedtls_ssl_context *MBEDTLS_PRIVATE(ssl);
+    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform);
+    const unsigned char *MBEDTLS_PRIVATE(buf);    /*!< application data         */
+    size_t MBEDTLS_PRIVATE(len);                  /*!< length of buf            */
+    unsigned char *MBEDTLS_PRIVATE(out);          /*!< protected records        */
+    size_t MBEDTLS_PRIVATE(out_len);              /*!< total length of records  */
+    size_t MBEDTLS_PRIVATE(record_len);           /*!< payload of a full record */
+    size_t MBEDTLS_PRIVATE(record_out_len);       /*!< size of a full record    */
+    size_t MBEDTLS_PRIVATE(records);              /*!< number of records        */
+    uint64_t MBEDTLS_PRIVATE(first_ctr);          /*!< sequence number of the first record */
+} mbedtls_ssl_bulk_write;
+
 /**
  * SSL/TLS configuration to be shared between mbedtls_ssl_context structures.
  */
@@ -1434,6 +1553,20 @@ struct mbedtls_ssl_config {
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
     uint8_t MBEDTLS_PRIVATE(anti_replay);   /*!< detect and prevent replay?         */
 #endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS) && defined(MBEDTLS_HAVE_TIME)
+    uint8_t MBEDTLS_PRIVATE(dtls_rto);      /*!< DTLS: retransmission timeout from
+                                                 the measured round-trip time?     */
+#endif
+    uint8_t MBEDTLS_PRIVATE(read_ahead);    /*!< TLS: read more than one record
+                                                 per call to \c f_recv?            */
+#if defined(MBEDTLS_SSL_KTLS_C)
+    uint8_t MBEDTLS_PRIVATE(ktls);          /*!< make traffic keys exportable to
+                                                 the kernel?                       */
+#endif
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    uint8_t MBEDTLS_PRIVATE(full_duplex);   /*!< TLS: allow concurrent read and
+                                                 write after the handshake?        */
+#endif
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
     uint8_t MBEDTLS_PRIVATE(disable_renegotiation); /*!< disable renegotiation?     */
 #endif
@@ -1521,6 +1654,12 @@ struct mbedtls_ssl_config {
     void *MBEDTLS_PRIVATE(p_cookie);                 /*!< context for the cookie callbacks   */
 #endif
 
+#if defined(MBEDTLS_SSL_SRV_C)
+    /** Callback to admit, shed or challenge incoming handshakes            */
+    int(*MBEDTLS_PRIVATE(f_admission))(void *, const unsigned char *, size_t, int);
+    void *MBEDTLS_PRIVATE(p_admission);              /*!< context for admission control      */
+#endif
+
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_SRV_C)
     /** Callback to create & write a session ticket                         */
     int(*MBEDTLS_PRIVATE(f_ticket_write))(void *, const mbedtls_ssl_session *,
@@ -1609,6 +1748,11 @@ struct mbedtls_ssl_config {
 #if defined(MBEDTLS_SSL_SRV_C)
     /* The maximum amount of 0-RTT data. RFC 8446 section 4.6.1 */
     uint32_t MBEDTLS_PRIVATE(max_early_data_size);
+
+    /** Callback to detect replayed ClientHellos carrying early data */
+    int(*MBEDTLS_PRIVATE(f_early_data_replay))(void *, const unsigned char *,
+                                               size_t, int32_t);
+    void *MBEDTLS_PRIVATE(p_early_data_replay);  /*!< context for replay detection */
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #endif /* MBEDTLS_SSL_EARLY_DATA */
@@ -1635,6 +1779,9 @@ struct mbedtls_ssl_config {
                                                         retransmission timeout (ms)        */
     uint32_t MBEDTLS_PRIVATE(hs_timeout_max);        /*!< maximum value of the handshake
                                                         retransmission timeout (ms)        */
+    uint16_t MBEDTLS_PRIVATE(pmtud_base);            /*!< PMTU assumed before discovery     */
+    uint16_t MBEDTLS_PRIVATE(pmtud_max);             /*!< largest PMTU probed, or 0 if
+                                                        discovery is disabled              */
 #endif
 
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
@@ -1645,6 +1792,10 @@ struct mbedtls_ssl_config {
 
     unsigned int MBEDTLS_PRIVATE(badmac_limit);      /*!< limit of records with a bad MAC    */
 
+    uint16_t MBEDTLS_PRIVATE(record_small_len);      /*!< payload of warm-up records, or 0   */
+    uint32_t MBEDTLS_PRIVATE(record_boost_threshold); /*!< bytes sent before full records    */
+    uint32_t MBEDTLS_PRIVATE(record_idle_timeout);   /*!< idle time before warm-up again (ms) */
+
 #if defined(MBEDTLS_DHM_C) && defined(MBEDTLS_SSL_CLI_C)
     unsigned int MBEDTLS_PRIVATE(dhm_min_bitlen);    /*!< min. bit length of the DHM prime   */
 #endif
@@ -1663,6 +1814,21 @@ struct mbedtls_ssl_config {
 #if defined(MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED)
     const mbedtls_x509_crt *MBEDTLS_PRIVATE(dn_hints);/*!< acceptable client cert issuers    */
 #endif
+
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats *MBEDTLS_PRIVATE(stats);      /*!< shared statistics, or NULL      */
+#endif
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+    mbedtls_ssl_hs_timing *MBEDTLS_PRIVATE(hs_timing); /*!< handshake histograms, or NULL */
+#endif
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    mbedtls_ssl_session_store *MBEDTLS_PRIVATE(session_store); /*!< client sessions, or NULL */
+#endif
+
+    mbedtls_ssl_conf_tables *MBEDTLS_PRIVATE(tables); /*!< precomputed by
+                                                         mbedtls_ssl_conf_finalize() */
 };
 
 struct mbedtls_ssl_context {
@@ -1786,11 +1952,15 @@ struct mbedtls_ssl_context {
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t MBEDTLS_PRIVATE(in_buf_len);          /*!< length of input buffer           */
 #endif
+    size_t MBEDTLS_PRIVATE(in_buf_dirty);        /*!< length of the start of the input
+                                                    buffer that may hold data, zeroized
+                                                    on reset                         */
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint16_t MBEDTLS_PRIVATE(in_epoch);          /*!< DTLS epoch for incoming records  */
-    size_t MBEDTLS_PRIVATE(next_record_offset);  /*!< offset of the next record in datagram
-                                                    (equal to in_left if none)       */
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
+    size_t MBEDTLS_PRIVATE(next_record_offset);  /*!< offset of the next record in datagram,
+                                                    or in read-ahead data (TLS)
+                                                    (equal to in_left if none)       */
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
     uint64_t MBEDTLS_PRIVATE(in_window_top);     /*!< last validated record seq_num    */
     uint64_t MBEDTLS_PRIVATE(in_window);         /*!< bitmask for replay detection     */
@@ -1819,6 +1989,9 @@ struct mbedtls_ssl_context {
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint8_t MBEDTLS_PRIVATE(disable_datagram_packing);  /*!< Disable packing multiple records
                                                          *   within a single datagram.  */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ssl_dtls_rtt MBEDTLS_PRIVATE(rtt);          /*!< Round-trip time estimate   */
+#endif
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 #if defined(MBEDTLS_SSL_EARLY_DATA)
@@ -1834,6 +2007,26 @@ struct mbedtls_ssl_context {
     uint32_t MBEDTLS_PRIVATE(total_early_data_size); /*!< Number of received/written early data bytes */
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /*
+     * Full-duplex mode, see mbedtls_ssl_conf_full_duplex(). The fields above
+     * belong to mbedtls_ssl_read() and the fields below to mbedtls_ssl_write().
+     * The padding keeps them, and the hand-over between them, on separate
+     * cache lines.
+     */
+    unsigned char MBEDTLS_PRIVATE(duplex_pad_in)[MBEDTLS_SSL_CACHE_LINE_SIZE];
+    uint8_t MBEDTLS_PRIVATE(duplex);             /*!< set once the handshake is over
+                                                    if full-duplex is configured   */
+    uint32_t MBEDTLS_PRIVATE(duplex_flags);      /*!< MBEDTLS_SSL_DUPLEX_xxx, only
+                                                    accessed atomically            */
+    unsigned char MBEDTLS_PRIVATE(duplex_alert_type);  /*!< warning alert and */
+    unsigned char MBEDTLS_PRIVATE(duplex_fatal_type);  /*!< fatal alert handed
+                                                          over to the writer  */
+    int MBEDTLS_PRIVATE(duplex_alert_reason);    /*!< error returned by the writer
+                                                    after a fatal alert            */
+    unsigned char MBEDTLS_PRIVATE(duplex_pad_out)[MBEDTLS_SSL_CACHE_LINE_SIZE];
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
     /*
      * Record layer (outgoing data)
      */
@@ -1851,15 +2044,41 @@ struct mbedtls_ssl_context {
     int MBEDTLS_PRIVATE(out_msgtype);            /*!< record header: message type      */
     size_t MBEDTLS_PRIVATE(out_msglen);          /*!< record header: message length    */
     size_t MBEDTLS_PRIVATE(out_left);            /*!< amount of data not yet written   */
+    uint8_t MBEDTLS_PRIVATE(out_corked);         /*!< TLS: application data records
+                                                    are packed, see mbedtls_ssl_cork() */
+    uint8_t MBEDTLS_PRIVATE(out_packed);         /*!< out_left only holds records
+                                                    packed while corked            */
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    uint8_t MBEDTLS_PRIVATE(duplex_alert_sending); /*!< level of the alert handed
+                                                      over by the reader that
+                                                      out_left holds, or 0     */
+#endif
+    size_t MBEDTLS_PRIVATE(record_warm_bytes);   /*!< application data sent since the
+                                                    start or the last idle period   */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(record_last_write); /*!< time of the last write */
+#endif
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t MBEDTLS_PRIVATE(out_buf_len);         /*!< length of output buffer          */
 #endif
+    size_t MBEDTLS_PRIVATE(out_buf_dirty);       /*!< length of the start of the output
+                                                    buffer that may hold data, zeroized
+                                                    on reset                         */
 
     unsigned char MBEDTLS_PRIVATE(cur_out_ctr)[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN]; /*!<  Outgoing record sequence  number. */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint16_t MBEDTLS_PRIVATE(mtu);               /*!< path mtu, used to fragment outgoing messages */
+    uint16_t MBEDTLS_PRIVATE(pmtu);              /*!< path mtu confirmed by discovery, or 0 */
+    uint16_t MBEDTLS_PRIVATE(pmtu_probe);        /*!< datagram size being probed        */
+    uint16_t MBEDTLS_PRIVATE(pmtu_high);         /*!< largest size not known to be lost,
+                                                    or 0 before discovery starts    */
+    uint8_t MBEDTLS_PRIVATE(pmtu_state);         /*!< probe state                       */
+    uint8_t MBEDTLS_PRIVATE(pmtu_lost);          /*!< probes of this size lost so far   */
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    unsigned char MBEDTLS_PRIVATE(duplex_pad_end)[MBEDTLS_SSL_CACHE_LINE_SIZE];
+#endif
 
     /*
      * User settings
@@ -1869,6 +2088,15 @@ struct mbedtls_ssl_context {
                                                     (and SNI if available)                 */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
+#if defined(MBEDTLS_SSL_GROUP_HINTS_C)
+    struct mbedtls_ssl_group_hints *MBEDTLS_PRIVATE(group_hints); /*!< groups chosen by servers */
+    uint16_t MBEDTLS_PRIVATE(group_hints_port);  /*!< server port, key of group_hints    */
+#endif /* MBEDTLS_SSL_GROUP_HINTS_C */
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    uint16_t MBEDTLS_PRIVATE(server_port);       /*!< server port, key of session_store  */
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
 #if defined(MBEDTLS_SSL_ALPN)
     const char *MBEDTLS_PRIVATE(alpn_chosen);    /*!<  negotiated protocol                   */
 #endif /* MBEDTLS_SSL_ALPN */
@@ -1888,6 +2116,11 @@ struct mbedtls_ssl_context {
     size_t          MBEDTLS_PRIVATE(cli_id_len);     /*!<  length of cli_id                  */
 #endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY && MBEDTLS_SSL_SRV_C */
 
+#if defined(MBEDTLS_SSL_SRV_C)
+    unsigned char   MBEDTLS_PRIVATE(peer_addr)[16];  /*!<  client IP address, for admission  */
+    size_t          MBEDTLS_PRIVATE(peer_addr_len);  /*!<  length of peer_addr, 4 or 16      */
+#endif /* MBEDTLS_SSL_SRV_C */
+
     /*
      * Secure renegotiation
      */
@@ -1919,6 +2152,32 @@ struct mbedtls_ssl_context {
     mbedtls_ssl_export_keys_t *MBEDTLS_PRIVATE(f_export_keys);
     void *MBEDTLS_PRIVATE(p_export_keys);            /*!< context for key export callback    */
 
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats MBEDTLS_PRIVATE(stats);        /*!< per-connection statistics          */
+#endif
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+    /*
+     * Handshake timing, see mbedtls_ssl_conf_handshake_timing()
+     */
+    uint64_t MBEDTLS_PRIVATE(hs_timing_entry);   /*!< start of the current step       */
+    uint64_t MBEDTLS_PRIVATE(hs_timing_exit);    /*!< end of the last step            */
+    uint64_t MBEDTLS_PRIVATE(hs_timing_cpu);     /*!< time in steps, current state    */
+    uint64_t MBEDTLS_PRIVATE(hs_timing_wait);    /*!< time waiting, current state     */
+    uint64_t MBEDTLS_PRIVATE(hs_timing_total_cpu);  /*!< time in steps, handshake     */
+    uint64_t MBEDTLS_PRIVATE(hs_timing_total_wait); /*!< time waiting, handshake      */
+    int MBEDTLS_PRIVATE(hs_timing_waiting);      /*!< last step asked to be resumed   */
+#endif
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+    /*
+     * Kernel TLS offload, see mbedtls_ssl_ktls_enable()
+     */
+    int MBEDTLS_PRIVATE(ktls_fd);                /*!< socket with kTLS enabled        */
+    int MBEDTLS_PRIVATE(ktls_mode);              /*!< MBEDTLS_SSL_KTLS_TX/RX flags    */
+    int MBEDTLS_PRIVATE(ktls_out_type);          /*!< content type of pending output  */
+#endif
+
     /** User data pointer or handle.
      *
      * The library sets this to \p 0 when creating a context and does not
@@ -2119,6 +2378,53 @@ void mbedtls_ssl_conf_early_data(mbedtls_ssl_config *conf,
  */
 void mbedtls_ssl_conf_max_early_data_size(
     mbedtls_ssl_config *conf, uint32_t max_early_data_size);
+
+/**
+ * \brief          Callback type: detect a replayed ClientHello
+ *
+ *                 This callback is called by the server when a ClientHello
+ *                 offers early data and meets all the other requirements to
+ *                 have it accepted, see RFC 8446 section 8.
+ *
+ * \param ctx      Context for the callback
+ * \param binder   Binder of the pre-shared key the early data is protected
+ *                 with. It is unique to the ClientHello.
+ * \param binder_len Length of \p binder
+ * \param ticket_age_diff Difference in milliseconds between the age of the
+ *                 ticket computed by the server and the age reported by the
+ *                 client, or 0 if #MBEDTLS_HAVE_TIME is disabled. A large
+ *                 value means that the ClientHello is not fresh.
+ *
+ * \return         The callback must return 0 if the early data can be
+ *                 accepted, and a non-zero value otherwise. In the latter
+ *                 case, the early data is rejected but the handshake goes on.
+ */
+typedef int mbedtls_ssl_early_data_replay_t(void *ctx,
+                                            const unsigned char *binder,
+                                            size_t binder_len,
+                                            int32_t ticket_age_diff);
+
+/**
+ * \brief          Register a callback to protect early data against replay
+ *                 (Server only. TLS 1.3 only.)
+ *
+ *                 Default: none. Without it, the same ClientHello and early
+ *                 data may be accepted several times: only enable early data
+ *                 without it if the application protocol is resistant to
+ *                 replays.
+ *
+ * \note           An implementation is provided by
+ *                 #MBEDTLS_SSL_EARLY_DATA_REPLAY_C, see
+ *                 mbedtls_ssl_early_data_replay_check().
+ *
+ * \param conf             SSL configuration
+ * \param f_early_data_replay Replay detection callback
+ * \param p_early_data_replay Context for the callback
+ */
+void mbedtls_ssl_conf_early_data_replay(
+    mbedtls_ssl_config *conf,
+    mbedtls_ssl_early_data_replay_t *f_early_data_replay,
+    void *p_early_data_replay);
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #endif /* MBEDTLS_SSL_EARLY_DATA */
@@ -2433,10 +2739,94 @@ int mbedtls_ssl_get_peer_cid(mbedtls_ssl_context *ssl,
  * \note           Values lower than the current record layer expansion will
  *                 result in an error when trying to send data.
  *
+ * \note           With path MTU discovery, see mbedtls_ssl_conf_dtls_pmtud(),
+ *                 this value is an upper bound of the discovered path MTU.
+ *
  * \param ssl      SSL context
  * \param mtu      Value of the path MTU in bytes
  */
 void mbedtls_ssl_set_mtu(mbedtls_ssl_context *ssl, uint16_t mtu);
+
+/**
+ * \brief          Enable packetization layer path MTU discovery for DTLS
+ *                 (RFC 8899). (DTLS only, no effect on TLS.)
+ *                 Default: disabled.
+ *
+ *                 The handshake is fragmented to fit in datagrams of
+ *                 \p base bytes. Once the handshake is over, the path MTU
+ *                 is searched between \p base and \p max: a probe size is
+ *                 let through mbedtls_ssl_get_max_out_record_payload() for
+ *                 one application record, the application reports whether
+ *                 that datagram reached the peer with
+ *                 mbedtls_ssl_dtls_pmtu_feedback(), and the next probe size
+ *                 is chosen by bisection. A size is given up after
+ *                 #MBEDTLS_SSL_DTLS_PMTUD_MAX_PROBES lost probes.
+ *
+ *                 The discovered value, see mbedtls_ssl_get_dtls_pmtu(), is
+ *                 then used to fragment handshake messages and to bound
+ *                 the size of application records. If a later handshake
+ *                 (renegotiation) has to retransmit a flight twice, the
+ *                 path MTU falls back to \p base and the search starts
+ *                 again at the end of that handshake.
+ *
+ * \note           DTLS 1.2 has no message that the peer echoes, so probes
+ *                 are regular application records and their delivery must
+ *                 be confirmed by the application protocol, for example by
+ *                 its acknowledgements.
+ *
+ * \param conf     SSL configuration
+ * \param base     Path MTU assumed until discovery confirms a larger
+ *                 value, in bytes. 1200 is safe on most IPv4 and IPv6 paths.
+ * \param max      Largest path MTU to probe, in bytes, or \c 0 to disable
+ *                 discovery. For example 1472 for UDP over IPv4 on Ethernet.
+ *                 Probes are also bounded by mbedtls_ssl_set_mtu() and by
+ *                 #MBEDTLS_SSL_OUT_CONTENT_LEN.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p max is not \c 0 and
+ *                 \p base is \c 0 or larger than \p max. The configuration
+ *                 is then unchanged.
+ */
+int mbedtls_ssl_conf_dtls_pmtud(mbedtls_ssl_config *conf,
+                                uint16_t base, uint16_t max);
+
+/**
+ * \brief          Get the path MTU used by a DTLS connection.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         The path MTU confirmed by discovery, or the \p base value
+ *                 of mbedtls_ssl_conf_dtls_pmtud() until then, bounded by
+ *                 mbedtls_ssl_set_mtu(). Without discovery, the value set
+ *                 with mbedtls_ssl_set_mtu(), \c 0 meaning no limit.
+ */
+uint16_t mbedtls_ssl_get_dtls_pmtu(const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Get the size of the path MTU probe waiting for feedback.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         The size of the datagram sent as probe, in bytes, if its
+ *                 delivery is to be reported with
+ *                 mbedtls_ssl_dtls_pmtu_feedback(), or \c 0.
+ */
+uint16_t mbedtls_ssl_get_dtls_pmtu_probe(const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Report whether the last path MTU probe reached the peer.
+ *
+ *                 The probe is the first datagram sent with a size larger
+ *                 than mbedtls_ssl_get_dtls_pmtu() since the previous
+ *                 feedback. No other probe is sent until this function is
+ *                 called. Calls without a probe waiting for feedback, see
+ *                 mbedtls_ssl_get_dtls_pmtu_probe(), are ignored.
+ *
+ * \param ssl      SSL context
+ * \param delivered \c 1 if the peer received the probe, \c 0 if it
+ *                 was lost.
+ */
+void mbedtls_ssl_dtls_pmtu_feedback(mbedtls_ssl_context *ssl, int delivered);
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
@@ -2481,6 +2871,111 @@ void mbedtls_ssl_set_verify(mbedtls_ssl_context *ssl,
  */
 void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout);
 
+/**
+ * \brief          Enable or disable read-ahead for TLS.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: disabled.
+ *
+ *                 By default, each call to the receive callback asks for the
+ *                 rest of the current record header or body only, so that
+ *                 reading a record takes at least two calls. With read-ahead
+ *                 enabled, the receive callback is asked for as many bytes
+ *                 as fit in the input buffer, and the records received
+ *                 beyond the current one are kept for the following reads.
+ *
+ * \param conf     SSL configuration
+ * \param mode     MBEDTLS_SSL_READ_AHEAD_ENABLED or
+ *                 MBEDTLS_SSL_READ_AHEAD_DISABLED.
+ *
+ * \note           Only enable this if the receive callback returns the data
+ *                 that is already available instead of waiting until it
+ *                 has received the requested length, as \c recv() does on a
+ *                 stream socket.
+ *
+ * \note           With read-ahead, records may be buffered in the SSL context
+ *                 while the underlying transport has no more data to read.
+ *                 Event-driven applications must call
+ *                 mbedtls_ssl_check_pending() before waiting for the
+ *                 transport to become readable.
+ */
+void mbedtls_ssl_conf_read_ahead(mbedtls_ssl_config *conf, char mode);
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+/**
+ * \brief          Enable or disable the full-duplex mode.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: disabled.
+ *
+ *                 In full-duplex mode, once the handshake is over, one
+ *                 thread may call mbedtls_ssl_read() while another thread
+ *                 calls mbedtls_ssl_write() or mbedtls_ssl_close_notify()
+ *                 on the same SSL context, without locking. Each direction
+ *                 only modifies its own part of the context:
+ *                 - Alerts caused by incoming records are not sent by
+ *                   mbedtls_ssl_read(). They are handed over to the writing
+ *                   thread, and sent by the next call to mbedtls_ssl_write()
+ *                   or mbedtls_ssl_close_notify(). After a fatal alert, these
+ *                   functions return the error that caused it.
+ *                 - Post-handshake messages (TLS 1.3 NewSessionTicket) are
+ *                   processed by mbedtls_ssl_read() only.
+ *                 - Renegotiation is refused, as if it was disabled with
+ *                   mbedtls_ssl_conf_renegotiation().
+ *
+ * \param conf     SSL configuration
+ * \param mode     MBEDTLS_SSL_FULL_DUPLEX_ENABLED or
+ *                 MBEDTLS_SSL_FULL_DUPLEX_DISABLED.
+ *
+ * \note           The handshake must be completed by a single thread, and
+ *                 the threads must be started (or otherwise synchronized
+ *                 with it) after mbedtls_ssl_handshake() returned \c 0.
+ *                 At most one thread may read and one thread may write at
+ *                 any time.
+ *
+ * \note           The send and receive callbacks set with
+ *                 mbedtls_ssl_set_bio() are then called concurrently. They
+ *                 must support this, as \c send() and \c recv() do on a
+ *                 socket.
+ *
+ * \note           mbedtls_ssl_session_reset(), mbedtls_ssl_renegotiate() and
+ *                 the other functions on the context must not be called
+ *                 while either thread is running.
+ */
+void mbedtls_ssl_conf_full_duplex(mbedtls_ssl_config *conf, char mode);
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
+/**
+ * \brief          Set the dynamic record sizing policy for application data.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: disabled, records are as large as allowed by
+ *                 mbedtls_ssl_get_max_out_record_payload().
+ *
+ *                 At the start of a connection, the TCP congestion window
+ *                 is small, and a large record spread over several round
+ *                 trips cannot be decrypted by the peer until its last
+ *                 segment arrives. With this policy, the application data
+ *                 written by mbedtls_ssl_write() is first sent in records
+ *                 of at most \p small_len bytes, chosen so that a record
+ *                 fits in one TCP segment. Once \p boost_threshold bytes
+ *                 have been written, records grow to their maximum size.
+ *                 After \p idle_timeout milliseconds without writes, the
+ *                 connection goes back to small records.
+ *
+ * \param conf     SSL configuration
+ * \param small_len  Maximum payload of the records sent while warming up,
+ *                 or \c 0 to disable dynamic record sizing. A common
+ *                 value is 1369 bytes, which leaves room for the record
+ *                 expansion and for TCP options in a 1460-byte segment.
+ * \param boost_threshold  Number of bytes of application data written before
+ *                 switching to full-size records.
+ * \param idle_timeout  Idle time in milliseconds after which records go back
+ *                 to \p small_len, or \c 0 to never go back. Only effective
+ *                 if \c MBEDTLS_HAVE_TIME is enabled.
+ */
+void mbedtls_ssl_conf_dynamic_record_sizing(mbedtls_ssl_config *conf,
+                                            uint16_t small_len,
+                                            uint32_t boost_threshold,
+                                            uint32_t idle_timeout);
+
 /**
  * \brief          Check whether a buffer contains a valid and authentic record
  *                 that has not been seen before. (DTLS only).
@@ -3033,6 +3528,101 @@ int mbedtls_ssl_set_client_transport_id(mbedtls_ssl_context *ssl,
 
 #endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY && MBEDTLS_SSL_SRV_C */
 
+#if defined(MBEDTLS_SSL_SRV_C)
+/*
+ * Flags passed to the admission control callback
+ */
+/** The client resumes a session (TLS 1.2 ticket or session ID found in the
+ *  cache) or proved knowledge of a pre-shared key (TLS 1.3). No certificate
+ *  based authentication is needed. */
+#define MBEDTLS_SSL_ADMISSION_RESUMPTION        0x01
+/** The client is known to receive messages at its address: the transport is
+ *  connection-oriented, or the DTLS ClientHello carried a valid cookie. */
+#define MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED  0x02
+
+/*
+ * Decisions of the admission control callback
+ */
+#define MBEDTLS_SSL_ADMISSION_ACCEPT            0 /*!< go on with the handshake   */
+#define MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE    1 /*!< verify the address first   */
+#define MBEDTLS_SSL_ADMISSION_REJECT            2 /*!< abort the handshake        */
+
+/**
+ * \brief          Callback type: admission control
+ *
+ *                 This callback is called by the server once per handshake,
+ *                 when the first ClientHello has been parsed and before any
+ *                 expensive operation (certificate selection, key exchange,
+ *                 signature) is started. It lets the server shed load when it
+ *                 receives more handshakes than it can handle.
+ *
+ * \param ctx      Context for the callback
+ * \param peer_addr Client IP address set with mbedtls_ssl_set_peer_addr(),
+ *                 in network byte order, or NULL if it was not set.
+ * \param peer_addr_len Length of \p peer_addr: 4 (IPv4), 16 (IPv6) or 0.
+ * \param flags    A combination of #MBEDTLS_SSL_ADMISSION_RESUMPTION and
+ *                 #MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED.
+ *
+ * \return         #MBEDTLS_SSL_ADMISSION_ACCEPT to go on with the handshake.
+ * \return         #MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE to go on only once the
+ *                 client has proved that it receives messages at its address.
+ *                 This is the same as #MBEDTLS_SSL_ADMISSION_ACCEPT if
+ *                 \p flags contains #MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED,
+ *                 and the handshake is rejected otherwise, which only
+ *                 happens with DTLS when cookies are not configured.
+ * \return         #MBEDTLS_SSL_ADMISSION_REJECT to abort the handshake with
+ *                 #MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED.
+ * \return         A negative error code to abort the handshake with it.
+ */
+typedef int mbedtls_ssl_admission_t(void *ctx,
+                                    const unsigned char *peer_addr,
+                                    size_t peer_addr_len,
+                                    int flags);
+
+/**
+ * \brief          Register an admission control callback
+ *                 (Server only.)
+ *
+ *                 Default: none, all handshakes are accepted. Renegotiations
+ *                 are not subject to admission control.
+ *
+ * \note           An implementation is provided by #MBEDTLS_SSL_ADMISSION_C,
+ *                 see mbedtls_ssl_admission_check().
+ *
+ * \note           With DTLS and cookies configured with
+ *                 mbedtls_ssl_conf_dtls_cookies(), a ClientHello without a
+ *                 valid cookie is still answered with a HelloVerifyRequest
+ *                 and is not passed to this callback. The callback can only
+ *                 reject handshakes that would otherwise go on.
+ *
+ * \param conf         SSL configuration
+ * \param f_admission  Admission control callback, or NULL to disable
+ * \param p_admission  Context for the callback
+ */
+void mbedtls_ssl_conf_admission(mbedtls_ssl_config *conf,
+                                mbedtls_ssl_admission_t *f_admission,
+                                void *p_admission);
+
+/**
+ * \brief          Set the IP address of the client, for admission control.
+ *                 (Server only.)
+ *
+ *                 It is reset by mbedtls_ssl_session_reset().
+ *
+ * \param ssl      SSL context
+ * \param addr     Client IP address in network byte order, as returned by
+ *                 mbedtls_net_accept()
+ * \param addr_len Length of \p addr: 4 for IPv4 or 16 for IPv6
+ *
+ * \return         0 on success,
+ *                 MBEDTLS_ERR_SSL_BAD_INPUT_DATA if used on client or if
+ *                 \p addr_len is not valid.
+ */
+int mbedtls_ssl_set_peer_addr(mbedtls_ssl_context *ssl,
+                              const unsigned char *addr,
+                              size_t addr_len);
+#endif /* MBEDTLS_SSL_SRV_C */
+
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
 /**
  * \brief          Enable or disable anti-replay protection for DTLS.
@@ -3142,6 +3732,61 @@ void mbedtls_ssl_set_datagram_packing(mbedtls_ssl_context *ssl,
  *                 resend ... 5s -> give up and return a timeout error.
  */
 void mbedtls_ssl_conf_handshake_timeout(mbedtls_ssl_config *conf, uint32_t min, uint32_t max);
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Choose how the DTLS handshake retransmission timeout is
+ *                 computed. (DTLS only, no effect on TLS.)
+ *                 Default: MBEDTLS_SSL_DTLS_RTO_FIXED.
+ *
+ * \param conf     SSL configuration
+ * \param mode     MBEDTLS_SSL_DTLS_RTO_FIXED or MBEDTLS_SSL_DTLS_RTO_ADAPTIVE.
+ *
+ * \note           With MBEDTLS_SSL_DTLS_RTO_FIXED, each flight is first
+ *                 retransmitted after the 'min' value of
+ *                 mbedtls_ssl_conf_handshake_timeout().
+ *
+ * \note           With MBEDTLS_SSL_DTLS_RTO_ADAPTIVE, the time between the
+ *                 transmission of a flight and the reception of the peer's
+ *                 next flight is measured, and the initial timeout of the
+ *                 next flights is computed as in RFC 6298 section 2:
+ *                 smoothed RTT + 4 * RTT variation. Flights that were
+ *                 retransmitted are not measured. The timeout is bounded
+ *                 by MBEDTLS_SSL_DTLS_RTO_MIN and by the 'max' value of
+ *                 mbedtls_ssl_conf_handshake_timeout(), and still doubles
+ *                 at each retransmission. The 'min' value is the timeout
+ *                 used until a first measurement is available.
+ *
+ * \note           The estimate lives in the SSL context: it is kept across
+ *                 renegotiations, but cleared by mbedtls_ssl_session_reset().
+ *                 Use mbedtls_ssl_get_dtls_rtt() and mbedtls_ssl_set_dtls_rtt()
+ *                 to keep it across connections to the same peer.
+ */
+void mbedtls_ssl_conf_dtls_rto(mbedtls_ssl_config *conf, char mode);
+
+/**
+ * \brief          Get the round-trip time estimate of a DTLS connection.
+ *
+ * \param ssl      SSL context, typically after the handshake.
+ * \param rtt      Destination of the estimate.
+ */
+void mbedtls_ssl_get_dtls_rtt(const mbedtls_ssl_context *ssl,
+                              mbedtls_ssl_dtls_rtt *rtt);
+
+/**
+ * \brief          Set the round-trip time estimate of a DTLS connection,
+ *                 for example from a previous connection to the same peer.
+ *
+ * \param ssl      SSL context, after mbedtls_ssl_setup() or
+ *                 mbedtls_ssl_session_reset() and before the handshake.
+ * \param rtt      Estimate obtained with mbedtls_ssl_get_dtls_rtt().
+ *
+ * \note           This has no effect unless MBEDTLS_SSL_DTLS_RTO_ADAPTIVE
+ *                 is configured with mbedtls_ssl_conf_dtls_rto().
+ */
+void mbedtls_ssl_set_dtls_rtt(mbedtls_ssl_context *ssl,
+                              const mbedtls_ssl_dtls_rtt *rtt);
+#endif /* MBEDTLS_HAVE_TIME */
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 #if defined(MBEDTLS_SSL_SRV_C)
@@ -3312,6 +3957,86 @@ int mbedtls_ssl_session_save(const mbedtls_ssl_session *session,
                              size_t buf_len,
                              size_t *olen);
 
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+#define MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT   0x01 /*!< Keep the peer certificate */
+#define MBEDTLS_SSL_SESSION_COMPACT_ALPN        0x02 /*!< Keep the ALPN of a TLS 1.3
+                                                          ticket, needed to accept
+                                                          early data */
+
+/**
+ * \brief          Save a server session in the compact encoding.
+ *
+ *                 The compact encoding only holds what a server needs to
+ *                 resume the session, with every field at a fixed offset for
+ *                 a given TLS version, so that it is smaller and cheaper to
+ *                 load than the encoding of mbedtls_ssl_session_save(). It is
+ *                 meant for session tickets, see
+ *                 mbedtls_ssl_ticket_set_compact(), and for alternative
+ *                 implementations of a session cache.
+ *
+ * \see            mbedtls_ssl_session_load_compact()
+ *
+ * \param session  The server session to be saved.
+ * \param flags    Optional data to keep: a combination of
+ *                 #MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT and
+ *                 #MBEDTLS_SSL_SESSION_COMPACT_ALPN, or \c 0.
+ * \param buf      The buffer to write the serialized data to. It must be a
+ *                 writeable buffer of at least \p buf_len bytes, or may be \c
+ *                 NULL if \p buf_len is \c 0.
+ * \param buf_len  The number of bytes available for writing in \p buf.
+ * \param olen     The size in bytes of the data that has been or would have
+ *                 been written. It must point to a valid \c size_t.
+ *
+ * \note           Unless #MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT is set, a
+ *                 session loaded from the compact encoding has no peer
+ *                 certificate: mbedtls_ssl_get_peer_cert() returns \c NULL
+ *                 after resumption, while the verification result is kept.
+ *                 Unless #MBEDTLS_SSL_SESSION_COMPACT_ALPN is set, early data
+ *                 is rejected when resuming a TLS 1.3 session that was
+ *                 established with ALPN.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if \p buf is too small.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p session is not a
+ *                 server session or \p flags is invalid.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the TLS version of
+ *                 the session or one of \p flags is not supported in this
+ *                 configuration.
+ */
+int mbedtls_ssl_session_save_compact(const mbedtls_ssl_session *session,
+                                     int flags,
+                                     unsigned char *buf,
+                                     size_t buf_len,
+                                     size_t *olen);
+
+/**
+ * \brief          Load a session saved with mbedtls_ssl_session_save_compact().
+ *
+ *                 Apart from the optional peer certificate and ALPN, loading
+ *                 checks the length of the input once and does not allocate
+ *                 memory.
+ *
+ * \param session  The session structure to be populated. It must have been
+ *                 initialised with mbedtls_ssl_session_init() but not
+ *                 populated yet.
+ * \param buf      The buffer holding the serialized session data. It must be a
+ *                 readable buffer of at least \p len bytes.
+ * \param len      The size of the serialized data in bytes.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if memory allocation failed.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if input data is invalid.
+ * \return         #MBEDTLS_ERR_SSL_VERSION_MISMATCH if \p buf does not hold
+ *                 a compact session or was written with another revision of
+ *                 the compact encoding.
+ * \return         Another negative value for other kinds of errors (for
+ *                 example, unsupported features in the embedded certificate).
+ */
+int mbedtls_ssl_session_load_compact(mbedtls_ssl_session *session,
+                                     const unsigned char *buf,
+                                     size_t len);
+#endif /* MBEDTLS_SSL_COMPACT_SESSION */
+
 /**
  * \brief               Set the list of allowed ciphersuites and the preference
  *                      order. First in the list has the highest preference.
@@ -4726,6 +5451,148 @@ int mbedtls_ssl_get_max_out_record_payload(const mbedtls_ssl_context *ssl);
  */
 int mbedtls_ssl_get_max_in_record_payload(const mbedtls_ssl_context *ssl);
 
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+/**
+ * \brief          Attach handshake latency histograms to a configuration.
+ *
+ *                 Every call to mbedtls_ssl_handshake_step() made by an SSL
+ *                 context using this configuration is timed. When the
+ *                 handshake moves to another state, the time spent in the
+ *                 previous state is added to the histograms of \p timing:
+ *                 the time spent inside mbedtls_ssl_handshake_step() and
+ *                 the time spent between calls that returned
+ *                 #MBEDTLS_ERR_SSL_WANT_READ, #MBEDTLS_ERR_SSL_WANT_WRITE,
+ *                 #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS or
+ *                 #MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS are kept apart.
+ *                 Handshakes that fail are not recorded.
+ *
+ * \note           The histograms are updated with relaxed atomic
+ *                 operations where the compiler provides them, so
+ *                 \p timing may be shared between contexts running in
+ *                 different threads.
+ *
+ * \param conf     SSL configuration
+ * \param timing   Handshake timing context (see mbedtls/ssl_hs_timing.h),
+ *                 or NULL to disable timing. It must remain valid for as
+ *                 long as any SSL context uses \p conf.
+ */
+void mbedtls_ssl_conf_handshake_timing(mbedtls_ssl_config *conf,
+                                       mbedtls_ssl_hs_timing *timing);
+#endif /* MBEDTLS_SSL_HANDSHAKE_TIMING */
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+/**
+ * \brief          Attach a client session store to a configuration.
+ *                 (Client only.)
+ *
+ *                 Every SSL context using this configuration that has a
+ *                 host name (see mbedtls_ssl_set_hostname()) then:
+ *                 - resumes a session from \p store in its initial
+ *                   handshake, unless one was set with
+ *                   mbedtls_ssl_set_session();
+ *                 - adds the session to \p store at the end of a TLS 1.2
+ *                   handshake, and each TLS 1.3 ticket it receives.
+ *                   mbedtls_ssl_read() still returns
+ *                   #MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET for tickets.
+ *
+ * \param conf     SSL configuration
+ * \param store    Client session store (see mbedtls/ssl_session_store.h),
+ *                 or NULL to disable it. It must remain valid for as long
+ *                 as any SSL context uses \p conf.
+ */
+void mbedtls_ssl_conf_session_store(mbedtls_ssl_config *conf,
+                                    mbedtls_ssl_session_store *store);
+
+/**
+ * \brief          Set the port of the server, which identifies it in the
+ *                 session store together with the host name.
+ *                 (Client only. Default: 0.)
+ *
+ * \note           This setting survives mbedtls_ssl_session_reset().
+ *
+ * \param ssl      SSL context
+ * \param port     Port of the server
+ */
+void mbedtls_ssl_set_server_port(mbedtls_ssl_context *ssl, uint16_t port);
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+/**
+ * \brief          Allow the record protection of connections using this
+ *                 configuration to be offloaded to the Linux kernel.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: disabled.
+ *
+ *                 When enabled, the traffic keys are created with the
+ *                 #PSA_KEY_USAGE_EXPORT usage flag, so that
+ *                 mbedtls_ssl_ktls_enable() can pass them to the kernel
+ *                 once the handshake is over.
+ *
+ * \warning        The traffic keys can then be exported by anyone holding
+ *                 their PSA key identifier. Only enable this in processes
+ *                 that use kernel TLS.
+ *
+ * \param conf     SSL configuration
+ * \param mode     MBEDTLS_SSL_KTLS_ENABLED or MBEDTLS_SSL_KTLS_DISABLED.
+ */
+void mbedtls_ssl_conf_ktls(mbedtls_ssl_config *conf, char mode);
+#endif /* MBEDTLS_SSL_KTLS_C */
+
+#if defined(MBEDTLS_SSL_STATS)
+/**
+ * \brief          Initialize a statistics structure (all counters zero).
+ *
+ * \param stats    Statistics structure to initialize
+ */
+void mbedtls_ssl_stats_init(mbedtls_ssl_stats *stats);
+
+/**
+ * \brief          Attach a shared statistics structure to a configuration.
+ *
+ *                 Every SSL context using this configuration adds its
+ *                 events to \p stats in addition to its own per-connection
+ *                 counters. Updates use relaxed atomic operations where the
+ *                 compiler provides them, so \p stats may be shared between
+ *                 contexts running in different threads.
+ *
+ * \note           On platforms without 64-bit atomic operations, concurrent
+ *                 updates may lose increments. The per-connection counters
+ *                 are always exact.
+ *
+ * \param conf     SSL configuration
+ * \param stats    Statistics structure to update, or NULL to disable
+ *                 aggregation. It must remain valid for as long as any
+ *                 SSL context uses \p conf.
+ */
+void mbedtls_ssl_conf_stats(mbedtls_ssl_config *conf,
+                            mbedtls_ssl_stats *stats);
+
+/**
+ * \brief          Take a snapshot of a shared statistics structure.
+ *
+ *                 Each counter is read atomically, but the snapshot as a
+ *                 whole is not: counters may be updated between reads.
+ *
+ * \param stats    Shared statistics structure, as passed to
+ *                 mbedtls_ssl_conf_stats()
+ * \param snapshot Structure to copy the counters to
+ */
+void mbedtls_ssl_stats_read(const mbedtls_ssl_stats *stats,
+                            mbedtls_ssl_stats *snapshot);
+
+/**
+ * \brief          Get the statistics of a single connection.
+ *
+ *                 The counters cover the lifetime of the connection and are
+ *                 cleared by mbedtls_ssl_session_reset().
+ *
+ * \param ssl      SSL context
+ * \param stats    Structure to copy the counters to
+ */
+void mbedtls_ssl_get_stats(const mbedtls_ssl_context *ssl,
+                           mbedtls_ssl_stats *stats);
+#endif /* MBEDTLS_SSL_STATS */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 /**
  * \brief          Return the peer certificate from the current connection.
@@ -5091,6 +5958,165 @@ int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
  */
 int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len);
 
+/**
+ * \brief          Cork the connection: delay sending application data.
+ *                 (TLS only.)
+ *
+ *                 While the connection is corked, each call to
+ *                 mbedtls_ssl_write() protects its data into a record that
+ *                 is appended to the output buffer instead of being sent
+ *                 immediately. The records are sent together, with a single
+ *                 call to the send callback in most cases, when the output
+ *                 buffer is full, when mbedtls_ssl_uncork() is called, or
+ *                 before any other message (alert, handshake message) is
+ *                 written.
+ *
+ *                 This is useful when the application writes many small
+ *                 messages in a row, for example protocol frames.
+ *
+ * \note           mbedtls_ssl_write() may return #MBEDTLS_ERR_SSL_WANT_WRITE
+ *                 while corked, if the records already packed had to be sent
+ *                 to make room. As usual, it must then be called again with
+ *                 the same arguments.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl uses DTLS, or if
+ *                 a previous call to mbedtls_ssl_write() returned
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE and has not been completed:
+ *                 repeat that call before corking.
+ */
+int mbedtls_ssl_cork(mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Uncork the connection and send the records written while
+ *                 it was corked. See mbedtls_ssl_cork().
+ *
+ * \param ssl      SSL context
+ *
+ * \return         \c 0 if all pending records have been sent.
+ * \return         #MBEDTLS_ERR_SSL_WANT_WRITE if the send callback could not
+ *                 take all the pending data. The connection is uncorked
+ *                 anyway: the data is sent by the next call to
+ *                 mbedtls_ssl_uncork(), mbedtls_ssl_write() or
+ *                 mbedtls_ssl_send_alert_message().
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_uncork(mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Compute the size of the output buffer needed to protect
+ *                 \p len bytes of application data with
+ *                 mbedtls_ssl_bulk_write_setup().
+ *
+ * \param ssl      SSL context, after the handshake is over
+ * \param len      Length of the application data
+ * \param out_size On success, the required output buffer size.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA or
+ *                 #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if bulk writes cannot
+ *                 be used on this connection, see
+ *                 mbedtls_ssl_bulk_write_setup().
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the size does not fit
+ *                 in a \c size_t.
+ */
+int mbedtls_ssl_bulk_write_output_size(const mbedtls_ssl_context *ssl,
+                                       size_t len, size_t *out_size);
+
+/**
+ * \brief          Prepare to protect a large buffer of application data
+ *                 into consecutive records. (TLS only, AEAD ciphersuites.)
+ *
+ *                 The data is split into records of the maximum size, as
+ *                 mbedtls_ssl_write() would do, and the sequence numbers of
+ *                 all the records are reserved by this call. The records are
+ *                 then protected with mbedtls_ssl_bulk_write_protect(), which
+ *                 can be called from several threads on disjoint ranges of
+ *                 records, since AEAD records only depend on their own
+ *                 sequence number. The protected records are laid out
+ *                 contiguously in \p out, ready to be sent.
+ *
+ * \warning        Since the sequence numbers are reserved, the caller
+ *                 must protect all the records and send the
+ *                 mbedtls_ssl_bulk_write_get_output_len() bytes of \p out
+ *                 on the transport, in order, before anything else is
+ *                 written on the connection. Until all the records are
+ *                 protected, \p ssl must not be used, except for concurrent
+ *                 calls to mbedtls_ssl_bulk_write_protect(), and \p buf and
+ *                 \p out must stay valid.
+ *
+ * \param ssl      SSL context, after the handshake is over. There must not
+ *                 be any pending output and kernel TLS transmission must not
+ *                 be enabled.
+ * \param bulk     Bulk write context to set up
+ * \param buf      Application data
+ * \param len      Length of the application data
+ * \param out      Buffer for the protected records. It must not overlap
+ *                 with \p buf.
+ * \param out_size Size of \p out, at least the size returned by
+ *                 mbedtls_ssl_bulk_write_output_size().
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the handshake is not
+ *                 over, if output is pending, with DTLS, or if the size of
+ *                 the output does not fit in a \c size_t.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the ciphersuite
+ *                 is not an AEAD one, or if kernel TLS is in use.
+ * \return         #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if \p out_size is too
+ *                 small.
+ * \return         #MBEDTLS_ERR_SSL_COUNTER_WRAPPING if the sequence numbers
+ *                 would wrap.
+ */
+int mbedtls_ssl_bulk_write_setup(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_bulk_write *bulk,
+                                 const unsigned char *buf, size_t len,
+                                 unsigned char *out, size_t out_size);
+
+/**
+ * \brief          Return the number of records of a bulk write.
+ *
+ * \param bulk     Bulk write context, set up with
+ *                 mbedtls_ssl_bulk_write_setup()
+ *
+ * \return         The number of records.
+ */
+size_t mbedtls_ssl_bulk_write_get_records(const mbedtls_ssl_bulk_write *bulk);
+
+/**
+ * \brief          Protect some of the records of a bulk write.
+ *
+ * \note           This function may be called concurrently from several
+ *                 threads, as long as the ranges of records do not overlap.
+ *                 With #MBEDTLS_DEBUG_C, the debug callback may then also be
+ *                 called concurrently.
+ *
+ * \param bulk     Bulk write context, set up with
+ *                 mbedtls_ssl_bulk_write_setup()
+ * \param first    Index of the first record to protect
+ * \param count    Number of records to protect
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the range exceeds
+ *                 the number of records.
+ * \return         Another negative error code on failure. The connection
+ *                 must then be closed.
+ */
+int mbedtls_ssl_bulk_write_protect(const mbedtls_ssl_bulk_write *bulk,
+                                   size_t first, size_t count);
+
+/**
+ * \brief          Return the total length of the protected records of a bulk
+ *                 write, to be sent from the start of the output buffer.
+ *
+ * \param bulk     Bulk write context, set up with
+ *                 mbedtls_ssl_bulk_write_setup()
+ *
+ * \return         The length of the output.
+ */
+size_t mbedtls_ssl_bulk_write_get_output_len(const mbedtls_ssl_bulk_write *bulk);
+
 /**
  * \brief           Send an alert message
  *
@@ -5470,6 +6496,32 @@ void mbedtls_ssl_config_init(mbedtls_ssl_config *conf);
 int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
                                 int endpoint, int transport, int preset);
 
+/**
+ * \brief          Precompute the negotiation tables of a configuration.
+ *
+ *                 This resolves the configured ciphersuites and serializes
+ *                 the signature_algorithms and supported_groups extensions
+ *                 once, so that handshakes using this configuration copy
+ *                 them instead of deriving them again.
+ *
+ *                 Call this function after the configuration is complete
+ *                 and before it is used by any SSL context. Calling it
+ *                 again recomputes the tables.
+ *
+ * \warning        The configuration must not be modified afterwards while
+ *                 SSL contexts use it. Calling mbedtls_ssl_conf_ciphersuites(),
+ *                 mbedtls_ssl_conf_sig_algs() or mbedtls_ssl_conf_groups()
+ *                 discards the tables.
+ *
+ * \param conf     SSL configuration
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code if the configuration is
+ *                 inconsistent.
+ */
+int mbedtls_ssl_conf_finalize(mbedtls_ssl_config *conf);
+
 /**
  * \brief          Free an SSL configuration context
  *
@@ -0,0 +1,236 @@
+/**
+ * \file ssl_admission.h
+ *
+ * \brief SSL server handshake admission control callback implementation
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_ADMISSION_H
+#define MBEDTLS_SSL_ADMISSION_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_ADMISSION_DEFAULT_RATE)
+#define MBEDTLS_SSL_ADMISSION_DEFAULT_RATE            200 /*!< Full handshakes per second */
+#endif
+
+#if !defined(MBEDTLS_SSL_ADMISSION_DEFAULT_PREFIX_RATE)
+#define MBEDTLS_SSL_ADMISSION_DEFAULT_PREFIX_RATE      20 /*!< Full handshakes per second and per prefix */
+#endif
+
+#if !defined(MBEDTLS_SSL_ADMISSION_DEFAULT_COOKIE_THRESHOLD)
+#define MBEDTLS_SSL_ADMISSION_DEFAULT_COOKIE_THRESHOLD 50 /*!< Percentage of the global burst below which cookies are required */
+#endif
+
+/** \} name SECTION: Module settings */
+
+/** Length in bits of the prefix of IPv4 addresses sharing a bucket. */
+#define MBEDTLS_SSL_ADMISSION_IPV4_PREFIX_LEN  24
+/** Length in bits of the prefix of IPv6 addresses sharing a bucket. */
+#define MBEDTLS_SSL_ADMISSION_IPV6_PREFIX_LEN  56
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Admission control counters.
+ *
+ * \note           The fields of this structure are public so that a
+ *                 snapshot obtained with mbedtls_ssl_admission_get_stats()
+ *                 can be inspected directly.
+ */
+typedef struct mbedtls_ssl_admission_stats {
+    uint64_t admitted_full;         /*!< full handshakes admitted            */
+    uint64_t admitted_resumption;   /*!< resumptions admitted                */
+    uint64_t cookie_required;       /*!< ClientHellos asked for a cookie     */
+    uint64_t rejected_global;       /*!< rejected by the global limit        */
+    uint64_t rejected_prefix;       /*!< rejected by a per-prefix limit      */
+} mbedtls_ssl_admission_stats;
+
+/**
+ * \brief   Token bucket
+ */
+typedef struct mbedtls_ssl_admission_bucket {
+    int64_t MBEDTLS_PRIVATE(tokens);           /*!< tokens, in thousandths  */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(last);   /*!< time of the last refill */
+} mbedtls_ssl_admission_bucket;
+
+/**
+ * \brief   Admission control context
+ *
+ *          Each admitted handshake takes a token from a global bucket and,
+ *          if the address of the client is known and verified, from the
+ *          bucket of its address prefix. Buckets are refilled at a constant
+ *          rate, up to a maximum burst.
+ *
+ *          Full handshakes need a whole token in each bucket. Resumptions
+ *          may take the buckets into debt by up to one burst: they go on
+ *          when full handshakes are shed, and only delay the following full
+ *          handshakes when they are very frequent themselves.
+ *
+ *          Prefixes are hashed with a random key into a fixed number of
+ *          buckets. Colliding prefixes share the same limit, and no prefix
+ *          can evict the state of another one.
+ *
+ *          When the global bucket falls below the cookie threshold, clients
+ *          whose address is not verified (DTLS without cookies) are asked
+ *          to prove it first, which rejects them, and do not take any
+ *          token.
+ */
+typedef struct mbedtls_ssl_admission_context {
+    mbedtls_ssl_admission_bucket MBEDTLS_PRIVATE(global);    /*!< global bucket      */
+    mbedtls_ssl_admission_bucket *MBEDTLS_PRIVATE(prefixes); /*!< per-prefix buckets */
+    size_t MBEDTLS_PRIVATE(nb_prefixes);         /*!< number of buckets, power of 2  */
+    uint64_t MBEDTLS_PRIVATE(key);               /*!< prefix hashing key             */
+    uint32_t MBEDTLS_PRIVATE(rate);              /*!< global rate, per second        */
+    uint32_t MBEDTLS_PRIVATE(burst);             /*!< global burst                   */
+    uint32_t MBEDTLS_PRIVATE(prefix_rate);       /*!< per-prefix rate, per second    */
+    uint32_t MBEDTLS_PRIVATE(prefix_burst);      /*!< per-prefix burst               */
+    unsigned MBEDTLS_PRIVATE(cookie_threshold);  /*!< percentage of the burst        */
+    mbedtls_ssl_admission_stats MBEDTLS_PRIVATE(stats); /*!< decision counters       */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< mutex                     */
+#endif
+} mbedtls_ssl_admission_context;
+
+/**
+ * \brief          Initialize an admission control context, with the
+ *                 default limits: #MBEDTLS_SSL_ADMISSION_DEFAULT_RATE and
+ *                 #MBEDTLS_SSL_ADMISSION_DEFAULT_PREFIX_RATE full handshakes
+ *                 per second, with a burst of one second worth of
+ *                 handshakes, and #MBEDTLS_SSL_ADMISSION_DEFAULT_COOKIE_THRESHOLD.
+ *
+ * \param ctx      Admission control context
+ */
+void mbedtls_ssl_admission_init(mbedtls_ssl_admission_context *ctx);
+
+/**
+ * \brief          Set the global limit on the rate of full handshakes.
+ *                 Call it before the context is used.
+ *
+ * \param ctx      Admission control context
+ * \param rate     Full handshakes admitted per second, in the long run
+ * \param burst    Full handshakes that can be admitted at once after an
+ *                 idle period
+ *
+ * \return         \c 0 on success, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if
+ *                 \p rate or \p burst is 0.
+ */
+int mbedtls_ssl_admission_set_global_limit(mbedtls_ssl_admission_context *ctx,
+                                           uint32_t rate, uint32_t burst);
+
+/**
+ * \brief          Set the limit on the rate of full handshakes from each
+ *                 client address prefix (/24 for IPv4, /56 for IPv6).
+ *                 Call it before the context is used.
+ *
+ * \param ctx      Admission control context
+ * \param rate     Full handshakes admitted per second and per prefix
+ * \param burst    Full handshakes that can be admitted at once from a
+ *                 prefix after an idle period
+ *
+ * \return         \c 0 on success, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if
+ *                 \p rate or \p burst is 0.
+ */
+int mbedtls_ssl_admission_set_prefix_limit(mbedtls_ssl_admission_context *ctx,
+                                           uint32_t rate, uint32_t burst);
+
+/**
+ * \brief          Set the level of the global bucket, as a percentage of
+ *                 its burst, below which clients must prove their address
+ *                 before they are admitted. Call it before the context is
+ *                 used.
+ *
+ * \param ctx      Admission control context
+ * \param percent  Threshold from 0 (never require cookies) to 100
+ *
+ * \return         \c 0 on success, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if
+ *                 \p percent is larger than 100.
+ */
+int mbedtls_ssl_admission_set_cookie_threshold(mbedtls_ssl_admission_context *ctx,
+                                               unsigned percent);
+
+/**
+ * \brief          Allocate the per-prefix buckets of an admission control
+ *                 context and fill all buckets.
+ *
+ * \param ctx      Admission control context
+ * \param nb_prefixes  Number of per-prefix buckets, rounded up to a power
+ *                 of 2. It should be well above the number of prefixes
+ *                 expected to be active at once.
+ * \param f_rng    RNG function, used to generate the prefix hashing key
+ * \param p_rng    RNG parameter
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p nb_prefixes is 0 or
+ *                 too large.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         An error code returned by \p f_rng.
+ */
+int mbedtls_ssl_admission_setup(mbedtls_ssl_admission_context *ctx,
+                                size_t nb_prefixes,
+                                int (*f_rng)(void *, unsigned char *, size_t),
+                                void *p_rng);
+
+/**
+ * \brief          Admission control callback
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Install it with
+ *                 `mbedtls_ssl_conf_admission(conf,
+ *                 mbedtls_ssl_admission_check, ctx)`.
+ *                 See \c mbedtls_ssl_admission_t.
+ *
+ * \return         #MBEDTLS_SSL_ADMISSION_ACCEPT if the handshake is admitted.
+ * \return         #MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE if the server is under
+ *                 pressure and the address of the client is not verified.
+ * \return         #MBEDTLS_SSL_ADMISSION_REJECT if a limit is exceeded.
+ * \return         A negative error code on failure.
+ */
+int mbedtls_ssl_admission_check(void *p_ctx,
+                                const unsigned char *peer_addr,
+                                size_t peer_addr_len,
+                                int flags);
+
+/**
+ * \brief          Get a snapshot of the admission control counters
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param ctx      Admission control context
+ * \param stats    Structure to copy the counters to
+ *
+ * \return         \c 0 on success, or a threading error code.
+ */
+int mbedtls_ssl_admission_get_stats(mbedtls_ssl_admission_context *ctx,
+                                    mbedtls_ssl_admission_stats *stats);
+
+/**
+ * \brief          Free an admission control context
+ *
+ * \param ctx      Admission control context
+ */
+void mbedtls_ssl_admission_free(mbedtls_ssl_admission_context *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_admission.h */
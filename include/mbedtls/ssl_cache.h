@@ -19,6 +19,10 @@
 #include "mbedtls/threading.h"
 #endif
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+#include "mbedtls/ssl_cert_store.h"
+#endif
+
 /**
  * \name SECTION: Module settings
  *
@@ -58,6 +62,11 @@ struct mbedtls_ssl_cache_entry {
     unsigned char *MBEDTLS_PRIVATE(session);             /*!< serialized session */
     size_t MBEDTLS_PRIVATE(session_len);
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(peer_cert);        /*!< shared peer cert,
+                                                              not in \c session */
+#endif
+
     mbedtls_ssl_cache_entry *MBEDTLS_PRIVATE(next);      /*!< chain pointer      */
 };
 
@@ -68,6 +77,9 @@ struct mbedtls_ssl_cache_context {
     mbedtls_ssl_cache_entry *MBEDTLS_PRIVATE(chain);     /*!< start of the chain     */
     int MBEDTLS_PRIVATE(timeout);                /*!< cache entry timeout    */
     int MBEDTLS_PRIVATE(max_entries);            /*!< maximum entries        */
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    mbedtls_ssl_cert_store *MBEDTLS_PRIVATE(cert_store); /*!< shared peer certs */
+#endif
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< mutex                  */
 #endif
@@ -173,6 +185,23 @@ static inline int mbedtls_ssl_cache_get_timeout(mbedtls_ssl_cache_context *cache
  */
 void mbedtls_ssl_cache_set_max_entries(mbedtls_ssl_cache_context *cache, int max);
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+/**
+ * \brief          Share the peer certificates of the cached sessions
+ *
+ *                 Sessions stored after this call keep a reference to their
+ *                 peer certificate in \p store instead of a serialized copy,
+ *                 and sessions loaded from the cache refer to that shared
+ *                 certificate instead of parsing a copy of their own.
+ *
+ * \param cache    SSL cache context
+ * \param store    Certificate store, or \c NULL to stop sharing. It must
+ *                 outlive the cache and the sessions loaded from it.
+ */
+void mbedtls_ssl_cache_set_cert_store(mbedtls_ssl_cache_context *cache,
+                                      mbedtls_ssl_cert_store *store);
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
+
 /**
  * \brief          Free referenced items in a cache context and clear memory
  *
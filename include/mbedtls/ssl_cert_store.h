@@ -0,0 +1,132 @@
+/**
+ * \file ssl_cert_store.h
+ *
+ * \brief Shared store of parsed peer certificates
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CERT_STORE_H
+#define MBEDTLS_SSL_CERT_STORE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/x509_crt.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_CERT_STORE_BUCKETS)
+#define MBEDTLS_SSL_CERT_STORE_BUCKETS          64   /*!< Hash table size */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_cert_store mbedtls_ssl_cert_store;
+typedef struct mbedtls_ssl_cert_store_entry mbedtls_ssl_cert_store_entry;
+
+/**
+ * \brief   A certificate of the store
+ */
+struct mbedtls_ssl_cert_store_entry {
+    mbedtls_x509_crt MBEDTLS_PRIVATE(crt);            /*!< parsed certificate,
+                                                           first member    */
+    uint32_t MBEDTLS_PRIVATE(hash);                   /*!< hash of the DER    */
+    size_t MBEDTLS_PRIVATE(refs);                     /*!< reference count    */
+    mbedtls_ssl_cert_store *MBEDTLS_PRIVATE(store);   /*!< owning store       */
+    mbedtls_ssl_cert_store_entry *MBEDTLS_PRIVATE(next); /*!< bucket chain    */
+};
+
+/**
+ * \brief   Certificate store
+ *
+ *          The store keeps a single parsed copy of each distinct
+ *          certificate, indexed by its DER encoding, with a reference
+ *          count. When a session cache uses a store, see
+ *          mbedtls_ssl_cache_set_cert_store(), cached sessions do not carry
+ *          a copy of the peer certificate: sessions loaded from the cache
+ *          refer to the shared copy instead of parsing their own, which
+ *          saves both memory and parsing time when many sessions share the
+ *          same few client certificates.
+ *
+ *          A certificate is dropped from the store when its last reference
+ *          is released.
+ */
+struct mbedtls_ssl_cert_store {
+    mbedtls_ssl_cert_store_entry *MBEDTLS_PRIVATE(table)[MBEDTLS_SSL_CERT_STORE_BUCKETS];
+    size_t MBEDTLS_PRIVATE(count);                    /*!< number of certs    */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< mutex              */
+#endif
+};
+
+/**
+ * \brief          Initialize a certificate store
+ *
+ * \param store    Certificate store
+ */
+void mbedtls_ssl_cert_store_init(mbedtls_ssl_cert_store *store);
+
+/**
+ * \brief          Get the shared copy of a certificate
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The certificate is parsed and added to the store if it is
+ *                 not there yet. Either way, a reference is taken, to be
+ *                 released with mbedtls_ssl_cert_store_release().
+ *
+ * \param store    Certificate store
+ * \param der      DER encoding of the certificate
+ * \param der_len  Length of \p der in bytes
+ * \param crt      On success, the shared certificate. It must not be
+ *                 modified.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code if the certificate could not
+ *                 be parsed.
+ */
+int mbedtls_ssl_cert_store_get(mbedtls_ssl_cert_store *store,
+                               const unsigned char *der, size_t der_len,
+                               mbedtls_x509_crt **crt);
+
+/**
+ * \brief          Release a reference to a shared certificate
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param crt      Certificate obtained with mbedtls_ssl_cert_store_get(),
+ *                 or from a session that refers to the store.
+ */
+void mbedtls_ssl_cert_store_release(mbedtls_x509_crt *crt);
+
+/**
+ * \brief          Free the contents of a certificate store
+ *
+ *                 The store must outlive the session caches that use it and
+ *                 all the sessions loaded from them.
+ *
+ * \param store    Certificate store
+ */
+void mbedtls_ssl_cert_store_free(mbedtls_ssl_cert_store *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_cert_store.h */
@@ -0,0 +1,245 @@
+/**
+ * \file ssl_conn_pool.h
+ *
+ * \brief Pool of pre-established outbound TLS connections
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CONN_POOL_H
+#define MBEDTLS_SSL_CONN_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_CONN_POOL_DEFAULT_MAX_IDLE)
+#define MBEDTLS_SSL_CONN_POOL_DEFAULT_MAX_IDLE  30000   /*!< 30 seconds */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_conn_pool mbedtls_ssl_conn_pool;
+typedef struct mbedtls_ssl_pooled_conn mbedtls_ssl_pooled_conn;
+
+/**
+ * \brief   A connection of a pool
+ */
+struct mbedtls_ssl_pooled_conn {
+    mbedtls_net_context MBEDTLS_PRIVATE(net);         /*!< socket             */
+    mbedtls_ssl_context MBEDTLS_PRIVATE(ssl);         /*!< TLS context        */
+    int MBEDTLS_PRIVATE(state);                       /*!< MBEDTLS_SSL_CONN_POOL_XXX
+                                                           in ssl_conn_pool.c */
+    int MBEDTLS_PRIVATE(reset_pending);               /*!< reset failed, to be
+                                                           retried         */
+    int MBEDTLS_PRIVATE(checked);                     /*!< checked by the
+                                                           current
+                                                           maintain()      */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(ready_since);   /*!< start of idleness  */
+#endif
+    mbedtls_ssl_pooled_conn *MBEDTLS_PRIVATE(next);   /*!< next in its list   */
+};
+
+/**
+ * \brief   Outbound connection pool
+ *
+ *          A pool holds a fixed number of connections to a single upstream
+ *          server. Each connection owns an SSL context that is set up once,
+ *          when the pool is set up, and reused with
+ *          mbedtls_ssl_session_reset() whenever the connection is closed.
+ *
+ *          mbedtls_ssl_conn_pool_maintain() keeps a number of connections
+ *          connected and handshaken in advance, so that
+ *          mbedtls_ssl_conn_pool_get() can hand one out without any network
+ *          round trip. Ready connections are kept in a stack and handed out
+ *          in constant time.
+ *
+ *          Handshakes resume a session when the configuration uses a client
+ *          session store, see mbedtls_ssl_conf_session_store(): the pool
+ *          sets the host name and the port of its contexts accordingly.
+ */
+struct mbedtls_ssl_conn_pool {
+    mbedtls_ssl_pooled_conn *MBEDTLS_PRIVATE(conns);  /*!< all connections    */
+    size_t MBEDTLS_PRIVATE(size);                     /*!< number of conns    */
+    size_t MBEDTLS_PRIVATE(idle_target);              /*!< ready connections
+                                                           to keep         */
+    char *MBEDTLS_PRIVATE(host);                      /*!< server host name   */
+    char MBEDTLS_PRIVATE(port)[6];                    /*!< server port        */
+    uint32_t MBEDTLS_PRIVATE(max_idle);               /*!< milliseconds       */
+    mbedtls_ssl_pooled_conn *MBEDTLS_PRIVATE(ready);  /*!< ready, most recent
+                                                           first           */
+    mbedtls_ssl_pooled_conn *MBEDTLS_PRIVATE(spare);  /*!< closed             */
+    mbedtls_ssl_pooled_conn *MBEDTLS_PRIVATE(warming); /*!< being established,
+                                                            owned by
+                                                            maintain()     */
+    size_t MBEDTLS_PRIVATE(ready_count);
+    size_t MBEDTLS_PRIVATE(warming_count);            /*!< owned by
+                                                           maintain()      */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< mutex              */
+#endif
+};
+
+/**
+ * \brief          Initialize a connection pool
+ *
+ * \param pool     Connection pool
+ */
+void mbedtls_ssl_conn_pool_init(mbedtls_ssl_conn_pool *pool);
+
+/**
+ * \brief          Set up a connection pool for an upstream server
+ *
+ *                 This allocates and sets up the SSL contexts of all the
+ *                 connections. No connection is opened: see
+ *                 mbedtls_ssl_conn_pool_maintain().
+ *
+ * \param pool     Connection pool
+ * \param conf     Client SSL configuration. It must outlive the pool.
+ * \param host     Host name of the server, as a null-terminated string. It
+ *                 is used both to connect and for mbedtls_ssl_set_hostname().
+ * \param port     Port of the server
+ * \param size     Maximum number of connections, ready or in use
+ * \param idle_target Number of ready connections to keep, at most \p size
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p conf is not a client
+ *                 configuration or a parameter is invalid.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code from mbedtls_ssl_setup() or
+ *                 mbedtls_ssl_set_hostname().
+ */
+int mbedtls_ssl_conn_pool_setup(mbedtls_ssl_conn_pool *pool,
+                                const mbedtls_ssl_config *conf,
+                                const char *host, uint16_t port,
+                                size_t size, size_t idle_target);
+
+/**
+ * \brief          Set how long a connection may stay ready
+ *                 (Default: MBEDTLS_SSL_CONN_POOL_DEFAULT_MAX_IDLE)
+ *
+ *                 Servers close idle connections after a while. Connections
+ *                 that stayed ready for longer than this are closed by
+ *                 mbedtls_ssl_conn_pool_maintain() and replaced. A value of
+ *                 0 indicates no limit.
+ *
+ * \param pool     Connection pool
+ * \param max_idle Maximum idle time in milliseconds
+ */
+void mbedtls_ssl_conn_pool_set_max_idle(mbedtls_ssl_conn_pool *pool,
+                                        uint32_t max_idle);
+
+/**
+ * \brief          Establish connections in advance
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled, see note)
+ *
+ *                 This closes the ready connections that were closed by the
+ *                 server or idle for too long, opens new connections until
+ *                 the idle target is met, and advances the handshakes in
+ *                 progress. The connection itself is blocking, see
+ *                 mbedtls_net_connect(), but handshakes are non-blocking:
+ *                 a handshake waiting for the server continues on the next
+ *                 call.
+ *
+ *                 Call it periodically, for example from a background thread
+ *                 or the idle path of an event loop.
+ *
+ * \note           This function may run concurrently with
+ *                 mbedtls_ssl_conn_pool_get() and
+ *                 mbedtls_ssl_conn_pool_release(), but not with itself.
+ *
+ * \param pool     Connection pool
+ *
+ * \return         The number of ready connections on success.
+ * \return         A negative error code if a connection attempt or a
+ *                 handshake failed. The failed connection is closed and
+ *                 retried on the next call.
+ */
+int mbedtls_ssl_conn_pool_maintain(mbedtls_ssl_conn_pool *pool);
+
+/**
+ * \brief          Get a connection to the server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 A ready connection is handed out if there is one.
+ *                 Otherwise a spare connection is established on the spot,
+ *                 which blocks for the connection and the handshake.
+ *
+ *                 The connection is in blocking mode. Use
+ *                 mbedtls_ssl_pooled_conn_ssl() to exchange data, and give it
+ *                 back with mbedtls_ssl_conn_pool_release().
+ *
+ * \param pool     Connection pool
+ * \param conn     On success, the connection
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if all the connections of
+ *                 the pool are in use or being established.
+ * \return         Another negative error code if the connection or the
+ *                 handshake failed.
+ */
+int mbedtls_ssl_conn_pool_get(mbedtls_ssl_conn_pool *pool,
+                              mbedtls_ssl_pooled_conn **conn);
+
+/**
+ * \brief          Give a connection back to its pool
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param pool     Connection pool
+ * \param conn     Connection obtained with mbedtls_ssl_conn_pool_get()
+ * \param reuse    Non-zero to make the connection ready again, for example
+ *                 after a complete request and response. The connection is
+ *                 closed instead if it has unread data. With \c 0, the
+ *                 connection is closed and its SSL context is reset.
+ *
+ * \return         \c 0 on success.
+ * \return         A negative error code on failure.
+ */
+int mbedtls_ssl_conn_pool_release(mbedtls_ssl_conn_pool *pool,
+                                  mbedtls_ssl_pooled_conn *conn,
+                                  int reuse);
+
+/**
+ * \brief          Get the SSL context of a connection
+ *
+ * \param conn     Connection obtained with mbedtls_ssl_conn_pool_get()
+ *
+ * \return         The SSL context, after a completed handshake.
+ */
+mbedtls_ssl_context *mbedtls_ssl_pooled_conn_ssl(mbedtls_ssl_pooled_conn *conn);
+
+/**
+ * \brief          Close all the connections and free the contents of a
+ *                 connection pool
+ *
+ *                 No connection may be in use.
+ *
+ * \param pool     Connection pool
+ */
+void mbedtls_ssl_conn_pool_free(mbedtls_ssl_conn_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_conn_pool.h */
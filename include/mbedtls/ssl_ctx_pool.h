@@ -0,0 +1,122 @@
+/**
+ * \file ssl_ctx_pool.h
+ *
+ * \brief Pool of pre-allocated SSL contexts
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CTX_POOL_H
+#define MBEDTLS_SSL_CTX_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   SSL context pool
+ *
+ *          A pool holds SSL contexts that are set up once for a
+ *          configuration, with their record buffers, so that a new
+ *          connection does not pay for mbedtls_ssl_setup() and a closed one
+ *          does not pay for mbedtls_ssl_free(). Released contexts are reset
+ *          with mbedtls_ssl_session_reset(), which only zeroizes the part
+ *          of the record buffers that was used by the connection.
+ *
+ *          Free contexts are kept in a lock-free stack: contexts may be
+ *          acquired and released concurrently from any thread, without
+ *          MBEDTLS_THREADING_C.
+ */
+typedef struct mbedtls_ssl_ctx_pool {
+    mbedtls_ssl_context *MBEDTLS_PRIVATE(ctx);        /*!< all contexts       */
+    uint32_t *MBEDTLS_PRIVATE(next);                  /*!< free stack links   */
+    uint64_t MBEDTLS_PRIVATE(head);                   /*!< top of the free
+                                                           stack and ABA tag */
+    size_t MBEDTLS_PRIVATE(size);                     /*!< number of contexts */
+} mbedtls_ssl_ctx_pool;
+
+/**
+ * \brief          Initialize an SSL context pool
+ *
+ * \param pool     SSL context pool
+ */
+void mbedtls_ssl_ctx_pool_init(mbedtls_ssl_ctx_pool *pool);
+
+/**
+ * \brief          Allocate and set up the contexts of a pool
+ *
+ * \param pool     SSL context pool
+ * \param conf     SSL configuration of all the contexts. It must outlive
+ *                 the pool.
+ * \param size     Number of contexts
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p size is invalid or
+ *                 the pool is already set up.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code from mbedtls_ssl_setup().
+ */
+int mbedtls_ssl_ctx_pool_setup(mbedtls_ssl_ctx_pool *pool,
+                               const mbedtls_ssl_config *conf,
+                               size_t size);
+
+/**
+ * \brief          Take a context from the pool
+ *                 (Thread-safe)
+ *
+ *                 The context is ready for a handshake, as after
+ *                 mbedtls_ssl_setup(). Settings made on a context with
+ *                 mbedtls_ssl_set_xxx() functions survive its release: set
+ *                 the BIO callbacks and the other per-connection settings
+ *                 after acquiring it.
+ *
+ * \param pool     SSL context pool
+ * \param ssl      On success, the SSL context
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if all the contexts are in
+ *                 use. The caller may then fall back to mbedtls_ssl_init()
+ *                 and mbedtls_ssl_setup(), or refuse the connection.
+ * \return         Another negative error code if the context could not be
+ *                 reset after its previous use.
+ */
+int mbedtls_ssl_ctx_pool_acquire(mbedtls_ssl_ctx_pool *pool,
+                                 mbedtls_ssl_context **ssl);
+
+/**
+ * \brief          Reset a context and give it back to the pool
+ *                 (Thread-safe)
+ *
+ * \param pool     SSL context pool
+ * \param ssl      SSL context obtained with mbedtls_ssl_ctx_pool_acquire()
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl does not belong
+ *                 to \p pool.
+ * \return         Another negative error code if the reset failed. The
+ *                 context is back in the pool in this case too, and the
+ *                 reset is retried when it is acquired.
+ */
+int mbedtls_ssl_ctx_pool_release(mbedtls_ssl_ctx_pool *pool,
+                                 mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Free the contexts of a pool
+ *
+ *                 No context may be in use.
+ *
+ * \param pool     SSL context pool
+ */
+void mbedtls_ssl_ctx_pool_free(mbedtls_ssl_ctx_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_ctx_pool.h */
@@ -0,0 +1,125 @@
+/**
+ * \file ssl_early_data_replay.h
+ *
+ * \brief TLS 1.3 early data anti-replay callback implementation
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_EARLY_DATA_REPLAY_H
+#define MBEDTLS_SSL_EARLY_DATA_REPLAY_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_EARLY_DATA_REPLAY_WINDOW)
+#define MBEDTLS_SSL_EARLY_DATA_REPLAY_WINDOW   10000 /*!< Default anti-replay window, in milliseconds */
+#endif
+
+/** \} name SECTION: Module settings */
+
+/** Number of bytes of each binder kept in the anti-replay context. */
+#define MBEDTLS_SSL_EARLY_DATA_REPLAY_KEY_LEN  16
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Anti-replay context for TLS 1.3 early data (RFC 8446 section 8.2)
+ *
+ *          The binders of the ClientHellos that carried early data are
+ *          recorded in two hash sets of bounded size. Each set covers one
+ *          window: when the current window ends, the older set is cleared
+ *          and reused, so that a binder is remembered for at least one full
+ *          window.
+ */
+typedef struct mbedtls_ssl_early_data_replay_ctx {
+    unsigned char *MBEDTLS_PRIVATE(slots)[2];    /*!< hash sets of binders       */
+    size_t MBEDTLS_PRIVATE(used)[2];             /*!< entries in each set        */
+    size_t MBEDTLS_PRIVATE(nb_slots);            /*!< slots per set, power of 2  */
+    size_t MBEDTLS_PRIVATE(max_entries);         /*!< entries per set            */
+    int MBEDTLS_PRIVATE(current);                /*!< index of the current set   */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(window_start); /*!< start of current window */
+    uint32_t MBEDTLS_PRIVATE(window);            /*!< window length, in ms       */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< mutex                 */
+#endif
+} mbedtls_ssl_early_data_replay_ctx;
+
+/**
+ * \brief          Initialize an anti-replay context
+ *
+ * \param ctx      Anti-replay context
+ */
+void mbedtls_ssl_early_data_replay_init(mbedtls_ssl_early_data_replay_ctx *ctx);
+
+/**
+ * \brief          Allocate the hash sets of an anti-replay context
+ *
+ * \param ctx      Anti-replay context
+ * \param max_entries  Maximum number of ClientHellos with early data
+ *                 accepted per window. Once it is reached, early data is
+ *                 rejected until the window ends. Memory usage is about
+ *                 4 * #MBEDTLS_SSL_EARLY_DATA_REPLAY_KEY_LEN bytes per entry.
+ * \param window   Length of the anti-replay window in milliseconds, or 0
+ *                 for #MBEDTLS_SSL_EARLY_DATA_REPLAY_WINDOW. Early data is
+ *                 rejected if the ticket age sent by the client differs from
+ *                 the age computed by the server by more than half of
+ *                 \p window.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p max_entries is 0 or
+ *                 too large.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_ssl_early_data_replay_setup(mbedtls_ssl_early_data_replay_ctx *ctx,
+                                        size_t max_entries,
+                                        uint32_t window);
+
+/**
+ * \brief          Early data anti-replay callback
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Install it with
+ *                 `mbedtls_ssl_conf_early_data_replay(conf,
+ *                 mbedtls_ssl_early_data_replay_check, ctx)`.
+ *                 See \c mbedtls_ssl_early_data_replay_t.
+ *
+ * \return         \c 0 if the ClientHello is fresh and was not seen in the
+ *                 current window. Its binder is then recorded.
+ * \return         A non-zero value if it may be a replay, if it is outside
+ *                 the freshness window or if the context is full.
+ */
+int mbedtls_ssl_early_data_replay_check(void *p_ctx,
+                                        const unsigned char *binder,
+                                        size_t binder_len,
+                                        int32_t ticket_age_diff);
+
+/**
+ * \brief          Free an anti-replay context
+ *
+ * \param ctx      Anti-replay context
+ */
+void mbedtls_ssl_early_data_replay_free(mbedtls_ssl_early_data_replay_ctx *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_early_data_replay.h */
@@ -0,0 +1,175 @@
+/**
+ * \file ssl_group_hints.h
+ *
+ * \brief Client-side memory of the key exchange groups chosen by servers
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_GROUP_HINTS_H
+#define MBEDTLS_SSL_GROUP_HINTS_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_GROUP_HINTS_DEFAULT_MAX_ENTRIES)
+#define MBEDTLS_SSL_GROUP_HINTS_DEFAULT_MAX_ENTRIES  64   /*!< Maximum number of servers remembered */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_group_hints mbedtls_ssl_group_hints;
+typedef struct mbedtls_ssl_group_hint mbedtls_ssl_group_hint;
+
+/**
+ * \brief   The group last chosen by a server
+ */
+struct mbedtls_ssl_group_hint {
+    unsigned char *MBEDTLS_PRIVATE(name);             /*!< lowercase host name */
+    size_t MBEDTLS_PRIVATE(name_len);
+    uint32_t MBEDTLS_PRIVATE(hash);                   /*!< hash of \c name and
+                                                           \c port            */
+    uint16_t MBEDTLS_PRIVATE(port);                   /*!< server port        */
+    uint16_t MBEDTLS_PRIVATE(group);                  /*!< TLS NamedGroup     */
+    mbedtls_ssl_group_hint *MBEDTLS_PRIVATE(next);    /*!< next entry         */
+};
+
+/**
+ * \brief   Key share group hints
+ *
+ *          A TLS 1.3 client sends a single key share in its first
+ *          ClientHello, for the first usable group of its group list. A
+ *          server that prefers another group answers with a
+ *          HelloRetryRequest, which costs an extra round trip and a
+ *          wasted key generation. This store remembers, for each server,
+ *          the group it selected, so that later connections to the same
+ *          server offer that group first.
+ *
+ *          Entries are kept in most recently used order. When the store
+ *          is full, the least recently used server is forgotten.
+ */
+struct mbedtls_ssl_group_hints {
+    mbedtls_ssl_group_hint *MBEDTLS_PRIVATE(chain);   /*!< most recent first  */
+    size_t MBEDTLS_PRIVATE(count);                    /*!< number of entries  */
+    size_t MBEDTLS_PRIVATE(max_entries);              /*!< maximum entries    */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< mutex              */
+#endif
+};
+
+/**
+ * \brief          Initialize a group hints store
+ *
+ * \param hints    Group hints store
+ */
+void mbedtls_ssl_group_hints_init(mbedtls_ssl_group_hints *hints);
+
+/**
+ * \brief          Set the maximum number of servers remembered
+ *                 (Default: MBEDTLS_SSL_GROUP_HINTS_DEFAULT_MAX_ENTRIES)
+ *
+ * \param hints    Group hints store
+ * \param max      Maximum number of entries. Existing entries beyond
+ *                 this limit are dropped when the next hint is recorded.
+ */
+void mbedtls_ssl_group_hints_set_max_entries(mbedtls_ssl_group_hints *hints,
+                                             size_t max);
+
+/**
+ * \brief          Look up the group last selected by a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param hints    Group hints store
+ * \param host     Host name of the server, as a null-terminated string.
+ *                 Names are compared case-insensitively.
+ * \param port     Port of the server
+ * \param group    On success, the TLS NamedGroup identifier
+ *                 (MBEDTLS_SSL_IANA_TLS_GROUP_XXX)
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if the server is
+ *                 not in the store.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_group_hints_get(mbedtls_ssl_group_hints *hints,
+                                const char *host, uint16_t port,
+                                uint16_t *group);
+
+/**
+ * \brief          Record the group selected by a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This is done by the library during TLS 1.3 handshakes of
+ *                 SSL contexts attached with mbedtls_ssl_set_group_hints().
+ *                 Applications may also call it, for example to load hints
+ *                 saved by a previous run.
+ *
+ * \param hints    Group hints store
+ * \param host     Host name of the server, as a null-terminated string
+ * \param port     Port of the server
+ * \param group    TLS NamedGroup identifier
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p host is not a valid
+ *                 host name.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_ssl_group_hints_set(mbedtls_ssl_group_hints *hints,
+                                const char *host, uint16_t port,
+                                uint16_t group);
+
+/**
+ * \brief          Free the contents of a group hints store
+ *
+ * \param hints    Group hints store
+ */
+void mbedtls_ssl_group_hints_free(mbedtls_ssl_group_hints *hints);
+
+/**
+ * \brief          Use a group hints store for the TLS 1.3 handshakes of a
+ *                 client SSL context.
+ *
+ *                 The server is identified by the host name set with
+ *                 mbedtls_ssl_set_hostname() and by \p port. The first
+ *                 ClientHello offers a key share for the group this server
+ *                 selected last time, if it is in the configured group list,
+ *                 and the group selected by the server in this handshake is
+ *                 recorded in \p hints once the handshake has completed.
+ *                 Without a host name, the store is not used.
+ *
+ * \note           This setting survives mbedtls_ssl_session_reset(). The
+ *                 store may be shared by many SSL contexts and must outlive
+ *                 them.
+ *
+ * \param ssl      SSL context, client side
+ * \param hints    Group hints store, or \c NULL to stop using one
+ * \param port     Port of the server
+ */
+void mbedtls_ssl_set_group_hints(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_group_hints *hints,
+                                 uint16_t port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_group_hints.h */
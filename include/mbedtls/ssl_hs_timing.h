@@ -0,0 +1,151 @@
+/**
+ * \file ssl_hs_timing.h
+ *
+ * \brief SSL handshake latency histograms
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_HS_TIMING_H
+#define MBEDTLS_SSL_HS_TIMING_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#include <stdint.h>
+
+/** Number of handshake states tracked, see ::mbedtls_ssl_states. */
+#define MBEDTLS_SSL_HS_TIMING_STATES  (MBEDTLS_SSL_TLS1_3_NEW_SESSION_TICKET_FLUSH + 1)
+
+/**
+ * Number of buckets in each histogram.
+ *
+ * Values below 4 microseconds have one bucket each. Above that, each power
+ * of two is split into 4 buckets of equal width, up to 2^27 microseconds
+ * (about 134 seconds). Larger values are counted in the last bucket.
+ */
+#define MBEDTLS_SSL_HS_TIMING_BUCKETS 104
+
+/** Time spent inside mbedtls_ssl_handshake_step() for a state. */
+#define MBEDTLS_SSL_HS_TIMING_CPU     0
+/** Time spent between calls to mbedtls_ssl_handshake_step() that returned
+ *  #MBEDTLS_ERR_SSL_WANT_READ, #MBEDTLS_ERR_SSL_WANT_WRITE,
+ *  #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS or
+ *  #MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS for a state. */
+#define MBEDTLS_SSL_HS_TIMING_WAIT    1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Callback type: monotonic clock.
+ *
+ * \param p_clock  Context for the callback.
+ *
+ * \return         The current time in microseconds. Only differences
+ *                 between two values are used.
+ */
+typedef uint64_t mbedtls_ssl_hs_timing_clock_t(void *p_clock);
+
+/**
+ * \brief   A log-linear histogram of durations in microseconds.
+ */
+typedef struct mbedtls_ssl_hs_histogram {
+    uint64_t MBEDTLS_PRIVATE(count);                                  /*!< samples       */
+    uint64_t MBEDTLS_PRIVATE(buckets)[MBEDTLS_SSL_HS_TIMING_BUCKETS]; /*!< sample counts */
+} mbedtls_ssl_hs_histogram;
+
+/**
+ * \brief   Handshake timing context.
+ *
+ *          For every handshake state, this holds one histogram of the time
+ *          spent processing the state and one histogram of the time spent
+ *          waiting for the network (or for asynchronous operations) in
+ *          that state. The slot for #MBEDTLS_SSL_HANDSHAKE_OVER holds the
+ *          totals for complete handshakes.
+ */
+struct mbedtls_ssl_hs_timing {
+    mbedtls_ssl_hs_timing_clock_t *MBEDTLS_PRIVATE(f_clock);  /*!< clock callback    */
+    void *MBEDTLS_PRIVATE(p_clock);                           /*!< clock context     */
+    mbedtls_ssl_hs_histogram MBEDTLS_PRIVATE(hist)[MBEDTLS_SSL_HS_TIMING_STATES][2];
+};
+
+/**
+ * \brief          Initialize a handshake timing context.
+ *
+ *                 The default clock is mbedtls_ms_time() if
+ *                 #MBEDTLS_HAVE_TIME is enabled, which only has millisecond
+ *                 resolution. Use mbedtls_ssl_hs_timing_set_clock() to
+ *                 install a finer clock.
+ *
+ * \param timing   Handshake timing context
+ */
+void mbedtls_ssl_hs_timing_init(mbedtls_ssl_hs_timing *timing);
+
+/**
+ * \brief          Set the clock used to time handshake steps.
+ *
+ * \note           This must be called before the context is attached to a
+ *                 configuration with mbedtls_ssl_conf_handshake_timing().
+ *
+ * \param timing   Handshake timing context
+ * \param f_clock  Monotonic clock returning microseconds
+ * \param p_clock  Context for \p f_clock
+ */
+void mbedtls_ssl_hs_timing_set_clock(mbedtls_ssl_hs_timing *timing,
+                                     mbedtls_ssl_hs_timing_clock_t *f_clock,
+                                     void *p_clock);
+
+/**
+ * \brief          Clear all histograms.
+ *
+ * \note           Samples recorded concurrently with this call by SSL
+ *                 contexts running in other threads may be partially kept.
+ *
+ * \param timing   Handshake timing context
+ */
+void mbedtls_ssl_hs_timing_reset(mbedtls_ssl_hs_timing *timing);
+
+/**
+ * \brief          Get the number of samples in a histogram.
+ *
+ * \param timing   Handshake timing context
+ * \param state    Handshake state (a value of ::mbedtls_ssl_states), or
+ *                 #MBEDTLS_SSL_HANDSHAKE_OVER for complete handshakes.
+ * \param kind     #MBEDTLS_SSL_HS_TIMING_CPU or #MBEDTLS_SSL_HS_TIMING_WAIT.
+ *
+ * \return         The number of samples, or 0 if \p state or \p kind
+ *                 is out of range.
+ */
+uint64_t mbedtls_ssl_hs_timing_count(const mbedtls_ssl_hs_timing *timing,
+                                     int state, int kind);
+
+/**
+ * \brief          Get a percentile of a histogram.
+ *
+ * \param timing   Handshake timing context
+ * \param state    Handshake state (a value of ::mbedtls_ssl_states), or
+ *                 #MBEDTLS_SSL_HANDSHAKE_OVER for complete handshakes.
+ * \param kind     #MBEDTLS_SSL_HS_TIMING_CPU or #MBEDTLS_SSL_HS_TIMING_WAIT.
+ * \param per_mille The percentile to compute, in thousandths:
+ *                 500 for the median, 990 for p99, 999 for p99.9.
+ *                 Values above 1000 are treated as 1000.
+ *
+ * \return         An upper bound, in microseconds, of the requested
+ *                 percentile. The relative error is at most 25%.
+ * \return         0 if the histogram is empty or if \p state or \p kind
+ *                 is out of range.
+ */
+uint64_t mbedtls_ssl_hs_timing_percentile(const mbedtls_ssl_hs_timing *timing,
+                                          int state, int kind,
+                                          unsigned int per_mille);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_hs_timing.h */
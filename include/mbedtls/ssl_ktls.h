@@ -0,0 +1,94 @@
+/**
+ * \file ssl_ktls.h
+ *
+ * \brief Linux kernel TLS (kTLS) offload
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_KTLS_H
+#define MBEDTLS_SSL_KTLS_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+/** Protect outgoing records in the kernel. */
+#define MBEDTLS_SSL_KTLS_TX     0x01
+/** Authenticate and decrypt incoming records in the kernel. */
+#define MBEDTLS_SSL_KTLS_RX     0x02
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Hand over the record protection of a connection to the
+ *                 Linux kernel.
+ *
+ *                 The traffic keys, IVs and record sequence numbers of the
+ *                 current transform are installed on \p fd with
+ *                 \c setsockopt(SOL_TLS, TLS_TX / TLS_RX). From then on:
+ *                 - mbedtls_ssl_write() passes plaintext to the kernel, which
+ *                   builds the records. Data may also be written to \p fd
+ *                   directly, for example with \c sendfile(), as long as
+ *                   the last call to mbedtls_ssl_write() did not return
+ *                   #MBEDTLS_ERR_SSL_WANT_WRITE.
+ *                 - mbedtls_ssl_read() receives plaintext from the kernel.
+ *                 - Other records (alerts, post-handshake messages such as
+ *                   TLS 1.3 NewSessionTicket) are still processed by the
+ *                   library, and exchanged with the kernel through the
+ *                   \c TLS_SET_RECORD_TYPE and \c TLS_GET_RECORD_TYPE control
+ *                   messages.
+ *
+ *                 The BIO callbacks set with mbedtls_ssl_set_bio() are no
+ *                 longer used in the directions that are offloaded.
+ *
+ * \note           The configuration must have been set up with
+ *                 mbedtls_ssl_conf_ktls(), so that the traffic keys can be
+ *                 exported. Supported ciphersuites are those using AES-GCM
+ *                 with a 16-byte tag or ChaCha20-Poly1305, in TLS 1.2 and
+ *                 TLS 1.3. The kernel must have been built with
+ *                 \c CONFIG_TLS.
+ *
+ * \note           The keys cannot be updated once they are in the kernel:
+ *                 TLS 1.2 renegotiation must be disabled. TLS 1.3 KeyUpdate
+ *                 messages are not supported by the library anyway.
+ *
+ * \param ssl      SSL context, after the handshake is over.
+ *                 There must not be any pending output, nor any
+ *                 unread or read-ahead input if #MBEDTLS_SSL_KTLS_RX is
+ *                 requested: see mbedtls_ssl_check_pending().
+ * \param fd       Connected TCP socket of the connection. It must be the
+ *                 same socket if this function is called again to enable
+ *                 the other direction.
+ * \param directions  #MBEDTLS_SSL_KTLS_TX, #MBEDTLS_SSL_KTLS_RX or both.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the handshake is not
+ *                 over, if data is pending, or if the arguments are invalid.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the ciphersuite,
+ *                 the configuration or the kernel does not support kernel
+ *                 TLS. The directions enabled before the failure, as
+ *                 reported by mbedtls_ssl_ktls_get_mode(), remain enabled.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_ktls_enable(mbedtls_ssl_context *ssl, int fd, int directions);
+
+/**
+ * \brief          Return the directions offloaded to the kernel.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         A combination of #MBEDTLS_SSL_KTLS_TX and
+ *                 #MBEDTLS_SSL_KTLS_RX, or \c 0 if kernel TLS is not in use.
+ */
+int mbedtls_ssl_ktls_get_mode(const mbedtls_ssl_context *ssl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_ktls.h */
@@ -0,0 +1,245 @@
+/**
+ * \file ssl_scheduler.h
+ *
+ * \brief Cooperative scheduler for SSL connections on an event loop
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_SCHEDULER_H
+#define MBEDTLS_SSL_SCHEDULER_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief          Callback type: serve an established connection
+ *
+ *                 Called by mbedtls_ssl_scheduler_run() for each established
+ *                 connection that was notified with
+ *                 mbedtls_ssl_scheduler_notify(), to read and write
+ *                 application data.
+ *
+ * \param p_cb     Context for the callbacks
+ * \param ssl      SSL context of the connection
+ * \param p_user   User data given to mbedtls_ssl_scheduler_add()
+ *
+ * \return         \c 0 to keep the connection in the scheduler, or a
+ *                 negative value to remove it.
+ */
+typedef int mbedtls_ssl_scheduler_io_t(void *p_cb,
+                                       mbedtls_ssl_context *ssl,
+                                       void *p_user);
+
+/**
+ * \brief          Callback type: end of a handshake
+ *
+ * \param p_cb     Context for the callbacks
+ * \param ssl      SSL context of the connection
+ * \param p_user   User data given to mbedtls_ssl_scheduler_add()
+ * \param ret      \c 0 if the handshake is complete. The connection then
+ *                 stays in the scheduler as an established connection.
+ *                 Otherwise, the error returned by
+ *                 mbedtls_ssl_handshake_step(): the connection has already
+ *                 been removed from the scheduler.
+ */
+typedef void mbedtls_ssl_scheduler_done_t(void *p_cb,
+                                          mbedtls_ssl_context *ssl,
+                                          void *p_user,
+                                          int ret);
+
+/**
+ * \brief   Connection slot of a scheduler
+ */
+typedef struct mbedtls_ssl_scheduler_entry {
+    mbedtls_ssl_context *MBEDTLS_PRIVATE(ssl);    /*!< connection, or NULL   */
+    void *MBEDTLS_PRIVATE(p_user);                /*!< user data             */
+    unsigned char MBEDTLS_PRIVATE(established);   /*!< handshake is over     */
+    unsigned char MBEDTLS_PRIVATE(queued);        /*!< in a run queue        */
+} mbedtls_ssl_scheduler_entry;
+
+/**
+ * \brief   Run queue: a ring of connection slot indexes
+ */
+typedef struct mbedtls_ssl_scheduler_queue {
+    uint32_t *MBEDTLS_PRIVATE(slots);             /*!< ring buffer           */
+    size_t MBEDTLS_PRIVATE(head);                 /*!< index of the first    */
+    size_t MBEDTLS_PRIVATE(count);                /*!< number of slots       */
+} mbedtls_ssl_scheduler_queue;
+
+/**
+ * \brief   Cooperative scheduler
+ *
+ *          A scheduler drives many connections from a single-threaded event
+ *          loop. The application adds each new connection, notifies the
+ *          scheduler when the socket of a connection becomes ready, and
+ *          calls mbedtls_ssl_scheduler_run() in its loop.
+ *
+ *          Connections whose handshake is in progress are served in round
+ *          robin, one call to mbedtls_ssl_handshake_step() at a time, so
+ *          that a burst of handshakes does not hold up the loop. Each round
+ *          serves established connections first, then runs a bounded
+ *          number of handshake steps: the latency added to application data
+ *          is bounded by the cost of these steps.
+ *
+ *          With #MBEDTLS_ECP_RESTARTABLE, the EC operations that support it
+ *          (see mbedtls_ecp_set_max_ops()) are also split across steps. The
+ *          other expensive operations, such as the private key operations
+ *          of a server, run in one step unless they are offloaded with
+ *          #MBEDTLS_SSL_ASYNC_PRIVATE.
+ *
+ * \note    This structure is not thread-safe: use it from the thread of the
+ *          event loop only.
+ */
+typedef struct mbedtls_ssl_scheduler {
+    mbedtls_ssl_scheduler_entry *MBEDTLS_PRIVATE(entries); /*!< slots        */
+    size_t MBEDTLS_PRIVATE(size);                 /*!< number of slots       */
+    uint32_t *MBEDTLS_PRIVATE(free_slots);        /*!< stack of free slots   */
+    size_t MBEDTLS_PRIVATE(nb_free);              /*!< free slots            */
+    mbedtls_ssl_scheduler_queue MBEDTLS_PRIVATE(io_queue); /*!< established  */
+    mbedtls_ssl_scheduler_queue MBEDTLS_PRIVATE(hs_queue); /*!< handshaking  */
+    mbedtls_ssl_scheduler_io_t *MBEDTLS_PRIVATE(f_io);     /*!< I/O callback */
+    mbedtls_ssl_scheduler_done_t *MBEDTLS_PRIVATE(f_done); /*!< end callback */
+    void *MBEDTLS_PRIVATE(p_cb);                  /*!< callback context      */
+    unsigned MBEDTLS_PRIVATE(max_ops);            /*!< EC operations budget  */
+} mbedtls_ssl_scheduler;
+
+/**
+ * \brief          Initialize a scheduler
+ *
+ * \param sched    Scheduler
+ */
+void mbedtls_ssl_scheduler_init(mbedtls_ssl_scheduler *sched);
+
+/**
+ * \brief          Allocate the connection slots of a scheduler
+ *
+ * \param sched    Scheduler
+ * \param size     Maximum number of connections
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p size is invalid or
+ *                 the scheduler is already set up.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_ssl_scheduler_setup(mbedtls_ssl_scheduler *sched, size_t size);
+
+/**
+ * \brief          Set the callbacks of a scheduler
+ *
+ * \param sched    Scheduler
+ * \param f_io     Callback serving established connections, or NULL to
+ *                 remove connections from the scheduler once their
+ *                 handshake is complete.
+ * \param f_done   Callback called at the end of each handshake, or NULL
+ * \param p_cb     Context for both callbacks
+ */
+void mbedtls_ssl_scheduler_set_callbacks(mbedtls_ssl_scheduler *sched,
+                                         mbedtls_ssl_scheduler_io_t *f_io,
+                                         mbedtls_ssl_scheduler_done_t *f_done,
+                                         void *p_cb);
+
+/**
+ * \brief          Set the budget of EC operations of a handshake step.
+ *                 (Only with #MBEDTLS_ECP_RESTARTABLE.)
+ *
+ *                 mbedtls_ssl_scheduler_run() passes it to
+ *                 mbedtls_ecp_set_max_ops() before running handshake steps.
+ *                 Note that this setting is global.
+ *
+ *                 Default: 0, the setting is left unchanged.
+ *
+ * \param sched    Scheduler
+ * \param max_ops  Maximum number of basic EC operations per step, or 0
+ */
+void mbedtls_ssl_scheduler_set_max_ops(mbedtls_ssl_scheduler *sched,
+                                       unsigned max_ops);
+
+/**
+ * \brief          Add a connection to a scheduler
+ *
+ *                 The connection is ready to start its handshake: it is
+ *                 served by the next call to mbedtls_ssl_scheduler_run().
+ *
+ * \param sched    Scheduler
+ * \param ssl      SSL context, set up and with its BIO callbacks set. It
+ *                 must stay valid until it is removed from the scheduler.
+ * \param p_user   User data passed to the callbacks
+ *
+ * \return         A non-negative handle for the connection on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl is NULL.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if all the slots are in use.
+ */
+int mbedtls_ssl_scheduler_add(mbedtls_ssl_scheduler *sched,
+                              mbedtls_ssl_context *ssl,
+                              void *p_user);
+
+/**
+ * \brief          Tell a scheduler that a connection can make progress:
+ *                 its socket is readable or writable, or an asynchronous
+ *                 private key operation is complete.
+ *
+ *                 Connections are not polled: a handshake that returned
+ *                 #MBEDTLS_ERR_SSL_WANT_READ, #MBEDTLS_ERR_SSL_WANT_WRITE or
+ *                 #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS, and an established
+ *                 connection, are only served again after this call.
+ *
+ * \param sched    Scheduler
+ * \param handle   Handle returned by mbedtls_ssl_scheduler_add()
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p handle is invalid.
+ */
+int mbedtls_ssl_scheduler_notify(mbedtls_ssl_scheduler *sched, int handle);
+
+/**
+ * \brief          Remove a connection from a scheduler
+ *
+ *                 The SSL context is not freed.
+ *
+ * \param sched    Scheduler
+ * \param handle   Handle returned by mbedtls_ssl_scheduler_add()
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p handle is invalid.
+ */
+int mbedtls_ssl_scheduler_remove(mbedtls_ssl_scheduler *sched, int handle);
+
+/**
+ * \brief          Run one round of a scheduler
+ *
+ *                 First, the I/O callback is called once for each established
+ *                 connection notified since the last round. Then, up to
+ *                 \p max_steps handshake steps are run, one at a time for
+ *                 each connection in turn.
+ *
+ * \param sched    Scheduler
+ * \param max_steps Maximum number of calls to mbedtls_ssl_handshake_step()
+ *
+ * \return         The number of connections that can make progress
+ *                 without waiting for their socket. If it is not 0, the
+ *                 event loop should poll without blocking before calling
+ *                 this function again.
+ */
+size_t mbedtls_ssl_scheduler_run(mbedtls_ssl_scheduler *sched,
+                                 unsigned max_steps);
+
+/**
+ * \brief          Free a scheduler. The SSL contexts are not freed.
+ *
+ * \param sched    Scheduler
+ */
+void mbedtls_ssl_scheduler_free(mbedtls_ssl_scheduler *sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_scheduler.h */
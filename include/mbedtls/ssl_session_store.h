@@ -0,0 +1,201 @@
+/**
+ * \file ssl_session_store.h
+ *
+ * \brief Client-side session and ticket store for outbound connections
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_SESSION_STORE_H
+#define MBEDTLS_SSL_SESSION_STORE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_SESSION_STORE_DEFAULT_MAX_ENTRIES)
+#define MBEDTLS_SSL_SESSION_STORE_DEFAULT_MAX_ENTRIES  256   /*!< Maximum number of servers */
+#endif
+
+#if !defined(MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT)
+#define MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT    86400   /*!< 1 day  */
+#endif
+
+#if !defined(MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS)
+#define MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS            4   /*!< TLS 1.3 tickets kept per server */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_session_store_entry mbedtls_ssl_session_store_entry;
+typedef struct mbedtls_ssl_session_store_item mbedtls_ssl_session_store_item;
+
+/**
+ * \brief   A stored session
+ */
+struct mbedtls_ssl_session_store_item {
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(expiry);        /*!< expiry time, or 0  */
+#endif
+    int MBEDTLS_PRIVATE(single_use);                  /*!< TLS 1.3 ticket     */
+    unsigned char *MBEDTLS_PRIVATE(session);          /*!< serialized session */
+    size_t MBEDTLS_PRIVATE(session_len);
+    mbedtls_ssl_session_store_item *MBEDTLS_PRIVATE(next); /*!< older item    */
+};
+
+/**
+ * \brief   The sessions of one server
+ */
+struct mbedtls_ssl_session_store_entry {
+    unsigned char *MBEDTLS_PRIVATE(key);              /*!< host name, port
+                                                           and ALPN list   */
+    size_t MBEDTLS_PRIVATE(key_len);
+    uint32_t MBEDTLS_PRIVATE(hash);                   /*!< hash of \c key     */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(last_used);     /*!< for eviction       */
+#endif
+    mbedtls_ssl_session_store_item *MBEDTLS_PRIVATE(items); /*!< newest first */
+    size_t MBEDTLS_PRIVATE(item_count);
+    mbedtls_ssl_session_store_entry *MBEDTLS_PRIVATE(next); /*!< bucket chain */
+};
+
+/**
+ * \brief   Client session store
+ *
+ *          Sessions are indexed by the host name set with
+ *          mbedtls_ssl_set_hostname(), the port set with
+ *          mbedtls_ssl_set_server_port() and the ALPN protocols of the
+ *          configuration, so that contexts connecting to the same upstream
+ *          with the same settings share them.
+ *
+ *          A TLS 1.2 session is kept until it expires and may be resumed
+ *          any number of times. TLS 1.3 tickets are single-use: each one is
+ *          handed out to a single connection, as recommended by RFC 8446
+ *          appendix C.4, and removed from the store.
+ */
+struct mbedtls_ssl_session_store {
+    mbedtls_ssl_session_store_entry **MBEDTLS_PRIVATE(table); /*!< buckets   */
+    size_t MBEDTLS_PRIVATE(buckets);
+    size_t MBEDTLS_PRIVATE(count);                    /*!< number of servers  */
+    size_t MBEDTLS_PRIVATE(max_entries);              /*!< maximum servers    */
+    int MBEDTLS_PRIVATE(timeout);                     /*!< TLS 1.2 session
+                                                           lifetime        */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< mutex              */
+#endif
+};
+
+/**
+ * \brief          Initialize a client session store
+ *
+ * \param store    Client session store
+ */
+void mbedtls_ssl_session_store_init(mbedtls_ssl_session_store *store);
+
+/**
+ * \brief          Set the maximum number of servers remembered
+ *                 (Default: MBEDTLS_SSL_SESSION_STORE_DEFAULT_MAX_ENTRIES)
+ *
+ *                 When the store is full, the sessions of the server that
+ *                 was used least recently are dropped.
+ *
+ * \param store    Client session store
+ * \param max      Maximum number of servers
+ */
+void mbedtls_ssl_session_store_set_max_entries(mbedtls_ssl_session_store *store,
+                                               size_t max);
+
+/**
+ * \brief          Set the lifetime of TLS 1.2 sessions
+ *                 (Default: MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT)
+ *
+ *                 A TLS 1.2 session ticket with a shorter lifetime hint
+ *                 expires earlier. TLS 1.3 tickets expire according to
+ *                 their own lifetime. A timeout of 0 indicates no timeout.
+ *
+ * \param store    Client session store
+ * \param timeout  Session lifetime in seconds
+ */
+void mbedtls_ssl_session_store_set_timeout(mbedtls_ssl_session_store *store,
+                                           int timeout);
+
+/**
+ * \brief          Store the current session of a connection
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This is done by the library for SSL contexts whose
+ *                 configuration uses the store, see
+ *                 mbedtls_ssl_conf_session_store().
+ *
+ * \param store    Client session store
+ * \param ssl      Client SSL context with a host name, after the handshake
+ *                 or after receiving a TLS 1.3 NewSessionTicket message
+ *
+ * \return         \c 0 on success, including when the session cannot be
+ *                 resumed and is not stored.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl has no host name.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_session_store_put(mbedtls_ssl_session_store *store,
+                                  const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Get a session to resume with the server of a connection
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The most recent TLS 1.3 ticket is removed from the store.
+ *
+ * \param store    Client session store
+ * \param ssl      Client SSL context with a host name
+ * \param session  Initialized session to load the session into
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if there is no
+ *                 valid session for this server.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_session_store_get(mbedtls_ssl_session_store *store,
+                                  const mbedtls_ssl_context *ssl,
+                                  mbedtls_ssl_session *session);
+
+/**
+ * \brief          Drop the sessions of all servers
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param store    Client session store
+ *
+ * \return         \c 0 on success.
+ * \return         A negative error code on failure.
+ */
+int mbedtls_ssl_session_store_clear(mbedtls_ssl_session_store *store);
+
+/**
+ * \brief          Free the contents of a client session store
+ *
+ * \param store    Client session store
+ */
+void mbedtls_ssl_session_store_free(mbedtls_ssl_session_store *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_session_store.h */
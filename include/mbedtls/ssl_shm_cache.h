@@ -0,0 +1,196 @@
+/**
+ * \file ssl_shm_cache.h
+ *
+ * \brief SSL session cache in memory shared between processes
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_SHM_CACHE_H
+#define MBEDTLS_SSL_SHM_CACHE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_SHM_CACHE_DEFAULT_MAX_ENTRIES)
+#define MBEDTLS_SSL_SHM_CACHE_DEFAULT_MAX_ENTRIES  1024   /*!< Maximum entries in cache */
+#endif
+
+#if !defined(MBEDTLS_SSL_SHM_CACHE_DEFAULT_SESSION_LEN)
+#define MBEDTLS_SSL_SHM_CACHE_DEFAULT_SESSION_LEN  2048   /*!< Maximum serialized session size */
+#endif
+
+#if !defined(MBEDTLS_SSL_SHM_CACHE_DEFAULT_TIMEOUT)
+#define MBEDTLS_SSL_SHM_CACHE_DEFAULT_TIMEOUT     86400   /*!< 1 day  */
+#endif
+
+#if !defined(MBEDTLS_SSL_SHM_CACHE_WAYS)
+#define MBEDTLS_SSL_SHM_CACHE_WAYS                    4   /*!< Slots a session ID may map to */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Shared SSL session cache
+ *
+ *          The cache lives in an anonymous shared memory mapping, created by
+ *          mbedtls_ssl_shm_cache_setup(). Processes forked afterwards
+ *          inherit the mapping, so that a session established by one worker
+ *          of a pre-forking server can be resumed by any other worker.
+ *
+ *          The mapping is an array of fixed-size slots, each holding a
+ *          session ID and the session serialized with
+ *          mbedtls_ssl_session_save(). A session ID maps to
+ *          MBEDTLS_SSL_SHM_CACHE_WAYS slots; when they are all in use, the
+ *          oldest one is replaced.
+ *
+ *          Each slot is protected by a sequence lock: readers never block
+ *          writers, and a process that dies while writing a slot only loses
+ *          that slot, without blocking the other processes. No
+ *          MBEDTLS_THREADING_C is needed, and the cache may also be used by
+ *          several threads of a process.
+ *
+ * \note    This context is process-local and may be copied by fork(). It
+ *          only refers to the shared mapping.
+ */
+typedef struct mbedtls_ssl_shm_cache_context {
+    unsigned char *MBEDTLS_PRIVATE(map);              /*!< shared mapping     */
+    size_t MBEDTLS_PRIVATE(map_len);                  /*!< mapping size       */
+} mbedtls_ssl_shm_cache_context;
+
+/**
+ * \brief          Initialize a shared SSL cache context
+ *
+ * \param cache    SSL cache context to be initialized
+ */
+void mbedtls_ssl_shm_cache_init(mbedtls_ssl_shm_cache_context *cache);
+
+/**
+ * \brief          Create the shared memory mapping of the cache
+ *
+ *                 Call this in the parent process, before forking the
+ *                 workers.
+ *
+ * \param cache    SSL cache context
+ * \param max_entries Number of slots, rounded up to a multiple of
+ *                 MBEDTLS_SSL_SHM_CACHE_WAYS. If \c 0,
+ *                 MBEDTLS_SSL_SHM_CACHE_DEFAULT_MAX_ENTRIES is used.
+ * \param max_session_len Maximum size of a serialized session. Larger
+ *                 sessions are not cached. If \c 0,
+ *                 MBEDTLS_SSL_SHM_CACHE_DEFAULT_SESSION_LEN is used.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the cache is already
+ *                 set up or the parameters are too large.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if the mapping could not be
+ *                 created.
+ */
+int mbedtls_ssl_shm_cache_setup(mbedtls_ssl_shm_cache_context *cache,
+                                size_t max_entries,
+                                size_t max_session_len);
+
+/**
+ * \brief          Cache get callback implementation
+ *                 (Thread-safe and process-safe)
+ *
+ * \param data            The shared SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        for the session to load.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The address at which to store the session
+ *                        associated with \p session_id, if present.
+ *
+ * \return                \c 0 on success.
+ * \return                #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if there is
+ *                        no valid cache entry with specified session ID, or
+ *                        if the entry is being written by another process.
+ * \return                Another negative error code on failure.
+ */
+int mbedtls_ssl_shm_cache_get(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              mbedtls_ssl_session *session);
+
+/**
+ * \brief          Cache set callback implementation
+ *                 (Thread-safe and process-safe)
+ *
+ * \param data            The shared SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to \p session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The session to store.
+ *
+ * \return                \c 0 on success. The session may not be stored if
+ *                        all the slots it maps to are being written by other
+ *                        processes.
+ * \return                #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if the serialized
+ *                        session does not fit in a slot.
+ * \return                Another negative error code on failure.
+ */
+int mbedtls_ssl_shm_cache_set(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              const mbedtls_ssl_session *session);
+
+/**
+ * \brief          Remove the cache entry by the session ID
+ *                 (Thread-safe and process-safe)
+ *
+ * \param data            The shared SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ *
+ * \return                \c 0 on success. This indicates the cache entry for
+ *                        the session with provided ID is removed or does not
+ *                        exist.
+ * \return                A negative error code on failure.
+ */
+int mbedtls_ssl_shm_cache_remove(void *data,
+                                 unsigned char const *session_id,
+                                 size_t session_id_len);
+
+/**
+ * \brief          Set the cache timeout
+ *                 (Default: MBEDTLS_SSL_SHM_CACHE_DEFAULT_TIMEOUT (1 day))
+ *
+ *                 The timeout is stored in the shared mapping: it applies to
+ *                 all the processes. A timeout of 0 indicates no timeout.
+ *
+ * \param cache    SSL cache context, after mbedtls_ssl_shm_cache_setup()
+ * \param timeout  cache entry timeout in seconds
+ */
+void mbedtls_ssl_shm_cache_set_timeout(mbedtls_ssl_shm_cache_context *cache,
+                                       int timeout);
+
+/**
+ * \brief          Unmap the cache from this process
+ *
+ *                 The mapping is released when the last process using it
+ *                 unmaps it or exits.
+ *
+ * \param cache    SSL cache context
+ */
+void mbedtls_ssl_shm_cache_free(mbedtls_ssl_shm_cache_context *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_shm_cache.h */
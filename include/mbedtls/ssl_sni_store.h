@@ -0,0 +1,187 @@
+/**
+ * \file ssl_sni_store.h
+ *
+ * \brief SNI-indexed server certificate store
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_SNI_STORE_H
+#define MBEDTLS_SSL_SNI_STORE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_SNI_STORE_INITIAL_BUCKETS)
+#define MBEDTLS_SSL_SNI_STORE_INITIAL_BUCKETS   64   /*!< Initial hash table size, power of 2 */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_sni_store mbedtls_ssl_sni_store;
+typedef struct mbedtls_ssl_sni_entry mbedtls_ssl_sni_entry;
+typedef struct mbedtls_ssl_sni_cert mbedtls_ssl_sni_cert;
+
+/**
+ * \brief   A certificate and key registered for a name
+ */
+struct mbedtls_ssl_sni_cert {
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(cert);          /*!< certificate chain  */
+    mbedtls_pk_context *MBEDTLS_PRIVATE(key);         /*!< private key        */
+    uint32_t MBEDTLS_PRIVATE(sig_algs);               /*!< usable TLS 1.3 signature
+                                                           algorithms          */
+    mbedtls_ssl_sni_cert *MBEDTLS_PRIVATE(next);      /*!< next certificate   */
+};
+
+/**
+ * \brief   A host name, or a wildcard suffix, and its certificates
+ */
+struct mbedtls_ssl_sni_entry {
+    unsigned char *MBEDTLS_PRIVATE(name);             /*!< lowercase name     */
+    size_t MBEDTLS_PRIVATE(name_len);
+    uint32_t MBEDTLS_PRIVATE(hash);                   /*!< hash of \c name    */
+    mbedtls_ssl_sni_cert *MBEDTLS_PRIVATE(certs);     /*!< certificates       */
+    mbedtls_ssl_sni_entry *MBEDTLS_PRIVATE(next);     /*!< bucket chain       */
+};
+
+/**
+ * \brief   SNI certificate store
+ *
+ *          Exact host names and wildcard names are kept in two hash
+ *          tables. A wildcard name \c *.example.com is indexed by its
+ *          suffix \c example.com and matches exactly one extra label, as
+ *          specified in RFC 6125. The lookup cost does not depend on the
+ *          number of names in the store.
+ */
+struct mbedtls_ssl_sni_store {
+    mbedtls_ssl_sni_entry **MBEDTLS_PRIVATE(exact);      /*!< exact names        */
+    size_t MBEDTLS_PRIVATE(exact_buckets);
+    size_t MBEDTLS_PRIVATE(exact_count);
+    mbedtls_ssl_sni_entry **MBEDTLS_PRIVATE(wildcard);   /*!< wildcard suffixes  */
+    size_t MBEDTLS_PRIVATE(wildcard_buckets);
+    size_t MBEDTLS_PRIVATE(wildcard_count);
+    int MBEDTLS_PRIVATE(strict);                         /*!< reject unknown names */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< mutex              */
+#endif
+};
+
+/**
+ * \brief          Initialize an SNI certificate store
+ *
+ * \param store    SNI certificate store
+ */
+void mbedtls_ssl_sni_store_init(mbedtls_ssl_sni_store *store);
+
+/**
+ * \brief          Register a certificate for a host name
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Several certificates may be registered for the same name,
+ *                 for example one with an RSA key and one with an ECDSA
+ *                 key: the handshake then picks one according to the
+ *                 signature algorithms offered by the client.
+ *
+ * \note           The store does not copy \p cert and \p key: they must
+ *                 remain valid until they are removed from the store and
+ *                 no handshake in progress uses them.
+ *
+ * \param store    SNI certificate store
+ * \param name     Host name, as a null-terminated string. Names are
+ *                 compared case-insensitively. A name of the form
+ *                 \c *.suffix registers a wildcard certificate.
+ * \param cert     Certificate chain to use for \p name
+ * \param key      Private key matching the first certificate of \p cert
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p name is not a valid
+ *                 host name or wildcard name.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_ssl_sni_store_add(mbedtls_ssl_sni_store *store,
+                              const char *name,
+                              mbedtls_x509_crt *cert,
+                              mbedtls_pk_context *key);
+
+/**
+ * \brief          Remove all certificates registered for a name
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param store    SNI certificate store
+ * \param name     Host name or wildcard name, as passed to
+ *                 mbedtls_ssl_sni_store_add()
+ *
+ * \return         \c 0 on success, including if \p name was not registered.
+ * \return         A negative error code on failure.
+ */
+int mbedtls_ssl_sni_store_remove(mbedtls_ssl_sni_store *store,
+                                 const char *name);
+
+/**
+ * \brief          Choose what happens when the client asks for a name that
+ *                 is not in the store.
+ *
+ * \param store    SNI certificate store
+ * \param strict   If \c 0 (default), the handshake continues with the
+ *                 certificates configured with mbedtls_ssl_conf_own_cert().
+ *                 Otherwise, the handshake is aborted with an
+ *                 \c unrecognized_name alert.
+ */
+void mbedtls_ssl_sni_store_set_strict(mbedtls_ssl_sni_store *store,
+                                      int strict);
+
+/**
+ * \brief          SNI callback implementation
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Install it with
+ *                 `mbedtls_ssl_conf_sni(conf, mbedtls_ssl_sni_store_cb, store)`.
+ *                 It looks \p name up in the store, first as an exact name,
+ *                 then as a wildcard, and sets the certificates found with
+ *                 mbedtls_ssl_set_hs_own_cert().
+ *
+ * \param p_store  The SNI certificate store (mbedtls_ssl_sni_store *)
+ * \param ssl      SSL context
+ * \param name     Server name sent by the client (not null-terminated)
+ * \param name_len Length of \p name
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_UNRECOGNIZED_NAME if \p name is not in
+ *                 the store and the store is strict.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_sni_store_cb(void *p_store, mbedtls_ssl_context *ssl,
+                             const unsigned char *name, size_t name_len);
+
+/**
+ * \brief          Free the store and clear memory. The certificates and
+ *                 keys themselves are not freed.
+ *
+ * \param store    SNI certificate store
+ */
+void mbedtls_ssl_sni_store_free(mbedtls_ssl_sni_store *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_sni_store.h */
@@ -72,6 +72,11 @@ typedef struct mbedtls_ssl_ticket_context {
     int(*MBEDTLS_PRIVATE(f_rng))(void *, unsigned char *, size_t);
     void *MBEDTLS_PRIVATE(p_rng);                    /*!< context for the RNG function       */
 
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+    unsigned char MBEDTLS_PRIVATE(compact);          /*!< write compact sessions             */
+    int MBEDTLS_PRIVATE(compact_flags);              /*!< MBEDTLS_SSL_SESSION_COMPACT_xxx    */
+#endif
+
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
 #endif
@@ -163,6 +168,28 @@ int mbedtls_ssl_ticket_rotate(mbedtls_ssl_ticket_context *ctx,
                               const unsigned char *k, size_t klength,
                               uint32_t lifetime);
 
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+/**
+ * \brief           Choose the encoding of the session in new tickets.
+ *
+ *                  With the compact encoding, see
+ *                  mbedtls_ssl_session_save_compact(), tickets are smaller
+ *                  and cheaper to parse, but do not carry the peer
+ *                  certificate unless \p flags asks for it. Tickets in
+ *                  either encoding are accepted by mbedtls_ssl_ticket_parse()
+ *                  whatever this setting, so it can be changed on a running
+ *                  server.
+ *
+ * \param ctx       Ticket context
+ * \param enable    \c 1 to write compact sessions, \c 0 (default) to write
+ *                  sessions as mbedtls_ssl_session_save() does.
+ * \param flags     Optional data to keep in compact sessions, see
+ *                  mbedtls_ssl_session_save_compact().
+ */
+void mbedtls_ssl_ticket_set_compact(mbedtls_ssl_ticket_context *ctx,
+                                    int enable, int flags);
+#endif /* MBEDTLS_SSL_COMPACT_SESSION */
+
 /**
  * \brief           Implementation of the ticket write callback
  *
@@ -0,0 +1,620 @@
+/*
+ *  io_uring based network transport
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * The send and receive callbacks only fill submission queue entries. They
+ * are submitted, and the completions collected, by mbedtls_net_uring_run()
+ * with one io_uring_enter() for the whole event loop iteration. A completed
+ * operation is kept in its connection until the SSL layer retries the call
+ * that returned WANT_READ or WANT_WRITE, with the same arguments.
+ *
+ * The raw system calls are used, so that no liburing is needed.
+ */
+
+/* Enable the declaration of syscall() even when compiling with -std=c99.
+ * Must be set before mbedtls_config.h, which pulls in glibc's features.h
+ * indirectly. */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_NET_URING_C)
+
+#if !defined(__linux__)
+#error "This module only works on Linux, see MBEDTLS_NET_URING_C in mbedtls_config.h"
+#endif
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/net_uring.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+#include <limits.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+
+/* Older C libraries do not define these. */
+#if !defined(__NR_io_uring_setup)
+#define __NR_io_uring_setup     425
+#endif
+#if !defined(__NR_io_uring_enter)
+#define __NR_io_uring_enter     426
+#endif
+#if !defined(__NR_io_uring_register)
+#define __NR_io_uring_register  427
+#endif
+
+/* State of a mbedtls_net_uring_op */
+#define NET_URING_IDLE          0
+#define NET_URING_INFLIGHT      1
+#define NET_URING_DONE          2
+
+/* Direction, in the low bit of the user data of the requests */
+#define NET_URING_RX            0
+#define NET_URING_TX            1
+
+static int net_uring_setup_sys(unsigned entries, struct io_uring_params *p)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int net_uring_enter_sys(int fd, unsigned to_submit,
+                               unsigned min_complete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                         flags, NULL, 0);
+}
+
+static int net_uring_register_sys(int fd, unsigned opcode,
+                                  const void *arg, unsigned nr_args)
+{
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+void mbedtls_net_uring_init(mbedtls_net_uring *ring)
+{
+    memset(ring, 0, sizeof(mbedtls_net_uring));
+    ring->fd = -1;
+}
+
+/*
+ * Map the rings, see io_uring_setup(2).
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int net_uring_map(mbedtls_net_uring *ring,
+                         const struct io_uring_params *p)
+{
+    unsigned char *sq, *cq;
+
+    ring->sq_map_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    ring->cq_map_len = p->cq_off.cqes +
+                       p->cq_entries * sizeof(struct io_uring_cqe);
+
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_len > ring->sq_map_len) {
+            ring->sq_map_len = ring->cq_map_len;
+        }
+        ring->cq_map_len = ring->sq_map_len;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd,
+                        IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd,
+                            IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+    }
+
+    ring->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    sq = ring->sq_map;
+    ring->sq_head = (unsigned *) (sq + p->sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + p->sq_off.tail);
+    ring->sq_array = (unsigned *) (sq + p->sq_off.array);
+    ring->sq_mask = *(unsigned *) (sq + p->sq_off.ring_mask);
+    ring->sq_entries = *(unsigned *) (sq + p->sq_off.ring_entries);
+
+    cq = ring->cq_map;
+    ring->cq_head = (unsigned *) (cq + p->cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + p->cq_off.tail);
+    ring->cqes = cq + p->cq_off.cqes;
+    ring->cq_mask = *(unsigned *) (cq + p->cq_off.ring_mask);
+    ring->cq_entries = *(unsigned *) (cq + p->cq_off.ring_entries);
+
+    return 0;
+}
+
+int mbedtls_net_uring_setup(mbedtls_net_uring *ring, unsigned entries,
+                            unsigned max_conns)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    struct io_uring_params p;
+
+    if (ring == NULL || ring->fd != -1 || entries == 0 ||
+        entries > UINT_MAX / 2 || max_conns > UINT_MAX / 2) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = 2 * entries;
+
+    ring->fd = net_uring_setup_sys(entries, &p);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return (errno == EINVAL) ? MBEDTLS_ERR_NET_BAD_INPUT_DATA :
+               MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+    ring->features = p.features;
+
+    if ((ret = net_uring_map(ring, &p)) != 0) {
+        goto cleanup;
+    }
+
+#if defined(IORING_RSRC_REGISTER_SPARSE)
+    /* Two slots per connection, filled by mbedtls_net_uring_register_ssl().
+     * Without kernel support, the SSL buffers are simply not registered. */
+    if (max_conns != 0) {
+        struct io_uring_rsrc_register reg;
+
+        ring->buf_used = mbedtls_calloc(2, max_conns);
+        if (ring->buf_used == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto cleanup;
+        }
+
+        memset(&reg, 0, sizeof(reg));
+        reg.nr = 2 * max_conns;
+        reg.flags = IORING_RSRC_REGISTER_SPARSE;
+        if (net_uring_register_sys(ring->fd, IORING_REGISTER_BUFFERS2,
+                                   &reg, sizeof(reg)) == 0) {
+            ring->nr_bufs = 2 * max_conns;
+        } else {
+            mbedtls_free(ring->buf_used);
+            ring->buf_used = NULL;
+        }
+    }
+#else
+    (void) max_conns;
+#endif /* IORING_RSRC_REGISTER_SPARSE */
+
+    return 0;
+
+cleanup:
+    mbedtls_net_uring_free(ring);
+    return ret;
+}
+
+void mbedtls_net_uring_free(mbedtls_net_uring *ring)
+{
+    if (ring == NULL) {
+        return;
+    }
+
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_len);
+    }
+    if (ring->sq_map != NULL) {
+        munmap(ring->sq_map, ring->sq_map_len);
+    }
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    mbedtls_free(ring->buf_used);
+
+    mbedtls_net_uring_init(ring);
+}
+
+void mbedtls_net_uring_conn_init(mbedtls_net_uring_conn *conn,
+                                 mbedtls_net_uring *ring, int fd)
+{
+    memset(conn, 0, sizeof(mbedtls_net_uring_conn));
+    conn->ring = ring;
+    conn->fd = fd;
+    conn->in_index = -1;
+    conn->out_index = -1;
+}
+
+int mbedtls_net_uring_conn_busy(const mbedtls_net_uring_conn *conn)
+{
+    return conn->rx.state == NET_URING_INFLIGHT ||
+           conn->tx.state == NET_URING_INFLIGHT;
+}
+
+/*
+ * Point the fixed buffer slot index at buf, or empty it if buf is NULL.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int net_uring_update_buf(mbedtls_net_uring *ring, int index,
+                                unsigned char *buf, size_t len)
+{
+#if defined(IORING_RSRC_REGISTER_SPARSE)
+    struct iovec iov;
+    struct io_uring_rsrc_update2 up;
+
+    iov.iov_base = buf;
+    iov.iov_len = len;
+
+    memset(&up, 0, sizeof(up));
+    up.offset = (unsigned) index;
+    up.data = (uintptr_t) &iov;
+    up.nr = 1;
+
+    if (net_uring_register_sys(ring->fd, IORING_REGISTER_BUFFERS_UPDATE,
+                               &up, sizeof(up)) != 1) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    return 0;
+#else
+    (void) ring;
+    (void) index;
+    (void) buf;
+    (void) len;
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+#endif /* IORING_RSRC_REGISTER_SPARSE */
+}
+
+static int net_uring_alloc_buf(mbedtls_net_uring *ring)
+{
+    unsigned i;
+
+    for (i = 0; i < ring->nr_bufs; i++) {
+        if (ring->buf_used[i] == 0) {
+            ring->buf_used[i] = 1;
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+static void net_uring_release_buf(mbedtls_net_uring *ring, int *index)
+{
+    if (*index < 0) {
+        return;
+    }
+
+    /* An empty slot no longer pins the pages of the SSL buffer. */
+    (void) net_uring_update_buf(ring, *index, NULL, 0);
+    ring->buf_used[*index] = 0;
+    *index = -1;
+}
+
+int mbedtls_net_uring_register_ssl(mbedtls_net_uring_conn *conn,
+                                   const mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_net_uring *ring;
+    size_t in_len, out_len;
+
+    if (conn == NULL || conn->ring == NULL || ssl == NULL ||
+        ssl->in_buf == NULL || ssl->out_buf == NULL ||
+        mbedtls_net_uring_conn_busy(conn)) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+    ring = conn->ring;
+
+    if (ring->nr_bufs == 0) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    in_len = ssl->in_buf_len;
+    out_len = ssl->out_buf_len;
+#else
+    in_len = MBEDTLS_SSL_IN_BUFFER_LEN;
+    out_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#endif
+
+    if (conn->in_index < 0) {
+        conn->in_index = net_uring_alloc_buf(ring);
+    }
+    if (conn->out_index < 0) {
+        conn->out_index = net_uring_alloc_buf(ring);
+    }
+    if (conn->in_index < 0 || conn->out_index < 0) {
+        ret = MBEDTLS_ERR_NET_BUFFER_TOO_SMALL;
+        goto cleanup;
+    }
+
+    if ((ret = net_uring_update_buf(ring, conn->in_index,
+                                    ssl->in_buf, in_len)) != 0 ||
+        (ret = net_uring_update_buf(ring, conn->out_index,
+                                    ssl->out_buf, out_len)) != 0) {
+        goto cleanup;
+    }
+
+    conn->in_buf = ssl->in_buf;
+    conn->in_len = in_len;
+    conn->out_buf = ssl->out_buf;
+    conn->out_len = out_len;
+
+    return 0;
+
+cleanup:
+    net_uring_release_buf(ring, &conn->in_index);
+    net_uring_release_buf(ring, &conn->out_index);
+    conn->in_buf = NULL;
+    conn->out_buf = NULL;
+    return ret;
+}
+
+void mbedtls_net_uring_conn_free(mbedtls_net_uring_conn *conn)
+{
+    mbedtls_net_uring_conn **p;
+
+    if (conn == NULL || conn->ring == NULL) {
+        return;
+    }
+
+    if (conn->is_deferred) {
+        for (p = &conn->ring->deferred; *p != NULL; p = &(*p)->next_deferred) {
+            if (*p == conn) {
+                *p = conn->next_deferred;
+                break;
+            }
+        }
+    }
+
+    net_uring_release_buf(conn->ring, &conn->in_index);
+    net_uring_release_buf(conn->ring, &conn->out_index);
+
+    memset(conn, 0, sizeof(mbedtls_net_uring_conn));
+    conn->fd = -1;
+    conn->in_index = -1;
+    conn->out_index = -1;
+}
+
+/*
+ * Queue a request for the operation op of conn. If there is no room in the
+ * queues, the connection is reported as ready by the next
+ * mbedtls_net_uring_run() instead, so that the request is retried.
+ */
+static void net_uring_queue(mbedtls_net_uring_conn *conn,
+                            mbedtls_net_uring_op *op, int dir)
+{
+    mbedtls_net_uring *ring = conn->ring;
+    struct io_uring_sqe *sqe;
+    unsigned head, tail, idx;
+    int fixed = -1;
+
+    head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    tail = *ring->sq_tail;
+
+    /* Every request in flight needs room for its completion. */
+    if (tail - head >= ring->sq_entries || ring->inflight >= ring->cq_entries) {
+        if (!conn->is_deferred) {
+            conn->is_deferred = 1;
+            conn->next_deferred = ring->deferred;
+            ring->deferred = conn;
+        }
+        return;
+    }
+
+    idx = tail & ring->sq_mask;
+    sqe = (struct io_uring_sqe *) ring->sqes + idx;
+    memset(sqe, 0, sizeof(*sqe));
+
+    if (dir == NET_URING_RX) {
+        if (conn->in_index >= 0 && op->buf >= conn->in_buf &&
+            op->len <= conn->in_len - (size_t) (op->buf - conn->in_buf)) {
+            fixed = conn->in_index;
+        }
+        sqe->opcode = (fixed >= 0) ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+    } else {
+        if (conn->out_index >= 0 && op->buf >= conn->out_buf &&
+            op->len <= conn->out_len - (size_t) (op->buf - conn->out_buf)) {
+            fixed = conn->out_index;
+        }
+        sqe->opcode = (fixed >= 0) ? IORING_OP_WRITE_FIXED : IORING_OP_SEND;
+        sqe->msg_flags = (fixed >= 0) ? 0 : MSG_NOSIGNAL;
+    }
+
+    sqe->fd = conn->fd;
+    sqe->addr = (uintptr_t) op->buf;
+    sqe->len = (unsigned) op->len;
+    if (fixed >= 0) {
+        /* Sockets have no file position: -1 means "current position". */
+        sqe->off = (uint64_t) -1;
+        sqe->buf_index = (uint16_t) fixed;
+    }
+    sqe->user_data = (uintptr_t) conn | (unsigned) dir;
+
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    ring->queued++;
+    ring->inflight++;
+    op->state = NET_URING_INFLIGHT;
+}
+
+/*
+ * Common part of the send and receive callbacks.
+ */
+static int net_uring_io(mbedtls_net_uring_conn *conn, int dir,
+                        unsigned char *buf, size_t len)
+{
+    mbedtls_net_uring_op *op = (dir == NET_URING_RX) ? &conn->rx : &conn->tx;
+    int want = (dir == NET_URING_RX) ? MBEDTLS_ERR_SSL_WANT_READ :
+               MBEDTLS_ERR_SSL_WANT_WRITE;
+    int res;
+
+    if (conn->ring == NULL || conn->fd < 0) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+
+    /* The kernel reports the result as an int. */
+    if (len > INT_MAX) {
+        len = INT_MAX;
+    }
+
+    if (op->state == NET_URING_IDLE) {
+        op->buf = buf;
+        op->len = len;
+        net_uring_queue(conn, op, dir);
+        return want;
+    }
+
+    /* The request was queued for this exact call. */
+    if (buf != op->buf || len != op->len) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    if (op->state == NET_URING_INFLIGHT) {
+        return want;
+    }
+
+    op->state = NET_URING_IDLE;
+    res = op->res;
+
+    if (res >= 0) {
+        return res;
+    }
+
+    if (res == -EAGAIN || res == -EINTR) {
+        net_uring_queue(conn, op, dir);
+        return want;
+    }
+
+    if (res == -EPIPE || res == -ECONNRESET) {
+        return MBEDTLS_ERR_NET_CONN_RESET;
+    }
+
+    return (dir == NET_URING_RX) ? MBEDTLS_ERR_NET_RECV_FAILED :
+           MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int mbedtls_net_uring_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    return net_uring_io((mbedtls_net_uring_conn *) ctx, NET_URING_RX,
+                        buf, len);
+}
+
+int mbedtls_net_uring_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    return net_uring_io((mbedtls_net_uring_conn *) ctx, NET_URING_TX,
+                        (unsigned char *) buf, len);
+}
+
+int mbedtls_net_uring_run(mbedtls_net_uring *ring, unsigned wait_nr,
+                          mbedtls_net_uring_conn **ready, size_t max_ready)
+{
+    mbedtls_net_uring_conn *conn;
+    struct io_uring_cqe *cqe;
+    unsigned head, tail;
+    size_t n = 0, i;
+    int ret;
+
+    if (ring == NULL || ring->fd == -1 || (ready == NULL && max_ready != 0)) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    /* Do not wait for completions that cannot come, nor when some are
+     * already available or connections must retry their request. */
+    if (wait_nr > ring->inflight) {
+        wait_nr = ring->inflight;
+    }
+    if (ring->deferred != NULL ||
+        *ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        wait_nr = 0;
+    }
+
+    if (ring->queued != 0 || wait_nr != 0) {
+        do {
+            ret = net_uring_enter_sys(ring->fd, ring->queued, wait_nr,
+                                      wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret >= 0) {
+            ring->queued -= (unsigned) ret;
+        } else if (errno != EAGAIN && errno != EBUSY) {
+            return MBEDTLS_ERR_NET_POLL_FAILED;
+        }
+    }
+
+    head = *ring->cq_head;
+    tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        cqe = (struct io_uring_cqe *) ring->cqes + (head & ring->cq_mask);
+        conn = (mbedtls_net_uring_conn *) (uintptr_t) (cqe->user_data &
+                                                       ~(uint64_t) 1);
+
+        if (!conn->ready) {
+            if (n == max_ready) {
+                break;
+            }
+            conn->ready = 1;
+            ready[n++] = conn;
+        }
+
+        if (cqe->user_data & NET_URING_TX) {
+            conn->tx.res = cqe->res;
+            conn->tx.state = NET_URING_DONE;
+        } else {
+            conn->rx.res = cqe->res;
+            conn->rx.state = NET_URING_DONE;
+        }
+
+        ring->inflight--;
+        head++;
+    }
+
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    while (ring->deferred != NULL && n < max_ready) {
+        conn = ring->deferred;
+        ring->deferred = conn->next_deferred;
+        conn->is_deferred = 0;
+        conn->next_deferred = NULL;
+
+        if (!conn->ready) {
+            conn->ready = 1;
+            ready[n++] = conn;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        ready[i]->ready = 0;
+    }
+
+    return (int) n;
+}
+
+#endif /* MBEDTLS_NET_URING_C */
@@ -0,0 +1,306 @@
+/*
+ *  SSL server handshake admission control callback implementation
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Token buckets are kept in thousandths of a token, so that a rate of r
+ * handshakes per second refills r thousandths per millisecond. A bucket is
+ * only refilled when it is used, from the time elapsed since its last use.
+ *
+ * The per-prefix buckets form a hash table without keys, like a count-min
+ * sketch with a single row: a prefix always maps to the same bucket, and an
+ * attacker cycling through prefixes cannot reset the bucket of another one.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_ADMISSION_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_admission.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#define TOKEN 1000
+
+void mbedtls_ssl_admission_init(mbedtls_ssl_admission_context *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_ssl_admission_context));
+
+    ctx->rate = MBEDTLS_SSL_ADMISSION_DEFAULT_RATE;
+    ctx->burst = MBEDTLS_SSL_ADMISSION_DEFAULT_RATE;
+    ctx->prefix_rate = MBEDTLS_SSL_ADMISSION_DEFAULT_PREFIX_RATE;
+    ctx->prefix_burst = MBEDTLS_SSL_ADMISSION_DEFAULT_PREFIX_RATE;
+    ctx->cookie_threshold = MBEDTLS_SSL_ADMISSION_DEFAULT_COOKIE_THRESHOLD;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&ctx->mutex);
+#endif
+}
+
+int mbedtls_ssl_admission_set_global_limit(mbedtls_ssl_admission_context *ctx,
+                                           uint32_t rate, uint32_t burst)
+{
+    if (rate == 0 || burst == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ctx->rate = rate;
+    ctx->burst = burst;
+
+    return 0;
+}
+
+int mbedtls_ssl_admission_set_prefix_limit(mbedtls_ssl_admission_context *ctx,
+                                           uint32_t rate, uint32_t burst)
+{
+    if (rate == 0 || burst == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ctx->prefix_rate = rate;
+    ctx->prefix_burst = burst;
+
+    return 0;
+}
+
+int mbedtls_ssl_admission_set_cookie_threshold(mbedtls_ssl_admission_context *ctx,
+                                               unsigned percent)
+{
+    if (percent > 100) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ctx->cookie_threshold = percent;
+
+    return 0;
+}
+
+int mbedtls_ssl_admission_setup(mbedtls_ssl_admission_context *ctx,
+                                size_t nb_prefixes,
+                                int (*f_rng)(void *, unsigned char *, size_t),
+                                void *p_rng)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[8];
+    mbedtls_ms_time_t now;
+    size_t n = 1;
+    size_t i;
+
+    if (nb_prefixes == 0 ||
+        nb_prefixes > SIZE_MAX / (2 * sizeof(mbedtls_ssl_admission_bucket))) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (n < nb_prefixes) {
+        n *= 2;
+    }
+
+    if ((ret = f_rng(p_rng, key, sizeof(key))) != 0) {
+        return ret;
+    }
+
+    mbedtls_free(ctx->prefixes);
+    ctx->nb_prefixes = 0;
+    ctx->prefixes = mbedtls_calloc(n, sizeof(mbedtls_ssl_admission_bucket));
+    if (ctx->prefixes == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* All buckets start full */
+    now = mbedtls_ms_time();
+    for (i = 0; i < n; i++) {
+        ctx->prefixes[i].tokens = (int64_t) ctx->prefix_burst * TOKEN;
+        ctx->prefixes[i].last = now;
+    }
+    ctx->global.tokens = (int64_t) ctx->burst * TOKEN;
+    ctx->global.last = now;
+
+    ctx->nb_prefixes = n;
+    ctx->key = MBEDTLS_GET_UINT64_LE(key, 0);
+    mbedtls_platform_zeroize(key, sizeof(key));
+
+    return 0;
+}
+
+static void ssl_admission_refill(mbedtls_ssl_admission_bucket *bucket,
+                                 uint32_t rate, uint32_t burst,
+                                 mbedtls_ms_time_t now)
+{
+    const int64_t max = (int64_t) burst * TOKEN;
+    mbedtls_ms_time_t elapsed = now - bucket->last;
+
+    bucket->last = now;
+
+    if (elapsed <= 0 || bucket->tokens >= max) {
+        return;
+    }
+
+    /* The bucket is full again after (max - tokens) / rate milliseconds,
+     * including when it is in debt: do not multiply longer periods, which
+     * could overflow. */
+    if (elapsed > (mbedtls_ms_time_t) ((max - bucket->tokens) / rate)) {
+        bucket->tokens = max;
+        return;
+    }
+
+    bucket->tokens += (int64_t) elapsed * rate;
+    if (bucket->tokens > max) {
+        bucket->tokens = max;
+    }
+}
+
+/*
+ * Return the bucket of the prefix of the given address, or NULL if the
+ * address is not an IPv4 or IPv6 address.
+ */
+static mbedtls_ssl_admission_bucket *ssl_admission_prefix_bucket(
+    const mbedtls_ssl_admission_context *ctx,
+    const unsigned char *addr, size_t addr_len)
+{
+    size_t prefix_len, i;
+    uint64_t h;
+
+    if (addr == NULL) {
+        return NULL;
+    }
+
+    if (addr_len == 4) {
+        prefix_len = MBEDTLS_SSL_ADMISSION_IPV4_PREFIX_LEN / 8;
+    } else if (addr_len == 16) {
+        prefix_len = MBEDTLS_SSL_ADMISSION_IPV6_PREFIX_LEN / 8;
+    } else {
+        return NULL;
+    }
+
+    /* FNV-1a, seeded with the key and the address family */
+    h = 0xcbf29ce484222325 ^ ctx->key ^ addr_len;
+    for (i = 0; i < prefix_len; i++) {
+        h = (h ^ addr[i]) * 0x100000001b3;
+    }
+    h ^= h >> 32;
+
+    return &ctx->prefixes[(size_t) h & (ctx->nb_prefixes - 1)];
+}
+
+int mbedtls_ssl_admission_check(void *p_ctx,
+                                const unsigned char *peer_addr,
+                                size_t peer_addr_len,
+                                int flags)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_admission_context *ctx = (mbedtls_ssl_admission_context *) p_ctx;
+    mbedtls_ssl_admission_bucket *prefix = NULL;
+    const int resumption = (flags & MBEDTLS_SSL_ADMISSION_RESUMPTION) != 0;
+    const int verified = (flags & MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED) != 0;
+    mbedtls_ms_time_t now;
+
+    if (ctx == NULL || ctx->nb_prefixes == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* An unverified address may be spoofed: it must not use up the tokens
+     * of the prefix it claims to be in. */
+    if (verified) {
+        prefix = ssl_admission_prefix_bucket(ctx, peer_addr, peer_addr_len);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    now = mbedtls_ms_time();
+    ssl_admission_refill(&ctx->global, ctx->rate, ctx->burst, now);
+
+    if (!verified &&
+        ctx->global.tokens < (int64_t) ctx->burst * TOKEN / 100 *
+        ctx->cookie_threshold) {
+        ctx->stats.cookie_required++;
+        ret = MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE;
+        goto exit;
+    }
+
+    /* Resumptions may go into debt by one burst */
+    if (ctx->global.tokens - TOKEN <
+        (resumption ? -(int64_t) ctx->burst * TOKEN : 0)) {
+        ctx->stats.rejected_global++;
+        ret = MBEDTLS_SSL_ADMISSION_REJECT;
+        goto exit;
+    }
+
+    if (prefix != NULL) {
+        ssl_admission_refill(prefix, ctx->prefix_rate, ctx->prefix_burst, now);
+
+        if (prefix->tokens - TOKEN <
+            (resumption ? -(int64_t) ctx->prefix_burst * TOKEN : 0)) {
+            ctx->stats.rejected_prefix++;
+            ret = MBEDTLS_SSL_ADMISSION_REJECT;
+            goto exit;
+        }
+
+        prefix->tokens -= TOKEN;
+    }
+
+    ctx->global.tokens -= TOKEN;
+
+    if (resumption) {
+        ctx->stats.admitted_resumption++;
+    } else {
+        ctx->stats.admitted_full++;
+    }
+    ret = MBEDTLS_SSL_ADMISSION_ACCEPT;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_admission_get_stats(mbedtls_ssl_admission_context *ctx,
+                                    mbedtls_ssl_admission_stats *stats)
+{
+#if defined(MBEDTLS_THREADING_C)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    *stats = ctx->stats;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_admission_free(mbedtls_ssl_admission_context *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_free(ctx->prefixes);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&ctx->mutex);
+#endif
+
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_ssl_admission_context));
+}
+
+#endif /* MBEDTLS_SSL_ADMISSION_C */
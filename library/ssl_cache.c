@@ -97,6 +97,17 @@ int mbedtls_ssl_cache_get(void *data,
         goto exit;
     }
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    if (entry->peer_cert != NULL) {
+        if ((ret = mbedtls_ssl_cert_store_ref(entry->peer_cert)) != 0) {
+            mbedtls_ssl_session_free(session);
+            goto exit;
+        }
+        session->peer_cert = entry->peer_cert;
+        session->peer_cert_shared = 1;
+    }
+#endif
+
     ret = 0;
 
 exit:
@@ -121,10 +132,33 @@ static void ssl_cache_entry_zeroize(mbedtls_ssl_cache_entry *entry)
         mbedtls_zeroize_and_free(entry->session, entry->session_len);
     }
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    mbedtls_ssl_cert_store_release(entry->peer_cert);
+#endif
+
     /* zeroize the whole entry structure */
     mbedtls_platform_zeroize(entry, sizeof(mbedtls_ssl_cache_entry));
 }
 
+/* Serialize a session, without its peer certificate if the cache entry
+ * keeps a reference to it instead. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cache_session_save(const mbedtls_ssl_session *session,
+                                  unsigned char *buf, size_t buf_len,
+                                  size_t *olen, int without_peer_cert)
+{
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    if (without_peer_cert) {
+        return mbedtls_ssl_session_save_without_peer_cert(session, buf,
+                                                          buf_len, olen);
+    }
+#else
+    (void) without_peer_cert;
+#endif
+
+    return mbedtls_ssl_session_save(session, buf, buf_len, olen);
+}
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_cache_pick_writing_slot(mbedtls_ssl_cache_context *cache,
                                        unsigned char const *session_id,
@@ -253,6 +287,10 @@ int mbedtls_ssl_cache_set(void *data,
 
     size_t session_serialized_len = 0;
     unsigned char *session_serialized = NULL;
+    int without_peer_cert = 0;
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    mbedtls_x509_crt *peer_cert = NULL;
+#endif
 
 #if defined(MBEDTLS_THREADING_C)
     if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
@@ -267,9 +305,24 @@ int mbedtls_ssl_cache_set(void *data,
         goto exit;
     }
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    /* Keep a reference to the shared peer certificate instead of a copy. */
+    if (cache->cert_store != NULL && session->peer_cert != NULL) {
+        ret = mbedtls_ssl_cert_store_get(cache->cert_store,
+                                         session->peer_cert->raw.p,
+                                         session->peer_cert->raw.len,
+                                         &peer_cert);
+        if (ret != 0) {
+            goto exit;
+        }
+        without_peer_cert = 1;
+    }
+#endif
+
     /* Check how much space we need to serialize the session
      * and allocate a sufficiently large buffer. */
-    ret = mbedtls_ssl_session_save(session, NULL, 0, &session_serialized_len);
+    ret = ssl_cache_session_save(session, NULL, 0, &session_serialized_len,
+                                 without_peer_cert);
     if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
         goto exit;
     }
@@ -281,10 +334,11 @@ int mbedtls_ssl_cache_set(void *data,
     }
 
     /* Now serialize the session into the allocated buffer. */
-    ret = mbedtls_ssl_session_save(session,
-                                   session_serialized,
-                                   session_serialized_len,
-                                   &session_serialized_len);
+    ret = ssl_cache_session_save(session,
+                                 session_serialized,
+                                 session_serialized_len,
+                                 &session_serialized_len,
+                                 without_peer_cert);
     if (ret != 0) {
         goto exit;
     }
@@ -299,6 +353,10 @@ int mbedtls_ssl_cache_set(void *data,
     cur->session = session_serialized;
     cur->session_len = session_serialized_len;
     session_serialized = NULL;
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    cur->peer_cert = peer_cert;
+    peer_cert = NULL;
+#endif
 
     ret = 0;
 
@@ -314,6 +372,10 @@ exit:
         session_serialized = NULL;
     }
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    mbedtls_ssl_cert_store_release(peer_cert);
+#endif
+
     return ret;
 }
 
@@ -386,6 +448,14 @@ void mbedtls_ssl_cache_set_max_entries(mbedtls_ssl_cache_context *cache, int max
     cache->max_entries = max;
 }
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+void mbedtls_ssl_cache_set_cert_store(mbedtls_ssl_cache_context *cache,
+                                      mbedtls_ssl_cert_store *store)
+{
+    cache->cert_store = store;
+}
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
+
 void mbedtls_ssl_cache_free(mbedtls_ssl_cache_context *cache)
 {
     mbedtls_ssl_cache_entry *cur, *prv;
@@ -0,0 +1,195 @@
+/*
+ *  Shared store of parsed peer certificates
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Certificates are kept in a fixed-size hash table indexed by a hash of
+ * their DER encoding, and compared in full on a hash match. Each entry
+ * embeds the parsed certificate as its first member, so that the entry of
+ * a certificate handed out by the store is found back from its address,
+ * and points to its store, so that sessions only need to keep the
+ * certificate pointer.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_cert_store.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+static uint32_t ssl_cert_store_hash(const unsigned char *der, size_t der_len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < der_len; i++) {
+        hash = (hash ^ der[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+static mbedtls_ssl_cert_store_entry *ssl_cert_store_entry_of(mbedtls_x509_crt *crt)
+{
+    return (mbedtls_ssl_cert_store_entry *) crt;
+}
+
+void mbedtls_ssl_cert_store_init(mbedtls_ssl_cert_store *store)
+{
+    memset(store, 0, sizeof(mbedtls_ssl_cert_store));
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&store->mutex);
+#endif
+}
+
+int mbedtls_ssl_cert_store_get(mbedtls_ssl_cert_store *store,
+                               const unsigned char *der, size_t der_len,
+                               mbedtls_x509_crt **crt)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cert_store_entry *entry;
+    uint32_t hash = ssl_cert_store_hash(der, der_len);
+    size_t bucket = hash % MBEDTLS_SSL_CERT_STORE_BUCKETS;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    for (entry = store->table[bucket]; entry != NULL; entry = entry->next) {
+        if (entry->hash == hash && entry->crt.raw.len == der_len &&
+            memcmp(entry->crt.raw.p, der, der_len) == 0) {
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        entry = mbedtls_calloc(1, sizeof(mbedtls_ssl_cert_store_entry));
+        if (entry == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+
+        mbedtls_x509_crt_init(&entry->crt);
+        if ((ret = mbedtls_x509_crt_parse_der(&entry->crt, der, der_len)) != 0) {
+            mbedtls_x509_crt_free(&entry->crt);
+            mbedtls_free(entry);
+            goto exit;
+        }
+
+        entry->hash = hash;
+        entry->store = store;
+        entry->next = store->table[bucket];
+        store->table[bucket] = entry;
+        store->count++;
+    }
+
+    entry->refs++;
+    *crt = &entry->crt;
+
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_cert_store_ref(mbedtls_x509_crt *crt)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cert_store_entry *entry = ssl_cert_store_entry_of(crt);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&entry->store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry->refs++;
+
+    ret = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&entry->store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_cert_store_release(mbedtls_x509_crt *crt)
+{
+    mbedtls_ssl_cert_store_entry *entry, **prev;
+    mbedtls_ssl_cert_store *store;
+
+    if (crt == NULL) {
+        return;
+    }
+
+    entry = ssl_cert_store_entry_of(crt);
+    store = entry->store;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&store->mutex) != 0) {
+        return;
+    }
+#endif
+
+    if (--entry->refs == 0) {
+        for (prev = &store->table[entry->hash % MBEDTLS_SSL_CERT_STORE_BUCKETS];
+             *prev != entry; prev = &(*prev)->next) {
+            ;
+        }
+        *prev = entry->next;
+        store->count--;
+
+        mbedtls_x509_crt_free(&entry->crt);
+        mbedtls_free(entry);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock(&store->mutex);
+#endif
+}
+
+void mbedtls_ssl_cert_store_free(mbedtls_ssl_cert_store *store)
+{
+    mbedtls_ssl_cert_store_entry *entry, *next;
+    size_t i;
+
+    if (store == NULL) {
+        return;
+    }
+
+    for (i = 0; i < MBEDTLS_SSL_CERT_STORE_BUCKETS; i++) {
+        for (entry = store->table[i]; entry != NULL; entry = next) {
+            next = entry->next;
+            mbedtls_x509_crt_free(&entry->crt);
+            mbedtls_free(entry);
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&store->mutex);
+#endif
+
+    mbedtls_platform_zeroize(store, sizeof(mbedtls_ssl_cert_store));
+}
+
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
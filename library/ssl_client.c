@@ -209,20 +209,16 @@ static int ssl_write_alpn_ext(mbedtls_ssl_context *ssl,
  * share the same extension identifier.
  *
  */
-#define SSL_WRITE_SUPPORTED_GROUPS_EXT_TLS1_2_FLAG 1
-#define SSL_WRITE_SUPPORTED_GROUPS_EXT_TLS1_3_FLAG 2
-
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_write_supported_groups_ext(mbedtls_ssl_context *ssl,
-                                          unsigned char *buf,
-                                          const unsigned char *end,
-                                          int flags,
-                                          size_t *out_len)
+int mbedtls_ssl_write_supported_groups_list_ext(const mbedtls_ssl_context *ssl,
+                                                const uint16_t *group_list,
+                                                unsigned char *buf,
+                                                const unsigned char *end,
+                                                int flags,
+                                                size_t *out_len)
 {
     unsigned char *p = buf;
     unsigned char *named_group_list; /* Start of named_group_list */
     size_t named_group_list_len;     /* Length of named_group_list */
-    const uint16_t *group_list = ssl->conf->group_list;
 
     *out_len = 0;
 
@@ -302,6 +298,37 @@ static int ssl_write_supported_groups_ext(mbedtls_ssl_context *ssl,
 
     *out_len = (size_t) (p - buf);
 
+    return 0;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_write_supported_groups_ext(mbedtls_ssl_context *ssl,
+                                          unsigned char *buf,
+                                          const unsigned char *end,
+                                          int flags,
+                                          size_t *out_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_ssl_conf_tables *tables = ssl->conf->tables;
+
+    *out_len = 0;
+
+    if (tables != NULL && tables->groups_ext[flags] != NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("client hello, adding precomputed "
+                                  "supported_groups extension"));
+        MBEDTLS_SSL_CHK_BUF_PTR(buf, end, tables->groups_ext_len[flags]);
+        memcpy(buf, tables->groups_ext[flags], tables->groups_ext_len[flags]);
+        *out_len = tables->groups_ext_len[flags];
+    } else {
+        ret = mbedtls_ssl_write_supported_groups_list_ext(ssl,
+                                                          ssl->conf->group_list,
+                                                          buf, end, flags,
+                                                          out_len);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     mbedtls_ssl_tls13_set_hs_sent_ext_mask(
         ssl, MBEDTLS_TLS_EXT_SUPPORTED_GROUPS);
@@ -350,7 +377,7 @@ static int ssl_write_client_hello_cipher_suites(
         int cipher_suite = ciphersuite_list[i];
         const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
 
-        ciphersuite_info = mbedtls_ssl_ciphersuite_from_id(cipher_suite);
+        ciphersuite_info = mbedtls_ssl_conf_ciphersuite_at(ssl->conf, i);
 
         if (mbedtls_ssl_validate_ciphersuite(ssl, ciphersuite_info,
                                              ssl->handshake->min_tls_version,
@@ -742,6 +769,10 @@ static int ssl_prepare_client_hello(mbedtls_ssl_context *ssl)
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    mbedtls_ssl_session_store_resume(ssl);
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3) && \
     defined(MBEDTLS_SSL_SESSION_TICKETS) && \
     defined(MBEDTLS_HAVE_TIME)
@@ -15,4 +15,24 @@
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_write_client_hello(mbedtls_ssl_context *ssl);
 
+#if defined(MBEDTLS_SSL_TLS1_2_SOME_ECC) || \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED)
+#define SSL_WRITE_SUPPORTED_GROUPS_EXT_TLS1_2_FLAG 1
+#define SSL_WRITE_SUPPORTED_GROUPS_EXT_TLS1_3_FLAG 2
+
+/*
+ * Write the supported_groups extension for the groups of group_list that
+ * can be used with the protocol versions selected by flags.
+ * ssl is only used for debug output and may be NULL.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_write_supported_groups_list_ext(const mbedtls_ssl_context *ssl,
+                                                const uint16_t *group_list,
+                                                unsigned char *buf,
+                                                const unsigned char *end,
+                                                int flags,
+                                                size_t *out_len);
+#endif /* MBEDTLS_SSL_TLS1_2_SOME_ECC ||
+          MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED */
+
 #endif /* MBEDTLS_SSL_CLIENT_H */
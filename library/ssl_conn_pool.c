@@ -0,0 +1,532 @@
+/*
+ *  Pool of pre-established outbound TLS connections
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Every connection of a pool is in exactly one of these places:
+ * - the spare stack: closed, with a reset SSL context;
+ * - the warming list: being connected and handshaken by maintain(), which
+ *   works on it without holding the mutex;
+ * - the ready stack: handshaken and idle, in non-blocking mode so that
+ *   maintain() can poll it for closure and post-handshake messages. To do
+ *   so, maintain() takes one connection at a time off the stack, checks it
+ *   without holding the mutex and puts it back, so that get() still finds
+ *   all the other ready connections;
+ * - with maintain(), while it checks the connection;
+ * - with the caller, between get() and release().
+ * The mutex only protects the two stacks and the counters, so get() and
+ * release() never wait for the network.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CONN_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_conn_pool.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#define MBEDTLS_SSL_CONN_POOL_CLOSED      0
+#define MBEDTLS_SSL_CONN_POOL_CONNECTED   1
+#define MBEDTLS_SSL_CONN_POOL_READY       2
+#define MBEDTLS_SSL_CONN_POOL_IN_USE      3
+
+void mbedtls_ssl_conn_pool_init(mbedtls_ssl_conn_pool *pool)
+{
+    memset(pool, 0, sizeof(mbedtls_ssl_conn_pool));
+
+    pool->max_idle = MBEDTLS_SSL_CONN_POOL_DEFAULT_MAX_IDLE;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&pool->mutex);
+#endif
+}
+
+void mbedtls_ssl_conn_pool_set_max_idle(mbedtls_ssl_conn_pool *pool,
+                                        uint32_t max_idle)
+{
+    pool->max_idle = max_idle;
+}
+
+int mbedtls_ssl_conn_pool_setup(mbedtls_ssl_conn_pool *pool,
+                                const mbedtls_ssl_config *conf,
+                                const char *host, uint16_t port,
+                                size_t size, size_t idle_target)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_pooled_conn *conn;
+    size_t i, host_len;
+
+    if (conf == NULL || conf->endpoint != MBEDTLS_SSL_IS_CLIENT ||
+        conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        host == NULL || size == 0 || idle_target > size ||
+        pool->conns != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    host_len = strlen(host);
+    if (host_len == 0 || host_len > MBEDTLS_SSL_MAX_HOST_NAME_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    pool->host = mbedtls_calloc(1, host_len + 1);
+    pool->conns = mbedtls_calloc(size, sizeof(mbedtls_ssl_pooled_conn));
+    if (pool->host == NULL || pool->conns == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+    memcpy(pool->host, host, host_len);
+    mbedtls_snprintf(pool->port, sizeof(pool->port), "%u", (unsigned) port);
+
+    for (i = 0; i < size; i++) {
+        conn = &pool->conns[i];
+        mbedtls_net_init(&conn->net);
+        mbedtls_ssl_init(&conn->ssl);
+    }
+    pool->size = size;
+
+    for (i = 0; i < size; i++) {
+        conn = &pool->conns[i];
+
+        if ((ret = mbedtls_ssl_setup(&conn->ssl, conf)) != 0 ||
+            (ret = mbedtls_ssl_set_hostname(&conn->ssl, host)) != 0) {
+            goto exit;
+        }
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+        mbedtls_ssl_set_server_port(&conn->ssl, port);
+#endif
+        mbedtls_ssl_set_bio(&conn->ssl, &conn->net,
+                            mbedtls_net_send, mbedtls_net_recv, NULL);
+
+        conn->state = MBEDTLS_SSL_CONN_POOL_CLOSED;
+        conn->next = pool->spare;
+        pool->spare = conn;
+    }
+
+    pool->idle_target = idle_target;
+    ret = 0;
+
+exit:
+    if (ret != 0) {
+        for (i = 0; i < pool->size; i++) {
+            mbedtls_ssl_free(&pool->conns[i].ssl);
+        }
+        mbedtls_free(pool->conns);
+        mbedtls_free(pool->host);
+        pool->conns = NULL;
+        pool->host = NULL;
+        pool->size = 0;
+        pool->spare = NULL;
+    }
+
+    return ret;
+}
+
+/*
+ * Close a connection and prepare its SSL context for the next one. The
+ * connection is not on any list.
+ */
+static void ssl_conn_pool_close(mbedtls_ssl_pooled_conn *conn)
+{
+    if (conn->state == MBEDTLS_SSL_CONN_POOL_READY ||
+        conn->state == MBEDTLS_SSL_CONN_POOL_IN_USE) {
+        /* Best effort: the socket is non-blocking or the peer is gone. */
+        (void) mbedtls_ssl_close_notify(&conn->ssl);
+    }
+    mbedtls_net_free(&conn->net);
+
+    conn->state = MBEDTLS_SSL_CONN_POOL_CLOSED;
+    conn->reset_pending = (mbedtls_ssl_session_reset(&conn->ssl) != 0);
+}
+
+/*
+ * Connect a closed connection, or continue its handshake. Returns
+ * MBEDTLS_ERR_SSL_WANT_READ or MBEDTLS_ERR_SSL_WANT_WRITE while the
+ * handshake waits for the server in non-blocking mode.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_conn_pool_establish(mbedtls_ssl_conn_pool *pool,
+                                   mbedtls_ssl_pooled_conn *conn,
+                                   int blocking)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (conn->state == MBEDTLS_SSL_CONN_POOL_CLOSED) {
+        if (conn->reset_pending) {
+            if ((ret = mbedtls_ssl_session_reset(&conn->ssl)) != 0) {
+                return ret;
+            }
+            conn->reset_pending = 0;
+        }
+
+        ret = mbedtls_net_connect(&conn->net, pool->host, pool->port,
+                                  MBEDTLS_NET_PROTO_TCP);
+        if (ret == 0 && !blocking) {
+            ret = mbedtls_net_set_nonblock(&conn->net);
+        }
+        if (ret != 0) {
+            mbedtls_net_free(&conn->net);
+            return ret;
+        }
+        conn->state = MBEDTLS_SSL_CONN_POOL_CONNECTED;
+    }
+
+    return mbedtls_ssl_handshake(&conn->ssl);
+}
+
+/*
+ * Check whether an idle connection is still usable: its server may have
+ * closed it, and a TLS 1.3 server sends NewSessionTicket messages after the
+ * handshake, which are processed here.
+ */
+static int ssl_conn_pool_is_alive(mbedtls_ssl_pooled_conn *conn)
+{
+    unsigned char buf[1];
+    int ret;
+
+    do {
+        ret = mbedtls_ssl_read(&conn->ssl, buf, sizeof(buf));
+    } while (ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET);
+
+    /* Application data on an idle connection is unexpected: drop it. */
+    return ret == MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+/*
+ * Take the oldest ready connection that the current maintain() has not
+ * checked yet off the ready stack. Called with the mutex held.
+ */
+static mbedtls_ssl_pooled_conn *ssl_conn_pool_take_unchecked(
+    mbedtls_ssl_conn_pool *pool)
+{
+    mbedtls_ssl_pooled_conn **prev, **oldest = NULL, *conn;
+
+    for (prev = &pool->ready; *prev != NULL; prev = &(*prev)->next) {
+        if (!(*prev)->checked) {
+            oldest = prev;
+        }
+    }
+    if (oldest == NULL) {
+        return NULL;
+    }
+
+    conn = *oldest;
+    *oldest = conn->next;
+    pool->ready_count--;
+    return conn;
+}
+
+int mbedtls_ssl_conn_pool_maintain(mbedtls_ssl_conn_pool *pool)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int err = 0;
+    mbedtls_ssl_pooled_conn **prev, *conn;
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+    size_t active;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Connections released from now on are known to be usable. */
+    for (conn = pool->ready; conn != NULL; conn = conn->next) {
+        conn->checked = 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_unlock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Drop the ready connections that are stale or dead. Each one is
+     * checked without the mutex, while the others stay available to
+     * get(). */
+    for (;;) {
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+            return ret;
+        }
+#endif
+        conn = ssl_conn_pool_take_unchecked(pool);
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_unlock(&pool->mutex)) != 0) {
+            /* The ready stack is consistent: only conn is off it. */
+            if (conn != NULL) {
+                conn->next = pool->warming;
+                pool->warming = conn;
+                pool->warming_count++;
+            }
+            return ret;
+        }
+#endif
+        if (conn == NULL) {
+            break;
+        }
+
+        conn->checked = 1;
+        if ((pool->max_idle != 0 &&
+             now - conn->ready_since > (mbedtls_ms_time_t) pool->max_idle) ||
+            !ssl_conn_pool_is_alive(conn)) {
+            ssl_conn_pool_close(conn);
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+            /* Keep the connection on the list owned by maintain(): the
+             * next call finishes its handshake if it was closed, or puts
+             * it back on the ready stack otherwise. */
+            conn->next = pool->warming;
+            pool->warming = conn;
+            pool->warming_count++;
+            return ret;
+        }
+#endif
+
+        if (conn->state == MBEDTLS_SSL_CONN_POOL_READY) {
+            /* Behind the connections released meanwhile, which are more
+             * recent. */
+            for (prev = &pool->ready; *prev != NULL; prev = &(*prev)->next) {
+                ;
+            }
+            conn->next = NULL;
+            *prev = conn;
+            pool->ready_count++;
+        } else {
+            conn->next = pool->spare;
+            pool->spare = conn;
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_unlock(&pool->mutex)) != 0) {
+            return ret;
+        }
+#endif
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Start as many connections as needed to meet the target. */
+    active = pool->ready_count + pool->warming_count;
+    while (active < pool->idle_target && pool->spare != NULL) {
+        conn = pool->spare;
+        pool->spare = conn->next;
+        conn->next = pool->warming;
+        pool->warming = conn;
+        pool->warming_count++;
+        active++;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_unlock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Advance the connections in progress, without the mutex. */
+    for (prev = &pool->warming; *prev != NULL;) {
+        conn = *prev;
+        ret = ssl_conn_pool_establish(pool, conn, 0);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+            ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            prev = &conn->next;
+            continue;
+        }
+
+        if (ret != 0) {
+            ssl_conn_pool_close(conn);
+            if (err == 0) {
+                err = ret;
+            }
+        } else {
+            conn->state = MBEDTLS_SSL_CONN_POOL_READY;
+            conn->ready_since = mbedtls_ms_time();
+            conn->checked = 1;
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        /* On failure, the connection stays on the warming list and is
+         * handled again by the next call. */
+        if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+            return ret;
+        }
+#endif
+        *prev = conn->next;
+        pool->warming_count--;
+        if (conn->state == MBEDTLS_SSL_CONN_POOL_READY) {
+            conn->next = pool->ready;
+            pool->ready = conn;
+            pool->ready_count++;
+        } else {
+            conn->next = pool->spare;
+            pool->spare = conn;
+        }
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_unlock(&pool->mutex)) != 0) {
+            return ret;
+        }
+#endif
+    }
+
+    if (err != 0) {
+        return err;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    ret = (int) pool->ready_count;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_conn_pool_get(mbedtls_ssl_conn_pool *pool,
+                              mbedtls_ssl_pooled_conn **conn)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_pooled_conn *cur = NULL;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (pool->ready != NULL) {
+        cur = pool->ready;
+        pool->ready = cur->next;
+        pool->ready_count--;
+        ret = 0;
+    } else if (pool->spare != NULL) {
+        cur = pool->spare;
+        pool->spare = cur->next;
+        ret = 0;
+    } else {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (cur->state == MBEDTLS_SSL_CONN_POOL_READY) {
+        ret = mbedtls_net_set_block(&cur->net);
+    } else {
+        /* Cold path: establish a connection now. */
+        ret = ssl_conn_pool_establish(pool, cur, 1);
+    }
+
+    if (ret != 0) {
+        (void) mbedtls_ssl_conn_pool_release(pool, cur, 0);
+        return ret;
+    }
+
+    cur->state = MBEDTLS_SSL_CONN_POOL_IN_USE;
+    cur->next = NULL;
+    *conn = cur;
+
+    return 0;
+}
+
+int mbedtls_ssl_conn_pool_release(mbedtls_ssl_conn_pool *pool,
+                                  mbedtls_ssl_pooled_conn *conn,
+                                  int reuse)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (reuse &&
+        mbedtls_ssl_is_handshake_over(&conn->ssl) &&
+        mbedtls_ssl_check_pending(&conn->ssl) == 0 &&
+        mbedtls_net_set_nonblock(&conn->net) == 0) {
+        conn->state = MBEDTLS_SSL_CONN_POOL_READY;
+        conn->ready_since = mbedtls_ms_time();
+        conn->checked = 1;
+    } else {
+        ssl_conn_pool_close(conn);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (conn->state == MBEDTLS_SSL_CONN_POOL_READY) {
+        conn->next = pool->ready;
+        pool->ready = conn;
+        pool->ready_count++;
+    } else {
+        conn->next = pool->spare;
+        pool->spare = conn;
+    }
+    ret = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+mbedtls_ssl_context *mbedtls_ssl_pooled_conn_ssl(mbedtls_ssl_pooled_conn *conn)
+{
+    return &conn->ssl;
+}
+
+void mbedtls_ssl_conn_pool_free(mbedtls_ssl_conn_pool *pool)
+{
+    mbedtls_ssl_pooled_conn *conn;
+    size_t i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    for (i = 0; i < pool->size; i++) {
+        conn = &pool->conns[i];
+        if (conn->state == MBEDTLS_SSL_CONN_POOL_READY) {
+            (void) mbedtls_ssl_close_notify(&conn->ssl);
+        }
+        mbedtls_net_free(&conn->net);
+        mbedtls_ssl_free(&conn->ssl);
+    }
+
+    mbedtls_free(pool->conns);
+    mbedtls_free(pool->host);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&pool->mutex);
+#endif
+
+    mbedtls_platform_zeroize(pool, sizeof(mbedtls_ssl_conn_pool));
+}
+
+#endif /* MBEDTLS_SSL_CONN_POOL_C */
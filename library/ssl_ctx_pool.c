@@ -0,0 +1,183 @@
+/*
+ *  Pool of pre-allocated SSL contexts
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * The free contexts form a Treiber stack over the context array: next[i] is
+ * the index of the context below context i, and the head word holds the
+ * index of the top context in its low half and a tag in its high half. The
+ * tag is incremented by every push and pop, so that a compare-and-swap fails
+ * if the stack changed in between, even if the same context is back on top
+ * (the ABA problem). Contexts are never freed while the pool is in use, so
+ * reading a stale link is harmless.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CTX_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_ctx_pool.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#define SSL_CTX_POOL_NONE           0xFFFFFFFF
+
+#define SSL_CTX_POOL_INDEX(head)    ((uint32_t) ((head) & 0xFFFFFFFF))
+#define SSL_CTX_POOL_HEAD(tag, index) \
+    ((((uint64_t) (uint32_t) (tag)) << 32) | (uint64_t) (index))
+#define SSL_CTX_POOL_NEXT_TAG(head) ((uint32_t) ((head) >> 32) + 1)
+
+void mbedtls_ssl_ctx_pool_init(mbedtls_ssl_ctx_pool *pool)
+{
+    memset(pool, 0, sizeof(mbedtls_ssl_ctx_pool));
+
+    pool->head = SSL_CTX_POOL_HEAD(0, SSL_CTX_POOL_NONE);
+}
+
+static void ssl_ctx_pool_push(mbedtls_ssl_ctx_pool *pool, uint32_t index)
+{
+    uint64_t head = mbedtls_ssl_atomic_load_acquire_u64(&pool->head);
+
+    do {
+        mbedtls_ssl_atomic_store_u32(&pool->next[index],
+                                     SSL_CTX_POOL_INDEX(head));
+    } while (!mbedtls_ssl_atomic_cas_u64(&pool->head, &head,
+                                         SSL_CTX_POOL_HEAD(
+                                             SSL_CTX_POOL_NEXT_TAG(head),
+                                             index)));
+}
+
+static uint32_t ssl_ctx_pool_pop(mbedtls_ssl_ctx_pool *pool)
+{
+    uint64_t head = mbedtls_ssl_atomic_load_acquire_u64(&pool->head);
+    uint32_t index, next;
+
+    do {
+        index = SSL_CTX_POOL_INDEX(head);
+        if (index == SSL_CTX_POOL_NONE) {
+            return SSL_CTX_POOL_NONE;
+        }
+        next = mbedtls_ssl_atomic_load_u32(&pool->next[index]);
+    } while (!mbedtls_ssl_atomic_cas_u64(&pool->head, &head,
+                                         SSL_CTX_POOL_HEAD(
+                                             SSL_CTX_POOL_NEXT_TAG(head),
+                                             next)));
+
+    return index;
+}
+
+int mbedtls_ssl_ctx_pool_setup(mbedtls_ssl_ctx_pool *pool,
+                               const mbedtls_ssl_config *conf,
+                               size_t size)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t i;
+
+    if (conf == NULL || size == 0 || size >= SSL_CTX_POOL_NONE ||
+        pool->ctx != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    pool->ctx = mbedtls_calloc(size, sizeof(mbedtls_ssl_context));
+    pool->next = mbedtls_calloc(size, sizeof(uint32_t));
+    if (pool->ctx == NULL || pool->next == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+
+    for (i = 0; i < size; i++) {
+        mbedtls_ssl_init(&pool->ctx[i]);
+    }
+    pool->size = size;
+
+    for (i = 0; i < size; i++) {
+        if ((ret = mbedtls_ssl_setup(&pool->ctx[i], conf)) != 0) {
+            goto exit;
+        }
+    }
+
+    /* Context 0 on top, for a better locality of the first connections. */
+    for (i = size; i > 0; i--) {
+        ssl_ctx_pool_push(pool, (uint32_t) (i - 1));
+    }
+
+    ret = 0;
+
+exit:
+    if (ret != 0) {
+        for (i = 0; i < pool->size; i++) {
+            mbedtls_ssl_free(&pool->ctx[i]);
+        }
+        mbedtls_free(pool->ctx);
+        mbedtls_free(pool->next);
+        mbedtls_ssl_ctx_pool_init(pool);
+    }
+
+    return ret;
+}
+
+int mbedtls_ssl_ctx_pool_acquire(mbedtls_ssl_ctx_pool *pool,
+                                 mbedtls_ssl_context **ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    uint32_t index;
+
+    index = ssl_ctx_pool_pop(pool);
+    if (index == SSL_CTX_POOL_NONE) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* The reset failed on release: retry it. */
+    if (pool->ctx[index].handshake == NULL) {
+        if ((ret = mbedtls_ssl_session_reset(&pool->ctx[index])) != 0) {
+            ssl_ctx_pool_push(pool, index);
+            return ret;
+        }
+    }
+
+    *ssl = &pool->ctx[index];
+
+    return 0;
+}
+
+int mbedtls_ssl_ctx_pool_release(mbedtls_ssl_ctx_pool *pool,
+                                 mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t index;
+
+    if (ssl < pool->ctx || ssl >= pool->ctx + pool->size) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    index = (size_t) (ssl - pool->ctx);
+
+    ret = mbedtls_ssl_session_reset(ssl);
+    ssl_ctx_pool_push(pool, (uint32_t) index);
+
+    return ret;
+}
+
+void mbedtls_ssl_ctx_pool_free(mbedtls_ssl_ctx_pool *pool)
+{
+    size_t i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    for (i = 0; i < pool->size; i++) {
+        mbedtls_ssl_free(&pool->ctx[i]);
+    }
+
+    mbedtls_free(pool->ctx);
+    mbedtls_free(pool->next);
+
+    mbedtls_platform_zeroize(pool, sizeof(mbedtls_ssl_ctx_pool));
+}
+
+#endif /* MBEDTLS_SSL_CTX_POOL_C */
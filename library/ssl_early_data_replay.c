@@ -0,0 +1,205 @@
+/*
+ *  TLS 1.3 early data anti-replay callback implementation
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * This implements the single-use ticket alternative of RFC 8446 section 8.2
+ * ("ClientHello recording") with bounded memory: the binders of the
+ * ClientHellos whose early data was accepted are kept in two open-addressing
+ * hash sets, one per time window. Binders are HMAC values, so their first
+ * bytes are used directly as hash keys.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_EARLY_DATA_REPLAY_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_early_data_replay.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#define KEY_LEN MBEDTLS_SSL_EARLY_DATA_REPLAY_KEY_LEN
+
+void mbedtls_ssl_early_data_replay_init(mbedtls_ssl_early_data_replay_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_ssl_early_data_replay_ctx));
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&ctx->mutex);
+#endif
+}
+
+int mbedtls_ssl_early_data_replay_setup(mbedtls_ssl_early_data_replay_ctx *ctx,
+                                        size_t max_entries,
+                                        uint32_t window)
+{
+    size_t nb_slots = 1;
+
+    if (max_entries == 0 || max_entries > SIZE_MAX / (4 * KEY_LEN)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Keep the load factor at most 1/2 so that probe sequences are short */
+    while (nb_slots < 2 * max_entries) {
+        nb_slots *= 2;
+    }
+
+    mbedtls_free(ctx->slots[0]);
+    mbedtls_free(ctx->slots[1]);
+    ctx->slots[0] = mbedtls_calloc(nb_slots, KEY_LEN);
+    ctx->slots[1] = mbedtls_calloc(nb_slots, KEY_LEN);
+    if (ctx->slots[0] == NULL || ctx->slots[1] == NULL) {
+        mbedtls_free(ctx->slots[0]);
+        mbedtls_free(ctx->slots[1]);
+        ctx->slots[0] = NULL;
+        ctx->slots[1] = NULL;
+        ctx->nb_slots = 0;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    ctx->nb_slots = nb_slots;
+    ctx->max_entries = max_entries;
+    ctx->used[0] = 0;
+    ctx->used[1] = 0;
+    ctx->current = 0;
+    ctx->window = window != 0 ? window : MBEDTLS_SSL_EARLY_DATA_REPLAY_WINDOW;
+    ctx->window_start = mbedtls_ms_time();
+
+    return 0;
+}
+
+static void ssl_early_data_replay_clear(mbedtls_ssl_early_data_replay_ctx *ctx,
+                                        int set)
+{
+    memset(ctx->slots[set], 0, ctx->nb_slots * KEY_LEN);
+    ctx->used[set] = 0;
+}
+
+/*
+ * Return the slot holding key in the given set, or the empty slot where it
+ * would be inserted.
+ */
+static unsigned char *ssl_early_data_replay_probe(
+    const mbedtls_ssl_early_data_replay_ctx *ctx, int set,
+    const unsigned char key[KEY_LEN])
+{
+    static const unsigned char empty[KEY_LEN] = { 0 };
+    size_t mask = ctx->nb_slots - 1;
+    size_t i = (size_t) MBEDTLS_GET_UINT32_LE(key, 0) & mask;
+    unsigned char *slot;
+
+    for (;;) {
+        slot = ctx->slots[set] + i * KEY_LEN;
+        if (memcmp(slot, key, KEY_LEN) == 0 ||
+            memcmp(slot, empty, KEY_LEN) == 0) {
+            return slot;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+int mbedtls_ssl_early_data_replay_check(void *p_ctx,
+                                        const unsigned char *binder,
+                                        size_t binder_len,
+                                        int32_t ticket_age_diff)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_early_data_replay_ctx *ctx =
+        (mbedtls_ssl_early_data_replay_ctx *) p_ctx;
+    unsigned char key[KEY_LEN];
+    unsigned char *slot;
+    mbedtls_ms_time_t now, elapsed;
+    int other;
+
+    if (ctx == NULL || ctx->nb_slots == 0 || binder_len < KEY_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* RFC 8446 section 8.3: a ClientHello whose expected arrival time is
+     * outside the window cannot be checked against the recorded ones. */
+    if ((int64_t) ticket_age_diff > (int64_t) (ctx->window / 2) ||
+        (int64_t) ticket_age_diff < -(int64_t) (ctx->window / 2)) {
+        return 1;
+    }
+
+    memcpy(key, binder, KEY_LEN);
+    /* An all-zero key marks an empty slot */
+    key[0] |= 1;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    now = mbedtls_ms_time();
+    elapsed = now - ctx->window_start;
+    other = 1 - ctx->current;
+
+    if (elapsed < 0 || elapsed >= 2 * (mbedtls_ms_time_t) ctx->window) {
+        ssl_early_data_replay_clear(ctx, 0);
+        ssl_early_data_replay_clear(ctx, 1);
+        ctx->window_start = now;
+    } else if (elapsed >= (mbedtls_ms_time_t) ctx->window) {
+        /* The binders of the previous window are now older than one full
+         * window: drop them and reuse their set. */
+        ssl_early_data_replay_clear(ctx, other);
+        ctx->current = other;
+        other = 1 - other;
+        ctx->window_start += ctx->window;
+    }
+
+    slot = ssl_early_data_replay_probe(ctx, other, key);
+    if (memcmp(slot, key, KEY_LEN) == 0) {
+        ret = 1;
+        goto exit;
+    }
+
+    slot = ssl_early_data_replay_probe(ctx, ctx->current, key);
+    if (memcmp(slot, key, KEY_LEN) == 0) {
+        ret = 1;
+        goto exit;
+    }
+
+    if (ctx->used[ctx->current] >= ctx->max_entries) {
+        /* Full: reject early data rather than forget recent binders. */
+        ret = 1;
+        goto exit;
+    }
+
+    memcpy(slot, key, KEY_LEN);
+    ctx->used[ctx->current]++;
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_early_data_replay_free(mbedtls_ssl_early_data_replay_ctx *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_free(ctx->slots[0]);
+    mbedtls_free(ctx->slots[1]);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&ctx->mutex);
+#endif
+
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_ssl_early_data_replay_ctx));
+}
+
+#endif /* MBEDTLS_SSL_EARLY_DATA_REPLAY_C */
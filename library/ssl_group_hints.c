@@ -0,0 +1,273 @@
+/*
+ *  Client-side memory of the key exchange groups chosen by servers
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A client talks to a limited set of servers, so the hints are kept in a
+ * short list in most recently used order: the servers a client connects to
+ * most often are found after a few comparisons of the precomputed hashes.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_GROUP_HINTS_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_group_hints.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+void mbedtls_ssl_group_hints_init(mbedtls_ssl_group_hints *hints)
+{
+    memset(hints, 0, sizeof(mbedtls_ssl_group_hints));
+
+    hints->max_entries = MBEDTLS_SSL_GROUP_HINTS_DEFAULT_MAX_ENTRIES;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&hints->mutex);
+#endif
+}
+
+void mbedtls_ssl_group_hints_set_max_entries(mbedtls_ssl_group_hints *hints,
+                                             size_t max)
+{
+    hints->max_entries = max;
+}
+
+/* FNV-1a of the port, then of the name */
+static uint32_t ssl_group_hints_hash(const unsigned char *name, size_t len,
+                                     uint16_t port)
+{
+    uint32_t h = 0x811c9dc5;
+    size_t i;
+
+    h ^= MBEDTLS_BYTE_1(port);
+    h *= 0x01000193;
+    h ^= MBEDTLS_BYTE_0(port);
+    h *= 0x01000193;
+
+    for (i = 0; i < len; i++) {
+        h ^= name[i];
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+/*
+ * Copy a host name to buf in lowercase, without a trailing dot.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_group_hints_normalize(unsigned char *buf, size_t *len,
+                                     const char *host)
+{
+    size_t host_len, i;
+
+    if (host == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    host_len = strlen(host);
+    if (host_len > 0 && host[host_len - 1] == '.') {
+        host_len--;
+    }
+
+    if (host_len == 0 || host_len > MBEDTLS_SSL_MAX_HOST_NAME_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    for (i = 0; i < host_len; i++) {
+        unsigned char c = (unsigned char) host[i];
+
+        if (c >= 'A' && c <= 'Z') {
+            c = (unsigned char) (c - 'A' + 'a');
+        }
+        buf[i] = c;
+    }
+
+    *len = host_len;
+
+    return 0;
+}
+
+/*
+ * Find an entry and move it to the front of the list.
+ */
+static mbedtls_ssl_group_hint *ssl_group_hints_find(
+    mbedtls_ssl_group_hints *hints,
+    const unsigned char *name, size_t len, uint16_t port, uint32_t hash)
+{
+    mbedtls_ssl_group_hint **prev, *cur;
+
+    for (prev = &hints->chain; *prev != NULL; prev = &(*prev)->next) {
+        cur = *prev;
+        if (cur->hash == hash && cur->port == port &&
+            cur->name_len == len && memcmp(cur->name, name, len) == 0) {
+            *prev = cur->next;
+            cur->next = hints->chain;
+            hints->chain = cur;
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+static void ssl_group_hints_entry_free(mbedtls_ssl_group_hint *entry)
+{
+    mbedtls_free(entry->name);
+    mbedtls_free(entry);
+}
+
+int mbedtls_ssl_group_hints_get(mbedtls_ssl_group_hints *hints,
+                                const char *host, uint16_t port,
+                                uint16_t *group)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char buf[MBEDTLS_SSL_MAX_HOST_NAME_LEN];
+    mbedtls_ssl_group_hint *entry;
+    size_t len;
+    uint32_t hash;
+
+    if (ssl_group_hints_normalize(buf, &len, host) != 0) {
+        return MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    }
+    hash = ssl_group_hints_hash(buf, len, port);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&hints->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry = ssl_group_hints_find(hints, buf, len, port, hash);
+    if (entry == NULL) {
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    } else {
+        *group = entry->group;
+        ret = 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&hints->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_group_hints_set(mbedtls_ssl_group_hints *hints,
+                                const char *host, uint16_t port,
+                                uint16_t group)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char buf[MBEDTLS_SSL_MAX_HOST_NAME_LEN];
+    mbedtls_ssl_group_hint *entry, **prev;
+    size_t len, kept;
+    uint32_t hash;
+
+    ret = ssl_group_hints_normalize(buf, &len, host);
+    if (ret != 0) {
+        return ret;
+    }
+    hash = ssl_group_hints_hash(buf, len, port);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&hints->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry = ssl_group_hints_find(hints, buf, len, port, hash);
+    if (entry != NULL) {
+        entry->group = group;
+        ret = 0;
+        goto exit;
+    }
+
+    if (hints->max_entries == 0) {
+        ret = 0;
+        goto exit;
+    }
+
+    /* Forget the least recently used servers to make room. */
+    kept = 0;
+    for (prev = &hints->chain; *prev != NULL;) {
+        if (kept + 1 < hints->max_entries) {
+            kept++;
+            prev = &(*prev)->next;
+            continue;
+        }
+        entry = *prev;
+        *prev = entry->next;
+        ssl_group_hints_entry_free(entry);
+        hints->count--;
+    }
+
+    entry = mbedtls_calloc(1, sizeof(mbedtls_ssl_group_hint));
+    if (entry == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+    entry->name = mbedtls_calloc(1, len);
+    if (entry->name == NULL) {
+        mbedtls_free(entry);
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+    memcpy(entry->name, buf, len);
+    entry->name_len = len;
+    entry->hash = hash;
+    entry->port = port;
+    entry->group = group;
+
+    entry->next = hints->chain;
+    hints->chain = entry;
+    hints->count++;
+
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&hints->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_group_hints_free(mbedtls_ssl_group_hints *hints)
+{
+    mbedtls_ssl_group_hint *cur, *next;
+
+    if (hints == NULL) {
+        return;
+    }
+
+    for (cur = hints->chain; cur != NULL; cur = next) {
+        next = cur->next;
+        ssl_group_hints_entry_free(cur);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&hints->mutex);
+#endif
+
+    mbedtls_platform_zeroize(hints, sizeof(mbedtls_ssl_group_hints));
+}
+
+void mbedtls_ssl_set_group_hints(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_group_hints *hints,
+                                 uint16_t port)
+{
+    ssl->group_hints = hints;
+    ssl->group_hints_port = port;
+}
+
+#endif /* MBEDTLS_SSL_GROUP_HINTS_C */
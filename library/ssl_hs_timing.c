@@ -0,0 +1,273 @@
+/*
+ *  SSL handshake latency histograms
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Every call to mbedtls_ssl_handshake_step() is timed. The time spent in a
+ * state is accumulated in the SSL context until the state machine moves on,
+ * then added to log-linear histograms shared by all contexts using the same
+ * configuration.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_hs_timing.h"
+
+#include <string.h>
+
+#if defined(MBEDTLS_HAVE_TIME)
+static uint64_t ssl_hs_timing_default_clock(void *p_clock)
+{
+    (void) p_clock;
+    return (uint64_t) mbedtls_ms_time() * 1000;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+void mbedtls_ssl_hs_timing_init(mbedtls_ssl_hs_timing *timing)
+{
+    memset(timing, 0, sizeof(mbedtls_ssl_hs_timing));
+
+#if defined(MBEDTLS_HAVE_TIME)
+    timing->f_clock = ssl_hs_timing_default_clock;
+#endif
+}
+
+void mbedtls_ssl_hs_timing_set_clock(mbedtls_ssl_hs_timing *timing,
+                                     mbedtls_ssl_hs_timing_clock_t *f_clock,
+                                     void *p_clock)
+{
+    timing->f_clock = f_clock;
+    timing->p_clock = p_clock;
+}
+
+void mbedtls_ssl_hs_timing_reset(mbedtls_ssl_hs_timing *timing)
+{
+    memset(timing->hist, 0, sizeof(timing->hist));
+}
+
+/*
+ * Map a duration to its bucket: values 0 to 3 have their own bucket, then
+ * each interval [2^e, 2^(e+1)) is split into 4 buckets of equal width.
+ */
+static size_t ssl_hs_timing_bucket(uint64_t us)
+{
+    unsigned int e = 0;
+    uint64_t v = us;
+    size_t idx;
+
+    if (us < 4) {
+        return (size_t) us;
+    }
+
+    /* e = index of the most significant bit of us */
+    if (v >> 32) {
+        v >>= 32; e += 32;
+    }
+    if (v >> 16) {
+        v >>= 16; e += 16;
+    }
+    if (v >> 8) {
+        v >>= 8; e += 8;
+    }
+    if (v >> 4) {
+        v >>= 4; e += 4;
+    }
+    if (v >> 2) {
+        v >>= 2; e += 2;
+    }
+    if (v >> 1) {
+        e += 1;
+    }
+
+    idx = 4 * (size_t) (e - 1) + (size_t) ((us >> (e - 2)) & 3);
+    if (idx >= MBEDTLS_SSL_HS_TIMING_BUCKETS) {
+        idx = MBEDTLS_SSL_HS_TIMING_BUCKETS - 1;
+    }
+
+    return idx;
+}
+
+/* Largest duration that maps to the given bucket. */
+static uint64_t ssl_hs_timing_bucket_max(size_t idx)
+{
+    unsigned int e;
+    uint64_t sub;
+
+    if (idx < 4) {
+        return (uint64_t) idx;
+    }
+
+    e = (unsigned int) (idx / 4) + 1;
+    sub = (uint64_t) (idx % 4);
+
+    return ((5 + sub) << (e - 2)) - 1;
+}
+
+static void ssl_hs_timing_record(mbedtls_ssl_hs_timing *timing,
+                                 int state, int kind, uint64_t us)
+{
+    mbedtls_ssl_hs_histogram *hist = &timing->hist[state][kind];
+
+    mbedtls_ssl_atomic_add_u64(&hist->buckets[ssl_hs_timing_bucket(us)], 1);
+    mbedtls_ssl_atomic_add_u64(&hist->count, 1);
+}
+
+uint64_t mbedtls_ssl_hs_timing_count(const mbedtls_ssl_hs_timing *timing,
+                                     int state, int kind)
+{
+    if (state < 0 || state >= MBEDTLS_SSL_HS_TIMING_STATES ||
+        (kind != MBEDTLS_SSL_HS_TIMING_CPU &&
+         kind != MBEDTLS_SSL_HS_TIMING_WAIT)) {
+        return 0;
+    }
+
+    return mbedtls_ssl_atomic_load_u64(&timing->hist[state][kind].count);
+}
+
+uint64_t mbedtls_ssl_hs_timing_percentile(const mbedtls_ssl_hs_timing *timing,
+                                          int state, int kind,
+                                          unsigned int per_mille)
+{
+    const mbedtls_ssl_hs_histogram *hist;
+    uint64_t counts[MBEDTLS_SSL_HS_TIMING_BUCKETS];
+    uint64_t total = 0, rank, seen = 0;
+    size_t i;
+
+    if (state < 0 || state >= MBEDTLS_SSL_HS_TIMING_STATES ||
+        (kind != MBEDTLS_SSL_HS_TIMING_CPU &&
+         kind != MBEDTLS_SSL_HS_TIMING_WAIT)) {
+        return 0;
+    }
+
+    if (per_mille > 1000) {
+        per_mille = 1000;
+    }
+
+    /* Work on a snapshot so that concurrent updates cannot make the
+     * cumulative count miss the rank computed from the total. */
+    hist = &timing->hist[state][kind];
+    for (i = 0; i < MBEDTLS_SSL_HS_TIMING_BUCKETS; i++) {
+        counts[i] = mbedtls_ssl_atomic_load_u64(&hist->buckets[i]);
+        total += counts[i];
+    }
+
+    if (total == 0) {
+        return 0;
+    }
+
+    /* Smallest rank such that rank / total >= per_mille / 1000 */
+    rank = (total * per_mille + 999) / 1000;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (i = 0; i < MBEDTLS_SSL_HS_TIMING_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    return ssl_hs_timing_bucket_max(i);
+}
+
+void mbedtls_ssl_hs_timing_reset_ctx(mbedtls_ssl_context *ssl)
+{
+    ssl->hs_timing_entry = 0;
+    ssl->hs_timing_exit = 0;
+    ssl->hs_timing_cpu = 0;
+    ssl->hs_timing_wait = 0;
+    ssl->hs_timing_total_cpu = 0;
+    ssl->hs_timing_total_wait = 0;
+    ssl->hs_timing_waiting = 0;
+}
+
+void mbedtls_ssl_hs_timing_step_start(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_hs_timing *timing = ssl->conf->hs_timing;
+    uint64_t now;
+
+    if (timing == NULL || timing->f_clock == NULL) {
+        return;
+    }
+
+    now = timing->f_clock(timing->p_clock);
+
+    if (ssl->hs_timing_waiting && now > ssl->hs_timing_exit) {
+        ssl->hs_timing_wait += now - ssl->hs_timing_exit;
+    }
+    ssl->hs_timing_waiting = 0;
+    ssl->hs_timing_entry = now;
+}
+
+void mbedtls_ssl_hs_timing_step_end(mbedtls_ssl_context *ssl,
+                                    int state, int ret)
+{
+    mbedtls_ssl_hs_timing *timing = ssl->conf->hs_timing;
+    uint64_t now;
+    int waiting;
+
+    if (timing == NULL || timing->f_clock == NULL) {
+        return;
+    }
+
+    now = timing->f_clock(timing->p_clock);
+    if (now > ssl->hs_timing_entry) {
+        ssl->hs_timing_cpu += now - ssl->hs_timing_entry;
+    }
+
+    waiting = (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+               ret == MBEDTLS_ERR_SSL_WANT_WRITE ||
+               ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS ||
+               ret == MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS);
+
+    if (ret != 0 && !waiting) {
+        /* Failed handshakes are not recorded. */
+        mbedtls_ssl_hs_timing_reset_ctx(ssl);
+        return;
+    }
+
+    if (waiting) {
+        /* The handshake will be resumed by a later call. */
+        ssl->hs_timing_waiting = 1;
+        ssl->hs_timing_exit = now;
+    }
+
+    if (ssl->state == state ||
+        state < 0 || state >= MBEDTLS_SSL_HS_TIMING_STATES) {
+        return;
+    }
+
+    ssl_hs_timing_record(timing, state, MBEDTLS_SSL_HS_TIMING_CPU,
+                         ssl->hs_timing_cpu);
+    ssl_hs_timing_record(timing, state, MBEDTLS_SSL_HS_TIMING_WAIT,
+                         ssl->hs_timing_wait);
+    ssl->hs_timing_total_cpu += ssl->hs_timing_cpu;
+    ssl->hs_timing_total_wait += ssl->hs_timing_wait;
+    ssl->hs_timing_cpu = 0;
+    ssl->hs_timing_wait = 0;
+
+    if (ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+        /* Post-handshake NewSessionTicket messages also end in
+         * HANDSHAKE_OVER: they are not complete handshakes. */
+        if (state != MBEDTLS_SSL_TLS1_3_NEW_SESSION_TICKET &&
+            state != MBEDTLS_SSL_TLS1_3_NEW_SESSION_TICKET_FLUSH) {
+            ssl_hs_timing_record(timing, MBEDTLS_SSL_HANDSHAKE_OVER,
+                                 MBEDTLS_SSL_HS_TIMING_CPU,
+                                 ssl->hs_timing_total_cpu);
+            ssl_hs_timing_record(timing, MBEDTLS_SSL_HANDSHAKE_OVER,
+                                 MBEDTLS_SSL_HS_TIMING_WAIT,
+                                 ssl->hs_timing_total_wait);
+        }
+        ssl->hs_timing_total_cpu = 0;
+        ssl->hs_timing_total_wait = 0;
+    }
+}
+
+#endif /* MBEDTLS_SSL_HANDSHAKE_TIMING */
@@ -0,0 +1,381 @@
+/*
+ *  Linux kernel TLS (kTLS) offload
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Once the handshake is over, the AEAD keys of the current transform are
+ * exported and installed on the socket with setsockopt(SOL_TLS). The record
+ * layer then exchanges plaintext with the kernel: application data with
+ * plain send()/recvmsg(), other content types through the
+ * TLS_SET_RECORD_TYPE and TLS_GET_RECORD_TYPE control messages.
+ */
+
+/* Enable the definition of struct msghdr and CMSG_SPACE() even when
+ * compiling with -std=c99. Must be set before mbedtls_config.h, which pulls
+ * in glibc's features.h indirectly. */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+
+#if !defined(__linux__)
+#error "This module only works on Linux, see MBEDTLS_SSL_KTLS_C in mbedtls_config.h"
+#endif
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_ktls.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <linux/tls.h>
+
+/* Older C libraries do not define these. */
+#if !defined(SOL_TLS)
+#define SOL_TLS 282
+#endif
+#if !defined(TCP_ULP)
+#define TCP_ULP 31
+#endif
+
+int mbedtls_ssl_ktls_get_mode(const mbedtls_ssl_context *ssl)
+{
+    return ssl->ktls_mode;
+}
+
+/*
+ * Fill the crypto_info structure for one direction.
+ * The kernel structures for AES-GCM only differ by the key size.
+ */
+#define SSL_KTLS_FILL_GCM(ci, cipher, key_buf, iv_buf, seq_buf, tls13)   \
+    do {                                                                \
+        (ci).info.cipher_type = (cipher);                               \
+        memcpy((ci).key, (key_buf), sizeof((ci).key));                  \
+        memcpy((ci).salt, (iv_buf), sizeof((ci).salt));                 \
+        if (tls13) {                                                    \
+            memcpy((ci).iv, (iv_buf) + sizeof((ci).salt),               \
+                   sizeof((ci).iv));                                    \
+        } else {                                                        \
+            /* The explicit nonce is the record sequence number,        \
+             * see mbedtls_ssl_encrypt_buf(). */                        \
+            memcpy((ci).iv, (seq_buf), sizeof((ci).iv));                \
+        }                                                               \
+        memcpy((ci).rec_seq, (seq_buf), sizeof((ci).rec_seq));          \
+    } while (0)
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ktls_set_crypto_info(mbedtls_ssl_context *ssl, int fd,
+                                    int direction)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    psa_status_t status;
+    union {
+        struct tls_crypto_info info;
+        struct tls12_crypto_info_aes_gcm_128 gcm_128;
+        struct tls12_crypto_info_aes_gcm_256 gcm_256;
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        struct tls12_crypto_info_chacha20_poly1305 chachapoly;
+#endif
+    } crypto_info;
+    size_t crypto_info_len = 0;
+    unsigned char key[32];
+    size_t key_len = 0;
+    const mbedtls_ssl_transform *transform;
+    mbedtls_svc_key_id_t key_id;
+    const unsigned char *iv;
+    const unsigned char *seq;
+    psa_algorithm_t alg;
+    int tls13;
+
+    if (direction == TLS_TX) {
+        transform = ssl->transform_out;
+        key_id = transform->psa_key_enc;
+        iv = transform->iv_enc;
+        seq = ssl->cur_out_ctr;
+    } else {
+        transform = ssl->transform_in;
+        key_id = transform->psa_key_dec;
+        iv = transform->iv_dec;
+        seq = ssl->in_ctr;
+    }
+
+    tls13 = (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3);
+    alg = PSA_ALG_AEAD_WITH_DEFAULT_LENGTH_TAG(transform->psa_alg);
+
+    status = psa_export_key(key_id, key, sizeof(key), &key_len);
+    if (status == PSA_ERROR_NOT_PERMITTED) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("traffic keys are not exportable, "
+                                  "see mbedtls_ssl_conf_ktls()"));
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_export_key", ret);
+        return ret;
+    }
+
+    memset(&crypto_info, 0, sizeof(crypto_info));
+    crypto_info.info.version = tls13 ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+
+    if (alg == PSA_ALG_GCM && transform->taglen == 16 && key_len == 16) {
+        SSL_KTLS_FILL_GCM(crypto_info.gcm_128, TLS_CIPHER_AES_GCM_128,
+                          key, iv, seq, tls13);
+        crypto_info_len = sizeof(crypto_info.gcm_128);
+    } else if (alg == PSA_ALG_GCM && transform->taglen == 16 &&
+               key_len == 32) {
+        SSL_KTLS_FILL_GCM(crypto_info.gcm_256, TLS_CIPHER_AES_GCM_256,
+                          key, iv, seq, tls13);
+        crypto_info_len = sizeof(crypto_info.gcm_256);
+    }
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+    else if (alg == PSA_ALG_CHACHA20_POLY1305 && key_len == 32) {
+        /* The nonce is the static IV xor the sequence number, in both
+         * TLS 1.2 (RFC 7905) and TLS 1.3. */
+        crypto_info.chachapoly.info.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+        memcpy(crypto_info.chachapoly.key, key, key_len);
+        memcpy(crypto_info.chachapoly.iv, iv, sizeof(crypto_info.chachapoly.iv));
+        memcpy(crypto_info.chachapoly.rec_seq, seq,
+               sizeof(crypto_info.chachapoly.rec_seq));
+        crypto_info_len = sizeof(crypto_info.chachapoly);
+    }
+#endif /* TLS_CIPHER_CHACHA20_POLY1305 */
+
+    if (crypto_info_len == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("ciphersuite not supported by kernel TLS"));
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+        goto exit;
+    }
+
+    if (setsockopt(fd, SOL_TLS, direction, &crypto_info,
+                   (socklen_t) crypto_info_len) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("setsockopt(SOL_TLS) failed, errno = %d",
+                                  errno));
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+        goto exit;
+    }
+
+    ret = 0;
+
+exit:
+    mbedtls_platform_zeroize(key, sizeof(key));
+    mbedtls_platform_zeroize(&crypto_info, sizeof(crypto_info));
+
+    return ret;
+}
+
+#undef SSL_KTLS_FILL_GCM
+
+int mbedtls_ssl_ktls_enable(mbedtls_ssl_context *ssl, int fd, int directions)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (ssl == NULL || ssl->conf == NULL || fd < 0 ||
+        directions == 0 ||
+        (directions & ~(MBEDTLS_SSL_KTLS_TX | MBEDTLS_SSL_KTLS_RX)) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        !mbedtls_ssl_is_handshake_over(ssl) ||
+        ssl->transform_in == NULL || ssl->transform_out == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (ssl->ktls_mode != 0 && ssl->ktls_fd != fd) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Records already built, or already received, by the library must be
+     * handled by the library. */
+    if ((directions & MBEDTLS_SSL_KTLS_TX) != 0 && ssl->out_left != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("output pending, cannot enable kTLS TX"));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    if ((directions & MBEDTLS_SSL_KTLS_RX) != 0 &&
+        (ssl->in_left != 0 || mbedtls_ssl_check_pending(ssl) != 0)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("input pending, cannot enable kTLS RX"));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    /* The kernel cannot switch to the keys of a new handshake. */
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2 &&
+        ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_ENABLED) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("kTLS requires renegotiation to be disabled"));
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif /* MBEDTLS_SSL_RENEGOTIATION */
+
+    if (ssl->ktls_mode == 0) {
+        if (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("setsockopt(TCP_ULP) failed, errno = %d",
+                                      errno));
+            return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+        }
+        ssl->ktls_fd = fd;
+    }
+
+    if ((directions & MBEDTLS_SSL_KTLS_TX) != 0 &&
+        (ssl->ktls_mode & MBEDTLS_SSL_KTLS_TX) == 0) {
+        if ((ret = ssl_ktls_set_crypto_info(ssl, fd, TLS_TX)) != 0) {
+            return ret;
+        }
+        ssl->ktls_mode |= MBEDTLS_SSL_KTLS_TX;
+        MBEDTLS_SSL_DEBUG_MSG(2, ("kTLS TX enabled"));
+    }
+
+    if ((directions & MBEDTLS_SSL_KTLS_RX) != 0 &&
+        (ssl->ktls_mode & MBEDTLS_SSL_KTLS_RX) == 0) {
+        if ((ret = ssl_ktls_set_crypto_info(ssl, fd, TLS_RX)) != 0) {
+            return ret;
+        }
+        ssl->ktls_mode |= MBEDTLS_SSL_KTLS_RX;
+        MBEDTLS_SSL_DEBUG_MSG(2, ("kTLS RX enabled"));
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_ktls_send(mbedtls_ssl_context *ssl,
+                          const unsigned char *buf, size_t len)
+{
+    ssize_t ret;
+
+    if (ssl->ktls_out_type == MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+        ret = send(ssl->ktls_fd, buf, len, 0);
+    } else {
+        struct msghdr msg;
+        struct iovec iov;
+        struct cmsghdr *cmsg;
+        union {
+            struct cmsghdr align;
+            unsigned char buf[CMSG_SPACE(sizeof(unsigned char))];
+        } control;
+
+        memset(&msg, 0, sizeof(msg));
+        memset(&control, 0, sizeof(control));
+        iov.iov_base = (void *) buf;
+        iov.iov_len = len;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+        *CMSG_DATA(cmsg) = (unsigned char) ssl->ktls_out_type;
+
+        ret = sendmsg(ssl->ktls_fd, &msg, 0);
+    }
+
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+        if (errno == EPIPE || errno == ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+
+    return (int) ret;
+}
+
+int mbedtls_ssl_ktls_read_record(mbedtls_ssl_context *ssl)
+{
+    ssize_t ret;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cmsg;
+    union {
+        struct cmsghdr align;
+        unsigned char buf[CMSG_SPACE(sizeof(unsigned char))];
+    } control;
+    int msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    size_t len;
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    size_t in_buf_len = ssl->in_buf_len;
+#else
+    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
+#endif
+
+    /* The whole record content is returned at once, there is no partial
+     * record to keep between calls. */
+    mbedtls_ssl_update_in_pointers(ssl);
+    ssl->in_left = 0;
+    ssl->next_record_offset = 0;
+
+    len = in_buf_len - (size_t) (ssl->in_msg - ssl->in_buf);
+    if (len > MBEDTLS_SSL_IN_CONTENT_LEN) {
+        len = MBEDTLS_SSL_IN_CONTENT_LEN;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    mbedtls_ssl_in_buf_dirty(ssl, ssl->in_msg + len);
+    iov.iov_base = ssl->in_msg;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ret = recvmsg(ssl->ktls_fd, &msg, 0);
+
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        }
+        if (errno == EBADMSG) {
+            /* Authentication failure: the kernel has already sent a
+             * bad_record_mac alert. */
+            return MBEDTLS_ERR_SSL_INVALID_MAC;
+        }
+        if (errno == EMSGSIZE) {
+            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+        }
+        if (errno == EPIPE || errno == ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+
+    if (ret == 0) {
+        return MBEDTLS_ERR_SSL_CONN_EOF;
+    }
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_TLS &&
+        cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+        msgtype = *CMSG_DATA(cmsg);
+    }
+
+    ssl->in_msgtype = msgtype;
+    ssl->in_hdr[0] = (unsigned char) msgtype;
+    ssl->in_msglen = (size_t) ret;
+    MBEDTLS_PUT_UINT16_BE(ssl->in_msglen, ssl->in_len, 0);
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("input record: msgtype = %d, "
+                              "msglen = %" MBEDTLS_PRINTF_SIZET " (kTLS)",
+                              ssl->in_msgtype, ssl->in_msglen));
+
+    MBEDTLS_SSL_STATS_ADD(ssl, bytes_in, ret);
+    MBEDTLS_SSL_STATS_ADD(ssl, records_in, 1);
+
+    return 0;
+}
+
+#endif /* MBEDTLS_SSL_KTLS_C */
@@ -42,6 +42,8 @@
 #include "x509_internal.h"
 #include "pk_internal.h"
 
+#include <stddef.h>
+
 /* Shorthand for restartable ECC */
 #if defined(MBEDTLS_ECP_RESTARTABLE) && \
     defined(MBEDTLS_SSL_CLI_C) && \
@@ -473,6 +475,353 @@ static inline size_t mbedtls_ssl_get_input_buflen(const mbedtls_ssl_context *ctx
 }
 #endif
 
+/*
+ * Record that the input or output buffer may hold data up to \p end, so that
+ * mbedtls_ssl_session_reset() only needs to zeroize that part. This must be
+ * called before data is written to the buffer.
+ */
+static inline void mbedtls_ssl_in_buf_dirty(mbedtls_ssl_context *ssl,
+                                            const unsigned char *end)
+{
+    size_t len = (size_t) (end - ssl->in_buf);
+
+    if (len > ssl->in_buf_dirty) {
+        ssl->in_buf_dirty = len;
+    }
+}
+
+static inline void mbedtls_ssl_out_buf_dirty(mbedtls_ssl_context *ssl,
+                                             const unsigned char *end)
+{
+    size_t len = (size_t) (end - ssl->out_buf);
+
+    if (len > ssl->out_buf_dirty) {
+        ssl->out_buf_dirty = len;
+    }
+}
+
+/*
+ * Relaxed atomic counters, for statistics shared between SSL contexts that
+ * may run in different threads. Where the compiler provides no 64-bit
+ * atomic operations, fall back to plain accesses: concurrent updates may
+ * then be lost, which is acceptable for statistics only.
+ */
+#if defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+#define MBEDTLS_SSL_HAVE_ATOMIC_U64
+static inline void mbedtls_ssl_atomic_add_u64(uint64_t *p, uint64_t n)
+{
+    (void) __atomic_fetch_add(p, n, __ATOMIC_RELAXED);
+}
+
+static inline uint64_t mbedtls_ssl_atomic_load_u64(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+#elif defined(_MSC_VER) && defined(_WIN64)
+#include <intrin.h>
+#define MBEDTLS_SSL_HAVE_ATOMIC_U64
+static inline void mbedtls_ssl_atomic_add_u64(uint64_t *p, uint64_t n)
+{
+    (void) _InterlockedExchangeAdd64((volatile __int64 *) p, (__int64) n);
+}
+
+static inline uint64_t mbedtls_ssl_atomic_load_u64(const uint64_t *p)
+{
+    /* Aligned 64-bit loads are atomic on 64-bit Windows targets. */
+    return *(const volatile uint64_t *) p;
+}
+#else
+static inline void mbedtls_ssl_atomic_add_u64(uint64_t *p, uint64_t n)
+{
+    *p += n;
+}
+
+static inline uint64_t mbedtls_ssl_atomic_load_u64(const uint64_t *p)
+{
+    return *p;
+}
+#endif
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX) || defined(MBEDTLS_SSL_CTX_POOL_C) || \
+    defined(MBEDTLS_SSL_SHM_CACHE_C)
+/*
+ * 32-bit atomic operations shared by the full-duplex alert hand-over, the
+ * SSL context pool and the sequence locks of the shared session cache.
+ */
+#if defined(__GCC_ATOMIC_INT_LOCK_FREE) && __GCC_ATOMIC_INT_LOCK_FREE == 2
+static inline uint32_t mbedtls_ssl_atomic_load_u32(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+static inline void mbedtls_ssl_atomic_store_u32(uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t mbedtls_ssl_atomic_load_acquire_u32(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void mbedtls_ssl_atomic_store_release_u32(uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+static inline void mbedtls_ssl_atomic_or_release_u32(uint32_t *p, uint32_t v)
+{
+    (void) __atomic_fetch_or(p, v, __ATOMIC_RELEASE);
+}
+
+static inline void mbedtls_ssl_atomic_and_release_u32(uint32_t *p, uint32_t v)
+{
+    (void) __atomic_fetch_and(p, v, __ATOMIC_RELEASE);
+}
+
+/* Returns non-zero if *p was \p expected and is now \p desired. */
+static inline int mbedtls_ssl_atomic_cas_acquire_u32(uint32_t *p,
+                                                     uint32_t expected,
+                                                     uint32_t desired)
+{
+    return __atomic_compare_exchange_n(p, &expected, desired, 0,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static inline void mbedtls_ssl_atomic_fence_acquire(void)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void mbedtls_ssl_atomic_fence_release(void)
+{
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+#elif defined(_MSC_VER)
+#include <intrin.h>
+/* Interlocked operations are full barriers. */
+static inline uint32_t mbedtls_ssl_atomic_load_u32(const uint32_t *p)
+{
+    return *(const volatile uint32_t *) p;
+}
+
+static inline void mbedtls_ssl_atomic_store_u32(uint32_t *p, uint32_t v)
+{
+    *(volatile uint32_t *) p = v;
+}
+
+static inline uint32_t mbedtls_ssl_atomic_load_acquire_u32(const uint32_t *p)
+{
+    return (uint32_t) _InterlockedOr((volatile long *) p, 0);
+}
+
+static inline void mbedtls_ssl_atomic_store_release_u32(uint32_t *p, uint32_t v)
+{
+    (void) _InterlockedExchange((volatile long *) p, (long) v);
+}
+
+static inline void mbedtls_ssl_atomic_or_release_u32(uint32_t *p, uint32_t v)
+{
+    (void) _InterlockedOr((volatile long *) p, (long) v);
+}
+
+static inline void mbedtls_ssl_atomic_and_release_u32(uint32_t *p, uint32_t v)
+{
+    (void) _InterlockedAnd((volatile long *) p, (long) v);
+}
+
+static inline int mbedtls_ssl_atomic_cas_acquire_u32(uint32_t *p,
+                                                     uint32_t expected,
+                                                     uint32_t desired)
+{
+    return (uint32_t) _InterlockedCompareExchange((volatile long *) p,
+                                                  (long) desired,
+                                                  (long) expected) == expected;
+}
+
+static inline void mbedtls_ssl_atomic_fence_acquire(void)
+{
+    long fence = 0;
+    (void) _InterlockedOr(&fence, 0);
+}
+
+static inline void mbedtls_ssl_atomic_fence_release(void)
+{
+    long fence = 0;
+    (void) _InterlockedOr(&fence, 0);
+}
+#else
+#error "MBEDTLS_SSL_FULL_DUPLEX, MBEDTLS_SSL_CTX_POOL_C and MBEDTLS_SSL_SHM_CACHE_C require a compiler with atomic operations"
+#endif
+#endif /* MBEDTLS_SSL_FULL_DUPLEX || MBEDTLS_SSL_CTX_POOL_C || MBEDTLS_SSL_SHM_CACHE_C */
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+/*
+ * Hand-over from mbedtls_ssl_read() to mbedtls_ssl_write() in full-duplex
+ * mode. The reader fills ssl->duplex_alert_type for a warning alert, or
+ * ssl->duplex_fatal_type and ssl->duplex_alert_reason for a fatal alert,
+ * then sets the matching flag with release semantics. The writer only reads
+ * these fields after seeing the flag with acquire semantics.
+ */
+#define MBEDTLS_SSL_DUPLEX_ALERT      0x01  /* a warning alert is waiting to be sent */
+#define MBEDTLS_SSL_DUPLEX_FATAL      0x02  /* a fatal alert was handed over, stop writing */
+#define MBEDTLS_SSL_DUPLEX_FATAL_SENT 0x04  /* the fatal alert was sent, set by the writer */
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
+#if defined(MBEDTLS_SSL_CTX_POOL_C)
+/*
+ * Lock-free stack of the SSL context pool: the head word is updated with a
+ * compare-and-swap, and the links are read while other threads may update
+ * them, which the tag in the head word makes harmless.
+ */
+#if defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE == 2
+static inline uint64_t mbedtls_ssl_atomic_load_acquire_u64(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+/* Returns non-zero on success. On failure, *expected is the current value. */
+static inline int mbedtls_ssl_atomic_cas_u64(uint64_t *p, uint64_t *expected,
+                                             uint64_t desired)
+{
+    return __atomic_compare_exchange_n(p, expected, desired, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#elif defined(_MSC_VER) && defined(_WIN64)
+/* Interlocked operations are full barriers. */
+static inline uint64_t mbedtls_ssl_atomic_load_acquire_u64(const uint64_t *p)
+{
+    return (uint64_t) _InterlockedCompareExchange64((volatile __int64 *) p,
+                                                    0, 0);
+}
+
+static inline int mbedtls_ssl_atomic_cas_u64(uint64_t *p, uint64_t *expected,
+                                             uint64_t desired)
+{
+    uint64_t prev = (uint64_t) _InterlockedCompareExchange64(
+        (volatile __int64 *) p, (__int64) desired, (__int64) *expected);
+
+    if (prev == *expected) {
+        return 1;
+    }
+    *expected = prev;
+    return 0;
+}
+#else
+#error "MBEDTLS_SSL_CTX_POOL_C requires a compiler with 64-bit atomic operations"
+#endif
+#endif /* MBEDTLS_SSL_CTX_POOL_C */
+
+#if defined(MBEDTLS_SSL_STATS)
+/*
+ * Account for \p n events of kind \p field on \p ssl, and on the shared
+ * statistics of its configuration if any.
+ */
+static inline void mbedtls_ssl_stats_add(mbedtls_ssl_context *ssl,
+                                         size_t offset, uint64_t n)
+{
+    *(uint64_t *) ((unsigned char *) &ssl->stats + offset) += n;
+    if (ssl->conf != NULL && ssl->conf->stats != NULL) {
+        mbedtls_ssl_atomic_add_u64(
+            (uint64_t *) ((unsigned char *) ssl->conf->stats + offset), n);
+    }
+}
+
+#define MBEDTLS_SSL_STATS_ADD(ssl, field, n)                               \
+    mbedtls_ssl_stats_add((ssl), offsetof(mbedtls_ssl_stats, field),      \
+                          (uint64_t) (n))
+#else
+#define MBEDTLS_SSL_STATS_ADD(ssl, field, n) ((void) 0)
+#endif /* MBEDTLS_SSL_STATS */
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+/*
+ * Handshake timing hooks, called around each handshake step.
+ * \p state is the handshake state when the step started and \p ret the
+ * return value of the step.
+ */
+void mbedtls_ssl_hs_timing_step_start(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_hs_timing_step_end(mbedtls_ssl_context *ssl,
+                                    int state, int ret);
+void mbedtls_ssl_hs_timing_reset_ctx(mbedtls_ssl_context *ssl);
+#endif /* MBEDTLS_SSL_HANDSHAKE_TIMING */
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+/*
+ * Client session store hooks, see mbedtls_ssl_conf_session_store().
+ * mbedtls_ssl_session_store_resume() is called before the first ClientHello
+ * and mbedtls_ssl_session_store_capture() when a resumable session or a
+ * TLS 1.3 ticket is available in ssl->session. Failures are not fatal.
+ */
+void mbedtls_ssl_session_store_resume(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_session_store_capture(mbedtls_ssl_context *ssl);
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+#include "mbedtls/ssl_cert_store.h"
+
+/*
+ * Shared peer certificates, see mbedtls/ssl_cert_store.h. A session whose
+ * peer_cert_shared flag is set holds a reference to its peer_cert, taken
+ * with mbedtls_ssl_cert_store_ref() and given back with
+ * mbedtls_ssl_cert_store_release() instead of being freed.
+ * mbedtls_ssl_session_save_without_peer_cert() serializes a session as if
+ * it had no peer certificate, for callers that keep a reference instead.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_cert_store_ref(mbedtls_x509_crt *crt);
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_session_save_without_peer_cert(const mbedtls_ssl_session *session,
+                                               unsigned char *buf,
+                                               size_t buf_len,
+                                               size_t *olen);
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
+
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+/*
+ * First byte of a session saved with mbedtls_ssl_session_save_compact().
+ * It never matches MBEDTLS_VERSION_MAJOR, the first byte of a session saved
+ * with mbedtls_ssl_session_save(), so that both encodings can be told apart.
+ */
+#define MBEDTLS_SSL_COMPACT_SESSION_MAGIC       0xC5
+#endif /* MBEDTLS_SSL_COMPACT_SESSION */
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+#include "mbedtls/ssl_ktls.h"
+
+/*
+ * Record layer hooks for kernel TLS, see mbedtls/ssl_ktls.h.
+ * mbedtls_ssl_ktls_send() sends plaintext of type ssl->ktls_out_type and
+ * returns like \c f_send. mbedtls_ssl_ktls_read_record() reads the next
+ * record into ssl->in_msg and sets ssl->in_msgtype and ssl->in_msglen.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_ktls_send(mbedtls_ssl_context *ssl,
+                          const unsigned char *buf, size_t len);
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_ktls_read_record(mbedtls_ssl_context *ssl);
+#endif /* MBEDTLS_SSL_KTLS_C */
+
+/*
+ * Extra usage flags for the PSA keys of a transform: traffic keys must be
+ * exportable if they may be handed over to the kernel.
+ */
+static inline psa_key_usage_t mbedtls_ssl_transform_key_usage(
+    const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_KTLS_C)
+    if (ssl != NULL && ssl->conf != NULL &&
+        ssl->conf->ktls == MBEDTLS_SSL_KTLS_ENABLED &&
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM) {
+        return PSA_KEY_USAGE_EXPORT;
+    }
+#else
+    (void) ssl;
+#endif
+    return 0;
+}
+
 /*
  * TLS extension flags (for extensions with outgoing ServerHello content
  * that need it (e.g. for RENEGOTIATION_INFO the server already knows because
@@ -872,6 +1221,13 @@ struct mbedtls_ssl_handshake_params {
     unsigned int in_msg_seq;            /*!<  Incoming handshake sequence number */
 
     uint32_t retransmit_timeout;        /*!<  Current value of timeout       */
+    uint32_t initial_retransmit_timeout; /*!< Timeout of the first transmission
+                                              of the current flight          */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t flight_sent_time; /*!<  Transmission of the flight
+                                              being measured                 */
+    unsigned char rtt_state;            /*!<  Round-trip time measurement    */
+#endif
     mbedtls_ssl_flight_item *flight;    /*!<  Current outgoing flight        */
     mbedtls_ssl_flight_item *cur_msg;   /*!<  Current message in flight      */
     unsigned char *cur_msg_p;           /*!<  Position in current message    */
@@ -978,10 +1334,26 @@ struct mbedtls_ssl_handshake_params {
         unsigned char app[MBEDTLS_TLS1_3_MD_MAX_SIZE];
     } tls13_master_secrets;
 
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
+    /** Hash algorithm of the early secret of the handshake PSK when it is
+     * already in tls13_master_secrets.early, having been derived along with
+     * the PSK binder, or #PSA_ALG_NONE. Reset when the handshake PSK
+     * changes. */
+    psa_algorithm_t tls13_psk_early_secret_alg;
+#endif
+
     mbedtls_ssl_tls13_handshake_secrets tls13_hs_secrets;
 #if defined(MBEDTLS_SSL_EARLY_DATA)
     /** TLS 1.3 transform for early data and handshake messages. */
     mbedtls_ssl_transform *transform_earlydata;
+#if defined(MBEDTLS_SSL_SRV_C)
+    /** Binder of the first PSK offered by the client and difference between
+     * the ticket age computed by the server and the one reported by the
+     * client, passed to the early data replay callback. */
+    unsigned char early_data_binder[MBEDTLS_TLS1_3_MD_MAX_SIZE];
+    size_t early_data_binder_len;
+    int32_t early_data_age_diff;
+#endif /* MBEDTLS_SSL_SRV_C */
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
@@ -1082,8 +1454,23 @@ typedef struct mbedtls_ssl_hs_buffer mbedtls_ssl_hs_buffer;
  * - For CBC transformations, encrypt_then_mac determines the
  *   order of encryption and authentication. This field is unused
  *   in other transformations.
+ * - protect and unprotect implement the record protection of the
+ *   transformation. They are set by mbedtls_ssl_transform_bind_record_ops()
+ *   once the other fields are populated, and called by
+ *   mbedtls_ssl_{en,de}crypt_buf().
  *
  */
+struct mbedtls_record;
+
+typedef int mbedtls_ssl_protect_record_t(mbedtls_ssl_context *ssl,
+                                         mbedtls_ssl_transform *transform,
+                                         struct mbedtls_record *rec,
+                                         int (*f_rng)(void *, unsigned char *, size_t),
+                                         void *p_rng);
+typedef int mbedtls_ssl_unprotect_record_t(mbedtls_ssl_context const *ssl,
+                                           mbedtls_ssl_transform *transform,
+                                           struct mbedtls_record *rec);
+
 struct mbedtls_ssl_transform {
     /*
      * Session specific crypto layer
@@ -1115,6 +1502,9 @@ struct mbedtls_ssl_transform {
     mbedtls_svc_key_id_t psa_key_dec;           /*!<  psa decryption key      */
     psa_algorithm_t psa_alg;                    /*!<  psa algorithm           */
 
+    mbedtls_ssl_protect_record_t *protect;      /*!<  record protection       */
+    mbedtls_ssl_unprotect_record_t *unprotect;  /*!<  record unprotection     */
+
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     uint8_t in_cid_len;
     uint8_t out_cid_len;
@@ -1173,7 +1563,7 @@ static inline int mbedtls_ssl_transform_uses_aead(
 #define MBEDTLS_SSL_CID_LEN_MAX MBEDTLS_SSL_CID_IN_LEN_MAX
 #endif
 
-typedef struct {
+typedef struct mbedtls_record {
     uint8_t ctr[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN];  /* In TLS:  The implicit record sequence number.
                                                     * In DTLS: The 2-byte epoch followed by
                                                     *          the 6-byte sequence number.
@@ -1208,7 +1598,27 @@ struct mbedtls_ssl_key_cert {
     mbedtls_x509_crt *cert;                 /*!< cert                       */
     mbedtls_pk_context *key;                /*!< private key                */
     mbedtls_ssl_key_cert *next;             /*!< next key/cert pair         */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    uint32_t sig_algs;                      /*!< precomputed TLS 1.3 signature
+                                                 algorithms, see
+                                                 mbedtls_ssl_tls13_sig_alg_bit() */
+#endif
 };
+
+/* Set in mbedtls_ssl_key_cert::sig_algs once the bitmap is computed. */
+#define MBEDTLS_SSL_KEY_CERT_SIG_ALGS_VALID     ((uint32_t) 1 << 31)
+
+#if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
+/*
+ * Same as mbedtls_ssl_set_hs_own_cert(), with the TLS 1.3 signature
+ * algorithms usable with this certificate already known.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_set_hs_own_cert_sig_algs(mbedtls_ssl_context *ssl,
+                                         mbedtls_x509_crt *own_cert,
+                                         mbedtls_pk_context *pk_key,
+                                         uint32_t sig_algs);
+#endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -1398,6 +1808,20 @@ int mbedtls_ssl_read_record(mbedtls_ssl_context *ssl,
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want);
 
+/*
+ * TLS: mark the record of length rec_len at ssl->in_hdr as read, keeping the
+ * data read ahead after it for the next call to mbedtls_ssl_fetch_input().
+ */
+static inline void mbedtls_ssl_done_reading_record(mbedtls_ssl_context *ssl,
+                                                   size_t rec_len)
+{
+    if (ssl->in_left > rec_len) {
+        ssl->next_record_offset = rec_len;
+    } else {
+        ssl->in_left = 0;
+    }
+}
+
 /*
  * Write handshake message header
  */
@@ -1695,6 +2119,33 @@ MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_resend(mbedtls_ssl_context *ssl);
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_flight_transmit(mbedtls_ssl_context *ssl);
+uint32_t mbedtls_ssl_dtls_initial_timeout(const mbedtls_ssl_context *ssl);
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+/* Path MTU discovery (ssl->pmtu_state) */
+#define MBEDTLS_SSL_PMTUD_IDLE          0   /* disabled, not started or over */
+#define MBEDTLS_SSL_PMTUD_PROBE_DUE     1   /* next large record is a probe  */
+#define MBEDTLS_SSL_PMTUD_PROBE_SENT    2   /* waiting for feedback          */
+
+/* The search stops when the bounds are closer than this, in bytes */
+#define MBEDTLS_SSL_PMTUD_GRANULARITY   16
+
+void mbedtls_ssl_dtls_pmtud_start(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_dtls_pmtud_sent(mbedtls_ssl_context *ssl, size_t len);
+void mbedtls_ssl_dtls_pmtud_black_hole(mbedtls_ssl_context *ssl);
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS) && defined(MBEDTLS_HAVE_TIME)
+/* Round-trip time measurement of the current flight (handshake->rtt_state) */
+#define MBEDTLS_SSL_RTT_NONE      0     /* no measurement in progress       */
+#define MBEDTLS_SSL_RTT_PREPARED  1     /* new flight, not transmitted yet  */
+#define MBEDTLS_SSL_RTT_SENT      2     /* transmitted once, timing         */
+
+/* Visible for testing purposes only */
+void mbedtls_ssl_dtls_rtt_update(mbedtls_ssl_dtls_rtt *rtt, uint32_t sample);
+uint32_t mbedtls_ssl_dtls_rtt_timeout(const mbedtls_ssl_dtls_rtt *rtt,
+                                      uint32_t initial, uint32_t max);
 #endif
 
 /* Visible for testing purposes only */
@@ -1733,6 +2184,13 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
                             mbedtls_ssl_transform *transform,
                             mbedtls_record *rec);
 
+/*
+ * Select the record protection functions of a transform from its cipher,
+ * protocol version and Encrypt-then-MAC setting. This must be called after
+ * these fields are populated and before the transform is used.
+ */
+void mbedtls_ssl_transform_bind_record_ops(mbedtls_ssl_transform *transform);
+
 /* Length of the "epoch" field in the record header */
 static inline size_t mbedtls_ssl_ep_len(const mbedtls_ssl_context *ssl)
 {
@@ -2361,6 +2819,42 @@ static inline int mbedtls_ssl_tls13_sig_alg_for_cert_verify_is_supported(
 
 }
 
+/*
+ * Bit of a CertificateVerify signature algorithm in
+ * mbedtls_ssl_key_cert::sig_algs, or 0 for algorithms that the server
+ * never signs with.
+ */
+static inline uint32_t mbedtls_ssl_tls13_sig_alg_bit(uint16_t sig_alg)
+{
+    switch (sig_alg) {
+        case MBEDTLS_TLS1_3_SIG_ECDSA_SECP256R1_SHA256:
+            return 1u << 0;
+        case MBEDTLS_TLS1_3_SIG_ECDSA_SECP384R1_SHA384:
+            return 1u << 1;
+        case MBEDTLS_TLS1_3_SIG_ECDSA_SECP521R1_SHA512:
+            return 1u << 2;
+        case MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA256:
+            return 1u << 3;
+        case MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA384:
+            return 1u << 4;
+        case MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA512:
+            return 1u << 5;
+        default:
+            return 0;
+    }
+}
+
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_X509_CRT_PARSE_C)
+/*
+ * Compute the TLS 1.3 signature algorithms that the server can use with
+ * a certificate, as a bitmap of mbedtls_ssl_tls13_sig_alg_bit() values
+ * with MBEDTLS_SSL_KEY_CERT_SIG_ALGS_VALID set. This performs the checks
+ * of the certificate selection once, so that they can be skipped during
+ * handshakes.
+ */
+uint32_t mbedtls_ssl_tls13_key_cert_sig_algs(mbedtls_x509_crt *cert);
+#endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_X509_CRT_PARSE_C */
+
 static inline int mbedtls_ssl_tls13_sig_alg_is_supported(
     const uint16_t sig_alg)
 {
@@ -2507,26 +3001,34 @@ static inline int mbedtls_ssl_tls12_sig_alg_is_supported(
 }
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
-static inline int mbedtls_ssl_sig_alg_is_supported(
-    const mbedtls_ssl_context *ssl,
+static inline int mbedtls_ssl_sig_alg_is_supported_by_version(
+    mbedtls_ssl_protocol_version tls_version,
     const uint16_t sig_alg)
 {
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+    if (tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
         return mbedtls_ssl_tls12_sig_alg_is_supported(sig_alg);
     }
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
-    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+    if (tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
         return mbedtls_ssl_tls13_sig_alg_is_supported(sig_alg);
     }
 #endif
-    ((void) ssl);
+    ((void) tls_version);
     ((void) sig_alg);
     return 0;
 }
+
+static inline int mbedtls_ssl_sig_alg_is_supported(
+    const mbedtls_ssl_context *ssl,
+    const uint16_t sig_alg)
+{
+    return mbedtls_ssl_sig_alg_is_supported_by_version(ssl->tls_version,
+                                                       sig_alg);
+}
 #endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
 
 /* Corresponding PSA algorithm for MBEDTLS_CIPHER_NULL.
@@ -2666,6 +3168,63 @@ int mbedtls_ssl_tls13_read_public_xxdhe_share(mbedtls_ssl_context *ssl,
 
 #endif /* PSA_WANT_ALG_ECDH || PSA_WANT_ALG_FFDH */
 
+/*
+ * Negotiation tables precomputed by mbedtls_ssl_conf_finalize().
+ */
+struct mbedtls_ssl_conf_tables {
+    /* conf->ciphersuite_list resolved: ciphersuites[i] is the result of
+     * mbedtls_ssl_ciphersuite_from_id(conf->ciphersuite_list[i]). */
+    const mbedtls_ssl_ciphersuite_t **ciphersuites;
+    size_t ciphersuites_len;
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
+    /* Serialized signature_algorithms extension built from conf->sig_algs,
+     * indexed by mbedtls_ssl_conf_tables_version_idx(). NULL if writing it
+     * failed: the extension is then written at handshake time, which
+     * reports the error. */
+    unsigned char *sig_alg_ext[2];
+    size_t sig_alg_ext_len[2];
+#endif
+
+#if defined(MBEDTLS_SSL_CLI_C) && \
+    (defined(MBEDTLS_SSL_TLS1_2_SOME_ECC) || \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED))
+    /* Serialized supported_groups extension built from conf->group_list,
+     * indexed by the SSL_WRITE_SUPPORTED_GROUPS_EXT_TLS1_x_FLAG flags. */
+    unsigned char *groups_ext[4];
+    size_t groups_ext_len[4];
+#endif
+};
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
+static inline int mbedtls_ssl_conf_tables_version_idx(
+    mbedtls_ssl_protocol_version tls_version)
+{
+    switch (tls_version) {
+        case MBEDTLS_SSL_VERSION_TLS1_2:
+            return 0;
+        case MBEDTLS_SSL_VERSION_TLS1_3:
+            return 1;
+        default:
+            return -1;
+    }
+}
+#endif
+
+/*
+ * Return the description of conf->ciphersuite_list[i], or NULL if the
+ * ciphersuite is unknown.
+ */
+static inline const mbedtls_ssl_ciphersuite_t *mbedtls_ssl_conf_ciphersuite_at(
+    const mbedtls_ssl_config *conf, size_t i)
+{
+    if (conf->tables != NULL) {
+        return conf->tables->ciphersuites[i];
+    }
+
+    return mbedtls_ssl_ciphersuite_from_id(conf->ciphersuite_list[i]);
+}
+
 static inline int mbedtls_ssl_tls13_cipher_suite_is_offered(
     mbedtls_ssl_context *ssl, int cipher_suite)
 {
@@ -393,9 +393,13 @@ static int ssl_double_retransmit_timeout(mbedtls_ssl_context *ssl)
      * This value is guaranteed to be deliverable (if not guaranteed to be
      * delivered) of any compliant IPv4 (and IPv6) network, and should work
      * on most non-IP stacks too. */
-    if (ssl->handshake->retransmit_timeout != ssl->conf->hs_timeout_min) {
+    if (ssl->handshake->retransmit_timeout !=
+        ssl->handshake->initial_retransmit_timeout) {
         ssl->handshake->mtu = 508;
         MBEDTLS_SSL_DEBUG_MSG(2, ("mtu autoreduction to %d bytes", ssl->handshake->mtu));
+
+        /* The discovered path MTU may no longer hold */
+        mbedtls_ssl_dtls_pmtud_black_hole(ssl);
     }
 
     new_timeout = 2 * ssl->handshake->retransmit_timeout;
@@ -413,9 +417,94 @@ static int ssl_double_retransmit_timeout(mbedtls_ssl_context *ssl)
     return 0;
 }
 
+#if defined(MBEDTLS_HAVE_TIME)
+/*
+ * Update the round-trip time estimate with a new measurement, as in
+ * RFC 6298 section 2 with alpha = 1/8 and beta = 1/4. SRTT is kept in
+ * 1/8 ms and RTTVAR in 1/4 ms, so that the updates are exact.
+ */
+void mbedtls_ssl_dtls_rtt_update(mbedtls_ssl_dtls_rtt *rtt, uint32_t sample)
+{
+    uint32_t err;
+
+    /* Keep 8 * sample in range, and 0 for "no measurement" */
+    if (sample > (UINT32_MAX >> 4)) {
+        sample = UINT32_MAX >> 4;
+    } else if (sample == 0) {
+        sample = 1;
+    }
+
+    if (rtt->srtt == 0) {
+        /* SRTT <- R, RTTVAR <- R/2 */
+        rtt->srtt = sample << 3;
+        rtt->rttvar = sample << 1;
+        return;
+    }
+
+    /* |SRTT - R'| in ms */
+    if (rtt->srtt >= (sample << 3)) {
+        err = (rtt->srtt - (sample << 3)) >> 3;
+    } else {
+        err = ((sample << 3) - rtt->srtt) >> 3;
+    }
+
+    /* RTTVAR <- 3/4 * RTTVAR + 1/4 * |SRTT - R'| */
+    rtt->rttvar = rtt->rttvar - (rtt->rttvar >> 2) + err;
+    /* SRTT <- 7/8 * SRTT + 1/8 * R' */
+    rtt->srtt = rtt->srtt - (rtt->srtt >> 3) + sample;
+}
+
+/*
+ * RTO <- SRTT + max(G, 4 * RTTVAR), with a clock granularity G of 1 ms,
+ * within [MBEDTLS_SSL_DTLS_RTO_MIN, max]. Without a measurement, use the
+ * configured initial value.
+ */
+uint32_t mbedtls_ssl_dtls_rtt_timeout(const mbedtls_ssl_dtls_rtt *rtt,
+                                      uint32_t initial, uint32_t max)
+{
+    uint64_t timeout;
+
+    if (rtt->srtt == 0) {
+        return initial;
+    }
+
+    timeout = (uint64_t) (rtt->srtt >> 3) +
+              (rtt->rttvar > 1 ? rtt->rttvar : 1);
+
+    if (timeout < MBEDTLS_SSL_DTLS_RTO_MIN) {
+        timeout = MBEDTLS_SSL_DTLS_RTO_MIN;
+    }
+    if (timeout > max) {
+        timeout = max;
+    }
+
+    return (uint32_t) timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+/*
+ * Timeout of the first transmission of a flight: the configured minimum,
+ * or the current RTO estimate in adaptive mode.
+ */
+uint32_t mbedtls_ssl_dtls_initial_timeout(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    if (ssl->conf->dtls_rto == MBEDTLS_SSL_DTLS_RTO_ADAPTIVE) {
+        return mbedtls_ssl_dtls_rtt_timeout(&ssl->rtt,
+                                            ssl->conf->hs_timeout_min,
+                                            ssl->conf->hs_timeout_max);
+    }
+#endif
+
+    return ssl->conf->hs_timeout_min;
+}
+
 static void ssl_reset_retransmit_timeout(mbedtls_ssl_context *ssl)
 {
-    ssl->handshake->retransmit_timeout = ssl->conf->hs_timeout_min;
+    uint32_t timeout = mbedtls_ssl_dtls_initial_timeout(ssl);
+
+    ssl->handshake->retransmit_timeout = timeout;
+    ssl->handshake->initial_retransmit_timeout = timeout;
     MBEDTLS_SSL_DEBUG_MSG(3, ("update timeout value to %lu millisecs",
                               (unsigned long) ssl->handshake->retransmit_timeout));
 }
@@ -753,12 +842,14 @@ static void ssl_extract_add_data_from_record(unsigned char *add_data,
 }
 
 #if defined(MBEDTLS_SSL_HAVE_AEAD)
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_transform_aead_dynamic_iv_is_explicit(
     mbedtls_ssl_transform const *transform)
 {
     return transform->ivlen != transform->fixed_ivlen;
 }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
 /* Compute IV := ( fixed_iv || 0 ) XOR ( 0 || dynamic_IV )
  *
@@ -799,1060 +890,1281 @@ static void ssl_build_record_nonce(unsigned char *dst_iv,
 }
 #endif /* MBEDTLS_SSL_HAVE_AEAD */
 
-int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
-                            mbedtls_ssl_transform *transform,
-                            mbedtls_record *rec,
-                            int (*f_rng)(void *, unsigned char *, size_t),
-                            void *p_rng)
-{
-    mbedtls_ssl_mode_t ssl_mode;
-    int auth_done = 0;
-    unsigned char *data;
-    /* For an explanation of the additional data length see
-     * the description of ssl_extract_add_data_from_record().
-     */
+/*
+ * Record protection
+ *
+ * The cipher-specific part of mbedtls_ssl_encrypt_buf() and
+ * mbedtls_ssl_decrypt_buf() is implemented by one protect/unprotect pair per
+ * construction: AEAD in TLS 1.3, AEAD in TLS 1.2 with an explicit or an
+ * implicit nonce, CBC with Encrypt-then-MAC, CBC with MAC-then-Encrypt and
+ * the NULL cipher. mbedtls_ssl_transform_bind_record_ops() selects the pair
+ * once, when the transform is populated, so that the cipher mode, the
+ * protocol version and the Encrypt-then-MAC setting are not looked at again
+ * for each record.
+ *
+ * The protect functions are passed the plaintext of the record, after
+ * the DTLSInnerPlaintext wrapping when a CID is used. The unprotect
+ * functions are passed the record content as received, after the CID
+ * has been matched.
+ */
+
+/* For an explanation of the additional data length see
+ * the description of ssl_extract_add_data_from_record().
+ */
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    unsigned char add_data[23 + MBEDTLS_SSL_CID_OUT_LEN_MAX];
+#define SSL_RECORD_ADD_DATA_MAX_LEN (23 + MBEDTLS_SSL_CID_LEN_MAX)
 #else
-    unsigned char add_data[13];
+#define SSL_RECORD_ADD_DATA_MAX_LEN 13
 #endif
+
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
+/*
+ * Append the MAC of the record to its content.
+ *
+ * This is the MAC of the plaintext with MAC-then-Encrypt and the NULL
+ * cipher, and the MAC of the IV and ciphertext with Encrypt-then-MAC.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_append_mac(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_transform *transform,
+                                 mbedtls_record *rec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    size_t post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
+    unsigned char add_data[SSL_RECORD_ADD_DATA_MAX_LEN];
     size_t add_data_len;
-    size_t post_avail;
+    unsigned char mac[MBEDTLS_SSL_MAC_ADD];
+    psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    size_t sign_mac_length = 0;
 
-    /* The SSL context is only used for debugging purposes! */
-#if !defined(MBEDTLS_DEBUG_C)
-    ssl = NULL; /* make sure we don't use it except for debug */
     ((void) ssl);
-#endif
 
-    /* The PRNG is used for dynamic IV generation that's used
-     * for CBC transformations in TLS 1.2. */
-#if !(defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC) && \
-    defined(MBEDTLS_SSL_PROTO_TLS1_2))
-    ((void) f_rng);
-    ((void) p_rng);
-#endif
+    if (post_avail < transform->maclen) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> encrypt buf"));
+    ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                     transform->tls_version,
+                                     transform->taglen);
 
-    if (transform == NULL) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("no transform provided to encrypt_buf"));
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    MBEDTLS_SSL_DEBUG_BUF(4, "MAC'd meta-data", add_data, add_data_len);
+
+    status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
+                                transform->psa_mac_alg);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
     }
-    if (rec == NULL
-        || rec->buf == NULL
-        || rec->buf_len < rec->data_offset
-        || rec->buf_len - rec->data_offset < rec->data_len
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-        || rec->cid_len != 0
-#endif
-        ) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("bad record structure provided to encrypt_buf"));
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+
+    status = psa_mac_update(&operation, add_data, add_data_len);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
     }
 
-    ssl_mode = mbedtls_ssl_get_mode_from_transform(transform);
+    status = psa_mac_update(&operation, data, rec->data_len);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
+    }
 
-    data = rec->buf + rec->data_offset;
-    post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
-    MBEDTLS_SSL_DEBUG_BUF(4, "before encrypt: output payload",
-                          data, rec->data_len);
+    status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
+                                 &sign_mac_length);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
+    }
 
-    if (rec->data_len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("Record content %" MBEDTLS_PRINTF_SIZET
-                                  " too large, maximum %" MBEDTLS_PRINTF_SIZET,
-                                  rec->data_len,
-                                  (size_t) MBEDTLS_SSL_OUT_CONTENT_LEN));
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    memcpy(data + rec->data_len, mac, transform->maclen);
+
+    MBEDTLS_SSL_DEBUG_BUF(4, "computed mac", data + rec->data_len,
+                          transform->maclen);
+
+    rec->data_len += transform->maclen;
+
+hmac_failed:
+    mbedtls_platform_zeroize(mac, transform->maclen);
+    ret = PSA_TO_MBEDTLS_ERR(status);
+    status = psa_mac_abort(&operation);
+    if (ret == 0 && status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+    }
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "HMAC calculation failed", ret);
     }
+    return ret;
+}
 
-    /* The following two code paths implement the (D)TLSInnerPlaintext
-     * structure present in TLS 1.3 and DTLS 1.2 + CID.
-     *
-     * See ssl_build_inner_plaintext() for more information.
+/*
+ * Compute the MAC of a record received with MAC-then-Encrypt or the NULL
+ * cipher and compare it with the MAC at the end of the plaintext, in
+ * constant time. padlen is the length of the CBC padding that was removed
+ * from the record, or 0 for the NULL cipher.
+ *
+ * A MAC mismatch is reported by clearing *correct, not by the return value.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_verify_mac_ct(mbedtls_ssl_context const *ssl,
+                                    mbedtls_ssl_transform *transform,
+                                    mbedtls_record *rec,
+                                    size_t padlen,
+                                    mbedtls_ct_condition_t *correct)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    unsigned char add_data[SSL_RECORD_ADD_DATA_MAX_LEN];
+    size_t add_data_len;
+    unsigned char mac_expect[MBEDTLS_SSL_MAC_ADD] = { 0 };
+    unsigned char mac_peer[MBEDTLS_SSL_MAC_ADD] = { 0 };
+
+    ((void) ssl);
+
+    /* For CBC+MAC, If the initial value of padlen was such that
+     * data_len < maclen + padlen + 1, then padlen
+     * got reset to 1, and the initial check
+     * data_len >= minlen + maclen + 1
+     * guarantees that at this point we still
+     * have at least data_len >= maclen.
      *
-     * Note that this changes `rec->data_len`, and hence
-     * `post_avail` needs to be recalculated afterwards.
+     * If the initial value of padlen was such that
+     * data_len >= maclen + padlen + 1, then we have
+     * subtracted either padlen + 1 (if the padding was correct)
+     * or 0 (if the padding was incorrect) since then,
+     * hence data_len >= maclen in any case.
      *
-     * Note also that the two code paths cannot occur simultaneously
-     * since they apply to different versions of the protocol. There
-     * is hence no risk of double-addition of the inner plaintext.
+     * For stream ciphers, the caller checked that
+     * data_len >= maclen.
      */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-    if (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
-        size_t padding =
-            ssl_compute_padding_length(rec->data_len,
-                                       MBEDTLS_SSL_CID_TLS1_3_PADDING_GRANULARITY);
-        if (ssl_build_inner_plaintext(data,
-                                      &rec->data_len,
-                                      post_avail,
-                                      rec->type,
-                                      padding) != 0) {
-            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-        }
+    rec->data_len -= transform->maclen;
+    ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                     transform->tls_version,
+                                     transform->taglen);
 
-        rec->type = MBEDTLS_SSL_MSG_APPLICATION_DATA;
-    }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
-
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     /*
-     * Add CID information
+     * The next two sizes are the minimum and maximum values of
+     * data_len over all padlen values.
+     *
+     * They're independent of padlen, since we previously did
+     * data_len -= padlen.
+     *
+     * Note that max_len + maclen is never more than the buffer
+     * length, as we previously did in_msglen -= maclen too.
      */
-    rec->cid_len = transform->out_cid_len;
-    memcpy(rec->cid, transform->out_cid, transform->out_cid_len);
-    MBEDTLS_SSL_DEBUG_BUF(3, "CID", rec->cid, rec->cid_len);
+    const size_t max_len = rec->data_len + padlen;
+    const size_t min_len = (max_len > 256) ? max_len - 256 : 0;
+
+    ret = mbedtls_ct_hmac(transform->psa_mac_dec,
+                          transform->psa_mac_alg,
+                          add_data, add_data_len,
+                          data, rec->data_len, min_len, max_len,
+                          mac_expect);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ct_hmac", ret);
+        goto hmac_failed;
+    }
 
-    if (rec->cid_len != 0) {
-        size_t padding =
-            ssl_compute_padding_length(rec->data_len,
-                                       MBEDTLS_SSL_CID_TLS1_3_PADDING_GRANULARITY);
-        /*
-         * Wrap plaintext into DTLSInnerPlaintext structure.
-         * See ssl_build_inner_plaintext() for more information.
-         *
-         * Note that this changes `rec->data_len`, and hence
-         * `post_avail` needs to be recalculated afterwards.
-         */
-        if (ssl_build_inner_plaintext(data,
-                                      &rec->data_len,
-                                      post_avail,
-                                      rec->type,
-                                      padding) != 0) {
-            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-        }
+    mbedtls_ct_memcpy_offset(mac_peer, data,
+                             rec->data_len,
+                             min_len, max_len,
+                             transform->maclen);
 
-        rec->type = MBEDTLS_SSL_MSG_CID;
-    }
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+#if defined(MBEDTLS_SSL_DEBUG_ALL)
+    MBEDTLS_SSL_DEBUG_BUF(4, "expected mac", mac_expect, transform->maclen);
+    MBEDTLS_SSL_DEBUG_BUF(4, "message  mac", mac_peer, transform->maclen);
+#endif
 
-    post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
+    if (mbedtls_ct_memcmp(mac_peer, mac_expect,
+                          transform->maclen) != 0) {
+#if defined(MBEDTLS_SSL_DEBUG_ALL)
+        MBEDTLS_SSL_DEBUG_MSG(1, ("message mac does not match"));
+#endif
+        *correct = MBEDTLS_CT_FALSE;
+    }
 
-    /*
-     * Add MAC before if needed
-     */
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
-    if (ssl_mode == MBEDTLS_SSL_MODE_STREAM ||
-        ssl_mode == MBEDTLS_SSL_MODE_CBC) {
-        if (post_avail < transform->maclen) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
-            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-        }
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        unsigned char mac[MBEDTLS_SSL_MAC_ADD];
-        int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-        psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-        size_t sign_mac_length = 0;
+hmac_failed:
+    mbedtls_platform_zeroize(mac_peer, transform->maclen);
+    mbedtls_platform_zeroize(mac_expect, transform->maclen);
+    return ret;
+}
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_MAC */
 
-        ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                         transform->tls_version,
-                                         transform->taglen);
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_STREAM)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_protect_record_null(mbedtls_ssl_context *ssl,
+                                   mbedtls_ssl_transform *transform,
+                                   mbedtls_record *rec,
+                                   int (*f_rng)(void *, unsigned char *, size_t),
+                                   void *p_rng)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
-                                    transform->psa_mac_alg);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+    ((void) f_rng);
+    ((void) p_rng);
 
-        status = psa_mac_update(&operation, add_data, add_data_len);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+    ret = ssl_record_append_mac(ssl, transform, rec);
+    if (ret != 0) {
+        return ret;
+    }
 
-        status = psa_mac_update(&operation, data, rec->data_len);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+    MBEDTLS_SSL_DEBUG_MSG(3, ("before encrypt: msglen = %" MBEDTLS_PRINTF_SIZET ", "
+                                                                                "including %d bytes of padding",
+                              rec->data_len, 0));
 
-        status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
-                                     &sign_mac_length);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+    /* The only supported stream cipher is "NULL",
+     * so there's nothing to do here.*/
+    return 0;
+}
 
-        memcpy(data + rec->data_len, mac, transform->maclen);
-#endif
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_unprotect_record_null(mbedtls_ssl_context const *ssl,
+                                     mbedtls_ssl_transform *transform,
+                                     mbedtls_record *rec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ct_condition_t correct = MBEDTLS_CT_TRUE;
 
-        MBEDTLS_SSL_DEBUG_BUF(4, "computed mac", data + rec->data_len,
-                              transform->maclen);
+    if (rec->data_len < transform->maclen) {
+        MBEDTLS_SSL_DEBUG_MSG(1,
+                              ("Record too short for MAC:"
+                               " %" MBEDTLS_PRINTF_SIZET " < %" MBEDTLS_PRINTF_SIZET,
+                               rec->data_len, transform->maclen));
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
 
-        rec->data_len += transform->maclen;
-        post_avail -= transform->maclen;
-        auth_done++;
+    /* The only supported stream cipher is "NULL",
+     * so there's no decryption to do here.*/
 
-hmac_failed_etm_disabled:
-        mbedtls_platform_zeroize(mac, transform->maclen);
-        ret = PSA_TO_MBEDTLS_ERR(status);
-        status = psa_mac_abort(&operation);
-        if (ret == 0 && status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-        }
-        if (ret != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_md_hmac_xxx", ret);
-            return ret;
-        }
+    ret = ssl_record_verify_mac_ct(ssl, transform, rec, 0, &correct);
+    if (ret != 0) {
+        return ret;
     }
-#endif /* MBEDTLS_SSL_SOME_SUITES_USE_MAC */
 
-    /*
-     * Encrypt
-     */
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_STREAM)
-    if (ssl_mode == MBEDTLS_SSL_MODE_STREAM) {
-        MBEDTLS_SSL_DEBUG_MSG(3, ("before encrypt: msglen = %" MBEDTLS_PRINTF_SIZET ", "
-                                                                                    "including %d bytes of padding",
-                                  rec->data_len, 0));
+    if (correct == MBEDTLS_CT_FALSE) {
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
 
-        /* The only supported stream cipher is "NULL",
-         * so there's nothing to do here.*/
-    } else
+    return 0;
+}
 #endif /* MBEDTLS_SSL_SOME_SUITES_USE_STREAM */
 
 #if defined(MBEDTLS_SSL_HAVE_AEAD)
-    if (ssl_mode == MBEDTLS_SSL_MODE_AEAD) {
-        unsigned char iv[12];
-        unsigned char *dynamic_iv;
-        size_t dynamic_iv_len;
-        int dynamic_iv_is_explicit =
-            ssl_transform_aead_dynamic_iv_is_explicit(transform);
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-        int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-
-        /* Check that there's space for the authentication tag. */
-        if (post_avail < transform->taglen) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
-            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-        }
-
-        /*
-         * Build nonce for AEAD encryption.
-         *
-         * Note: In the case of CCM and GCM in TLS 1.2, the dynamic
-         *       part of the IV is prepended to the ciphertext and
-         *       can be chosen freely - in particular, it need not
-         *       agree with the record sequence number.
-         *       However, since ChaChaPoly as well as all AEAD modes
-         *       in TLS 1.3 use the record sequence number as the
-         *       dynamic part of the nonce, we uniformly use the
-         *       record sequence number here in all cases.
-         */
-        dynamic_iv     = rec->ctr;
-        dynamic_iv_len = sizeof(rec->ctr);
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_aead_encrypt(mbedtls_ssl_context *ssl,
+                                   mbedtls_ssl_transform *transform,
+                                   mbedtls_record *rec,
+                                   int dynamic_iv_is_explicit)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    size_t post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
+    unsigned char add_data[SSL_RECORD_ADD_DATA_MAX_LEN];
+    size_t add_data_len;
+    unsigned char iv[12];
+    unsigned char *dynamic_iv;
+    size_t dynamic_iv_len;
 
-        ssl_build_record_nonce(iv, sizeof(iv),
-                               transform->iv_enc,
-                               transform->fixed_ivlen,
-                               dynamic_iv,
-                               dynamic_iv_len);
+    ((void) ssl);
 
-        /*
-         * Build additional data for AEAD encryption.
-         * This depends on the TLS version.
-         */
-        ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                         transform->tls_version,
-                                         transform->taglen);
-
-        MBEDTLS_SSL_DEBUG_BUF(4, "IV used (internal)",
-                              iv, transform->ivlen);
-        MBEDTLS_SSL_DEBUG_BUF(4, "IV used (transmitted)",
-                              dynamic_iv,
-                              dynamic_iv_is_explicit ? dynamic_iv_len : 0);
-        MBEDTLS_SSL_DEBUG_BUF(4, "additional data used for AEAD",
-                              add_data, add_data_len);
-        MBEDTLS_SSL_DEBUG_MSG(3, ("before encrypt: msglen = %" MBEDTLS_PRINTF_SIZET ", "
-                                                                                    "including 0 bytes of padding",
-                                  rec->data_len));
+    /* Check that there's space for the authentication tag. */
+    if (post_avail < transform->taglen) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
 
-        /*
-         * Encrypt and authenticate
-         */
-        status = psa_aead_encrypt(transform->psa_key_enc,
-                                  transform->psa_alg,
-                                  iv, transform->ivlen,
-                                  add_data, add_data_len,
-                                  data, rec->data_len,
-                                  data, rec->buf_len - (data - rec->buf),
-                                  &rec->data_len);
-
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_encrypt_buf", ret);
-            return ret;
-        }
+    /*
+     * Build nonce for AEAD encryption.
+     *
+     * Note: In the case of CCM and GCM in TLS 1.2, the dynamic
+     *       part of the IV is prepended to the ciphertext and
+     *       can be chosen freely - in particular, it need not
+     *       agree with the record sequence number.
+     *       However, since ChaChaPoly as well as all AEAD modes
+     *       in TLS 1.3 use the record sequence number as the
+     *       dynamic part of the nonce, we uniformly use the
+     *       record sequence number here in all cases.
+     */
+    dynamic_iv     = rec->ctr;
+    dynamic_iv_len = sizeof(rec->ctr);
 
-        MBEDTLS_SSL_DEBUG_BUF(4, "after encrypt: tag",
-                              data + rec->data_len - transform->taglen,
-                              transform->taglen);
-        /* Account for authentication tag. */
-        post_avail -= transform->taglen;
+    ssl_build_record_nonce(iv, sizeof(iv),
+                           transform->iv_enc,
+                           transform->fixed_ivlen,
+                           dynamic_iv,
+                           dynamic_iv_len);
 
-        /*
-         * Prefix record content with dynamic IV in case it is explicit.
-         */
-        if (dynamic_iv_is_explicit != 0) {
-            if (rec->data_offset < dynamic_iv_len) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
-                return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-            }
+    /*
+     * Build additional data for AEAD encryption.
+     * This depends on the TLS version.
+     */
+    ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                     transform->tls_version,
+                                     transform->taglen);
+
+    MBEDTLS_SSL_DEBUG_BUF(4, "IV used (internal)",
+                          iv, transform->ivlen);
+    MBEDTLS_SSL_DEBUG_BUF(4, "IV used (transmitted)",
+                          dynamic_iv,
+                          dynamic_iv_is_explicit ? dynamic_iv_len : 0);
+    MBEDTLS_SSL_DEBUG_BUF(4, "additional data used for AEAD",
+                          add_data, add_data_len);
+    MBEDTLS_SSL_DEBUG_MSG(3, ("before encrypt: msglen = %" MBEDTLS_PRINTF_SIZET ", "
+                                                                                "including 0 bytes of padding",
+                              rec->data_len));
 
-            memcpy(data - dynamic_iv_len, dynamic_iv, dynamic_iv_len);
-            rec->data_offset -= dynamic_iv_len;
-            rec->data_len    += dynamic_iv_len;
-        }
+    /*
+     * Encrypt and authenticate
+     */
+    status = psa_aead_encrypt(transform->psa_key_enc,
+                              transform->psa_alg,
+                              iv, transform->ivlen,
+                              add_data, add_data_len,
+                              data, rec->data_len,
+                              data, rec->buf_len - (data - rec->buf),
+                              &rec->data_len);
 
-        auth_done++;
-    } else
-#endif /* MBEDTLS_SSL_HAVE_AEAD */
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC)
-    if (ssl_mode == MBEDTLS_SSL_MODE_CBC ||
-        ssl_mode == MBEDTLS_SSL_MODE_CBC_ETM) {
-        int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-        size_t padlen, i;
-        size_t olen;
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-        size_t part_len;
-        psa_cipher_operation_t cipher_op = PSA_CIPHER_OPERATION_INIT;
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_encrypt_buf", ret);
+        return ret;
+    }
 
-        /* Currently we're always using minimal padding
-         * (up to 255 bytes would be allowed). */
-        padlen = transform->ivlen - (rec->data_len + 1) % transform->ivlen;
-        if (padlen == transform->ivlen) {
-            padlen = 0;
-        }
+    MBEDTLS_SSL_DEBUG_BUF(4, "after encrypt: tag",
+                          data + rec->data_len - transform->taglen,
+                          transform->taglen);
 
-        /* Check there's enough space in the buffer for the padding. */
-        if (post_avail < padlen + 1) {
+    /*
+     * Prefix record content with dynamic IV in case it is explicit.
+     */
+    if (dynamic_iv_is_explicit != 0) {
+        if (rec->data_offset < dynamic_iv_len) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
             return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
         }
 
-        for (i = 0; i <= padlen; i++) {
-            data[rec->data_len + i] = (unsigned char) padlen;
-        }
+        memcpy(data - dynamic_iv_len, dynamic_iv, dynamic_iv_len);
+        rec->data_offset -= dynamic_iv_len;
+        rec->data_len    += dynamic_iv_len;
+    }
 
-        rec->data_len += padlen + 1;
-        post_avail -= padlen + 1;
+    return 0;
+}
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        /*
-         * Prepend per-record IV for block cipher in TLS v1.2 as per
-         * Method 1 (6.2.3.2. in RFC4346 and RFC5246)
-         */
-        if (f_rng == NULL) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("No PRNG provided to encrypt_record routine"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-        }
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_aead_decrypt(mbedtls_ssl_context const *ssl,
+                                   mbedtls_ssl_transform *transform,
+                                   mbedtls_record *rec,
+                                   int dynamic_iv_is_explicit)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    unsigned char add_data[SSL_RECORD_ADD_DATA_MAX_LEN];
+    size_t add_data_len;
+    unsigned char iv[12];
+    unsigned char *dynamic_iv;
+    size_t dynamic_iv_len;
+    size_t olen;
 
-        if (rec->data_offset < transform->ivlen) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
-            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-        }
+    ((void) ssl);
 
-        /*
-         * Generate IV
-         */
-        ret = f_rng(p_rng, transform->iv_enc, transform->ivlen);
-        if (ret != 0) {
-            return ret;
+    /*
+     * Extract dynamic part of nonce for AEAD decryption.
+     *
+     * Note: In the case of CCM and GCM in TLS 1.2, the dynamic
+     *       part of the IV is prepended to the ciphertext and
+     *       can be chosen freely - in particular, it need not
+     *       agree with the record sequence number.
+     */
+    dynamic_iv_len = sizeof(rec->ctr);
+    if (dynamic_iv_is_explicit != 0) {
+        if (rec->data_len < dynamic_iv_len) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
+                                      " ) < explicit_iv_len (%" MBEDTLS_PRINTF_SIZET ") ",
+                                      rec->data_len,
+                                      dynamic_iv_len));
+            return MBEDTLS_ERR_SSL_INVALID_MAC;
         }
+        dynamic_iv = data;
 
-        memcpy(data - transform->ivlen, transform->iv_enc, transform->ivlen);
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+        data += dynamic_iv_len;
+        rec->data_offset += dynamic_iv_len;
+        rec->data_len    -= dynamic_iv_len;
+    } else {
+        dynamic_iv = rec->ctr;
+    }
 
-        MBEDTLS_SSL_DEBUG_MSG(3, ("before encrypt: msglen = %" MBEDTLS_PRINTF_SIZET ", "
-                                                                                    "including %"
-                                  MBEDTLS_PRINTF_SIZET
-                                  " bytes of IV and %" MBEDTLS_PRINTF_SIZET " bytes of padding",
-                                  rec->data_len, transform->ivlen,
-                                  padlen + 1));
+    /* Check that there's space for the authentication tag. */
+    if (rec->data_len < transform->taglen) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
+                                  ") < taglen (%" MBEDTLS_PRINTF_SIZET ") ",
+                                  rec->data_len,
+                                  transform->taglen));
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
+    rec->data_len -= transform->taglen;
 
-        status = psa_cipher_encrypt_setup(&cipher_op,
-                                          transform->psa_key_enc, transform->psa_alg);
+    /*
+     * Prepare nonce from dynamic and static parts.
+     */
+    ssl_build_record_nonce(iv, sizeof(iv),
+                           transform->iv_dec,
+                           transform->fixed_ivlen,
+                           dynamic_iv,
+                           dynamic_iv_len);
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_encrypt_setup", ret);
-            return ret;
-        }
+    /*
+     * Build additional data for AEAD encryption.
+     * This depends on the TLS version.
+     */
+    ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                     transform->tls_version,
+                                     transform->taglen);
+    MBEDTLS_SSL_DEBUG_BUF(4, "additional data used for AEAD",
+                          add_data, add_data_len);
+
+    /* Because of the check above, we know that there are
+     * explicit_iv_len Bytes preceding data, and taglen
+     * bytes following data + data_len. This justifies
+     * the debug message and the invocation of
+     * psa_aead_decrypt() below. */
+
+    MBEDTLS_SSL_DEBUG_BUF(4, "IV used", iv, transform->ivlen);
+    MBEDTLS_SSL_DEBUG_BUF(4, "TAG used", data + rec->data_len,
+                          transform->taglen);
 
-        status = psa_cipher_set_iv(&cipher_op, transform->iv_enc, transform->ivlen);
+    /*
+     * Decrypt and authenticate
+     */
+    status = psa_aead_decrypt(transform->psa_key_dec,
+                              transform->psa_alg,
+                              iv, transform->ivlen,
+                              add_data, add_data_len,
+                              data, rec->data_len + transform->taglen,
+                              data, rec->buf_len - (data - rec->buf),
+                              &olen);
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_set_iv", ret);
-            return ret;
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_aead_decrypt", ret);
+        return ret;
+    }
 
-        }
+    /* Double-check that AEAD decryption doesn't change content length. */
+    if (olen != rec->data_len) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
 
-        status = psa_cipher_update(&cipher_op,
-                                   data, rec->data_len,
-                                   data, rec->data_len, &olen);
+#if defined(MBEDTLS_SSL_DEBUG_ALL)
+    MBEDTLS_SSL_DEBUG_BUF(4, "raw buffer after decryption",
+                          data, rec->data_len);
+#endif
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_update", ret);
-            return ret;
+    return 0;
+}
 
-        }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_protect_record_tls13(mbedtls_ssl_context *ssl,
+                                    mbedtls_ssl_transform *transform,
+                                    mbedtls_record *rec,
+                                    int (*f_rng)(void *, unsigned char *, size_t),
+                                    void *p_rng)
+{
+    size_t post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
+    size_t padding =
+        ssl_compute_padding_length(rec->data_len,
+                                   MBEDTLS_SSL_CID_TLS1_3_PADDING_GRANULARITY);
 
-        status = psa_cipher_finish(&cipher_op,
-                                   data + olen, rec->data_len - olen,
-                                   &part_len);
+    ((void) f_rng);
+    ((void) p_rng);
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_finish", ret);
-            return ret;
+    /* Wrap the plaintext into the TLSInnerPlaintext structure.
+     * See ssl_build_inner_plaintext() for more information. */
+    if (ssl_build_inner_plaintext(rec->buf + rec->data_offset,
+                                  &rec->data_len,
+                                  post_avail,
+                                  rec->type,
+                                  padding) != 0) {
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
 
-        }
+    rec->type = MBEDTLS_SSL_MSG_APPLICATION_DATA;
 
-        olen += part_len;
+    return ssl_record_aead_encrypt(ssl, transform, rec, 0);
+}
 
-        if (rec->data_len != olen) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-        }
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_unprotect_record_tls13(mbedtls_ssl_context const *ssl,
+                                      mbedtls_ssl_transform *transform,
+                                      mbedtls_record *rec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        data             -= transform->ivlen;
-        rec->data_offset -= transform->ivlen;
-        rec->data_len    += transform->ivlen;
+    ret = ssl_record_aead_decrypt(ssl, transform, rec, 0);
+    if (ret != 0) {
+        return ret;
+    }
 
-#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
-        if (auth_done == 0) {
-            unsigned char mac[MBEDTLS_SSL_MAC_ADD];
-            psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
-            size_t sign_mac_length = 0;
+    /* Remove inner padding and infer true content type. */
+    ret = ssl_parse_inner_plaintext(rec->buf + rec->data_offset,
+                                    &rec->data_len, &rec->type);
+    if (ret != 0) {
+        return MBEDTLS_ERR_SSL_INVALID_RECORD;
+    }
 
-            /* MAC(MAC_write_key, add_data, IV, ENC(content + padding + padding_length))
-             */
+    return 0;
+}
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
-            if (post_avail < transform->maclen) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
-                return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-            }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+/* TLS 1.2 AEAD with a nonce derived from the sequence number (ChaChaPoly) */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_protect_record_aead(mbedtls_ssl_context *ssl,
+                                   mbedtls_ssl_transform *transform,
+                                   mbedtls_record *rec,
+                                   int (*f_rng)(void *, unsigned char *, size_t),
+                                   void *p_rng)
+{
+    ((void) f_rng);
+    ((void) p_rng);
 
-            ssl_extract_add_data_from_record(add_data, &add_data_len,
-                                             rec, transform->tls_version,
-                                             transform->taglen);
-
-            MBEDTLS_SSL_DEBUG_MSG(3, ("using encrypt then mac"));
-            MBEDTLS_SSL_DEBUG_BUF(4, "MAC'd meta-data", add_data,
-                                  add_data_len);
-            status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
-                                        transform->psa_mac_alg);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+    return ssl_record_aead_encrypt(ssl, transform, rec, 0);
+}
 
-            status = psa_mac_update(&operation, add_data, add_data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_unprotect_record_aead(mbedtls_ssl_context const *ssl,
+                                     mbedtls_ssl_transform *transform,
+                                     mbedtls_record *rec)
+{
+    return ssl_record_aead_decrypt(ssl, transform, rec, 0);
+}
 
-            status = psa_mac_update(&operation, data, rec->data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+/* TLS 1.2 AEAD with an explicit nonce in the record (GCM and CCM) */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_protect_record_aead_explicit_iv(mbedtls_ssl_context *ssl,
+                                               mbedtls_ssl_transform *transform,
+                                               mbedtls_record *rec,
+                                               int (*f_rng)(void *, unsigned char *, size_t),
+                                               void *p_rng)
+{
+    ((void) f_rng);
+    ((void) p_rng);
 
-            status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
-                                         &sign_mac_length);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+    return ssl_record_aead_encrypt(ssl, transform, rec, 1);
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_unprotect_record_aead_explicit_iv(mbedtls_ssl_context const *ssl,
+                                                 mbedtls_ssl_transform *transform,
+                                                 mbedtls_record *rec)
+{
+    return ssl_record_aead_decrypt(ssl, transform, rec, 1);
+}
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+#endif /* MBEDTLS_SSL_HAVE_AEAD */
+
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC)
+/*
+ * Pad the record content, encrypt it and prepend the IV.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_cbc_encrypt(mbedtls_ssl_context *ssl,
+                                  mbedtls_ssl_transform *transform,
+                                  mbedtls_record *rec,
+                                  int (*f_rng)(void *, unsigned char *, size_t),
+                                  void *p_rng)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    size_t post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
+    size_t padlen, i;
+    size_t olen;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    size_t part_len;
+    psa_cipher_operation_t cipher_op = PSA_CIPHER_OPERATION_INIT;
 
-            memcpy(data + rec->data_len, mac, transform->maclen);
+    ((void) ssl);
 
-            rec->data_len += transform->maclen;
-            post_avail -= transform->maclen;
-            auth_done++;
+    /* Currently we're always using minimal padding
+     * (up to 255 bytes would be allowed). */
+    padlen = transform->ivlen - (rec->data_len + 1) % transform->ivlen;
+    if (padlen == transform->ivlen) {
+        padlen = 0;
+    }
 
-hmac_failed_etm_enabled:
-            mbedtls_platform_zeroize(mac, transform->maclen);
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            status = psa_mac_abort(&operation);
-            if (ret == 0 && status != PSA_SUCCESS) {
-                ret = PSA_TO_MBEDTLS_ERR(status);
-            }
-            if (ret != 0) {
-                MBEDTLS_SSL_DEBUG_RET(1, "HMAC calculation failed", ret);
-                return ret;
-            }
-        }
-#endif /* MBEDTLS_SSL_ENCRYPT_THEN_MAC */
-    } else
-#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC) */
-    {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+    /* Check there's enough space in the buffer for the padding. */
+    if (post_avail < padlen + 1) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    for (i = 0; i <= padlen; i++) {
+        data[rec->data_len + i] = (unsigned char) padlen;
+    }
+
+    rec->data_len += padlen + 1;
+
+    /*
+     * Prepend per-record IV for block cipher in TLS v1.2 as per
+     * Method 1 (6.2.3.2. in RFC4346 and RFC5246)
+     */
+    if (f_rng == NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("No PRNG provided to encrypt_record routine"));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    /* Make extra sure authentication was performed, exactly once */
-    if (auth_done != 1) {
+    if (rec->data_offset < transform->ivlen) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Buffer provided for encrypted record not large enough"));
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    /*
+     * Generate IV
+     */
+    ret = f_rng(p_rng, transform->iv_enc, transform->ivlen);
+    if (ret != 0) {
+        return ret;
+    }
+
+    memcpy(data - transform->ivlen, transform->iv_enc, transform->ivlen);
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("before encrypt: msglen = %" MBEDTLS_PRINTF_SIZET ", "
+                                                                                "including %"
+                              MBEDTLS_PRINTF_SIZET
+                              " bytes of IV and %" MBEDTLS_PRINTF_SIZET " bytes of padding",
+                              rec->data_len, transform->ivlen,
+                              padlen + 1));
+
+    status = psa_cipher_encrypt_setup(&cipher_op,
+                                      transform->psa_key_enc, transform->psa_alg);
+
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_encrypt_setup", ret);
+        return ret;
+    }
+
+    status = psa_cipher_set_iv(&cipher_op, transform->iv_enc, transform->ivlen);
+
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_set_iv", ret);
+        return ret;
+
+    }
+
+    status = psa_cipher_update(&cipher_op,
+                               data, rec->data_len,
+                               data, rec->data_len, &olen);
+
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_update", ret);
+        return ret;
+
+    }
+
+    status = psa_cipher_finish(&cipher_op,
+                               data + olen, rec->data_len - olen,
+                               &part_len);
+
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_finish", ret);
+        return ret;
+
+    }
+
+    olen += part_len;
+
+    if (rec->data_len != olen) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= encrypt buf"));
+    rec->data_offset -= transform->ivlen;
+    rec->data_len    += transform->ivlen;
 
     return 0;
 }
 
-int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
-                            mbedtls_ssl_transform *transform,
-                            mbedtls_record *rec)
+/*
+ * Check the minimal length of a CBC record, before anything else is done
+ * with it.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_cbc_check_len(mbedtls_ssl_context const *ssl,
+                                    mbedtls_ssl_transform *transform,
+                                    mbedtls_record *rec)
 {
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC) || defined(MBEDTLS_SSL_HAVE_AEAD)
-    size_t olen;
-#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC || MBEDTLS_SSL_HAVE_AEAD */
-    mbedtls_ssl_mode_t ssl_mode;
-    int ret;
+    /* The ciphertext is prefixed with the CBC IV. */
+    size_t minlen = transform->ivlen;
 
-    int auth_done = 0;
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
-    size_t padlen = 0;
-    mbedtls_ct_condition_t correct = MBEDTLS_CT_TRUE;
-#endif
-    unsigned char *data;
-    /* For an explanation of the additional data length see
-     * the description of ssl_extract_add_data_from_record().
+    ((void) ssl);
+
+    /* Size considerations:
+     *
+     * - The CBC cipher text must not be empty and hence
+     *   at least of size transform->ivlen.
+     *
+     * Together with the potential IV-prefix, this explains
+     * the first of the two checks below.
+     *
+     * - The record must contain a MAC, either in plain or
+     *   encrypted, depending on whether Encrypt-then-MAC
+     *   is used or not.
+     *   - If it is, the message contains the IV-prefix,
+     *     the CBC ciphertext, and the MAC.
+     *   - If it is not, the padded plaintext, and hence
+     *     the CBC ciphertext, has at least length maclen + 1
+     *     because there is at least the padding length byte.
+     *
+     * As the CBC ciphertext is not empty, both cases give the
+     * lower bound minlen + maclen + 1 on the record size, which
+     * we test for in the second check below.
      */
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    unsigned char add_data[23 + MBEDTLS_SSL_CID_IN_LEN_MAX];
-#else
-    unsigned char add_data[13];
-#endif
-    size_t add_data_len;
+    if (rec->data_len < minlen + transform->ivlen ||
+        rec->data_len < minlen + transform->maclen + 1) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
+                                  ") < max( ivlen(%" MBEDTLS_PRINTF_SIZET
+                                  "), maclen (%" MBEDTLS_PRINTF_SIZET ") "
+                                                                      "+ 1 ) ( + expl IV )",
+                                  rec->data_len,
+                                  transform->ivlen,
+                                  transform->maclen));
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
+
+    return 0;
+}
+
+/*
+ * Decrypt a CBC record and remove the padding, in constant time.
+ *
+ * On success, *padlen is the number of bytes that were removed, and
+ * *correct is cleared if the padding is invalid. The padding must leave
+ * room for transform->maclen bytes, including with Encrypt-then-MAC where
+ * the MAC has already been removed.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_cbc_decrypt(mbedtls_ssl_context const *ssl,
+                                  mbedtls_ssl_transform *transform,
+                                  mbedtls_record *rec,
+                                  size_t *padlen_out,
+                                  mbedtls_ct_condition_t *correct)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    size_t padlen;
+    size_t olen;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    size_t part_len;
+    psa_cipher_operation_t cipher_op = PSA_CIPHER_OPERATION_INIT;
 
-#if !defined(MBEDTLS_DEBUG_C)
-    ssl = NULL; /* make sure we don't use it except for debug */
     ((void) ssl);
-#endif
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> decrypt buf"));
-    if (rec == NULL                     ||
-        rec->buf == NULL                ||
-        rec->buf_len < rec->data_offset ||
-        rec->buf_len - rec->data_offset < rec->data_len) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("bad record structure provided to decrypt_buf"));
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-    }
+    /*
+     * Check length sanity
+     */
 
-    data = rec->buf + rec->data_offset;
-    ssl_mode = mbedtls_ssl_get_mode_from_transform(transform);
+    /* We know from ssl_record_cbc_check_len() that data_len > minlen >= 0,
+     * so the following check in particular implies that
+     * data_len >= minlen + ivlen ( = minlen or 2 * minlen ). */
+    if (rec->data_len % transform->ivlen != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
+                                  ") %% ivlen (%" MBEDTLS_PRINTF_SIZET ") != 0",
+                                  rec->data_len, transform->ivlen));
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
 
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     /*
-     * Match record's CID with incoming CID.
+     * Initialize for prepended IV for block cipher in TLS v1.2
      */
-    if (rec->cid_len != transform->in_cid_len ||
-        memcmp(rec->cid, transform->in_cid, rec->cid_len) != 0) {
-        return MBEDTLS_ERR_SSL_UNEXPECTED_CID;
+    /* Safe because data_len >= minlen + ivlen = 2 * ivlen. */
+    memcpy(transform->iv_dec, data, transform->ivlen);
+
+    data += transform->ivlen;
+    rec->data_offset += transform->ivlen;
+    rec->data_len -= transform->ivlen;
+
+    /* We still have data_len % ivlen == 0 and data_len >= ivlen here. */
+
+    status = psa_cipher_decrypt_setup(&cipher_op,
+                                      transform->psa_key_dec, transform->psa_alg);
+
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_decrypt_setup", ret);
+        return ret;
     }
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_STREAM)
-    if (ssl_mode == MBEDTLS_SSL_MODE_STREAM) {
-        if (rec->data_len < transform->maclen) {
-            MBEDTLS_SSL_DEBUG_MSG(1,
-                                  ("Record too short for MAC:"
-                                   " %" MBEDTLS_PRINTF_SIZET " < %" MBEDTLS_PRINTF_SIZET,
-                                   rec->data_len, transform->maclen));
-            return MBEDTLS_ERR_SSL_INVALID_MAC;
-        }
+    status = psa_cipher_set_iv(&cipher_op, transform->iv_dec, transform->ivlen);
 
-        /* The only supported stream cipher is "NULL",
-         * so there's no encryption to do here.*/
-    } else
-#endif /* MBEDTLS_SSL_SOME_SUITES_USE_STREAM */
-#if defined(MBEDTLS_SSL_HAVE_AEAD)
-    if (ssl_mode == MBEDTLS_SSL_MODE_AEAD) {
-        unsigned char iv[12];
-        unsigned char *dynamic_iv;
-        size_t dynamic_iv_len;
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_set_iv", ret);
+        return ret;
+    }
 
-        /*
-         * Extract dynamic part of nonce for AEAD decryption.
-         *
-         * Note: In the case of CCM and GCM in TLS 1.2, the dynamic
-         *       part of the IV is prepended to the ciphertext and
-         *       can be chosen freely - in particular, it need not
-         *       agree with the record sequence number.
-         */
-        dynamic_iv_len = sizeof(rec->ctr);
-        if (ssl_transform_aead_dynamic_iv_is_explicit(transform) == 1) {
-            if (rec->data_len < dynamic_iv_len) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
-                                          " ) < explicit_iv_len (%" MBEDTLS_PRINTF_SIZET ") ",
-                                          rec->data_len,
-                                          dynamic_iv_len));
-                return MBEDTLS_ERR_SSL_INVALID_MAC;
-            }
-            dynamic_iv = data;
+    status = psa_cipher_update(&cipher_op,
+                               data, rec->data_len,
+                               data, rec->data_len, &olen);
 
-            data += dynamic_iv_len;
-            rec->data_offset += dynamic_iv_len;
-            rec->data_len    -= dynamic_iv_len;
-        } else {
-            dynamic_iv = rec->ctr;
-        }
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_update", ret);
+        return ret;
+    }
 
-        /* Check that there's space for the authentication tag. */
-        if (rec->data_len < transform->taglen) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
-                                      ") < taglen (%" MBEDTLS_PRINTF_SIZET ") ",
-                                      rec->data_len,
-                                      transform->taglen));
-            return MBEDTLS_ERR_SSL_INVALID_MAC;
-        }
-        rec->data_len -= transform->taglen;
+    status = psa_cipher_finish(&cipher_op,
+                               data + olen, rec->data_len - olen,
+                               &part_len);
 
-        /*
-         * Prepare nonce from dynamic and static parts.
-         */
-        ssl_build_record_nonce(iv, sizeof(iv),
-                               transform->iv_dec,
-                               transform->fixed_ivlen,
-                               dynamic_iv,
-                               dynamic_iv_len);
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_finish", ret);
+        return ret;
+    }
 
-        /*
-         * Build additional data for AEAD encryption.
-         * This depends on the TLS version.
-         */
-        ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                         transform->tls_version,
-                                         transform->taglen);
-        MBEDTLS_SSL_DEBUG_BUF(4, "additional data used for AEAD",
-                              add_data, add_data_len);
-
-        /* Because of the check above, we know that there are
-         * explicit_iv_len Bytes preceding data, and taglen
-         * bytes following data + data_len. This justifies
-         * the debug message and the invocation of
-         * mbedtls_cipher_auth_decrypt_ext() below. */
-
-        MBEDTLS_SSL_DEBUG_BUF(4, "IV used", iv, transform->ivlen);
-        MBEDTLS_SSL_DEBUG_BUF(4, "TAG used", data + rec->data_len,
-                              transform->taglen);
+    olen += part_len;
 
-        /*
-         * Decrypt and authenticate
+    /* Double-check that length hasn't changed during decryption. */
+    if (rec->data_len != olen) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    /* Safe since data_len >= minlen + maclen + 1, so after having
+     * subtracted at most minlen and maclen up to this point,
+     * data_len > 0 (because of data_len % ivlen == 0, it's actually
+     * >= ivlen ). */
+    padlen = data[rec->data_len - 1];
+
+#if defined(MBEDTLS_SSL_DEBUG_ALL)
+    if (rec->data_len < transform->maclen + padlen + 1) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
+                                  ") < maclen (%" MBEDTLS_PRINTF_SIZET
+                                  ") + padlen (%" MBEDTLS_PRINTF_SIZET ")",
+                                  rec->data_len,
+                                  transform->maclen,
+                                  padlen + 1));
+    }
+#endif
+    const mbedtls_ct_condition_t ge = mbedtls_ct_uint_ge(
+        rec->data_len,
+        transform->maclen + padlen + 1);
+    *correct = mbedtls_ct_bool_and(ge, *correct);
+    padlen  = mbedtls_ct_size_if_else_0(ge, padlen);
+
+    padlen++;
+
+    /* Regardless of the validity of the padding,
+     * we have data_len >= padlen here. */
+
+    /* The padding check involves a series of up to 256
+     * consecutive memory reads at the end of the record
+     * plaintext buffer. In order to hide the length and
+     * validity of the padding, always perform exactly
+     * `min(256,plaintext_len)` reads (but take into account
+     * only the last `padlen` bytes for the padding check). */
+    size_t pad_count = 0;
+    volatile unsigned char * const check = data;
+
+    /* Index of first padding byte; it has been ensured above
+     * that the subtraction is safe. */
+    size_t const padding_idx = rec->data_len - padlen;
+    size_t const num_checks = rec->data_len <= 256 ? rec->data_len : 256;
+    size_t const start_idx = rec->data_len - num_checks;
+    size_t idx;
+
+    for (idx = start_idx; idx < rec->data_len; idx++) {
+        /* pad_count += (idx >= padding_idx) &&
+         *              (check[idx] == padlen - 1);
          */
-        status = psa_aead_decrypt(transform->psa_key_dec,
-                                  transform->psa_alg,
-                                  iv, transform->ivlen,
-                                  add_data, add_data_len,
-                                  data, rec->data_len + transform->taglen,
-                                  data, rec->buf_len - (data - rec->buf),
-                                  &olen);
-
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_aead_decrypt", ret);
-            return ret;
-        }
+        const mbedtls_ct_condition_t a = mbedtls_ct_uint_ge(idx, padding_idx);
+        size_t increment = mbedtls_ct_size_if_else_0(a, 1);
+        const mbedtls_ct_condition_t b = mbedtls_ct_uint_eq(check[idx], padlen - 1);
+        increment = mbedtls_ct_size_if_else_0(b, increment);
+        pad_count += increment;
+    }
+    *correct = mbedtls_ct_bool_and(mbedtls_ct_uint_eq(pad_count, padlen), *correct);
 
-        auth_done++;
+#if defined(MBEDTLS_SSL_DEBUG_ALL)
+    if (padlen > 0 && *correct == MBEDTLS_CT_FALSE) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad padding byte detected"));
+    }
+#endif
+    padlen = mbedtls_ct_size_if_else_0(*correct, padlen);
 
-        /* Double-check that AEAD decryption doesn't change content length. */
-        if (olen != rec->data_len) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-        }
-    } else
-#endif /* MBEDTLS_SSL_HAVE_AEAD */
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC)
-    if (ssl_mode == MBEDTLS_SSL_MODE_CBC ||
-        ssl_mode == MBEDTLS_SSL_MODE_CBC_ETM) {
-        size_t minlen = 0;
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-        size_t part_len;
-        psa_cipher_operation_t cipher_op = PSA_CIPHER_OPERATION_INIT;
+    /* If the padding was found to be invalid, padlen == 0
+     * and the subtraction is safe. If the padding was found valid,
+     * padlen hasn't been changed and the previous assertion
+     * data_len >= padlen still holds. */
+    rec->data_len -= padlen;
+    *padlen_out = padlen;
 
-        /*
-         * Check immediate ciphertext sanity
-         */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        /* The ciphertext is prefixed with the CBC IV. */
-        minlen += transform->ivlen;
+#if defined(MBEDTLS_SSL_DEBUG_ALL)
+    MBEDTLS_SSL_DEBUG_BUF(4, "raw buffer after decryption",
+                          data, rec->data_len);
 #endif
 
-        /* Size considerations:
-         *
-         * - The CBC cipher text must not be empty and hence
-         *   at least of size transform->ivlen.
-         *
-         * Together with the potential IV-prefix, this explains
-         * the first of the two checks below.
-         *
-         * - The record must contain a MAC, either in plain or
-         *   encrypted, depending on whether Encrypt-then-MAC
-         *   is used or not.
-         *   - If it is, the message contains the IV-prefix,
-         *     the CBC ciphertext, and the MAC.
-         *   - If it is not, the padded plaintext, and hence
-         *     the CBC ciphertext, has at least length maclen + 1
-         *     because there is at least the padding length byte.
-         *
-         * As the CBC ciphertext is not empty, both cases give the
-         * lower bound minlen + maclen + 1 on the record size, which
-         * we test for in the second check below.
-         */
-        if (rec->data_len < minlen + transform->ivlen ||
-            rec->data_len < minlen + transform->maclen + 1) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
-                                      ") < max( ivlen(%" MBEDTLS_PRINTF_SIZET
-                                      "), maclen (%" MBEDTLS_PRINTF_SIZET ") "
-                                                                          "+ 1 ) ( + expl IV )",
-                                      rec->data_len,
-                                      transform->ivlen,
-                                      transform->maclen));
-            return MBEDTLS_ERR_SSL_INVALID_MAC;
-        }
+    return 0;
+}
 
-        /*
-         * Authenticate before decrypt if enabled
-         */
-#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
-        if (ssl_mode == MBEDTLS_SSL_MODE_CBC_ETM) {
-            psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
+/* CBC with MAC-then-Encrypt */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_protect_record_cbc(mbedtls_ssl_context *ssl,
+                                  mbedtls_ssl_transform *transform,
+                                  mbedtls_record *rec,
+                                  int (*f_rng)(void *, unsigned char *, size_t),
+                                  void *p_rng)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-            MBEDTLS_SSL_DEBUG_MSG(3, ("using encrypt then mac"));
+    ret = ssl_record_append_mac(ssl, transform, rec);
+    if (ret != 0) {
+        return ret;
+    }
 
-            /* Update data_len in tandem with add_data.
-             *
-             * The subtraction is safe because of the previous check
-             * data_len >= minlen + maclen + 1.
-             *
-             * Afterwards, we know that data + data_len is followed by at
-             * least maclen Bytes, which justifies the call to
-             * mbedtls_ct_memcmp() below.
-             *
-             * Further, we still know that data_len > minlen */
-            rec->data_len -= transform->maclen;
-            ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                             transform->tls_version,
-                                             transform->taglen);
-
-            /* Calculate expected MAC. */
-            MBEDTLS_SSL_DEBUG_BUF(4, "MAC'd meta-data", add_data,
-                                  add_data_len);
-            status = psa_mac_verify_setup(&operation, transform->psa_mac_dec,
-                                          transform->psa_mac_alg);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+    return ssl_record_cbc_encrypt(ssl, transform, rec, f_rng, p_rng);
+}
 
-            status = psa_mac_update(&operation, add_data, add_data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_unprotect_record_cbc(mbedtls_ssl_context const *ssl,
+                                    mbedtls_ssl_transform *transform,
+                                    mbedtls_record *rec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ct_condition_t correct = MBEDTLS_CT_TRUE;
+    size_t padlen = 0;
 
-            status = psa_mac_update(&operation, data, rec->data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+    ret = ssl_record_cbc_check_len(ssl, transform, rec);
+    if (ret != 0) {
+        return ret;
+    }
 
-            /* Compare expected MAC with MAC at the end of the record. */
-            status = psa_mac_verify_finish(&operation, data + rec->data_len,
-                                           transform->maclen);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
-            auth_done++;
+    ret = ssl_record_cbc_decrypt(ssl, transform, rec, &padlen, &correct);
+    if (ret != 0) {
+        return ret;
+    }
 
-hmac_failed_etm_enabled:
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            status = psa_mac_abort(&operation);
-            if (ret == 0 && status != PSA_SUCCESS) {
-                ret = PSA_TO_MBEDTLS_ERR(status);
-            }
-            if (ret != 0) {
-                if (ret != MBEDTLS_ERR_SSL_INVALID_MAC) {
-                    MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_hmac_xxx", ret);
-                }
-                return ret;
-            }
-        }
-#endif /* MBEDTLS_SSL_ENCRYPT_THEN_MAC */
+    /*
+     * Authenticate.
+     * Compute the MAC regardless of the padding result (RFC4346, CBCTIME).
+     */
+    ret = ssl_record_verify_mac_ct(ssl, transform, rec, padlen, &correct);
+    if (ret != 0) {
+        return ret;
+    }
 
-        /*
-         * Check length sanity
-         */
+    if (correct == MBEDTLS_CT_FALSE) {
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
 
-        /* We know from above that data_len > minlen >= 0,
-         * so the following check in particular implies that
-         * data_len >= minlen + ivlen ( = minlen or 2 * minlen ). */
-        if (rec->data_len % transform->ivlen != 0) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
-                                      ") %% ivlen (%" MBEDTLS_PRINTF_SIZET ") != 0",
-                                      rec->data_len, transform->ivlen));
-            return MBEDTLS_ERR_SSL_INVALID_MAC;
-        }
+    return 0;
+}
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        /*
-         * Initialize for prepended IV for block cipher in TLS v1.2
-         */
-        /* Safe because data_len >= minlen + ivlen = 2 * ivlen. */
-        memcpy(transform->iv_dec, data, transform->ivlen);
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM)
+/* CBC with Encrypt-then-MAC */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_protect_record_cbc_etm(mbedtls_ssl_context *ssl,
+                                      mbedtls_ssl_transform *transform,
+                                      mbedtls_record *rec,
+                                      int (*f_rng)(void *, unsigned char *, size_t),
+                                      void *p_rng)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        data += transform->ivlen;
-        rec->data_offset += transform->ivlen;
-        rec->data_len -= transform->ivlen;
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    ret = ssl_record_cbc_encrypt(ssl, transform, rec, f_rng, p_rng);
+    if (ret != 0) {
+        return ret;
+    }
 
-        /* We still have data_len % ivlen == 0 and data_len >= ivlen here. */
+    /* MAC(MAC_write_key, add_data, IV, ENC(content + padding + padding_length))
+     */
+    MBEDTLS_SSL_DEBUG_MSG(3, ("using encrypt then mac"));
 
-        status = psa_cipher_decrypt_setup(&cipher_op,
-                                          transform->psa_key_dec, transform->psa_alg);
+    return ssl_record_append_mac(ssl, transform, rec);
+}
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_decrypt_setup", ret);
-            return ret;
-        }
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_unprotect_record_cbc_etm(mbedtls_ssl_context const *ssl,
+                                        mbedtls_ssl_transform *transform,
+                                        mbedtls_record *rec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *data = rec->buf + rec->data_offset;
+    unsigned char add_data[SSL_RECORD_ADD_DATA_MAX_LEN];
+    size_t add_data_len;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
+    mbedtls_ct_condition_t correct = MBEDTLS_CT_TRUE;
+    size_t padlen = 0;
 
-        status = psa_cipher_set_iv(&cipher_op, transform->iv_dec, transform->ivlen);
+    ret = ssl_record_cbc_check_len(ssl, transform, rec);
+    if (ret != 0) {
+        return ret;
+    }
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_set_iv", ret);
-            return ret;
-        }
+    /*
+     * Authenticate before decrypt
+     */
+    MBEDTLS_SSL_DEBUG_MSG(3, ("using encrypt then mac"));
 
-        status = psa_cipher_update(&cipher_op,
-                                   data, rec->data_len,
-                                   data, rec->data_len, &olen);
+    /* Update data_len in tandem with add_data.
+     *
+     * The subtraction is safe because of the previous check
+     * data_len >= minlen + maclen + 1.
+     *
+     * Afterwards, we know that data + data_len is followed by at
+     * least maclen Bytes, which justifies the MAC verification below.
+     *
+     * Further, we still know that data_len > minlen */
+    rec->data_len -= transform->maclen;
+    ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                     transform->tls_version,
+                                     transform->taglen);
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_update", ret);
-            return ret;
-        }
+    /* Calculate expected MAC. */
+    MBEDTLS_SSL_DEBUG_BUF(4, "MAC'd meta-data", add_data,
+                          add_data_len);
+    status = psa_mac_verify_setup(&operation, transform->psa_mac_dec,
+                                  transform->psa_mac_alg);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
+    }
 
-        status = psa_cipher_finish(&cipher_op,
-                                   data + olen, rec->data_len - olen,
-                                   &part_len);
+    status = psa_mac_update(&operation, add_data, add_data_len);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
+    }
 
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_cipher_finish", ret);
-            return ret;
-        }
+    status = psa_mac_update(&operation, data, rec->data_len);
+    if (status != PSA_SUCCESS) {
+        goto hmac_failed;
+    }
 
-        olen += part_len;
+    /* Compare expected MAC with MAC at the end of the record. */
+    status = psa_mac_verify_finish(&operation, data + rec->data_len,
+                                   transform->maclen);
 
-        /* Double-check that length hasn't changed during decryption. */
-        if (rec->data_len != olen) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+hmac_failed:
+    ret = PSA_TO_MBEDTLS_ERR(status);
+    status = psa_mac_abort(&operation);
+    if (ret == 0 && status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+    }
+    if (ret != 0) {
+        if (ret != MBEDTLS_ERR_SSL_INVALID_MAC) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_hmac_xxx", ret);
         }
+        return ret;
+    }
 
-        /* Safe since data_len >= minlen + maclen + 1, so after having
-         * subtracted at most minlen and maclen up to this point,
-         * data_len > 0 (because of data_len % ivlen == 0, it's actually
-         * >= ivlen ). */
-        padlen = data[rec->data_len - 1];
+    ret = ssl_record_cbc_decrypt(ssl, transform, rec, &padlen, &correct);
+    if (ret != 0) {
+        return ret;
+    }
 
-        if (auth_done == 1) {
-            const mbedtls_ct_condition_t ge = mbedtls_ct_uint_ge(
-                rec->data_len,
-                padlen + 1);
-            correct = mbedtls_ct_bool_and(ge, correct);
-            padlen  = mbedtls_ct_size_if_else_0(ge, padlen);
-        } else {
-#if defined(MBEDTLS_SSL_DEBUG_ALL)
-            if (rec->data_len < transform->maclen + padlen + 1) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("msglen (%" MBEDTLS_PRINTF_SIZET
-                                          ") < maclen (%" MBEDTLS_PRINTF_SIZET
-                                          ") + padlen (%" MBEDTLS_PRINTF_SIZET ")",
-                                          rec->data_len,
-                                          transform->maclen,
-                                          padlen + 1));
-            }
-#endif
-            const mbedtls_ct_condition_t ge = mbedtls_ct_uint_ge(
-                rec->data_len,
-                transform->maclen + padlen + 1);
-            correct = mbedtls_ct_bool_and(ge, correct);
-            padlen  = mbedtls_ct_size_if_else_0(ge, padlen);
-        }
+    if (correct == MBEDTLS_CT_FALSE) {
+        return MBEDTLS_ERR_SSL_INVALID_MAC;
+    }
 
-        padlen++;
+    return 0;
+}
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM */
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC */
 
-        /* Regardless of the validity of the padding,
-         * we have data_len >= padlen here. */
+void mbedtls_ssl_transform_bind_record_ops(mbedtls_ssl_transform *transform)
+{
+    mbedtls_ssl_mode_t ssl_mode = mbedtls_ssl_get_mode_from_transform(transform);
+
+    transform->protect = NULL;
+    transform->unprotect = NULL;
 
+#if defined(MBEDTLS_SSL_HAVE_AEAD)
+    if (ssl_mode == MBEDTLS_SSL_MODE_AEAD) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        if (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+            transform->protect = ssl_protect_record_tls13;
+            transform->unprotect = ssl_unprotect_record_tls13;
+            return;
+        }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        /* The padding check involves a series of up to 256
-         * consecutive memory reads at the end of the record
-         * plaintext buffer. In order to hide the length and
-         * validity of the padding, always perform exactly
-         * `min(256,plaintext_len)` reads (but take into account
-         * only the last `padlen` bytes for the padding check). */
-        size_t pad_count = 0;
-        volatile unsigned char * const check = data;
-
-        /* Index of first padding byte; it has been ensured above
-         * that the subtraction is safe. */
-        size_t const padding_idx = rec->data_len - padlen;
-        size_t const num_checks = rec->data_len <= 256 ? rec->data_len : 256;
-        size_t const start_idx = rec->data_len - num_checks;
-        size_t idx;
-
-        for (idx = start_idx; idx < rec->data_len; idx++) {
-            /* pad_count += (idx >= padding_idx) &&
-             *              (check[idx] == padlen - 1);
-             */
-            const mbedtls_ct_condition_t a = mbedtls_ct_uint_ge(idx, padding_idx);
-            size_t increment = mbedtls_ct_size_if_else_0(a, 1);
-            const mbedtls_ct_condition_t b = mbedtls_ct_uint_eq(check[idx], padlen - 1);
-            increment = mbedtls_ct_size_if_else_0(b, increment);
-            pad_count += increment;
+        if (ssl_transform_aead_dynamic_iv_is_explicit(transform) != 0) {
+            transform->protect = ssl_protect_record_aead_explicit_iv;
+            transform->unprotect = ssl_unprotect_record_aead_explicit_iv;
+        } else {
+            transform->protect = ssl_protect_record_aead;
+            transform->unprotect = ssl_unprotect_record_aead;
         }
-        correct = mbedtls_ct_bool_and(mbedtls_ct_uint_eq(pad_count, padlen), correct);
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+        return;
+    }
+#endif /* MBEDTLS_SSL_HAVE_AEAD */
 
-#if defined(MBEDTLS_SSL_DEBUG_ALL)
-        if (padlen > 0 && correct == MBEDTLS_CT_FALSE) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("bad padding byte detected"));
-        }
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM)
+    if (ssl_mode == MBEDTLS_SSL_MODE_CBC_ETM) {
+        transform->protect = ssl_protect_record_cbc_etm;
+        transform->unprotect = ssl_unprotect_record_cbc_etm;
+        return;
+    }
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM */
+
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC)
+    if (ssl_mode == MBEDTLS_SSL_MODE_CBC) {
+        transform->protect = ssl_protect_record_cbc;
+        transform->unprotect = ssl_unprotect_record_cbc;
+        return;
+    }
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC */
+
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_STREAM)
+    if (ssl_mode == MBEDTLS_SSL_MODE_STREAM) {
+        transform->protect = ssl_protect_record_null;
+        transform->unprotect = ssl_unprotect_record_null;
+        return;
+    }
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_STREAM */
+
+    ((void) ssl_mode);
+}
+
+int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
+                            mbedtls_ssl_transform *transform,
+                            mbedtls_record *rec,
+                            int (*f_rng)(void *, unsigned char *, size_t),
+                            void *p_rng)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    /* The SSL context is only used for debugging purposes! */
+#if !defined(MBEDTLS_DEBUG_C)
+    ssl = NULL; /* make sure we don't use it except for debug */
+    ((void) ssl);
 #endif
-        padlen = mbedtls_ct_size_if_else_0(correct, padlen);
 
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> encrypt buf"));
 
-        /* If the padding was found to be invalid, padlen == 0
-         * and the subtraction is safe. If the padding was found valid,
-         * padlen hasn't been changed and the previous assertion
-         * data_len >= padlen still holds. */
-        rec->data_len -= padlen;
-    } else
-#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC */
-    {
+    if (transform == NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("no transform provided to encrypt_buf"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    if (transform->protect == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
-
-#if defined(MBEDTLS_SSL_DEBUG_ALL)
-    MBEDTLS_SSL_DEBUG_BUF(4, "raw buffer after decryption",
-                          data, rec->data_len);
+    if (rec == NULL
+        || rec->buf == NULL
+        || rec->buf_len < rec->data_offset
+        || rec->buf_len - rec->data_offset < rec->data_len
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        || rec->cid_len != 0
 #endif
+        ) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad record structure provided to encrypt_buf"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    MBEDTLS_SSL_DEBUG_BUF(4, "before encrypt: output payload",
+                          rec->buf + rec->data_offset, rec->data_len);
+
+    if (rec->data_len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Record content %" MBEDTLS_PRINTF_SIZET
+                                  " too large, maximum %" MBEDTLS_PRINTF_SIZET,
+                                  rec->data_len,
+                                  (size_t) MBEDTLS_SSL_OUT_CONTENT_LEN));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
 
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     /*
-     * Authenticate if not done yet.
-     * Compute the MAC regardless of the padding result (RFC4346, CBCTIME).
+     * Add CID information
      */
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
-    if (auth_done == 0) {
-        unsigned char mac_expect[MBEDTLS_SSL_MAC_ADD] = { 0 };
-        unsigned char mac_peer[MBEDTLS_SSL_MAC_ADD] = { 0 };
-
-        /* For CBC+MAC, If the initial value of padlen was such that
-         * data_len < maclen + padlen + 1, then padlen
-         * got reset to 1, and the initial check
-         * data_len >= minlen + maclen + 1
-         * guarantees that at this point we still
-         * have at least data_len >= maclen.
-         *
-         * If the initial value of padlen was such that
-         * data_len >= maclen + padlen + 1, then we have
-         * subtracted either padlen + 1 (if the padding was correct)
-         * or 0 (if the padding was incorrect) since then,
-         * hence data_len >= maclen in any case.
-         *
-         * For stream ciphers, we checked above that
-         * data_len >= maclen.
-         */
-        rec->data_len -= transform->maclen;
-        ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                         transform->tls_version,
-                                         transform->taglen);
+    rec->cid_len = transform->out_cid_len;
+    memcpy(rec->cid, transform->out_cid, transform->out_cid_len);
+    MBEDTLS_SSL_DEBUG_BUF(3, "CID", rec->cid, rec->cid_len);
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (rec->cid_len != 0) {
+        size_t padding =
+            ssl_compute_padding_length(rec->data_len,
+                                       MBEDTLS_SSL_CID_TLS1_3_PADDING_GRANULARITY);
         /*
-         * The next two sizes are the minimum and maximum values of
-         * data_len over all padlen values.
-         *
-         * They're independent of padlen, since we previously did
-         * data_len -= padlen.
+         * Wrap plaintext into DTLSInnerPlaintext structure.
+         * See ssl_build_inner_plaintext() for more information.
          *
-         * Note that max_len + maclen is never more than the buffer
-         * length, as we previously did in_msglen -= maclen too.
+         * The TLSInnerPlaintext structure of TLS 1.3 is built by the
+         * TLS 1.3 protect function; the two cannot occur simultaneously
+         * since they apply to different versions of the protocol.
          */
-        const size_t max_len = rec->data_len + padlen;
-        const size_t min_len = (max_len > 256) ? max_len - 256 : 0;
-
-        ret = mbedtls_ct_hmac(transform->psa_mac_dec,
-                              transform->psa_mac_alg,
-                              add_data, add_data_len,
-                              data, rec->data_len, min_len, max_len,
-                              mac_expect);
-        if (ret != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ct_hmac", ret);
-            goto hmac_failed_etm_disabled;
+        if (ssl_build_inner_plaintext(rec->buf + rec->data_offset,
+                                      &rec->data_len,
+                                      rec->buf_len - (rec->data_len + rec->data_offset),
+                                      rec->type,
+                                      padding) != 0) {
+            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
         }
 
-        mbedtls_ct_memcpy_offset(mac_peer, data,
-                                 rec->data_len,
-                                 min_len, max_len,
-                                 transform->maclen);
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+        rec->type = MBEDTLS_SSL_MSG_CID;
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-#if defined(MBEDTLS_SSL_DEBUG_ALL)
-        MBEDTLS_SSL_DEBUG_BUF(4, "expected mac", mac_expect, transform->maclen);
-        MBEDTLS_SSL_DEBUG_BUF(4, "message  mac", mac_peer, transform->maclen);
-#endif
+    ret = transform->protect(ssl, transform, rec, f_rng, p_rng);
+    if (ret != 0) {
+        return ret;
+    }
 
-        if (mbedtls_ct_memcmp(mac_peer, mac_expect,
-                              transform->maclen) != 0) {
-#if defined(MBEDTLS_SSL_DEBUG_ALL)
-            MBEDTLS_SSL_DEBUG_MSG(1, ("message mac does not match"));
-#endif
-            correct = MBEDTLS_CT_FALSE;
-        }
-        auth_done++;
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= encrypt buf"));
 
-hmac_failed_etm_disabled:
-        mbedtls_platform_zeroize(mac_peer, transform->maclen);
-        mbedtls_platform_zeroize(mac_expect, transform->maclen);
-        if (ret != 0) {
-            return ret;
-        }
-    }
+    return 0;
+}
 
-    /*
-     * Finally check the correct flag
-     */
-    if (correct == MBEDTLS_CT_FALSE) {
-        return MBEDTLS_ERR_SSL_INVALID_MAC;
+int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
+                            mbedtls_ssl_transform *transform,
+                            mbedtls_record *rec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+#if !defined(MBEDTLS_DEBUG_C)
+    ssl = NULL; /* make sure we don't use it except for debug */
+    ((void) ssl);
+#endif
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> decrypt buf"));
+    if (rec == NULL                     ||
+        rec->buf == NULL                ||
+        rec->buf_len < rec->data_offset ||
+        rec->buf_len - rec->data_offset < rec->data_len) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad record structure provided to decrypt_buf"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
-#endif /* MBEDTLS_SSL_SOME_SUITES_USE_MAC */
 
-    /* Make extra sure authentication was performed, exactly once */
-    if (auth_done != 1) {
+    if (transform->unprotect == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-    if (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
-        /* Remove inner padding and infer true content type. */
-        ret = ssl_parse_inner_plaintext(data, &rec->data_len,
-                                        &rec->type);
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    /*
+     * Match record's CID with incoming CID.
+     */
+    if (rec->cid_len != transform->in_cid_len ||
+        memcmp(rec->cid, transform->in_cid, rec->cid_len) != 0) {
+        return MBEDTLS_ERR_SSL_UNEXPECTED_CID;
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-        if (ret != 0) {
-            return MBEDTLS_ERR_SSL_INVALID_RECORD;
-        }
+    ret = transform->unprotect(ssl, transform, rec);
+    if (ret != 0) {
+        return ret;
     }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     if (rec->cid_len != 0) {
-        ret = ssl_parse_inner_plaintext(data, &rec->data_len,
+        ret = ssl_parse_inner_plaintext(rec->buf + rec->data_offset,
+                                        &rec->data_len,
                                         &rec->type);
         if (ret != 0) {
             return MBEDTLS_ERR_SSL_INVALID_RECORD;
@@ -1865,6 +2177,8 @@ hmac_failed_etm_disabled:
     return 0;
 }
 
+#undef SSL_RECORD_ADD_DATA_MAX_LEN
+
 #undef MAC_NONE
 #undef MAC_PLAINTEXT
 #undef MAC_CIPHERTEXT
@@ -1877,13 +2191,45 @@ hmac_failed_etm_disabled:
  * available (from this read and/or a previous one). Otherwise, an error code
  * is returned (possibly EOF or WANT_READ).
  *
- * With stream transport (TLS) on success ssl->in_left == nb_want, but
- * with datagram transport (DTLS) on success ssl->in_left >= nb_want,
- * since we always read a whole datagram at once.
+ * With stream transport (TLS) on success ssl->in_left == nb_want, unless
+ * read-ahead is enabled, but with datagram transport (DTLS) on success
+ * ssl->in_left >= nb_want, since we always read a whole datagram at once.
  *
- * For DTLS, it is up to the caller to set ssl->next_record_offset when
- * they're done reading a record.
+ * For DTLS and for TLS with read-ahead, it is up to the caller to set
+ * ssl->next_record_offset when they're done reading a record.
  */
+
+/*
+ * Move to the next record in the already read data if applicable
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_move_to_next_record(mbedtls_ssl_context *ssl)
+{
+    if (ssl->next_record_offset == 0) {
+        return 0;
+    }
+
+    if (ssl->in_left < ssl->next_record_offset) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    ssl->in_left -= ssl->next_record_offset;
+
+    if (ssl->in_left != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("next record in same datagram, offset: %"
+                                  MBEDTLS_PRINTF_SIZET,
+                                  ssl->next_record_offset));
+        memmove(ssl->in_hdr,
+                ssl->in_hdr + ssl->next_record_offset,
+                ssl->in_left);
+    }
+
+    ssl->next_record_offset = 0;
+
+    return 0;
+}
+
 int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -1920,24 +2266,8 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
         /*
          * Move to the next record in the already read datagram if applicable
          */
-        if (ssl->next_record_offset != 0) {
-            if (ssl->in_left < ssl->next_record_offset) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-                return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-            }
-
-            ssl->in_left -= ssl->next_record_offset;
-
-            if (ssl->in_left != 0) {
-                MBEDTLS_SSL_DEBUG_MSG(2, ("next record in same datagram, offset: %"
-                                          MBEDTLS_PRINTF_SIZET,
-                                          ssl->next_record_offset));
-                memmove(ssl->in_hdr,
-                        ssl->in_hdr + ssl->next_record_offset,
-                        ssl->in_left);
-            }
-
-            ssl->next_record_offset = 0;
+        if ((ret = ssl_move_to_next_record(ssl)) != 0) {
+            return ret;
         }
 
         MBEDTLS_SSL_DEBUG_MSG(2, ("in_left: %" MBEDTLS_PRINTF_SIZET
@@ -1972,6 +2302,7 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
             ret = MBEDTLS_ERR_SSL_TIMEOUT;
         } else {
             len = in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf);
+            mbedtls_ssl_in_buf_dirty(ssl, ssl->in_hdr + len);
 
             if (mbedtls_ssl_is_handshake_over(ssl) == 0) {
                 timeout = ssl->handshake->retransmit_timeout;
@@ -2026,20 +2357,39 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
 #endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_RENEGOTIATION */
         }
 
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ) {
+            MBEDTLS_SSL_STATS_ADD(ssl, want_read, 1);
+        }
+
         if (ret < 0) {
             return ret;
         }
 
         ssl->in_left = ret;
+        MBEDTLS_SSL_STATS_ADD(ssl, bytes_in, ret);
     } else
 #endif
     {
+        /*
+         * With read-ahead, the records following the current one may
+         * already be in the buffer.
+         */
+        if ((ret = ssl_move_to_next_record(ssl)) != 0) {
+            return ret;
+        }
+
         MBEDTLS_SSL_DEBUG_MSG(2, ("in_left: %" MBEDTLS_PRINTF_SIZET
                                   ", nb_want: %" MBEDTLS_PRINTF_SIZET,
                                   ssl->in_left, nb_want));
 
         while (ssl->in_left < nb_want) {
-            len = nb_want - ssl->in_left;
+            if (ssl->conf->read_ahead == MBEDTLS_SSL_READ_AHEAD_ENABLED) {
+                len = in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf) -
+                      ssl->in_left;
+            } else {
+                len = nb_want - ssl->in_left;
+            }
+            mbedtls_ssl_in_buf_dirty(ssl, ssl->in_hdr + ssl->in_left + len);
 
             if (mbedtls_ssl_check_timer(ssl) != 0) {
                 ret = MBEDTLS_ERR_SSL_TIMEOUT;
@@ -2063,6 +2413,10 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
                 return MBEDTLS_ERR_SSL_CONN_EOF;
             }
 
+            if (ret == MBEDTLS_ERR_SSL_WANT_READ) {
+                MBEDTLS_SSL_STATS_ADD(ssl, want_read, 1);
+            }
+
             if (ret < 0) {
                 return ret;
             }
@@ -2076,6 +2430,7 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
             }
 
             ssl->in_left += ret;
+            MBEDTLS_SSL_STATS_ADD(ssl, bytes_in, ret);
         }
     }
 
@@ -2111,10 +2466,19 @@ int mbedtls_ssl_flush_output(mbedtls_ssl_context *ssl)
                                   mbedtls_ssl_out_hdr_len(ssl) + ssl->out_msglen, ssl->out_left));
 
         buf = ssl->out_hdr - ssl->out_left;
+#if defined(MBEDTLS_SSL_KTLS_C)
+        if (ssl->ktls_mode & MBEDTLS_SSL_KTLS_TX) {
+            ret = mbedtls_ssl_ktls_send(ssl, buf, ssl->out_left);
+        } else
+#endif
         ret = ssl->f_send(ssl->p_bio, buf, ssl->out_left);
 
         MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_send", ret);
 
+        if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            MBEDTLS_SSL_STATS_ADD(ssl, want_write, 1);
+        }
+
         if (ret <= 0) {
             return ret;
         }
@@ -2128,10 +2492,12 @@ int mbedtls_ssl_flush_output(mbedtls_ssl_context *ssl)
         }
 
         ssl->out_left -= ret;
+        MBEDTLS_SSL_STATS_ADD(ssl, bytes_out, ret);
     }
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        mbedtls_ssl_dtls_pmtud_sent(ssl, (size_t) (ssl->out_hdr - ssl->out_buf));
         ssl->out_hdr = ssl->out_buf;
     } else
 #endif
@@ -2139,6 +2505,7 @@ int mbedtls_ssl_flush_output(mbedtls_ssl_context *ssl)
         ssl->out_hdr = ssl->out_buf + 8;
     }
     mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+    ssl->out_packed = 0;
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= flush output"));
 
@@ -2256,6 +2623,13 @@ int mbedtls_ssl_resend(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> mbedtls_ssl_resend"));
 
+    MBEDTLS_SSL_STATS_ADD(ssl, retransmissions, 1);
+
+#if defined(MBEDTLS_HAVE_TIME)
+    /* Karn's algorithm: the reply could be to either transmission */
+    ssl->handshake->rtt_state = MBEDTLS_SSL_RTT_NONE;
+#endif
+
     ret = mbedtls_ssl_flight_transmit(ssl);
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= mbedtls_ssl_resend"));
@@ -2416,6 +2790,12 @@ int mbedtls_ssl_flight_transmit(mbedtls_ssl_context *ssl)
     } else {
         ssl->handshake->retransmit_state = MBEDTLS_SSL_RETRANS_WAITING;
         mbedtls_ssl_set_timer(ssl, ssl->handshake->retransmit_timeout);
+#if defined(MBEDTLS_HAVE_TIME)
+        if (ssl->handshake->rtt_state == MBEDTLS_SSL_RTT_PREPARED) {
+            ssl->handshake->flight_sent_time = mbedtls_ms_time();
+            ssl->handshake->rtt_state = MBEDTLS_SSL_RTT_SENT;
+        }
+#endif
     }
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= mbedtls_ssl_flight_transmit"));
@@ -2445,6 +2825,22 @@ void mbedtls_ssl_recv_flight_completed(mbedtls_ssl_context *ssl)
     /* Cancel timer */
     mbedtls_ssl_set_timer(ssl, 0);
 
+#if defined(MBEDTLS_HAVE_TIME)
+    /* This flight answers ours, which was not retransmitted */
+    if (ssl->handshake->rtt_state == MBEDTLS_SSL_RTT_SENT) {
+        mbedtls_ms_time_t elapsed =
+            mbedtls_ms_time() - ssl->handshake->flight_sent_time;
+
+        if (elapsed >= 0 && elapsed <= (mbedtls_ms_time_t) UINT32_MAX) {
+            mbedtls_ssl_dtls_rtt_update(&ssl->rtt, (uint32_t) elapsed);
+            MBEDTLS_SSL_DEBUG_MSG(3, ("round-trip time %lu ms, srtt %lu ms",
+                                      (unsigned long) elapsed,
+                                      (unsigned long) (ssl->rtt.srtt >> 3)));
+        }
+    }
+    ssl->handshake->rtt_state = MBEDTLS_SSL_RTT_NONE;
+#endif
+
     if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
         ssl->in_msg[0] == MBEDTLS_SSL_HS_FINISHED) {
         ssl->handshake->retransmit_state = MBEDTLS_SSL_RETRANS_FINISHED;
@@ -2461,6 +2857,12 @@ void mbedtls_ssl_send_flight_completed(mbedtls_ssl_context *ssl)
     ssl_reset_retransmit_timeout(ssl);
     mbedtls_ssl_set_timer(ssl, ssl->handshake->retransmit_timeout);
 
+#if defined(MBEDTLS_HAVE_TIME)
+    if (ssl->conf->dtls_rto == MBEDTLS_SSL_DTLS_RTO_ADAPTIVE) {
+        ssl->handshake->rtt_state = MBEDTLS_SSL_RTT_PREPARED;
+    }
+#endif
+
     if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
         ssl->in_msg[0] == MBEDTLS_SSL_HS_FINISHED) {
         ssl->handshake->retransmit_state = MBEDTLS_SSL_RETRANS_FINISHED;
@@ -2625,6 +3027,11 @@ int mbedtls_ssl_write_handshake_msg_ext(mbedtls_ssl_context *ssl,
         }
     }
 
+    /* The whole message is in the output buffer, whether or not it is
+     * sent from there: a DTLS flight copies it and may send it later in
+     * fragments smaller than the message. */
+    mbedtls_ssl_out_buf_dirty(ssl, ssl->out_msg + ssl->out_msglen);
+
     /* Either send now, or just save to be sent (and resent) later */
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
@@ -2668,6 +3075,28 @@ cleanup:
  * Record layer functions
  */
 
+/*
+ * Offset in the output buffer of the end of a record with len bytes of
+ * content, once protected.
+ */
+static size_t ssl_out_buf_dirty_end(const mbedtls_ssl_context *ssl,
+                                    size_t len)
+{
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    size_t out_buf_len = ssl->out_buf_len;
+#else
+    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#endif
+    size_t end = (size_t) (ssl->out_msg - ssl->out_buf);
+
+    end += len + MBEDTLS_SSL_PAYLOAD_OVERHEAD;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    end += MBEDTLS_SSL_CID_OUT_LEN_MAX;
+#endif
+
+    return end < out_buf_len ? end : out_buf_len;
+}
+
 /*
  * Write current record.
  *
@@ -2684,6 +3113,37 @@ int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write record"));
 
+    /* The record is protected in place, after its header. */
+    mbedtls_ssl_out_buf_dirty(ssl, ssl->out_buf +
+                              ssl_out_buf_dirty_end(ssl, len));
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+    if (ssl->ktls_mode & MBEDTLS_SSL_KTLS_TX) {
+        /* The kernel adds the record header and protection. Records of
+         * different types must not be sent in a single call, so each one
+         * is flushed on its own, except application data written while
+         * corked. */
+        memmove(ssl->out_hdr, ssl->out_msg, len);
+        ssl->ktls_out_type = ssl->out_msgtype;
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("output record: msgtype = %d, "
+                                  "msglen = %" MBEDTLS_PRINTF_SIZET " (kTLS)",
+                                  ssl->out_msgtype, len));
+
+        ssl->out_left += len;
+        ssl->out_hdr  += len;
+        mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+
+        MBEDTLS_SSL_STATS_ADD(ssl, records_out, 1);
+
+        done = 1;
+        if (ssl->out_corked == 0 ||
+            ssl->out_msgtype != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+            flush = SSL_FORCE_FLUSH;
+        }
+    }
+#endif /* MBEDTLS_SSL_KTLS_C */
+
     if (!done) {
         unsigned i;
         size_t protected_record_size;
@@ -2778,6 +3238,8 @@ int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
         ssl->out_hdr  += protected_record_size;
         mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
 
+        MBEDTLS_SSL_STATS_ADD(ssl, records_out, 1);
+
         for (i = 8; i > mbedtls_ssl_ep_len(ssl); i--) {
             if (++ssl->cur_out_ctr[i - 1] != 0) {
                 break;
@@ -4576,12 +5038,147 @@ static int ssl_buffer_future_record(mbedtls_ssl_context *ssl,
 
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+/*
+ * Full-duplex mode, see mbedtls_ssl_conf_full_duplex(): hand an alert over
+ * from mbedtls_ssl_read() to the writing thread. A single warning alert can
+ * be pending: further warnings are dropped until it has been sent. A fatal
+ * alert replaces a pending warning, and all alerts are dropped once a fatal
+ * alert has been handed over.
+ */
+static void ssl_duplex_hand_over_alert(mbedtls_ssl_context *ssl,
+                                       unsigned char level,
+                                       unsigned char message,
+                                       int reason)
+{
+    uint32_t flags = mbedtls_ssl_atomic_load_acquire_u32(&ssl->duplex_flags);
+
+    if ((flags & MBEDTLS_SSL_DUPLEX_FATAL) ||
+        (level != MBEDTLS_SSL_ALERT_LEVEL_FATAL &&
+         (flags & MBEDTLS_SSL_DUPLEX_ALERT))) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("alert pending, drop alert message=%u",
+                                  message));
+        return;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("hand over alert level=%u message=%u",
+                              level, message));
+
+    /* The writer may still be sending a pending warning: a fatal alert
+     * does not overwrite it. */
+    if (level == MBEDTLS_SSL_ALERT_LEVEL_FATAL) {
+        ssl->duplex_fatal_type = message;
+        ssl->duplex_alert_reason = reason;
+        mbedtls_ssl_atomic_or_release_u32(&ssl->duplex_flags,
+                                          MBEDTLS_SSL_DUPLEX_FATAL);
+    } else {
+        ssl->duplex_alert_type = message;
+        mbedtls_ssl_atomic_or_release_u32(&ssl->duplex_flags,
+                                          MBEDTLS_SSL_DUPLEX_ALERT);
+    }
+}
+
+/*
+ * Send the alert handed over by mbedtls_ssl_read(), if any, from
+ * mbedtls_ssl_write() or mbedtls_ssl_close_notify().
+ *
+ * Return the error that caused the alert once a fatal alert has been sent.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_duplex_send_alert(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    uint32_t flags;
+    unsigned char level, message;
+
+    for (;;) {
+        flags = mbedtls_ssl_atomic_load_acquire_u32(&ssl->duplex_flags);
+
+        if (flags & MBEDTLS_SSL_DUPLEX_FATAL_SENT) {
+            return ssl->duplex_alert_reason;
+        }
+        if (flags & MBEDTLS_SSL_DUPLEX_FATAL) {
+            level = MBEDTLS_SSL_ALERT_LEVEL_FATAL;
+            message = ssl->duplex_fatal_type;
+        } else if (flags & MBEDTLS_SSL_DUPLEX_ALERT) {
+            level = MBEDTLS_SSL_ALERT_LEVEL_WARNING;
+            message = ssl->duplex_alert_type;
+        } else {
+            return 0;
+        }
+
+        /* A record of application data, or a warning alert, is still
+         * pending after MBEDTLS_ERR_SSL_WANT_WRITE. A warning alert waits
+         * for the retried write to send it. A fatal alert ends the
+         * connection: the record is sent here, and the alert right after
+         * it. */
+        if (ssl->out_left != 0 && ssl->out_packed == 0 &&
+            ssl->duplex_alert_sending != level) {
+            if (level != MBEDTLS_SSL_ALERT_LEVEL_FATAL) {
+                return 0;
+            }
+            if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+                return ret;
+            }
+        }
+
+        ssl->duplex_alert_sending = level;
+        ret = mbedtls_ssl_send_alert_message(ssl, level, message);
+        if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return ret;
+        }
+
+        ssl->duplex_alert_sending = 0;
+        if (level == MBEDTLS_SSL_ALERT_LEVEL_FATAL) {
+            mbedtls_ssl_atomic_or_release_u32(&ssl->duplex_flags,
+                                              MBEDTLS_SSL_DUPLEX_FATAL_SENT);
+        } else {
+            mbedtls_ssl_atomic_and_release_u32(&ssl->duplex_flags,
+                                               ~(uint32_t) MBEDTLS_SSL_DUPLEX_ALERT);
+        }
+        if (ret != 0) {
+            return ret;
+        }
+        /* After a warning, send a fatal alert handed over meanwhile */
+    }
+}
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
+#if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES) || defined(MBEDTLS_SSL_PROTO_TLS1_2)
+/*
+ * Send an alert caused by an incoming record. In full-duplex mode, the
+ * output belongs to the writing thread, so the alert is handed over to it.
+ */
+static int ssl_send_alert_from_read(mbedtls_ssl_context *ssl,
+                                    unsigned char level,
+                                    unsigned char message,
+                                    int reason)
+{
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    if (ssl->duplex) {
+        ssl_duplex_hand_over_alert(ssl, level, message, reason);
+        return 0;
+    }
+#endif
+    ((void) reason);
+
+    return mbedtls_ssl_send_alert_message(ssl, level, message);
+}
+#endif /* MBEDTLS_SSL_ALL_ALERT_MESSAGES || MBEDTLS_SSL_PROTO_TLS1_2 */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_get_next_record(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_record rec;
 
+#if defined(MBEDTLS_SSL_KTLS_C)
+    if (ssl->ktls_mode & MBEDTLS_SSL_KTLS_RX) {
+        /* Records are authenticated and decrypted by the kernel. */
+        return mbedtls_ssl_ktls_read_record(ssl);
+    }
+#endif /* MBEDTLS_SSL_KTLS_C */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     /* We might have buffered a future record; if so,
      * and if the epoch matches now, load it.
@@ -4682,7 +5279,7 @@ static int ssl_get_next_record(mbedtls_ssl_context *ssl)
             return ret;
         }
 
-        ssl->in_left = 0;
+        mbedtls_ssl_done_reading_record(ssl, rec.buf_len);
     }
 
     /*
@@ -4690,6 +5287,10 @@ static int ssl_get_next_record(mbedtls_ssl_context *ssl)
      */
 
     if ((ret = ssl_prepare_record_content(ssl, &rec)) != 0) {
+        if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
+            MBEDTLS_SSL_STATS_ADD(ssl, decrypt_failures, 1);
+        }
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
         if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
             /* Silently discard invalid records */
@@ -4732,9 +5333,10 @@ static int ssl_get_next_record(mbedtls_ssl_context *ssl)
             /* Error out (and send alert) on invalid records */
 #if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES)
             if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
-                mbedtls_ssl_send_alert_message(ssl,
-                                               MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                               MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC);
+                ssl_send_alert_from_read(ssl,
+                                         MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                         MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC,
+                                         ret);
             }
 #endif
             return ret;
@@ -4763,6 +5365,8 @@ static int ssl_get_next_record(mbedtls_ssl_context *ssl)
     ssl->in_msglen = rec.data_len;
     MBEDTLS_PUT_UINT16_BE(rec.data_len, ssl->in_len, 0);
 
+    MBEDTLS_SSL_STATS_ADD(ssl, records_in, 1);
+
     return 0;
 }
 
@@ -4898,7 +5502,14 @@ int mbedtls_ssl_send_alert_message(mbedtls_ssl_context *ssl,
     }
 
     if (ssl->out_left != 0) {
-        return mbedtls_ssl_flush_output(ssl);
+        /* Records packed while corked are sent before the alert.
+         * Otherwise, the pending data is this alert. */
+        if (ssl->out_packed == 0) {
+            return mbedtls_ssl_flush_output(ssl);
+        }
+        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            return ret;
+        }
     }
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> send alert message"));
@@ -5149,6 +5760,24 @@ int mbedtls_ssl_check_pending(const mbedtls_ssl_context *ssl)
     }
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
+    /*
+     * Case B': Further records have been read ahead (TLS).
+     */
+
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+        ssl->next_record_offset != 0) {
+        size_t ahead = ssl->in_left - ssl->next_record_offset;
+        const unsigned char *next = ssl->in_hdr + ssl->next_record_offset;
+
+        /* Only a complete record can be processed without reading more. */
+        if (ahead >= mbedtls_ssl_in_hdr_len(ssl) &&
+            ahead - mbedtls_ssl_in_hdr_len(ssl) >=
+            MBEDTLS_GET_UINT16_BE(next, mbedtls_ssl_in_hdr_len(ssl) - 2)) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: more records read ahead"));
+            return 1;
+        }
+    }
+
     /*
      * Case C: A handshake message is being processed.
      */
@@ -5244,6 +5873,14 @@ static int ssl_check_ctr_renegotiate(mbedtls_ssl_context *ssl)
     int in_ctr_cmp;
     int out_ctr_cmp;
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* Renegotiation is refused in full-duplex mode, and the counters
+     * belong to different threads. */
+    if (ssl->duplex) {
+        return 0;
+    }
+#endif
+
     if (mbedtls_ssl_is_handshake_over(ssl) == 0 ||
         ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING ||
         ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED) {
@@ -5366,6 +6003,9 @@ static int ssl_tls12_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
     /* Determine whether renegotiation attempt should be accepted */
     if (!(ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED ||
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+          ssl->duplex ||
+#endif
           (ssl->secure_renegotiation == MBEDTLS_SSL_LEGACY_RENEGOTIATION &&
            ssl->conf->allow_legacy_renegotiation ==
            MBEDTLS_SSL_LEGACY_NO_RENEGOTIATION))) {
@@ -5396,9 +6036,10 @@ static int ssl_tls12_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
 
         MBEDTLS_SSL_DEBUG_MSG(3, ("refusing renegotiation, sending alert"));
 
-        if ((ret = mbedtls_ssl_send_alert_message(ssl,
-                                                  MBEDTLS_SSL_ALERT_LEVEL_WARNING,
-                                                  MBEDTLS_SSL_ALERT_MSG_NO_RENEGOTIATION)) != 0) {
+        if ((ret = ssl_send_alert_from_read(ssl,
+                                            MBEDTLS_SSL_ALERT_LEVEL_WARNING,
+                                            MBEDTLS_SSL_ALERT_MSG_NO_RENEGOTIATION,
+                                            0)) != 0) {
             return ret;
         }
     }
@@ -5666,6 +6307,91 @@ int mbedtls_ssl_read_early_data(mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_EARLY_DATA */
 
+/*
+ * Dynamic record sizing, see mbedtls_ssl_conf_dynamic_record_sizing():
+ * return the maximum payload of the next application data record.
+ */
+static size_t ssl_dynamic_record_max_len(mbedtls_ssl_context *ssl,
+                                         size_t max_len)
+{
+    const mbedtls_ssl_config *conf = ssl->conf;
+
+    if (conf->record_small_len == 0 ||
+        conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+        return max_len;
+    }
+
+#if defined(MBEDTLS_HAVE_TIME)
+    /* Do not change the length while a record is being retransmitted:
+     * mbedtls_ssl_write() must return the length of the pending record. */
+    if (conf->record_idle_timeout != 0 && ssl->out_left == 0) {
+        mbedtls_ms_time_t now = mbedtls_ms_time();
+
+        if (ssl->record_warm_bytes != 0 &&
+            now - ssl->record_last_write > (mbedtls_ms_time_t) conf->record_idle_timeout) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("connection idle, back to small records"));
+            ssl->record_warm_bytes = 0;
+        }
+        ssl->record_last_write = now;
+    }
+#endif /* MBEDTLS_HAVE_TIME */
+
+    if (ssl->record_warm_bytes < conf->record_boost_threshold &&
+        conf->record_small_len < max_len) {
+        return conf->record_small_len;
+    }
+
+    return max_len;
+}
+
+/*
+ * Protect application data into a record appended to the records already
+ * pending in the output buffer, see mbedtls_ssl_cork(). The pending records
+ * are only sent if the new one would not fit after them.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_write_corked(mbedtls_ssl_context *ssl,
+                            const unsigned char *buf, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+    size_t out_buf_len = ssl->out_buf_len;
+#else
+    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#endif
+    size_t expansion;
+
+    ret = mbedtls_ssl_get_record_expansion(ssl);
+    if (ret < 0) {
+        return ret;
+    }
+    expansion = (size_t) ret;
+
+    if (ssl->out_left != 0 &&
+        (size_t) (ssl->out_hdr - ssl->out_buf) + expansion + len > out_buf_len) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("output buffer full, sending packed records"));
+        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+            return ret;
+        }
+    }
+
+    ssl->out_msglen  = len;
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    if (len > 0) {
+        memcpy(ssl->out_msg, buf, len);
+    }
+
+    if ((ret = mbedtls_ssl_write_record(ssl, SSL_DONT_FORCE_FLUSH)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_record", ret);
+        return ret;
+    }
+
+    ssl->out_packed = (ssl->out_left != 0);
+
+    return (int) len;
+}
+
 /*
  * Send application data to be encrypted by the SSL layer, taking care of max
  * fragment length and buffer size.
@@ -5683,13 +6409,15 @@ static int ssl_write_real(mbedtls_ssl_context *ssl,
                           const unsigned char *buf, size_t len)
 {
     int ret = mbedtls_ssl_get_max_out_record_payload(ssl);
-    const size_t max_len = (size_t) ret;
+    size_t max_len = (size_t) ret;
 
     if (ret < 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_get_max_out_record_payload", ret);
         return ret;
     }
 
+    max_len = ssl_dynamic_record_max_len(ssl, max_len);
+
     if (len > max_len) {
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
         if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
@@ -5703,6 +6431,19 @@ static int ssl_write_real(mbedtls_ssl_context *ssl,
         len = max_len;
     }
 
+    if (ssl->out_corked && mbedtls_ssl_is_handshake_over(ssl)) {
+        return ssl_write_corked(ssl, buf, len);
+    }
+
+    if (ssl->out_packed) {
+        /* The pending records were packed while corked: they do not
+         * contain buf. */
+        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+            return ret;
+        }
+    }
+
     if (ssl->out_left != 0) {
         /*
          * The user has previously tried to send the data and
@@ -5748,27 +6489,337 @@ int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* ssl->state belongs to mbedtls_ssl_read(), which may be processing a
+     * post-handshake message. */
+    if (ssl->duplex) {
+        if ((ret = ssl_duplex_send_alert(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_duplex_send_alert", ret);
+            return ret;
+        }
+    } else
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+    {
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
-    if ((ret = ssl_check_ctr_renegotiate(ssl)) != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "ssl_check_ctr_renegotiate", ret);
-        return ret;
-    }
+        if ((ret = ssl_check_ctr_renegotiate(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_check_ctr_renegotiate", ret);
+            return ret;
+        }
 #endif
 
-    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
-        if ((ret = mbedtls_ssl_handshake(ssl)) != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
-            return ret;
+        if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+            if ((ret = mbedtls_ssl_handshake(ssl)) != 0) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
+                return ret;
+            }
         }
     }
 
     ret = ssl_write_real(ssl, buf, len);
 
+    if (ret > 0 && ssl->record_warm_bytes < SIZE_MAX - (size_t) ret) {
+        ssl->record_warm_bytes += (size_t) ret;
+    }
+
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= write"));
 
     return ret;
 }
 
+int mbedtls_ssl_cork(mbedtls_ssl_context *ssl)
+{
+    if (ssl == NULL || ssl->conf == NULL ||
+        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* A record interrupted by MBEDTLS_ERR_SSL_WANT_WRITE already holds the
+     * data of the mbedtls_ssl_write() call to be repeated: corking now would
+     * make that call protect the data a second time. */
+    if (!ssl->out_corked && ssl->out_left != 0 && !ssl->out_packed) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("cannot cork while a write is pending"));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ssl->out_corked = 1;
+
+    return 0;
+}
+
+int mbedtls_ssl_uncork(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (ssl == NULL || ssl->conf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ssl->out_corked = 0;
+
+    if (ssl->out_packed && (ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+/* Length of a TLS record header */
+#define SSL_BULK_HDR_LEN 5
+
+/*
+ * Length on the wire of an AEAD record with len bytes of payload.
+ */
+static size_t ssl_bulk_record_out_len(const mbedtls_ssl_transform *transform,
+                                      size_t len)
+{
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        /* TLSInnerPlaintext: content type and padding */
+        len += 1 + ssl_compute_padding_length(len,
+                                              MBEDTLS_SSL_CID_TLS1_3_PADDING_GRANULARITY);
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
+    /* The explicit part of the nonce is empty except with GCM and CCM
+     * in TLS 1.2. */
+    return SSL_BULK_HDR_LEN + (transform->ivlen - transform->fixed_ivlen) +
+           len + transform->taglen;
+}
+
+/*
+ * Check that bulk writes can be used on the connection and compute the
+ * payload length of a full record.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_bulk_write_check(const mbedtls_ssl_context *ssl,
+                                size_t *record_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (ssl == NULL || ssl->conf == NULL ||
+        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        !mbedtls_ssl_is_handshake_over(ssl) ||
+        ssl->transform_out == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (!mbedtls_ssl_transform_uses_aead(ssl->transform_out)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bulk write needs an AEAD ciphersuite"));
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+    if (ssl->ktls_mode & MBEDTLS_SSL_KTLS_TX) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif /* MBEDTLS_SSL_KTLS_C */
+
+    ret = mbedtls_ssl_get_max_out_record_payload(ssl);
+    if (ret < 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_get_max_out_record_payload", ret);
+        return ret;
+    }
+    *record_len = (size_t) ret;
+
+    return 0;
+}
+
+/*
+ * Output size for len bytes of payload: all records but the last one are full.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_bulk_output_len(const mbedtls_ssl_transform *transform,
+                               size_t record_len, size_t len,
+                               size_t *out_len)
+{
+    size_t records = len / record_len;
+    size_t full_len = ssl_bulk_record_out_len(transform, record_len);
+    size_t last_len = 0;
+
+    if (len % record_len != 0) {
+        last_len = ssl_bulk_record_out_len(transform, len % record_len);
+    }
+
+    if (records > (SIZE_MAX - last_len) / full_len) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bulk write output size overflow"));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    *out_len = records * full_len + last_len;
+
+    return 0;
+}
+
+int mbedtls_ssl_bulk_write_output_size(const mbedtls_ssl_context *ssl,
+                                       size_t len, size_t *out_size)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t record_len;
+
+    if (out_size == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_bulk_write_check(ssl, &record_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return ssl_bulk_output_len(ssl->transform_out, record_len, len, out_size);
+}
+
+int mbedtls_ssl_bulk_write_setup(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_bulk_write *bulk,
+                                 const unsigned char *buf, size_t len,
+                                 unsigned char *out, size_t out_size)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t record_len;
+    size_t records;
+    size_t out_len;
+    uint64_t ctr;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> bulk write setup"));
+
+    if (bulk == NULL || (len != 0 && (buf == NULL || out == NULL))) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_bulk_write_check(ssl, &record_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (ssl->out_left != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bulk write with pending output"));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_bulk_output_len(ssl->transform_out, record_len, len, &out_len);
+    if (ret != 0) {
+        return ret;
+    }
+    if (out_size < out_len) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bulk write output buffer too small: %"
+                                  MBEDTLS_PRINTF_SIZET " < %" MBEDTLS_PRINTF_SIZET,
+                                  out_size, out_len));
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    records = len / record_len + (len % record_len != 0);
+
+    /* Reserve the sequence numbers of all the records. */
+    ctr = MBEDTLS_GET_UINT64_BE(ssl->cur_out_ctr, 0);
+    if ((uint64_t) records > UINT64_MAX - ctr) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("outgoing message counter would wrap"));
+        return MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
+    }
+    MBEDTLS_PUT_UINT64_BE(ctr + records, ssl->cur_out_ctr, 0);
+
+    bulk->ssl            = ssl;
+    bulk->transform      = ssl->transform_out;
+    bulk->buf            = buf;
+    bulk->len            = len;
+    bulk->out            = out;
+    bulk->out_len        = out_len;
+    bulk->record_len     = record_len;
+    bulk->record_out_len = ssl_bulk_record_out_len(ssl->transform_out,
+                                                   record_len);
+    bulk->records        = records;
+    bulk->first_ctr      = ctr;
+
+    MBEDTLS_SSL_STATS_ADD(ssl, records_out, records);
+    if (ssl->record_warm_bytes < SIZE_MAX - len) {
+        ssl->record_warm_bytes += len;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= bulk write setup: %" MBEDTLS_PRINTF_SIZET
+                              " records, %" MBEDTLS_PRINTF_SIZET " bytes",
+                              records, out_len));
+
+    return 0;
+}
+
+size_t mbedtls_ssl_bulk_write_get_records(const mbedtls_ssl_bulk_write *bulk)
+{
+    return bulk->records;
+}
+
+size_t mbedtls_ssl_bulk_write_get_output_len(const mbedtls_ssl_bulk_write *bulk)
+{
+    return bulk->out_len;
+}
+
+int mbedtls_ssl_bulk_write_protect(const mbedtls_ssl_bulk_write *bulk,
+                                   size_t first, size_t count)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_transform *transform;
+    mbedtls_ssl_protocol_version tls_ver;
+    size_t i;
+
+    if (bulk == NULL || first > bulk->records ||
+        count > bulk->records - first) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    transform = bulk->transform;
+    tls_ver = transform->tls_version;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    /* TLS 1.3 still uses the TLS 1.2 version identifier
+     * for backwards compatibility. */
+    if (tls_ver == MBEDTLS_SSL_VERSION_TLS1_3) {
+        tls_ver = MBEDTLS_SSL_VERSION_TLS1_2;
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
+    for (i = first; i < first + count; i++) {
+        size_t offset = i * bulk->record_len;
+        size_t len = bulk->len - offset;
+        unsigned char *hdr = bulk->out + i * bulk->record_out_len;
+        mbedtls_record rec;
+
+        if (len > bulk->record_len) {
+            len = bulk->record_len;
+        }
+
+        rec.buf         = hdr + SSL_BULK_HDR_LEN;
+        rec.buf_len     = ssl_bulk_record_out_len(transform, len) - SSL_BULK_HDR_LEN;
+        rec.data_offset = transform->ivlen - transform->fixed_ivlen;
+        rec.data_len    = len;
+        memcpy(rec.buf + rec.data_offset, bulk->buf + offset, len);
+
+        MBEDTLS_PUT_UINT64_BE(bulk->first_ctr + i, rec.ctr, 0);
+        mbedtls_ssl_write_version(rec.ver, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                  tls_ver);
+        rec.type = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        rec.cid_len = 0;
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+        /* AEAD transforms do not use the RNG. */
+        ret = mbedtls_ssl_encrypt_buf(bulk->ssl, transform, &rec, NULL, NULL);
+        if (ret != 0) {
+            return ret;
+        }
+
+        if (rec.data_offset != 0 ||
+            SSL_BULK_HDR_LEN + rec.data_len !=
+            ssl_bulk_record_out_len(transform, len)) {
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+
+        hdr[0] = rec.type;
+        memcpy(hdr + 1, rec.ver, sizeof(rec.ver));
+        MBEDTLS_PUT_UINT16_BE(rec.data_len, hdr, 3);
+    }
+
+    return 0;
+}
+
+#undef SSL_BULK_HDR_LEN
+
 #if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_CLI_C)
 int mbedtls_ssl_write_early_data(mbedtls_ssl_context *ssl,
                                  const unsigned char *buf, size_t len)
@@ -5880,6 +6931,7 @@ int mbedtls_ssl_write_early_data(mbedtls_ssl_context *ssl,
 int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int handshake_over;
 
     if (ssl == NULL || ssl->conf == NULL) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
@@ -5887,7 +6939,20 @@ int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write close notify"));
 
-    if (mbedtls_ssl_is_handshake_over(ssl) == 1) {
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* No closure alert after a fatal alert. As in mbedtls_ssl_write(),
+     * ssl->state belongs to mbedtls_ssl_read(). */
+    if (ssl->duplex) {
+        if ((ret = ssl_duplex_send_alert(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_duplex_send_alert", ret);
+            return ret;
+        }
+        handshake_over = 1;
+    } else
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+    handshake_over = mbedtls_ssl_is_handshake_over(ssl);
+
+    if (handshake_over == 1) {
         if ((ret = mbedtls_ssl_send_alert_message(ssl,
                                                   MBEDTLS_SSL_ALERT_LEVEL_WARNING,
                                                   MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY)) != 0) {
@@ -6026,6 +7091,16 @@ int mbedtls_ssl_handle_pending_alert(mbedtls_ssl_context *ssl)
         return 0;
     }
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* Only mbedtls_ssl_read() runs handshake steps in full-duplex mode. */
+    if (ssl->duplex) {
+        ssl_duplex_hand_over_alert(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                   ssl->alert_type, ssl->alert_reason);
+        ssl->send_alert = 0;
+        return ssl->alert_reason;
+    }
+#endif
+
     ret = mbedtls_ssl_send_alert_message(ssl,
                                          MBEDTLS_SSL_ALERT_LEVEL_FATAL,
                                          ssl->alert_type);
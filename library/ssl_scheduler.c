@@ -0,0 +1,314 @@
+/*
+ *  Cooperative scheduler for SSL connections on an event loop
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A connection is in at most one of the two run queues at a time, as
+ * recorded by its queued flag, so that each queue holds at most one index
+ * per slot. A slot removed while queued is only given back to the free
+ * stack when it leaves its queue: a handle cannot be reused while a stale
+ * index of it is still queued.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_SCHEDULER_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_scheduler.h"
+#include "mbedtls/error.h"
+
+#include <limits.h>
+#include <string.h>
+
+void mbedtls_ssl_scheduler_init(mbedtls_ssl_scheduler *sched)
+{
+    memset(sched, 0, sizeof(mbedtls_ssl_scheduler));
+}
+
+int mbedtls_ssl_scheduler_setup(mbedtls_ssl_scheduler *sched, size_t size)
+{
+    size_t i;
+
+    if (sched->entries != NULL || size == 0 || size > INT_MAX ||
+        size > SIZE_MAX / sizeof(mbedtls_ssl_scheduler_entry)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    sched->entries = mbedtls_calloc(size, sizeof(mbedtls_ssl_scheduler_entry));
+    sched->free_slots = mbedtls_calloc(size, sizeof(uint32_t));
+    sched->io_queue.slots = mbedtls_calloc(size, sizeof(uint32_t));
+    sched->hs_queue.slots = mbedtls_calloc(size, sizeof(uint32_t));
+    if (sched->entries == NULL || sched->free_slots == NULL ||
+        sched->io_queue.slots == NULL || sched->hs_queue.slots == NULL) {
+        mbedtls_ssl_scheduler_free(sched);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* Hand out the lowest handles first */
+    for (i = 0; i < size; i++) {
+        sched->free_slots[i] = (uint32_t) (size - 1 - i);
+    }
+    sched->nb_free = size;
+    sched->size = size;
+
+    return 0;
+}
+
+void mbedtls_ssl_scheduler_set_callbacks(mbedtls_ssl_scheduler *sched,
+                                         mbedtls_ssl_scheduler_io_t *f_io,
+                                         mbedtls_ssl_scheduler_done_t *f_done,
+                                         void *p_cb)
+{
+    sched->f_io = f_io;
+    sched->f_done = f_done;
+    sched->p_cb = p_cb;
+}
+
+void mbedtls_ssl_scheduler_set_max_ops(mbedtls_ssl_scheduler *sched,
+                                       unsigned max_ops)
+{
+    sched->max_ops = max_ops;
+}
+
+static void ssl_scheduler_push(mbedtls_ssl_scheduler *sched,
+                               mbedtls_ssl_scheduler_queue *queue,
+                               uint32_t slot)
+{
+    queue->slots[(queue->head + queue->count) % sched->size] = slot;
+    queue->count++;
+    sched->entries[slot].queued = 1;
+}
+
+static uint32_t ssl_scheduler_pop(mbedtls_ssl_scheduler *sched,
+                                  mbedtls_ssl_scheduler_queue *queue)
+{
+    uint32_t slot = queue->slots[queue->head];
+
+    queue->head = (queue->head + 1) % sched->size;
+    queue->count--;
+    sched->entries[slot].queued = 0;
+
+    return slot;
+}
+
+static void ssl_scheduler_release(mbedtls_ssl_scheduler *sched, uint32_t slot)
+{
+    mbedtls_ssl_scheduler_entry *entry = &sched->entries[slot];
+
+    entry->ssl = NULL;
+    entry->p_user = NULL;
+    entry->established = 0;
+
+    if (!entry->queued) {
+        sched->free_slots[sched->nb_free++] = slot;
+    }
+}
+
+int mbedtls_ssl_scheduler_add(mbedtls_ssl_scheduler *sched,
+                              mbedtls_ssl_context *ssl,
+                              void *p_user)
+{
+    uint32_t slot;
+
+    if (ssl == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    if (sched->nb_free == 0) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    slot = sched->free_slots[--sched->nb_free];
+    sched->entries[slot].ssl = ssl;
+    sched->entries[slot].p_user = p_user;
+    sched->entries[slot].established = 0;
+    ssl_scheduler_push(sched, &sched->hs_queue, slot);
+
+    return (int) slot;
+}
+
+static int ssl_scheduler_check_handle(const mbedtls_ssl_scheduler *sched,
+                                      int handle)
+{
+    return handle >= 0 && (size_t) handle < sched->size &&
+           sched->entries[handle].ssl != NULL;
+}
+
+int mbedtls_ssl_scheduler_notify(mbedtls_ssl_scheduler *sched, int handle)
+{
+    mbedtls_ssl_scheduler_entry *entry;
+
+    if (!ssl_scheduler_check_handle(sched, handle)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    entry = &sched->entries[handle];
+    if (!entry->queued) {
+        ssl_scheduler_push(sched,
+                           entry->established ? &sched->io_queue :
+                           &sched->hs_queue,
+                           (uint32_t) handle);
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_scheduler_remove(mbedtls_ssl_scheduler *sched, int handle)
+{
+    if (!ssl_scheduler_check_handle(sched, handle)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ssl_scheduler_release(sched, (uint32_t) handle);
+
+    return 0;
+}
+
+/*
+ * Run one handshake step of the connection in the given slot, and queue it
+ * again if it can go on without waiting for its socket.
+ */
+static void ssl_scheduler_step(mbedtls_ssl_scheduler *sched, uint32_t slot)
+{
+    mbedtls_ssl_scheduler_entry *entry = &sched->entries[slot];
+    mbedtls_ssl_context *ssl = entry->ssl;
+    void *p_user = entry->p_user;
+    int ret;
+
+    ret = mbedtls_ssl_handshake_step(ssl);
+
+    if (ret == 0 && mbedtls_ssl_is_handshake_over(ssl)) {
+        entry->established = 1;
+        if (sched->f_done != NULL) {
+            sched->f_done(sched->p_cb, ssl, p_user, 0);
+        }
+        /* The callback may have removed the connection */
+        if (entry->ssl != ssl || entry->queued) {
+            return;
+        }
+        if (sched->f_io == NULL) {
+            ssl_scheduler_release(sched, slot);
+        } else if (mbedtls_ssl_check_pending(ssl)) {
+            ssl_scheduler_push(sched, &sched->io_queue, slot);
+        }
+        return;
+    }
+
+    switch (ret) {
+        case 0:
+        case MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS:
+            /* More work to do: back to the end of the queue, unless a
+             * callback called during the step removed or notified the
+             * connection */
+            if (entry->ssl == ssl && !entry->queued) {
+                ssl_scheduler_push(sched, &sched->hs_queue, slot);
+            }
+            break;
+
+        case MBEDTLS_ERR_SSL_WANT_READ:
+        case MBEDTLS_ERR_SSL_WANT_WRITE:
+        case MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS:
+            /* Wait for mbedtls_ssl_scheduler_notify() */
+            break;
+
+        default:
+            if (entry->ssl == ssl) {
+                ssl_scheduler_release(sched, slot);
+            }
+            if (sched->f_done != NULL) {
+                sched->f_done(sched->p_cb, ssl, p_user, ret);
+            }
+            break;
+    }
+}
+
+size_t mbedtls_ssl_scheduler_run(mbedtls_ssl_scheduler *sched,
+                                 unsigned max_steps)
+{
+    mbedtls_ssl_scheduler_entry *entry;
+    mbedtls_ssl_context *ssl;
+    size_t n;
+    unsigned steps = 0;
+    uint32_t slot;
+
+    if (sched->entries == NULL) {
+        return 0;
+    }
+
+    /* Established connections first. Those queued again during this pass
+     * are served in the next round. */
+    for (n = sched->io_queue.count; n > 0; n--) {
+        slot = ssl_scheduler_pop(sched, &sched->io_queue);
+        entry = &sched->entries[slot];
+        ssl = entry->ssl;
+        if (ssl == NULL) {
+            sched->free_slots[sched->nb_free++] = slot;
+            continue;
+        }
+
+        if (sched->f_io == NULL ||
+            sched->f_io(sched->p_cb, ssl, entry->p_user) < 0) {
+            if (entry->ssl == ssl) {
+                ssl_scheduler_release(sched, slot);
+            }
+            continue;
+        }
+
+        /* Records left in the input buffer will not wake up the socket */
+        if (entry->ssl == ssl && !entry->queued &&
+            mbedtls_ssl_check_pending(ssl)) {
+            ssl_scheduler_push(sched, &sched->io_queue, slot);
+        }
+    }
+
+#if defined(MBEDTLS_ECP_RESTARTABLE)
+    if (sched->max_ops != 0) {
+        mbedtls_ecp_set_max_ops(sched->max_ops);
+    }
+#endif
+
+    /* Then a bounded number of handshake steps, in round robin */
+    while (sched->hs_queue.count > 0) {
+        entry = &sched->entries[sched->hs_queue.slots[sched->hs_queue.head]];
+        if (steps == max_steps && entry->ssl != NULL && !entry->established) {
+            break;
+        }
+
+        slot = ssl_scheduler_pop(sched, &sched->hs_queue);
+        if (entry->ssl == NULL) {
+            sched->free_slots[sched->nb_free++] = slot;
+            continue;
+        }
+
+        /* Notified during its last handshake step: serve it with the
+         * established connections in the next round. */
+        if (entry->established) {
+            ssl_scheduler_push(sched, &sched->io_queue, slot);
+            continue;
+        }
+
+        ssl_scheduler_step(sched, slot);
+        steps++;
+    }
+
+    return sched->io_queue.count + sched->hs_queue.count;
+}
+
+void mbedtls_ssl_scheduler_free(mbedtls_ssl_scheduler *sched)
+{
+    if (sched == NULL) {
+        return;
+    }
+
+    mbedtls_free(sched->entries);
+    mbedtls_free(sched->free_slots);
+    mbedtls_free(sched->io_queue.slots);
+    mbedtls_free(sched->hs_queue.slots);
+
+    mbedtls_platform_zeroize(sched, sizeof(mbedtls_ssl_scheduler));
+}
+
+#endif /* MBEDTLS_SSL_SCHEDULER_C */
@@ -0,0 +1,617 @@
+/*
+ *  Client-side session and ticket store for outbound connections
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Servers are looked up in a chained hash table keyed by host name, port
+ * and offered ALPN protocols. Each server has a short list of serialized
+ * sessions, newest first: a single reusable TLS 1.2 session, or up to
+ * MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS single-use TLS 1.3 tickets.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_session_store.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#define SSL_SESSION_STORE_INITIAL_BUCKETS   16
+
+/* Host name and its length, port, and up to 256 bytes of ALPN protocols */
+#define SSL_SESSION_STORE_KEY_MAX_LEN  (1 + MBEDTLS_SSL_MAX_HOST_NAME_LEN + 2 + 256)
+
+void mbedtls_ssl_session_store_init(mbedtls_ssl_session_store *store)
+{
+    memset(store, 0, sizeof(mbedtls_ssl_session_store));
+
+    store->max_entries = MBEDTLS_SSL_SESSION_STORE_DEFAULT_MAX_ENTRIES;
+    store->timeout = MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&store->mutex);
+#endif
+}
+
+void mbedtls_ssl_session_store_set_max_entries(mbedtls_ssl_session_store *store,
+                                               size_t max)
+{
+    store->max_entries = max;
+}
+
+void mbedtls_ssl_session_store_set_timeout(mbedtls_ssl_session_store *store,
+                                           int timeout)
+{
+    if (timeout < 0) {
+        timeout = 0;
+    }
+
+    store->timeout = timeout;
+}
+
+/* FNV-1a */
+static uint32_t ssl_session_store_hash(const unsigned char *key, size_t len)
+{
+    uint32_t h = 0x811c9dc5;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= key[i];
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+/*
+ * Build the key identifying the server of a connection:
+ * the lowercase host name prefixed with its length, the port, and the
+ * ALPN protocols of the configuration, each prefixed with its length.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_session_store_key(const mbedtls_ssl_context *ssl,
+                                 unsigned char *buf, size_t *len)
+{
+    const unsigned char * const end = buf + SSL_SESSION_STORE_KEY_MAX_LEN;
+    unsigned char *p = buf;
+    size_t host_len, i;
+
+    if (ssl->hostname == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    host_len = strlen(ssl->hostname);
+    /* A trailing dot denotes the same fully qualified name. */
+    if (host_len > 0 && ssl->hostname[host_len - 1] == '.') {
+        host_len--;
+    }
+    if (host_len == 0 || host_len > MBEDTLS_SSL_MAX_HOST_NAME_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    *p++ = MBEDTLS_BYTE_0(host_len);
+    for (i = 0; i < host_len; i++) {
+        unsigned char c = (unsigned char) ssl->hostname[i];
+
+        if (c >= 'A' && c <= 'Z') {
+            c = (unsigned char) (c - 'A' + 'a');
+        }
+        *p++ = c;
+    }
+
+    MBEDTLS_PUT_UINT16_BE(ssl->server_port, p, 0);
+    p += 2;
+
+#if defined(MBEDTLS_SSL_ALPN)
+    if (ssl->conf->alpn_list != NULL) {
+        const char **cur;
+
+        for (cur = ssl->conf->alpn_list; *cur != NULL; cur++) {
+            size_t alpn_len = strlen(*cur);
+
+            if (alpn_len > 255 || alpn_len + 1 > (size_t) (end - p)) {
+                return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            }
+            *p++ = MBEDTLS_BYTE_0(alpn_len);
+            memcpy(p, *cur, alpn_len);
+            p += alpn_len;
+        }
+    }
+#else
+    (void) end;
+#endif /* MBEDTLS_SSL_ALPN */
+
+    *len = (size_t) (p - buf);
+
+    return 0;
+}
+
+static mbedtls_ssl_session_store_entry *ssl_session_store_find(
+    mbedtls_ssl_session_store *store,
+    const unsigned char *key, size_t len, uint32_t hash)
+{
+    mbedtls_ssl_session_store_entry *cur;
+
+    if (store->buckets == 0) {
+        return NULL;
+    }
+
+    for (cur = store->table[hash & (store->buckets - 1)]; cur != NULL;
+         cur = cur->next) {
+        if (cur->hash == hash && cur->key_len == len &&
+            memcmp(cur->key, key, len) == 0) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+static void ssl_session_store_item_free(mbedtls_ssl_session_store_item *item)
+{
+    mbedtls_zeroize_and_free(item->session, item->session_len);
+    mbedtls_free(item);
+}
+
+static void ssl_session_store_entry_free(mbedtls_ssl_session_store_entry *entry)
+{
+    mbedtls_ssl_session_store_item *cur, *next;
+
+    for (cur = entry->items; cur != NULL; cur = next) {
+        next = cur->next;
+        ssl_session_store_item_free(cur);
+    }
+
+    mbedtls_free(entry->key);
+    mbedtls_free(entry);
+}
+
+static void ssl_session_store_remove(mbedtls_ssl_session_store *store,
+                                     mbedtls_ssl_session_store_entry *entry)
+{
+    mbedtls_ssl_session_store_entry **prev;
+
+    for (prev = &store->table[entry->hash & (store->buckets - 1)];
+         *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == entry) {
+            *prev = entry->next;
+            ssl_session_store_entry_free(entry);
+            store->count--;
+            return;
+        }
+    }
+}
+
+/* Drop the sessions that expired, and the ones beyond max_items. */
+static void ssl_session_store_purge(mbedtls_ssl_session_store_entry *entry,
+                                    mbedtls_ms_time_t now, size_t max_items)
+{
+    mbedtls_ssl_session_store_item **prev, *cur;
+    size_t kept = 0;
+
+    for (prev = &entry->items; *prev != NULL;) {
+        cur = *prev;
+        if ((cur->expiry != 0 && cur->expiry <= now) || kept >= max_items) {
+            *prev = cur->next;
+            ssl_session_store_item_free(cur);
+            entry->item_count--;
+            continue;
+        }
+        kept++;
+        prev = &cur->next;
+    }
+}
+
+/* Drop the server used least recently. */
+static void ssl_session_store_evict(mbedtls_ssl_session_store *store)
+{
+    mbedtls_ssl_session_store_entry *cur, *oldest = NULL;
+    size_t i;
+
+    for (i = 0; i < store->buckets; i++) {
+        for (cur = store->table[i]; cur != NULL; cur = cur->next) {
+            if (oldest == NULL || cur->last_used < oldest->last_used) {
+                oldest = cur;
+            }
+        }
+    }
+
+    if (oldest != NULL) {
+        ssl_session_store_remove(store, oldest);
+    }
+}
+
+/* Make room for one more entry, keeping the load factor at most 1. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_session_store_grow(mbedtls_ssl_session_store *store)
+{
+    mbedtls_ssl_session_store_entry **new_table, *cur, *next;
+    size_t new_buckets, i;
+
+    if (store->count < store->buckets) {
+        return 0;
+    }
+
+    new_buckets = store->buckets == 0 ? SSL_SESSION_STORE_INITIAL_BUCKETS
+                                      : store->buckets * 2;
+
+    new_table = mbedtls_calloc(new_buckets,
+                               sizeof(mbedtls_ssl_session_store_entry *));
+    if (new_table == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    for (i = 0; i < store->buckets; i++) {
+        for (cur = store->table[i]; cur != NULL; cur = next) {
+            next = cur->next;
+            cur->next = new_table[cur->hash & (new_buckets - 1)];
+            new_table[cur->hash & (new_buckets - 1)] = cur;
+        }
+    }
+
+    mbedtls_free(store->table);
+    store->table = new_table;
+    store->buckets = new_buckets;
+
+    return 0;
+}
+
+/*
+ * Serialize a session and compute its expiry time. Sessions that cannot be
+ * resumed are left with *item == NULL.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_session_store_item_new(const mbedtls_ssl_session_store *store,
+                                      const mbedtls_ssl_session *session,
+                                      mbedtls_ms_time_t now,
+                                      mbedtls_ssl_session_store_item **item)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_session_store_item *new_item;
+    mbedtls_ms_time_t expiry;
+    int single_use = 0;
+    size_t len;
+
+    *item = NULL;
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        if (session->ticket == NULL || session->ticket_lifetime == 0) {
+            return 0;
+        }
+        single_use = 1;
+        expiry = session->ticket_reception_time +
+                 (mbedtls_ms_time_t) session->ticket_lifetime * 1000;
+    } else
+#endif
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+        uint32_t lifetime = (uint32_t) store->timeout;
+        int has_ticket = 0;
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        if (session->ticket != NULL) {
+            has_ticket = 1;
+            if (session->ticket_lifetime != 0 &&
+                (lifetime == 0 || session->ticket_lifetime < lifetime)) {
+                lifetime = session->ticket_lifetime;
+            }
+        }
+#endif
+        if (session->id_len == 0 && !has_ticket) {
+            return 0;
+        }
+        expiry = lifetime == 0 ? 0 : now + (mbedtls_ms_time_t) lifetime * 1000;
+    } else {
+        return 0;
+    }
+
+    ret = mbedtls_ssl_session_save(session, NULL, 0, &len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return ret;
+    }
+
+    new_item = mbedtls_calloc(1, sizeof(mbedtls_ssl_session_store_item));
+    if (new_item == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    new_item->session = mbedtls_calloc(1, len);
+    if (new_item->session == NULL) {
+        mbedtls_free(new_item);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    ret = mbedtls_ssl_session_save(session, new_item->session, len,
+                                   &new_item->session_len);
+    if (ret != 0) {
+        ssl_session_store_item_free(new_item);
+        return ret;
+    }
+
+    new_item->expiry = expiry;
+    new_item->single_use = single_use;
+    *item = new_item;
+
+    return 0;
+}
+
+int mbedtls_ssl_session_store_put(mbedtls_ssl_session_store *store,
+                                  const mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[SSL_SESSION_STORE_KEY_MAX_LEN];
+    mbedtls_ssl_session_store_entry *entry;
+    mbedtls_ssl_session_store_item *item, *cur, *next;
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+    size_t key_len;
+    uint32_t hash;
+
+    if (ssl->session == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_session_store_key(ssl, key, &key_len);
+    if (ret != 0) {
+        return ret;
+    }
+    hash = ssl_session_store_hash(key, key_len);
+
+    ret = ssl_session_store_item_new(store, ssl->session, now, &item);
+    if (ret != 0 || item == NULL) {
+        return ret;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        ssl_session_store_item_free(item);
+        return ret;
+    }
+#endif
+
+    entry = ssl_session_store_find(store, key, key_len, hash);
+    if (entry == NULL) {
+        if (store->max_entries == 0) {
+            ret = 0;
+            goto exit;
+        }
+        while (store->count >= store->max_entries) {
+            ssl_session_store_evict(store);
+        }
+
+        ret = ssl_session_store_grow(store);
+        if (ret != 0) {
+            goto exit;
+        }
+
+        entry = mbedtls_calloc(1, sizeof(mbedtls_ssl_session_store_entry));
+        if (entry == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+        entry->key = mbedtls_calloc(1, key_len);
+        if (entry->key == NULL) {
+            mbedtls_free(entry);
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+        memcpy(entry->key, key, key_len);
+        entry->key_len = key_len;
+        entry->hash = hash;
+
+        entry->next = store->table[hash & (store->buckets - 1)];
+        store->table[hash & (store->buckets - 1)] = entry;
+        store->count++;
+    }
+
+    /* A new TLS 1.2 session replaces everything known about the server,
+     * and TLS 1.3 tickets replace a TLS 1.2 session. */
+    if (!item->single_use ||
+        (entry->items != NULL && !entry->items->single_use)) {
+        for (cur = entry->items; cur != NULL; cur = next) {
+            next = cur->next;
+            ssl_session_store_item_free(cur);
+        }
+        entry->items = NULL;
+        entry->item_count = 0;
+    }
+
+    item->next = entry->items;
+    entry->items = item;
+    entry->item_count++;
+    item = NULL;
+
+    ssl_session_store_purge(entry, now, MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS);
+    entry->last_used = now;
+
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (item != NULL) {
+        ssl_session_store_item_free(item);
+    }
+
+    return ret;
+}
+
+int mbedtls_ssl_session_store_get(mbedtls_ssl_session_store *store,
+                                  const mbedtls_ssl_context *ssl,
+                                  mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[SSL_SESSION_STORE_KEY_MAX_LEN];
+    mbedtls_ssl_session_store_entry *entry;
+    mbedtls_ssl_session_store_item *item;
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+    size_t key_len;
+    uint32_t hash;
+
+    if (ssl_session_store_key(ssl, key, &key_len) != 0) {
+        return MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    }
+    hash = ssl_session_store_hash(key, key_len);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+
+    entry = ssl_session_store_find(store, key, key_len, hash);
+    if (entry == NULL) {
+        goto exit;
+    }
+
+    ssl_session_store_purge(entry, now, MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS);
+    item = entry->items;
+    if (item != NULL) {
+        ret = mbedtls_ssl_session_load(session, item->session,
+                                       item->session_len);
+
+        /* A ticket is handed out once; a session that cannot be loaded
+         * is of no use either. */
+        if (item->single_use || ret != 0) {
+            entry->items = item->next;
+            entry->item_count--;
+            ssl_session_store_item_free(item);
+        }
+        entry->last_used = now;
+    }
+
+    if (entry->items == NULL) {
+        ssl_session_store_remove(store, entry);
+    }
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+static void ssl_session_store_table_free(mbedtls_ssl_session_store *store)
+{
+    mbedtls_ssl_session_store_entry *cur, *next;
+    size_t i;
+
+    for (i = 0; i < store->buckets; i++) {
+        for (cur = store->table[i]; cur != NULL; cur = next) {
+            next = cur->next;
+            ssl_session_store_entry_free(cur);
+        }
+    }
+
+    mbedtls_free(store->table);
+    store->table = NULL;
+    store->buckets = 0;
+    store->count = 0;
+}
+
+int mbedtls_ssl_session_store_clear(mbedtls_ssl_session_store *store)
+{
+    int ret = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    ssl_session_store_table_free(store);
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_session_store_free(mbedtls_ssl_session_store *store)
+{
+    if (store == NULL) {
+        return;
+    }
+
+    ssl_session_store_table_free(store);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&store->mutex);
+#endif
+
+    mbedtls_platform_zeroize(store, sizeof(mbedtls_ssl_session_store));
+}
+
+void mbedtls_ssl_session_store_resume(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_session session;
+
+    if (ssl->conf->session_store == NULL || ssl->hostname == NULL ||
+        ssl->handshake->resume != 0) {
+        return;
+    }
+
+    /* Only for the first ClientHello of an initial handshake */
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    if (ssl->renego_status != MBEDTLS_SSL_INITIAL_HANDSHAKE) {
+        return;
+    }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->handshake->hello_retry_request_flag) {
+        return;
+    }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS) || defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->handshake->cookie != NULL) {
+        return;
+    }
+#endif
+
+    mbedtls_ssl_session_init(&session);
+
+    ret = mbedtls_ssl_session_store_get(ssl->conf->session_store, ssl,
+                                        &session);
+    if (ret == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("resuming a session from the store"));
+        ret = mbedtls_ssl_set_session(ssl, &session);
+    }
+    if (ret != 0 && ret != MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND) {
+        MBEDTLS_SSL_DEBUG_RET(1, "session store", ret);
+    }
+
+    mbedtls_ssl_session_free(&session);
+}
+
+void mbedtls_ssl_session_store_capture(mbedtls_ssl_context *ssl)
+{
+    int ret;
+
+    if (ssl->conf->session_store == NULL || ssl->hostname == NULL) {
+        return;
+    }
+
+    ret = mbedtls_ssl_session_store_put(ssl->conf->session_store, ssl);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_session_store_put", ret);
+    }
+}
+
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
@@ -0,0 +1,429 @@
+/*
+ *  SSL session cache in memory shared between processes
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * The mapping starts with a header holding the geometry of the cache,
+ * followed by sets of MBEDTLS_SSL_SHM_CACHE_WAYS slots. A session ID is
+ * hashed to a set and may be in any slot of it.
+ *
+ * Each slot has a sequence number, odd while a writer owns the slot. A
+ * writer takes the slot by incrementing an even sequence number with a
+ * compare-and-swap, and never waits: if the slot is already taken, the
+ * session is simply not stored or removed. A reader copies the slot and
+ * keeps the copy only if the sequence number was even and did not change
+ * in between, so readers never take the slot at all. A process that dies
+ * while writing leaves the slot odd, which only makes that slot unusable.
+ *
+ * Nothing in the mapping is a pointer: the processes may map it at
+ * different addresses.
+ */
+
+/* Enable the declaration of MAP_ANONYMOUS even when compiling with
+ * -std=c99. Must be set before mbedtls_config.h, which pulls in glibc's
+ * features.h indirectly. */
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_SHM_CACHE_C)
+
+#if !defined(unix) && !defined(__unix__) && !defined(__unix) && \
+    !defined(__APPLE__)
+#error "This module only works on Unix, see MBEDTLS_SSL_SHM_CACHE_C in mbedtls_config.h"
+#endif
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_shm_cache.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#include <sys/mman.h>
+
+#if !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* Attempts to read a slot that is being written, before giving up. */
+#define SSL_SHM_CACHE_READ_TRIES    4
+
+/* Slots start on a cache line, so that writers of different slots do not
+ * slow each other down. */
+#define SSL_SHM_CACHE_ALIGN         64
+#define SSL_SHM_CACHE_ROUND(n)                                          \
+    (((n) + SSL_SHM_CACHE_ALIGN - 1) & ~((size_t) SSL_SHM_CACHE_ALIGN - 1))
+
+typedef struct {
+    uint32_t sets;                  /* number of sets                   */
+    uint32_t slot_size;             /* distance between slots           */
+    uint32_t max_session_len;       /* room for a serialized session    */
+    int32_t timeout;                /* entry lifetime, in seconds       */
+} ssl_shm_cache_header;
+
+typedef struct {
+    uint32_t seq;                   /* odd while being written          */
+    uint32_t session_len;           /* 0 if the slot is empty           */
+    int64_t timestamp;              /* time of insertion                */
+    unsigned char id_len;
+    unsigned char id[32];
+    /* Followed by the serialized session. */
+} ssl_shm_cache_slot;
+
+#define SSL_SHM_CACHE_HEADER_SIZE   SSL_SHM_CACHE_ROUND(sizeof(ssl_shm_cache_header))
+
+static ssl_shm_cache_slot *ssl_shm_cache_set_of(ssl_shm_cache_header *header,
+                                                unsigned char const *id,
+                                                size_t id_len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    /* FNV-1a */
+    for (i = 0; i < id_len; i++) {
+        hash = (hash ^ id[i]) * 16777619u;
+    }
+
+    return (ssl_shm_cache_slot *) ((unsigned char *) header +
+                                   SSL_SHM_CACHE_HEADER_SIZE +
+                                   (size_t) (hash % header->sets) *
+                                   MBEDTLS_SSL_SHM_CACHE_WAYS *
+                                   header->slot_size);
+}
+
+static ssl_shm_cache_slot *ssl_shm_cache_way(ssl_shm_cache_header *header,
+                                             ssl_shm_cache_slot *set,
+                                             size_t way)
+{
+    return (ssl_shm_cache_slot *) ((unsigned char *) set +
+                                   way * header->slot_size);
+}
+
+static unsigned char *ssl_shm_cache_data(ssl_shm_cache_slot *slot)
+{
+    return (unsigned char *) (slot + 1);
+}
+
+static int ssl_shm_cache_lock(ssl_shm_cache_slot *slot, uint32_t *seq)
+{
+    uint32_t cur = mbedtls_ssl_atomic_load_u32(&slot->seq);
+
+    if ((cur & 1) != 0 ||
+        !mbedtls_ssl_atomic_cas_acquire_u32(&slot->seq, cur, cur + 1)) {
+        return 0;
+    }
+
+    /* Readers must see the odd sequence number before any change to the
+     * slot. */
+    mbedtls_ssl_atomic_fence_release();
+
+    *seq = cur + 1;
+    return 1;
+}
+
+static void ssl_shm_cache_unlock(ssl_shm_cache_slot *slot, uint32_t seq)
+{
+    mbedtls_ssl_atomic_store_release_u32(&slot->seq, seq + 1);
+}
+
+static int ssl_shm_cache_matches(const ssl_shm_cache_slot *slot,
+                                 unsigned char const *id, size_t id_len)
+{
+    return slot->session_len != 0 && slot->id_len == id_len &&
+           memcmp(slot->id, id, id_len) == 0;
+}
+
+static int ssl_shm_cache_expired(const ssl_shm_cache_slot *slot,
+                                 mbedtls_time_t now, int32_t timeout)
+{
+    return timeout != 0 && (int64_t) now - slot->timestamp > timeout;
+}
+
+void mbedtls_ssl_shm_cache_init(mbedtls_ssl_shm_cache_context *cache)
+{
+    memset(cache, 0, sizeof(mbedtls_ssl_shm_cache_context));
+}
+
+int mbedtls_ssl_shm_cache_setup(mbedtls_ssl_shm_cache_context *cache,
+                                size_t max_entries,
+                                size_t max_session_len)
+{
+    ssl_shm_cache_header *header;
+    size_t sets, slot_size, map_len;
+    void *map;
+
+    if (cache->map != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (max_entries == 0) {
+        max_entries = MBEDTLS_SSL_SHM_CACHE_DEFAULT_MAX_ENTRIES;
+    }
+    if (max_session_len == 0) {
+        max_session_len = MBEDTLS_SSL_SHM_CACHE_DEFAULT_SESSION_LEN;
+    }
+
+    if (max_entries > UINT32_MAX || max_session_len > UINT32_MAX / 2) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    sets = (max_entries + MBEDTLS_SSL_SHM_CACHE_WAYS - 1) /
+           MBEDTLS_SSL_SHM_CACHE_WAYS;
+    slot_size = SSL_SHM_CACHE_ROUND(sizeof(ssl_shm_cache_slot) +
+                                    max_session_len);
+    if (sets * MBEDTLS_SSL_SHM_CACHE_WAYS >
+        (SIZE_MAX - SSL_SHM_CACHE_HEADER_SIZE) / slot_size) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    map_len = SSL_SHM_CACHE_HEADER_SIZE +
+              sets * MBEDTLS_SSL_SHM_CACHE_WAYS * slot_size;
+
+    /* Anonymous mappings are zero-filled: all the slots are empty. */
+    map = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    header = (ssl_shm_cache_header *) map;
+    header->sets = (uint32_t) sets;
+    header->slot_size = (uint32_t) slot_size;
+    header->max_session_len = (uint32_t) max_session_len;
+    header->timeout = MBEDTLS_SSL_SHM_CACHE_DEFAULT_TIMEOUT;
+
+    cache->map = map;
+    cache->map_len = map_len;
+
+    return 0;
+}
+
+int mbedtls_ssl_shm_cache_get(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    mbedtls_ssl_shm_cache_context *cache = (mbedtls_ssl_shm_cache_context *) data;
+    ssl_shm_cache_header *header = (ssl_shm_cache_header *) cache->map;
+    ssl_shm_cache_slot *set, *slot;
+    mbedtls_time_t now = mbedtls_time(NULL);
+    unsigned char *buf = NULL;
+    size_t way, len = 0;
+    uint32_t seq;
+    int32_t timeout;
+    int tries, match, found = 0;
+
+    if (header == NULL || session_id_len == 0 ||
+        session_id_len > sizeof(set->id)) {
+        return MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    }
+
+    buf = mbedtls_calloc(1, header->max_session_len);
+    if (buf == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    timeout = (int32_t) mbedtls_ssl_atomic_load_u32((const uint32_t *) &header->timeout);
+    set = ssl_shm_cache_set_of(header, session_id, session_id_len);
+
+    for (way = 0; way < MBEDTLS_SSL_SHM_CACHE_WAYS && !found; way++) {
+        slot = ssl_shm_cache_way(header, set, way);
+
+        for (tries = 0; tries < SSL_SHM_CACHE_READ_TRIES; tries++) {
+            seq = mbedtls_ssl_atomic_load_acquire_u32(&slot->seq);
+            if ((seq & 1) != 0) {
+                continue;
+            }
+
+            /* The slot may change under our feet: check the length before
+             * using it, and the sequence number before trusting the copy. */
+            len = slot->session_len;
+            match = len <= header->max_session_len &&
+                    ssl_shm_cache_matches(slot, session_id, session_id_len) &&
+                    !ssl_shm_cache_expired(slot, now, timeout);
+            if (match) {
+                memcpy(buf, ssl_shm_cache_data(slot), len);
+            }
+
+            mbedtls_ssl_atomic_fence_acquire();
+            if (mbedtls_ssl_atomic_load_u32(&slot->seq) == seq) {
+                found = match;
+                break;
+            }
+        }
+    }
+
+    if (!found) {
+        goto exit;
+    }
+
+    ret = mbedtls_ssl_session_load(session, buf, len);
+
+exit:
+    mbedtls_zeroize_and_free(buf, header->max_session_len);
+
+    return ret;
+}
+
+int mbedtls_ssl_shm_cache_set(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              const mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_shm_cache_context *cache = (mbedtls_ssl_shm_cache_context *) data;
+    ssl_shm_cache_header *header = (ssl_shm_cache_header *) cache->map;
+    ssl_shm_cache_slot *set, *slot;
+    ssl_shm_cache_slot *same = NULL, *free_slot = NULL, *oldest = NULL;
+    mbedtls_time_t now = mbedtls_time(NULL);
+    size_t way, len, old_len;
+    uint32_t seq;
+    int32_t timeout;
+
+    if (header == NULL || session_id_len == 0 ||
+        session_id_len > sizeof(set->id)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Do not evict anything for a session that cannot be stored. */
+    ret = mbedtls_ssl_session_save(session, NULL, 0, &len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return ret == 0 ? MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED : ret;
+    }
+    if (len > header->max_session_len) {
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    timeout = (int32_t) mbedtls_ssl_atomic_load_u32((const uint32_t *) &header->timeout);
+    set = ssl_shm_cache_set_of(header, session_id, session_id_len);
+
+    /* Choose a slot without locking: the choice may be out of date by the
+     * time we write, which at worst evicts another session than the
+     * oldest one. Slots owned by another writer are skipped, since their
+     * content is not meaningful and locking them would fail. */
+    for (way = 0; way < MBEDTLS_SSL_SHM_CACHE_WAYS; way++) {
+        slot = ssl_shm_cache_way(header, set, way);
+
+        if ((mbedtls_ssl_atomic_load_u32(&slot->seq) & 1) != 0) {
+            continue;
+        }
+        if (ssl_shm_cache_matches(slot, session_id, session_id_len)) {
+            same = slot;
+            break;
+        }
+        if (free_slot == NULL &&
+            (slot->session_len == 0 ||
+             ssl_shm_cache_expired(slot, now, timeout))) {
+            free_slot = slot;
+        }
+        if (oldest == NULL || slot->timestamp < oldest->timestamp) {
+            oldest = slot;
+        }
+    }
+
+    slot = same != NULL ? same : free_slot != NULL ? free_slot : oldest;
+    if (slot == NULL || !ssl_shm_cache_lock(slot, &seq)) {
+        return 0;
+    }
+
+    old_len = slot->session_len;
+    if (old_len > header->max_session_len) {
+        old_len = header->max_session_len;
+    }
+
+    ret = mbedtls_ssl_session_save(session, ssl_shm_cache_data(slot),
+                                   header->max_session_len, &len);
+    if (ret == 0) {
+        /* Leave nothing of a longer previous session behind. */
+        if (len < old_len) {
+            mbedtls_platform_zeroize(ssl_shm_cache_data(slot) + len,
+                                     old_len - len);
+        }
+        slot->session_len = (uint32_t) len;
+        slot->timestamp = (int64_t) now;
+        slot->id_len = (unsigned char) session_id_len;
+        memcpy(slot->id, session_id, session_id_len);
+    } else {
+        mbedtls_platform_zeroize(ssl_shm_cache_data(slot),
+                                 header->max_session_len);
+        slot->session_len = 0;
+    }
+
+    ssl_shm_cache_unlock(slot, seq);
+
+    return ret;
+}
+
+int mbedtls_ssl_shm_cache_remove(void *data,
+                                 unsigned char const *session_id,
+                                 size_t session_id_len)
+{
+    mbedtls_ssl_shm_cache_context *cache = (mbedtls_ssl_shm_cache_context *) data;
+    ssl_shm_cache_header *header = (ssl_shm_cache_header *) cache->map;
+    ssl_shm_cache_slot *set, *slot;
+    size_t way;
+    uint32_t seq;
+
+    if (header == NULL || session_id_len == 0 ||
+        session_id_len > sizeof(set->id)) {
+        return 0;
+    }
+
+    set = ssl_shm_cache_set_of(header, session_id, session_id_len);
+
+    for (way = 0; way < MBEDTLS_SSL_SHM_CACHE_WAYS; way++) {
+        slot = ssl_shm_cache_way(header, set, way);
+
+        if (!ssl_shm_cache_matches(slot, session_id, session_id_len) ||
+            !ssl_shm_cache_lock(slot, &seq)) {
+            continue;
+        }
+
+        /* Check again now that the slot cannot change. */
+        if (ssl_shm_cache_matches(slot, session_id, session_id_len)) {
+            slot->session_len = 0;
+            mbedtls_platform_zeroize(ssl_shm_cache_data(slot),
+                                     header->max_session_len);
+        }
+
+        ssl_shm_cache_unlock(slot, seq);
+    }
+
+    return 0;
+}
+
+void mbedtls_ssl_shm_cache_set_timeout(mbedtls_ssl_shm_cache_context *cache,
+                                       int timeout)
+{
+    ssl_shm_cache_header *header = (ssl_shm_cache_header *) cache->map;
+
+    if (header == NULL) {
+        return;
+    }
+
+    if (timeout < 0) {
+        timeout = 0;
+    }
+
+    mbedtls_ssl_atomic_store_u32((uint32_t *) &header->timeout, (uint32_t) timeout);
+}
+
+void mbedtls_ssl_shm_cache_free(mbedtls_ssl_shm_cache_context *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    if (cache->map != NULL) {
+        munmap(cache->map, cache->map_len);
+    }
+
+    mbedtls_platform_zeroize(cache, sizeof(mbedtls_ssl_shm_cache_context));
+}
+
+#endif /* MBEDTLS_SSL_SHM_CACHE_C */
@@ -0,0 +1,447 @@
+/*
+ *  SNI-indexed server certificate store
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Host names are kept in chained hash tables that grow with the number of
+ * names, so that the SNI callback does a constant amount of work however
+ * many virtual hosts are served. The TLS 1.3 signature algorithms usable
+ * with each certificate are computed once when the certificate is added.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_SNI_STORE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_sni_store.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+void mbedtls_ssl_sni_store_init(mbedtls_ssl_sni_store *store)
+{
+    memset(store, 0, sizeof(mbedtls_ssl_sni_store));
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&store->mutex);
+#endif
+}
+
+void mbedtls_ssl_sni_store_set_strict(mbedtls_ssl_sni_store *store,
+                                      int strict)
+{
+    store->strict = strict;
+}
+
+/* FNV-1a */
+static uint32_t ssl_sni_store_hash(const unsigned char *name, size_t len)
+{
+    uint32_t h = 0x811c9dc5;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        h ^= name[i];
+        h *= 0x01000193;
+    }
+
+    return h;
+}
+
+/*
+ * Copy a host name to buf in lowercase. Return its length, or 0 if it is
+ * empty, too long or contains a null byte.
+ */
+static size_t ssl_sni_store_normalize(unsigned char *buf,
+                                      const unsigned char *name, size_t len)
+{
+    size_t i;
+
+    /* A trailing dot denotes the same fully qualified name. */
+    if (len > 0 && name[len - 1] == '.') {
+        len--;
+    }
+
+    if (len == 0 || len > MBEDTLS_SSL_MAX_HOST_NAME_LEN) {
+        return 0;
+    }
+
+    for (i = 0; i < len; i++) {
+        unsigned char c = name[i];
+
+        if (c == '\0') {
+            return 0;
+        }
+        if (c >= 'A' && c <= 'Z') {
+            c = (unsigned char) (c - 'A' + 'a');
+        }
+        buf[i] = c;
+    }
+
+    return len;
+}
+
+static mbedtls_ssl_sni_entry *ssl_sni_store_find(
+    mbedtls_ssl_sni_entry **table, size_t buckets,
+    const unsigned char *name, size_t len, uint32_t hash)
+{
+    mbedtls_ssl_sni_entry *cur;
+
+    if (buckets == 0) {
+        return NULL;
+    }
+
+    for (cur = table[hash & (buckets - 1)]; cur != NULL; cur = cur->next) {
+        if (cur->hash == hash && cur->name_len == len &&
+            memcmp(cur->name, name, len) == 0) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+/* Make room for one more entry, keeping the load factor at most 1. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_sni_store_grow(mbedtls_ssl_sni_entry ***table,
+                              size_t *buckets, size_t count)
+{
+    mbedtls_ssl_sni_entry **new_table, *cur, *next;
+    size_t new_buckets, i;
+
+    if (count < *buckets) {
+        return 0;
+    }
+
+    new_buckets = *buckets == 0 ? MBEDTLS_SSL_SNI_STORE_INITIAL_BUCKETS
+                                : *buckets * 2;
+    if (new_buckets == 0 || (new_buckets & (new_buckets - 1)) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    new_table = mbedtls_calloc(new_buckets, sizeof(mbedtls_ssl_sni_entry *));
+    if (new_table == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    for (i = 0; i < *buckets; i++) {
+        for (cur = (*table)[i]; cur != NULL; cur = next) {
+            next = cur->next;
+            cur->next = new_table[cur->hash & (new_buckets - 1)];
+            new_table[cur->hash & (new_buckets - 1)] = cur;
+        }
+    }
+
+    mbedtls_free(*table);
+    *table = new_table;
+    *buckets = new_buckets;
+
+    return 0;
+}
+
+static void ssl_sni_store_entry_free(mbedtls_ssl_sni_entry *entry)
+{
+    mbedtls_ssl_sni_cert *cur, *next;
+
+    for (cur = entry->certs; cur != NULL; cur = next) {
+        next = cur->next;
+        mbedtls_free(cur);
+    }
+
+    mbedtls_free(entry->name);
+    mbedtls_free(entry);
+}
+
+/*
+ * Split a registered name into the table it belongs to and its key:
+ * "*.example.com" is stored as "example.com" in the wildcard table.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_sni_store_parse_name(const char *name,
+                                    unsigned char *buf, size_t *len,
+                                    int *wildcard)
+{
+    const unsigned char *p = (const unsigned char *) name;
+    size_t name_len;
+
+    if (name == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    name_len = strlen(name);
+    *wildcard = 0;
+
+    if (name_len >= 2 && p[0] == '*' && p[1] == '.') {
+        *wildcard = 1;
+        p += 2;
+        name_len -= 2;
+    }
+
+    *len = ssl_sni_store_normalize(buf, p, name_len);
+    if (*len == 0 || memchr(buf, '*', *len) != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_sni_store_add(mbedtls_ssl_sni_store *store,
+                              const char *name,
+                              mbedtls_x509_crt *cert,
+                              mbedtls_pk_context *key)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char buf[MBEDTLS_SSL_MAX_HOST_NAME_LEN];
+    size_t len;
+    int wildcard;
+    uint32_t hash;
+    mbedtls_ssl_sni_entry ***table, *entry;
+    size_t *buckets, *count;
+    mbedtls_ssl_sni_cert *new_cert, **tail;
+
+    if (cert == NULL || key == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_sni_store_parse_name(name, buf, &len, &wildcard);
+    if (ret != 0) {
+        return ret;
+    }
+    hash = ssl_sni_store_hash(buf, len);
+
+    new_cert = mbedtls_calloc(1, sizeof(mbedtls_ssl_sni_cert));
+    if (new_cert == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    new_cert->cert = cert;
+    new_cert->key = key;
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
+    new_cert->sig_algs = mbedtls_ssl_tls13_key_cert_sig_algs(cert);
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        mbedtls_free(new_cert);
+        return ret;
+    }
+#endif
+
+    if (wildcard) {
+        table = &store->wildcard;
+        buckets = &store->wildcard_buckets;
+        count = &store->wildcard_count;
+    } else {
+        table = &store->exact;
+        buckets = &store->exact_buckets;
+        count = &store->exact_count;
+    }
+
+    entry = ssl_sni_store_find(*table, *buckets, buf, len, hash);
+    if (entry == NULL) {
+        ret = ssl_sni_store_grow(table, buckets, *count);
+        if (ret != 0) {
+            goto exit;
+        }
+
+        entry = mbedtls_calloc(1, sizeof(mbedtls_ssl_sni_entry));
+        if (entry == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+        entry->name = mbedtls_calloc(1, len);
+        if (entry->name == NULL) {
+            mbedtls_free(entry);
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+        memcpy(entry->name, buf, len);
+        entry->name_len = len;
+        entry->hash = hash;
+
+        entry->next = (*table)[hash & (*buckets - 1)];
+        (*table)[hash & (*buckets - 1)] = entry;
+        (*count)++;
+    }
+
+    /* Keep the registration order: it is the order of preference. */
+    tail = &entry->certs;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = new_cert;
+    new_cert = NULL;
+
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    mbedtls_free(new_cert);
+
+    return ret;
+}
+
+int mbedtls_ssl_sni_store_remove(mbedtls_ssl_sni_store *store,
+                                 const char *name)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char buf[MBEDTLS_SSL_MAX_HOST_NAME_LEN];
+    size_t len;
+    int wildcard;
+    uint32_t hash;
+    mbedtls_ssl_sni_entry **table, **prev, *cur;
+    size_t buckets, *count;
+
+    ret = ssl_sni_store_parse_name(name, buf, &len, &wildcard);
+    if (ret != 0) {
+        return ret;
+    }
+    hash = ssl_sni_store_hash(buf, len);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (wildcard) {
+        table = store->wildcard;
+        buckets = store->wildcard_buckets;
+        count = &store->wildcard_count;
+    } else {
+        table = store->exact;
+        buckets = store->exact_buckets;
+        count = &store->exact_count;
+    }
+
+    if (buckets != 0) {
+        for (prev = &table[hash & (buckets - 1)]; *prev != NULL;
+             prev = &(*prev)->next) {
+            cur = *prev;
+            if (cur->hash == hash && cur->name_len == len &&
+                memcmp(cur->name, buf, len) == 0) {
+                *prev = cur->next;
+                ssl_sni_store_entry_free(cur);
+                (*count)--;
+                break;
+            }
+        }
+    }
+
+    ret = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_sni_store_cb(void *p_store, mbedtls_ssl_context *ssl,
+                             const unsigned char *name, size_t name_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_sni_store *store = (mbedtls_ssl_sni_store *) p_store;
+    unsigned char buf[MBEDTLS_SSL_MAX_HOST_NAME_LEN];
+    const unsigned char *dot;
+    mbedtls_ssl_sni_entry *entry;
+    mbedtls_ssl_sni_cert *cur;
+    size_t len;
+
+    len = ssl_sni_store_normalize(buf, name, name_len);
+    if (len == 0) {
+        return store->strict ? MBEDTLS_ERR_SSL_UNRECOGNIZED_NAME : 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry = ssl_sni_store_find(store->exact, store->exact_buckets,
+                               buf, len, ssl_sni_store_hash(buf, len));
+
+    /* A wildcard only stands for the leftmost label (RFC 6125 6.4.3). */
+    dot = entry == NULL ? memchr(buf, '.', len) : NULL;
+    if (dot != NULL && dot != buf) {
+        size_t suffix_len = len - (size_t) (dot + 1 - buf);
+
+        if (suffix_len > 0) {
+            entry = ssl_sni_store_find(store->wildcard,
+                                       store->wildcard_buckets,
+                                       dot + 1, suffix_len,
+                                       ssl_sni_store_hash(dot + 1,
+                                                          suffix_len));
+        }
+    }
+
+    if (entry == NULL) {
+        MBEDTLS_SSL_DEBUG_BUF(3, "SNI store: unknown server name",
+                              name, name_len);
+        ret = store->strict ? MBEDTLS_ERR_SSL_UNRECOGNIZED_NAME : 0;
+        goto exit;
+    }
+
+    for (cur = entry->certs; cur != NULL; cur = cur->next) {
+        ret = mbedtls_ssl_set_hs_own_cert_sig_algs(ssl, cur->cert, cur->key,
+                                                   cur->sig_algs);
+        if (ret != 0) {
+            goto exit;
+        }
+    }
+
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+static void ssl_sni_store_table_free(mbedtls_ssl_sni_entry **table,
+                                     size_t buckets)
+{
+    mbedtls_ssl_sni_entry *cur, *next;
+    size_t i;
+
+    for (i = 0; i < buckets; i++) {
+        for (cur = table[i]; cur != NULL; cur = next) {
+            next = cur->next;
+            ssl_sni_store_entry_free(cur);
+        }
+    }
+
+    mbedtls_free(table);
+}
+
+void mbedtls_ssl_sni_store_free(mbedtls_ssl_sni_store *store)
+{
+    if (store == NULL) {
+        return;
+    }
+
+    ssl_sni_store_table_free(store->exact, store->exact_buckets);
+    ssl_sni_store_table_free(store->wildcard, store->wildcard_buckets);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&store->mutex);
+#endif
+
+    mbedtls_platform_zeroize(store, sizeof(mbedtls_ssl_sni_store));
+}
+
+#endif /* MBEDTLS_SSL_SNI_STORE_C */
@@ -292,10 +292,16 @@ int mbedtls_ssl_ticket_write(void *p_ticket,
     }
 
     /* Dump session state */
-    if ((ret = mbedtls_ssl_session_save(session,
-                                        state, (size_t) (end - state),
-                                        &clear_len)) != 0 ||
-        (unsigned long) clear_len > 65535) {
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+    if (ctx->compact) {
+        ret = mbedtls_ssl_session_save_compact(session, ctx->compact_flags,
+                                               state, (size_t) (end - state),
+                                               &clear_len);
+    } else
+#endif
+    ret = mbedtls_ssl_session_save(session, state, (size_t) (end - state),
+                                   &clear_len);
+    if (ret != 0 || (unsigned long) clear_len > 65535) {
         goto cleanup;
     }
     MBEDTLS_PUT_UINT16_BE(clear_len, state_len_bytes, 0);
@@ -412,7 +418,13 @@ int mbedtls_ssl_ticket_parse(void *p_ticket,
     }
 
     /* Actually load session */
-    if ((ret = mbedtls_ssl_session_load(session, ticket, clear_len)) != 0) {
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+    if (clear_len > 0 && ticket[0] == MBEDTLS_SSL_COMPACT_SESSION_MAGIC) {
+        ret = mbedtls_ssl_session_load_compact(session, ticket, clear_len);
+    } else
+#endif
+    ret = mbedtls_ssl_session_load(session, ticket, clear_len);
+    if (ret != 0) {
         goto cleanup;
     }
 
@@ -444,6 +456,18 @@ cleanup:
     return ret;
 }
 
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+/*
+ * Choose the session encoding of new tickets
+ */
+void mbedtls_ssl_ticket_set_compact(mbedtls_ssl_ticket_context *ctx,
+                                    int enable, int flags)
+{
+    ctx->compact = (unsigned char) (enable != 0);
+    ctx->compact_flags = flags;
+}
+#endif /* MBEDTLS_SSL_COMPACT_SESSION */
+
 /*
  * Free context
  */
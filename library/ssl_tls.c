@@ -241,6 +241,17 @@ int mbedtls_ssl_session_copy(mbedtls_ssl_session *dst,
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    if (src->peer_cert != NULL && src->peer_cert_shared) {
+        /* Share the certificate, whose pointer was copied above. */
+        int ret = mbedtls_ssl_cert_store_ref(src->peer_cert);
+        if (ret != 0) {
+            dst->peer_cert = NULL;
+            dst->peer_cert_shared = 0;
+            return ret;
+        }
+    } else
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
     if (src->peer_cert != NULL) {
         int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
@@ -346,7 +357,8 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
         iv_offset_in = ssl->in_iv - ssl->in_buf;
         len_offset_in = ssl->in_len - ssl->in_buf;
         if (downsizing ?
-            ssl->in_buf_len > in_buf_new_len && ssl->in_left < in_buf_new_len :
+            ssl->in_buf_len > in_buf_new_len &&
+            (size_t) (ssl->in_hdr - ssl->in_buf) + ssl->in_left < in_buf_new_len :
             ssl->in_buf_len < in_buf_new_len) {
             if (resize_buffer(&ssl->in_buf, in_buf_new_len, &ssl->in_buf_len) != 0) {
                 MBEDTLS_SSL_DEBUG_MSG(1, ("input buffer resizing failed - out of memory"));
@@ -354,6 +366,7 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
                 MBEDTLS_SSL_DEBUG_MSG(2, ("Reallocating in_buf to %" MBEDTLS_PRINTF_SIZET,
                                           in_buf_new_len));
                 modified = 1;
+                MBEDTLS_SSL_STATS_ADD(ssl, buffer_resizes, 1);
             }
         }
     }
@@ -363,7 +376,8 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
         iv_offset_out = ssl->out_iv - ssl->out_buf;
         len_offset_out = ssl->out_len - ssl->out_buf;
         if (downsizing ?
-            ssl->out_buf_len > out_buf_new_len && ssl->out_left < out_buf_new_len :
+            ssl->out_buf_len > out_buf_new_len &&
+            (size_t) (ssl->out_hdr - ssl->out_buf) < out_buf_new_len :
             ssl->out_buf_len < out_buf_new_len) {
             if (resize_buffer(&ssl->out_buf, out_buf_new_len, &ssl->out_buf_len) != 0) {
                 MBEDTLS_SSL_DEBUG_MSG(1, ("output buffer resizing failed - out of memory"));
@@ -371,6 +385,7 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
                 MBEDTLS_SSL_DEBUG_MSG(2, ("Reallocating out_buf to %" MBEDTLS_PRINTF_SIZET,
                                           out_buf_new_len));
                 modified = 1;
+                MBEDTLS_SSL_STATS_ADD(ssl, buffer_resizes, 1);
             }
         }
     }
@@ -490,6 +505,13 @@ int  mbedtls_ssl_tls_prf(const mbedtls_tls_prf_types prf,
 static void ssl_clear_peer_cert(mbedtls_ssl_session *session)
 {
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    if (session->peer_cert != NULL && session->peer_cert_shared) {
+        mbedtls_ssl_cert_store_release(session->peer_cert);
+        session->peer_cert = NULL;
+        session->peer_cert_shared = 0;
+    }
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
     if (session->peer_cert != NULL) {
         mbedtls_x509_crt_free(session->peer_cert);
         mbedtls_free(session->peer_cert);
@@ -1317,6 +1339,20 @@ error:
     return ret;
 }
 
+/*
+ * Length of the start of a record buffer to zeroize on reset: the part that
+ * may hold data, and at least the record header, whose counter must start
+ * from zero again.
+ */
+static size_t ssl_buf_dirty_len(size_t dirty, size_t header, size_t buf_len)
+{
+    if (dirty < header) {
+        dirty = header;
+    }
+
+    return dirty < buf_len ? dirty : buf_len;
+}
+
 /*
  * Reset an initialized and used SSL context for re-use while retaining
  * all application-set variables, function pointers and data.
@@ -1353,24 +1389,39 @@ void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
     ssl->keep_current_message = 0;
     ssl->transform_in  = NULL;
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
     ssl->next_record_offset = 0;
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
     ssl->in_epoch = 0;
 #endif
 
     /* Keep current datagram if partial == 1 */
     if (partial == 0) {
         ssl->in_left = 0;
-        memset(ssl->in_buf, 0, in_buf_len);
+        memset(ssl->in_buf, 0, ssl_buf_dirty_len(ssl->in_buf_dirty,
+                                                 (size_t) (ssl->in_msg - ssl->in_buf),
+                                                 in_buf_len));
+        ssl->in_buf_dirty = 0;
     }
 
     ssl->send_alert = 0;
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    ssl->duplex = 0;
+    ssl->duplex_flags = 0;
+    ssl->duplex_alert_sending = 0;
+#endif
+
     /* Reset outgoing message writing */
     ssl->out_msgtype = 0;
     ssl->out_msglen  = 0;
     ssl->out_left    = 0;
-    memset(ssl->out_buf, 0, out_buf_len);
+    ssl->out_corked  = 0;
+    ssl->out_packed  = 0;
+    ssl->record_warm_bytes = 0;
+    memset(ssl->out_buf, 0, ssl_buf_dirty_len(ssl->out_buf_dirty,
+                                              (size_t) (ssl->out_msg - ssl->out_buf),
+                                              out_buf_len));
+    ssl->out_buf_dirty = 0;
     memset(ssl->cur_out_ctr, 0, sizeof(ssl->cur_out_ctr));
     ssl->transform_out = NULL;
 
@@ -1410,6 +1461,12 @@ int mbedtls_ssl_session_reset_int(mbedtls_ssl_context *ssl, int partial)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
+    /* A handshake that did not complete may have left a message partly
+     * written after the last record: zeroize the whole output buffer. */
+    if (!mbedtls_ssl_is_handshake_over(ssl)) {
+        ssl->out_buf_dirty = SIZE_MAX;
+    }
+
     ssl->state = MBEDTLS_SSL_HELLO_REQUEST;
     ssl->tls_version = ssl->conf->max_tls_version;
 
@@ -1438,6 +1495,29 @@ int mbedtls_ssl_session_reset_int(mbedtls_ssl_context *ssl, int partial)
     ssl->alpn_chosen = NULL;
 #endif
 
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats_init(&ssl->stats);
+#endif
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+    mbedtls_ssl_hs_timing_reset_ctx(ssl);
+#endif
+
+#if defined(MBEDTLS_SSL_KTLS_C)
+    ssl->ktls_mode = 0;
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    /* A partial reset keeps the same peer, with its round-trip time and
+     * path MTU */
+    if (partial == 0) {
+#if defined(MBEDTLS_HAVE_TIME)
+        memset(&ssl->rtt, 0, sizeof(ssl->rtt));
+#endif
+        mbedtls_ssl_dtls_pmtud_black_hole(ssl);
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY) && defined(MBEDTLS_SSL_SRV_C)
     int free_cli_id = 1;
 #if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE)
@@ -1450,6 +1530,13 @@ int mbedtls_ssl_session_reset_int(mbedtls_ssl_context *ssl, int partial)
     }
 #endif
 
+#if defined(MBEDTLS_SSL_SRV_C)
+    if (partial == 0) {
+        memset(ssl->peer_addr, 0, sizeof(ssl->peer_addr));
+        ssl->peer_addr_len = 0;
+    }
+#endif
+
     if ((ret = ssl_handshake_init(ssl)) != 0) {
         return ret;
     }
@@ -1491,6 +1578,72 @@ void mbedtls_ssl_conf_dtls_badmac_limit(mbedtls_ssl_config *conf, unsigned limit
     conf->badmac_limit = limit;
 }
 
+#if defined(MBEDTLS_SSL_KTLS_C)
+void mbedtls_ssl_conf_ktls(mbedtls_ssl_config *conf, char mode)
+{
+    conf->ktls = mode;
+}
+#endif /* MBEDTLS_SSL_KTLS_C */
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+void mbedtls_ssl_conf_handshake_timing(mbedtls_ssl_config *conf,
+                                       mbedtls_ssl_hs_timing *timing)
+{
+    conf->hs_timing = timing;
+}
+#endif /* MBEDTLS_SSL_HANDSHAKE_TIMING */
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+void mbedtls_ssl_conf_session_store(mbedtls_ssl_config *conf,
+                                    mbedtls_ssl_session_store *store)
+{
+    conf->session_store = store;
+}
+
+void mbedtls_ssl_set_server_port(mbedtls_ssl_context *ssl, uint16_t port)
+{
+    ssl->server_port = port;
+}
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
+#if defined(MBEDTLS_SSL_STATS)
+void mbedtls_ssl_stats_init(mbedtls_ssl_stats *stats)
+{
+    memset(stats, 0, sizeof(mbedtls_ssl_stats));
+}
+
+void mbedtls_ssl_conf_stats(mbedtls_ssl_config *conf,
+                            mbedtls_ssl_stats *stats)
+{
+    conf->stats = stats;
+}
+
+void mbedtls_ssl_stats_read(const mbedtls_ssl_stats *stats,
+                            mbedtls_ssl_stats *snapshot)
+{
+    snapshot->records_in = mbedtls_ssl_atomic_load_u64(&stats->records_in);
+    snapshot->records_out = mbedtls_ssl_atomic_load_u64(&stats->records_out);
+    snapshot->bytes_in = mbedtls_ssl_atomic_load_u64(&stats->bytes_in);
+    snapshot->bytes_out = mbedtls_ssl_atomic_load_u64(&stats->bytes_out);
+    snapshot->decrypt_failures =
+        mbedtls_ssl_atomic_load_u64(&stats->decrypt_failures);
+    snapshot->retransmissions =
+        mbedtls_ssl_atomic_load_u64(&stats->retransmissions);
+    snapshot->renegotiations =
+        mbedtls_ssl_atomic_load_u64(&stats->renegotiations);
+    snapshot->want_read = mbedtls_ssl_atomic_load_u64(&stats->want_read);
+    snapshot->want_write = mbedtls_ssl_atomic_load_u64(&stats->want_write);
+    snapshot->buffer_resizes =
+        mbedtls_ssl_atomic_load_u64(&stats->buffer_resizes);
+}
+
+void mbedtls_ssl_get_stats(const mbedtls_ssl_context *ssl,
+                           mbedtls_ssl_stats *stats)
+{
+    memcpy(stats, &ssl->stats, sizeof(mbedtls_ssl_stats));
+}
+#endif /* MBEDTLS_SSL_STATS */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 
 void mbedtls_ssl_set_datagram_packing(mbedtls_ssl_context *ssl,
@@ -1505,6 +1658,25 @@ void mbedtls_ssl_conf_handshake_timeout(mbedtls_ssl_config *conf,
     conf->hs_timeout_min = min;
     conf->hs_timeout_max = max;
 }
+
+#if defined(MBEDTLS_HAVE_TIME)
+void mbedtls_ssl_conf_dtls_rto(mbedtls_ssl_config *conf, char mode)
+{
+    conf->dtls_rto = mode;
+}
+
+void mbedtls_ssl_get_dtls_rtt(const mbedtls_ssl_context *ssl,
+                              mbedtls_ssl_dtls_rtt *rtt)
+{
+    *rtt = ssl->rtt;
+}
+
+void mbedtls_ssl_set_dtls_rtt(mbedtls_ssl_context *ssl,
+                              const mbedtls_ssl_dtls_rtt *rtt)
+{
+    ssl->rtt = *rtt;
+}
+#endif /* MBEDTLS_HAVE_TIME */
 #endif
 
 void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *conf, int authmode)
@@ -1555,6 +1727,152 @@ void mbedtls_ssl_set_mtu(mbedtls_ssl_context *ssl, uint16_t mtu)
 {
     ssl->mtu = mtu;
 }
+
+int mbedtls_ssl_conf_dtls_pmtud(mbedtls_ssl_config *conf,
+                                uint16_t base, uint16_t max)
+{
+    if (max != 0 && (base == 0 || base > max)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    conf->pmtud_base = base;
+    conf->pmtud_max = max;
+
+    return 0;
+}
+
+/*
+ * Path MTU assumed by discovery: the confirmed value, or the base value
+ * until then, within the limit set by the application.
+ */
+static uint16_t ssl_dtls_pmtud_current(const mbedtls_ssl_context *ssl)
+{
+    uint16_t pmtu = ssl->pmtu != 0 ? ssl->pmtu : ssl->conf->pmtud_base;
+
+    if (ssl->mtu != 0 && ssl->mtu < pmtu) {
+        pmtu = ssl->mtu;
+    }
+
+    return pmtu;
+}
+
+uint16_t mbedtls_ssl_get_dtls_pmtu(const mbedtls_ssl_context *ssl)
+{
+    if (ssl->conf->pmtud_max == 0) {
+        return ssl->mtu;
+    }
+
+    return ssl_dtls_pmtud_current(ssl);
+}
+
+uint16_t mbedtls_ssl_get_dtls_pmtu_probe(const mbedtls_ssl_context *ssl)
+{
+    if (ssl->pmtu_state != MBEDTLS_SSL_PMTUD_PROBE_SENT) {
+        return 0;
+    }
+
+    return ssl->pmtu_probe;
+}
+
+/*
+ * Choose the next probe size by bisection, or end the search.
+ */
+static void ssl_dtls_pmtud_next_probe(mbedtls_ssl_context *ssl)
+{
+    uint16_t pmtu = ssl_dtls_pmtud_current(ssl);
+
+    ssl->pmtu_lost = 0;
+
+    if (ssl->pmtu_high < pmtu + MBEDTLS_SSL_PMTUD_GRANULARITY) {
+        ssl->pmtu_state = MBEDTLS_SSL_PMTUD_IDLE;
+        ssl->pmtu_probe = 0;
+        MBEDTLS_SSL_DEBUG_MSG(2, ("path MTU discovery over: %u bytes",
+                                  (unsigned) pmtu));
+        return;
+    }
+
+    ssl->pmtu_probe = (uint16_t) (pmtu + (ssl->pmtu_high - pmtu + 1) / 2);
+    ssl->pmtu_state = MBEDTLS_SSL_PMTUD_PROBE_DUE;
+    MBEDTLS_SSL_DEBUG_MSG(3, ("next path MTU probe: %u bytes",
+                              (unsigned) ssl->pmtu_probe));
+}
+
+/*
+ * Start the search at the end of a handshake, unless it already ran.
+ */
+void mbedtls_ssl_dtls_pmtud_start(mbedtls_ssl_context *ssl)
+{
+    size_t high = ssl->conf->pmtud_max;
+    uint16_t pmtu = ssl_dtls_pmtud_current(ssl);
+
+    if (high == 0 || ssl->pmtu_high != 0) {
+        return;
+    }
+
+    if (ssl->mtu != 0 && ssl->mtu < high) {
+        high = ssl->mtu;
+    }
+    if (high > MBEDTLS_SSL_OUT_BUFFER_LEN) {
+        high = MBEDTLS_SSL_OUT_BUFFER_LEN;
+    }
+    if (high < pmtu) {
+        high = pmtu;
+    }
+    ssl->pmtu_high = (uint16_t) high;
+
+    /* Try the largest size first, a single probe on clean paths */
+    ssl_dtls_pmtud_next_probe(ssl);
+    if (ssl->pmtu_state == MBEDTLS_SSL_PMTUD_PROBE_DUE) {
+        ssl->pmtu_probe = ssl->pmtu_high;
+    }
+}
+
+/*
+ * Called for each datagram sent: the first one larger than the current
+ * path MTU is the probe.
+ */
+void mbedtls_ssl_dtls_pmtud_sent(mbedtls_ssl_context *ssl, size_t len)
+{
+    if (ssl->pmtu_state == MBEDTLS_SSL_PMTUD_PROBE_DUE &&
+        len > ssl_dtls_pmtud_current(ssl)) {
+        ssl->pmtu_probe = (uint16_t) len;
+        ssl->pmtu_state = MBEDTLS_SSL_PMTUD_PROBE_SENT;
+        MBEDTLS_SSL_DEBUG_MSG(3, ("path MTU probe of %u bytes sent",
+                                  (unsigned) ssl->pmtu_probe));
+    }
+}
+
+/*
+ * Forget the discovered path MTU, for example when large flights are
+ * lost: fall back to the base value until the next search.
+ */
+void mbedtls_ssl_dtls_pmtud_black_hole(mbedtls_ssl_context *ssl)
+{
+    ssl->pmtu = 0;
+    ssl->pmtu_probe = 0;
+    ssl->pmtu_high = 0;
+    ssl->pmtu_state = MBEDTLS_SSL_PMTUD_IDLE;
+    ssl->pmtu_lost = 0;
+}
+
+void mbedtls_ssl_dtls_pmtu_feedback(mbedtls_ssl_context *ssl, int delivered)
+{
+    if (ssl->pmtu_state != MBEDTLS_SSL_PMTUD_PROBE_SENT) {
+        return;
+    }
+
+    if (delivered) {
+        ssl->pmtu = ssl->pmtu_probe;
+    } else if (++ssl->pmtu_lost < MBEDTLS_SSL_DTLS_PMTUD_MAX_PROBES) {
+        /* Try the same size again */
+        ssl->pmtu_state = MBEDTLS_SSL_PMTUD_PROBE_DUE;
+        return;
+    } else {
+        ssl->pmtu_high = (uint16_t) (ssl->pmtu_probe - 1);
+    }
+
+    ssl_dtls_pmtud_next_probe(ssl);
+}
 #endif
 
 void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout)
@@ -1562,6 +1880,28 @@ void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout)
     conf->read_timeout   = timeout;
 }
 
+void mbedtls_ssl_conf_read_ahead(mbedtls_ssl_config *conf, char mode)
+{
+    conf->read_ahead = mode;
+}
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+void mbedtls_ssl_conf_full_duplex(mbedtls_ssl_config *conf, char mode)
+{
+    conf->full_duplex = mode;
+}
+#endif
+
+void mbedtls_ssl_conf_dynamic_record_sizing(mbedtls_ssl_config *conf,
+                                            uint16_t small_len,
+                                            uint32_t boost_threshold,
+                                            uint32_t idle_timeout)
+{
+    conf->record_small_len = small_len;
+    conf->record_boost_threshold = boost_threshold;
+    conf->record_idle_timeout = idle_timeout;
+}
+
 void mbedtls_ssl_set_timer_cb(mbedtls_ssl_context *ssl,
                               void *p_timer,
                               mbedtls_ssl_set_timer_t *f_set_timer,
@@ -1585,6 +1925,29 @@ void mbedtls_ssl_conf_session_cache(mbedtls_ssl_config *conf,
     conf->f_get_cache = f_get_cache;
     conf->f_set_cache = f_set_cache;
 }
+
+void mbedtls_ssl_conf_admission(mbedtls_ssl_config *conf,
+                                mbedtls_ssl_admission_t *f_admission,
+                                void *p_admission)
+{
+    conf->f_admission = f_admission;
+    conf->p_admission = p_admission;
+}
+
+int mbedtls_ssl_set_peer_addr(mbedtls_ssl_context *ssl,
+                              const unsigned char *addr,
+                              size_t addr_len)
+{
+    if (ssl->conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        (addr_len != 4 && addr_len != 16)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    memcpy(ssl->peer_addr, addr, addr_len);
+    ssl->peer_addr_len = addr_len;
+
+    return 0;
+}
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #if defined(MBEDTLS_SSL_CLI_C)
@@ -1638,9 +2001,36 @@ int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session
 }
 #endif /* MBEDTLS_SSL_CLI_C */
 
+static void ssl_conf_tables_free(mbedtls_ssl_config *conf)
+{
+    mbedtls_ssl_conf_tables *tables = conf->tables;
+
+    if (tables == NULL) {
+        return;
+    }
+
+    mbedtls_free(tables->ciphersuites);
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
+    for (size_t i = 0; i < 2; i++) {
+        mbedtls_free(tables->sig_alg_ext[i]);
+    }
+#endif
+#if defined(MBEDTLS_SSL_CLI_C) && \
+    (defined(MBEDTLS_SSL_TLS1_2_SOME_ECC) || \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED))
+    for (size_t i = 0; i < 4; i++) {
+        mbedtls_free(tables->groups_ext[i]);
+    }
+#endif
+
+    mbedtls_free(tables);
+    conf->tables = NULL;
+}
+
 void mbedtls_ssl_conf_ciphersuites(mbedtls_ssl_config *conf,
                                    const int *ciphersuites)
 {
+    ssl_conf_tables_free(conf);
     conf->ciphersuite_list = ciphersuites;
 }
 
@@ -1664,6 +2054,15 @@ void mbedtls_ssl_conf_max_early_data_size(
 {
     conf->max_early_data_size = max_early_data_size;
 }
+
+void mbedtls_ssl_conf_early_data_replay(
+    mbedtls_ssl_config *conf,
+    mbedtls_ssl_early_data_replay_t *f_early_data_replay,
+    void *p_early_data_replay)
+{
+    conf->f_early_data_replay = f_early_data_replay;
+    conf->p_early_data_replay = p_early_data_replay;
+}
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #endif /* MBEDTLS_SSL_EARLY_DATA */
@@ -1779,6 +2178,34 @@ int mbedtls_ssl_set_hs_own_cert(mbedtls_ssl_context *ssl,
                                own_cert, pk_key);
 }
 
+int mbedtls_ssl_set_hs_own_cert_sig_algs(mbedtls_ssl_context *ssl,
+                                         mbedtls_x509_crt *own_cert,
+                                         mbedtls_pk_context *pk_key,
+                                         uint32_t sig_algs)
+{
+    int ret;
+    mbedtls_ssl_key_cert *cur;
+
+    ret = ssl_append_key_cert(&ssl->handshake->sni_key_cert,
+                              own_cert, pk_key);
+    if (ret != 0 || own_cert == NULL) {
+        return ret;
+    }
+
+    cur = ssl->handshake->sni_key_cert;
+    while (cur->next != NULL) {
+        cur = cur->next;
+    }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    cur->sig_algs = sig_algs;
+#else
+    (void) cur;
+    (void) sig_algs;
+#endif
+
+    return 0;
+}
+
 void mbedtls_ssl_set_hs_ca_chain(mbedtls_ssl_context *ssl,
                                  mbedtls_x509_crt *ca_chain,
                                  mbedtls_x509_crl *ca_crl)
@@ -2039,6 +2466,9 @@ int mbedtls_ssl_conf_psk(mbedtls_ssl_config *conf,
 
 static void ssl_remove_psk(mbedtls_ssl_context *ssl)
 {
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
+    ssl->handshake->tls13_psk_early_secret_alg = PSA_ALG_NONE;
+#endif
     if (!mbedtls_svc_key_id_is_null(ssl->handshake->psk_opaque)) {
         /* The maintenance of the external PSK key slot is the
          * user's responsibility. */
@@ -2501,6 +2931,7 @@ void mbedtls_ssl_conf_sig_algs(mbedtls_ssl_config *conf,
 #if !defined(MBEDTLS_DEPRECATED_REMOVED)
     conf->sig_hashes = NULL;
 #endif /* !MBEDTLS_DEPRECATED_REMOVED */
+    ssl_conf_tables_free(conf);
     conf->sig_algs = sig_algs;
 }
 #endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
@@ -2511,6 +2942,7 @@ void mbedtls_ssl_conf_sig_algs(mbedtls_ssl_config *conf,
 void mbedtls_ssl_conf_groups(mbedtls_ssl_config *conf,
                              const uint16_t *group_list)
 {
+    ssl_conf_tables_free(conf);
     conf->group_list = group_list;
 }
 
@@ -2960,8 +3392,26 @@ size_t mbedtls_ssl_get_output_max_frag_len(const mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
+static size_t ssl_get_path_mtu(const mbedtls_ssl_context *ssl)
+{
+    if (ssl->conf->pmtud_max == 0) {
+        return ssl->mtu;
+    }
+
+    /* One application record may be as large as the probe */
+    if (ssl->pmtu_state == MBEDTLS_SSL_PMTUD_PROBE_DUE &&
+        mbedtls_ssl_is_handshake_over(ssl) == 1 &&
+        (ssl->mtu == 0 || ssl->pmtu_probe <= ssl->mtu)) {
+        return ssl->pmtu_probe;
+    }
+
+    return ssl_dtls_pmtud_current(ssl);
+}
+
 size_t mbedtls_ssl_get_current_mtu(const mbedtls_ssl_context *ssl)
 {
+    size_t mtu;
+
     /* Return unlimited mtu for client hello messages to avoid fragmentation. */
     if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
         (ssl->state == MBEDTLS_SSL_CLIENT_HELLO ||
@@ -2969,16 +3419,18 @@ size_t mbedtls_ssl_get_current_mtu(const mbedtls_ssl_context *ssl)
         return 0;
     }
 
+    mtu = ssl_get_path_mtu(ssl);
+
     if (ssl->handshake == NULL || ssl->handshake->mtu == 0) {
-        return ssl->mtu;
+        return mtu;
     }
 
-    if (ssl->mtu == 0) {
+    if (mtu == 0) {
         return ssl->handshake->mtu;
     }
 
-    return ssl->mtu < ssl->handshake->mtu ?
-           ssl->mtu : ssl->handshake->mtu;
+    return mtu < ssl->handshake->mtu ?
+           mtu : ssl->handshake->mtu;
 }
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
@@ -4119,6 +4571,27 @@ int mbedtls_ssl_session_save(const mbedtls_ssl_session *session,
     return ssl_session_save(session, 0, buf, buf_len, olen);
 }
 
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+int mbedtls_ssl_session_save_without_peer_cert(const mbedtls_ssl_session *session,
+                                               unsigned char *buf,
+                                               size_t buf_len,
+                                               size_t *olen)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_session tmp;
+
+    /* Shallow copy: nothing it points to is freed. */
+    memcpy(&tmp, session, sizeof(mbedtls_ssl_session));
+    tmp.peer_cert = NULL;
+
+    ret = ssl_session_save(&tmp, 0, buf, buf_len, olen);
+
+    mbedtls_platform_zeroize(&tmp, sizeof(mbedtls_ssl_session));
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_CERT_STORE_C */
+
 /*
  * Deserialize session, see mbedtls_ssl_session_save() for format.
  *
@@ -4140,59 +4613,449 @@ static int ssl_session_load(mbedtls_ssl_session *session,
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    if (!omit_header) {
-        /*
-         * Check Mbed TLS version identifier
-         */
+    if (!omit_header) {
+        /*
+         * Check Mbed TLS version identifier
+         */
+
+        if ((size_t) (end - p) < sizeof(ssl_serialized_session_header)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+
+        if (memcmp(p, ssl_serialized_session_header,
+                   sizeof(ssl_serialized_session_header)) != 0) {
+            return MBEDTLS_ERR_SSL_VERSION_MISMATCH;
+        }
+        p += sizeof(ssl_serialized_session_header);
+    }
+
+    /*
+     * TLS version identifier, endpoint, ciphersuite
+     */
+    if (4 > (size_t) (end - p)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    session->tls_version = (mbedtls_ssl_protocol_version) (0x0300 | *p++);
+    session->endpoint = *p++;
+    session->ciphersuite = MBEDTLS_GET_UINT16_BE(p, 0);
+    p += 2;
+
+    /* Dispatch according to TLS version. */
+    remaining_len = (size_t) (end - p);
+    switch (session->tls_version) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        case MBEDTLS_SSL_VERSION_TLS1_2:
+            return ssl_tls12_session_load(session, p, remaining_len);
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        case MBEDTLS_SSL_VERSION_TLS1_3:
+            return ssl_tls13_session_load(session, p, remaining_len);
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
+        default:
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+}
+
+/*
+ * Deserialize session: public wrapper for error cleaning
+ */
+int mbedtls_ssl_session_load(mbedtls_ssl_session *session,
+                             const unsigned char *buf,
+                             size_t len)
+{
+    int ret = ssl_session_load(session, 0, buf, len);
+
+    if (ret != 0) {
+        mbedtls_ssl_session_free(session);
+    }
+
+    return ret;
+}
+
+#if defined(MBEDTLS_SSL_COMPACT_SESSION)
+/*
+ * Compact encoding of a server session, for resumption only. Every field is
+ * at a fixed offset for a given TLS version, whatever the configuration:
+ * fields that are not compiled in are written as zero and ignored when
+ * loading. The optional parts follow the fixed part, in the order of their
+ * flags.
+ *
+ * header (6 bytes):
+ *    0  magic (MBEDTLS_SSL_COMPACT_SESSION_MAGIC)
+ *    1  revision of the encoding
+ *    2  TLS version (low byte)
+ *    3  flags (MBEDTLS_SSL_SESSION_COMPACT_xxx)
+ *    4  ciphersuite (2 bytes)
+ *
+ * TLS 1.2 (103 bytes):
+ *    0  start (8 bytes)
+ *    8  ticket_creation_time (8 bytes)
+ *   16  verify_result (4 bytes)
+ *   20  id_len
+ *   21  id (32 bytes)
+ *   53  master (48 bytes)
+ *  101  mfl_code
+ *  102  encrypt_then_mac
+ *
+ * TLS 1.3 (20 bytes + MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN):
+ *    0  ticket_creation_time (8 bytes)
+ *    8  ticket_age_add (4 bytes)
+ *   12  max_early_data_size (4 bytes)
+ *   16  record_size_limit (2 bytes)
+ *   18  ticket_flags
+ *   19  resumption_key_len
+ *   20  resumption_key
+ *
+ * optional:
+ *    opaque peer_cert<0..2^24-1>;    // MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT
+ *    opaque alpn<0..2^8-1>;          // MBEDTLS_SSL_SESSION_COMPACT_ALPN
+ */
+#define SSL_COMPACT_SESSION_REVISION    1
+#define SSL_COMPACT_SESSION_HEADER_LEN  6
+#define SSL_COMPACT_SESSION_TLS12_LEN   103
+#define SSL_COMPACT_SESSION_TLS13_LEN   (20 + MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN)
+#define SSL_COMPACT_SESSION_FLAGS       (MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT | \
+                                         MBEDTLS_SSL_SESSION_COMPACT_ALPN)
+
+int mbedtls_ssl_session_save_compact(const mbedtls_ssl_session *session,
+                                     int flags,
+                                     unsigned char *buf,
+                                     size_t buf_len,
+                                     size_t *olen)
+{
+    unsigned char *p = buf;
+    size_t needed = SSL_COMPACT_SESSION_HEADER_LEN;
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+    size_t cert_len = 0;
+#endif
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN)
+    size_t alpn_len = 0;
+#endif
+
+    *olen = 0;
+
+    if (session == NULL || session->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        (flags & ~SSL_COMPACT_SESSION_FLAGS) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    switch (session->tls_version) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        case MBEDTLS_SSL_VERSION_TLS1_2:
+            needed += SSL_COMPACT_SESSION_TLS12_LEN;
+            break;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+        case MBEDTLS_SSL_VERSION_TLS1_3:
+            if (session->resumption_key_len >
+                MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN) {
+                return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            }
+            needed += SSL_COMPACT_SESSION_TLS13_LEN;
+            break;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_SESSION_TICKETS */
+
+        default:
+            return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    if (flags & MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT) {
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+        if (session->peer_cert != NULL) {
+            cert_len = session->peer_cert->raw.len;
+        }
+        if (cert_len > 0xFFFFFF) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        needed += 3 + cert_len;
+#else
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+#endif
+    }
+
+    if (flags & MBEDTLS_SSL_SESSION_COMPACT_ALPN) {
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN)
+        if (session->ticket_alpn != NULL) {
+            alpn_len = strlen(session->ticket_alpn);
+        }
+        if (alpn_len > MBEDTLS_SSL_MAX_ALPN_NAME_LEN) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        needed += 1 + alpn_len;
+#else
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+#endif
+    }
+
+    *olen = needed;
+    if (needed > buf_len) {
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    memset(buf, 0, needed);
+
+    p[0] = MBEDTLS_SSL_COMPACT_SESSION_MAGIC;
+    p[1] = SSL_COMPACT_SESSION_REVISION;
+    p[2] = MBEDTLS_BYTE_0(session->tls_version);
+    p[3] = (unsigned char) flags;
+    MBEDTLS_PUT_UINT16_BE(session->ciphersuite, p, 4);
+    p += SSL_COMPACT_SESSION_HEADER_LEN;
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+#if defined(MBEDTLS_HAVE_TIME)
+        MBEDTLS_PUT_UINT64_BE((uint64_t) session->start, p, 0);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        MBEDTLS_PUT_UINT64_BE((uint64_t) session->ticket_creation_time, p, 8);
+#endif
+#endif /* MBEDTLS_HAVE_TIME */
+        MBEDTLS_PUT_UINT32_BE(session->verify_result, p, 16);
+        p[20] = (unsigned char) session->id_len;
+        memcpy(p + 21, session->id, 32);
+        memcpy(p + 53, session->master, 48);
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        p[101] = session->mfl_code;
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+        p[102] = (unsigned char) session->encrypt_then_mac;
+#endif
+        p += SSL_COMPACT_SESSION_TLS12_LEN;
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+#if defined(MBEDTLS_HAVE_TIME)
+        MBEDTLS_PUT_UINT64_BE((uint64_t) session->ticket_creation_time, p, 0);
+#endif
+        MBEDTLS_PUT_UINT32_BE(session->ticket_age_add, p, 8);
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+        MBEDTLS_PUT_UINT32_BE(session->max_early_data_size, p, 12);
+#endif
+#if defined(MBEDTLS_SSL_RECORD_SIZE_LIMIT)
+        MBEDTLS_PUT_UINT16_BE(session->record_size_limit, p, 16);
+#endif
+        p[18] = session->ticket_flags;
+        p[19] = session->resumption_key_len;
+        memcpy(p + 20, session->resumption_key, session->resumption_key_len);
+        p += SSL_COMPACT_SESSION_TLS13_LEN;
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_SESSION_TICKETS */
+
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+    if (flags & MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT) {
+        *p++ = MBEDTLS_BYTE_2(cert_len);
+        *p++ = MBEDTLS_BYTE_1(cert_len);
+        *p++ = MBEDTLS_BYTE_0(cert_len);
+        if (cert_len > 0) {
+            memcpy(p, session->peer_cert->raw.p, cert_len);
+            p += cert_len;
+        }
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN)
+    if (flags & MBEDTLS_SSL_SESSION_COMPACT_ALPN) {
+        *p++ = (unsigned char) alpn_len;
+        if (alpn_len > 0) {
+            memcpy(p, session->ticket_alpn, alpn_len);
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/*
+ * Deserialize a compact session, see mbedtls_ssl_session_save_compact().
+ *
+ * This internal version is wrapped by a public function that cleans up in
+ * case of error.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_session_load_compact(mbedtls_ssl_session *session,
+                                    const unsigned char *buf,
+                                    size_t len)
+{
+    const unsigned char *p = buf;
+    const unsigned char * const end = buf + len;
+    size_t fixed_len;
+    unsigned char flags;
+
+    if (session == NULL) {
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    if (len < SSL_COMPACT_SESSION_HEADER_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (p[0] != MBEDTLS_SSL_COMPACT_SESSION_MAGIC ||
+        p[1] != SSL_COMPACT_SESSION_REVISION) {
+        return MBEDTLS_ERR_SSL_VERSION_MISMATCH;
+    }
+
+    flags = p[3];
+    if ((flags & ~SSL_COMPACT_SESSION_FLAGS) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    session->tls_version = (mbedtls_ssl_protocol_version) (0x0300 | p[2]);
+    session->endpoint = MBEDTLS_SSL_IS_SERVER;
+    session->ciphersuite = MBEDTLS_GET_UINT16_BE(p, 4);
+
+    switch (session->tls_version) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        case MBEDTLS_SSL_VERSION_TLS1_2:
+            fixed_len = SSL_COMPACT_SESSION_TLS12_LEN;
+            break;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+        case MBEDTLS_SSL_VERSION_TLS1_3:
+            fixed_len = SSL_COMPACT_SESSION_TLS13_LEN;
+            break;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_SESSION_TICKETS */
+
+        default:
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* The only bounds check needed for the fixed part. */
+    if (len - SSL_COMPACT_SESSION_HEADER_LEN < fixed_len) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    p += SSL_COMPACT_SESSION_HEADER_LEN;
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+        if (p[20] > sizeof(session->id)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+#if defined(MBEDTLS_HAVE_TIME)
+        session->start = (mbedtls_time_t) MBEDTLS_GET_UINT64_BE(p, 0);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        session->ticket_creation_time =
+            (mbedtls_ms_time_t) MBEDTLS_GET_UINT64_BE(p, 8);
+#endif
+#endif /* MBEDTLS_HAVE_TIME */
+        session->verify_result = MBEDTLS_GET_UINT32_BE(p, 16);
+        session->id_len = p[20];
+        memcpy(session->id, p + 21, 32);
+        memcpy(session->master, p + 53, 48);
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+        session->mfl_code = p[101];
+#endif
+#if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC)
+        session->encrypt_then_mac = p[102];
+#endif
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        if (p[19] > MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+#if defined(MBEDTLS_HAVE_TIME)
+        session->ticket_creation_time =
+            (mbedtls_ms_time_t) MBEDTLS_GET_UINT64_BE(p, 0);
+#endif
+        session->ticket_age_add = MBEDTLS_GET_UINT32_BE(p, 8);
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+        session->max_early_data_size = MBEDTLS_GET_UINT32_BE(p, 12);
+#endif
+#if defined(MBEDTLS_SSL_RECORD_SIZE_LIMIT)
+        session->record_size_limit = MBEDTLS_GET_UINT16_BE(p, 16);
+#endif
+        session->ticket_flags = p[18];
+        session->resumption_key_len = p[19];
+        memcpy(session->resumption_key, p + 20, session->resumption_key_len);
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_SESSION_TICKETS */
+
+    p += fixed_len;
 
-        if ((size_t) (end - p) < sizeof(ssl_serialized_session_header)) {
+    /* Optional parts that are not supported by this configuration are
+     * skipped: the session can still be resumed without them. */
+    if (flags & MBEDTLS_SSL_SESSION_COMPACT_PEER_CERT) {
+        size_t cert_len;
+
+        if (3 > (size_t) (end - p)) {
             return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
         }
+        cert_len = MBEDTLS_GET_UINT24_BE(p, 0);
+        p += 3;
 
-        if (memcmp(p, ssl_serialized_session_header,
-                   sizeof(ssl_serialized_session_header)) != 0) {
-            return MBEDTLS_ERR_SSL_VERSION_MISMATCH;
+        if (cert_len > (size_t) (end - p)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
         }
-        p += sizeof(ssl_serialized_session_header);
-    }
 
-    /*
-     * TLS version identifier, endpoint, ciphersuite
-     */
-    if (4 > (size_t) (end - p)) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+        if (cert_len != 0) {
+            int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+            session->peer_cert = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+            if (session->peer_cert == NULL) {
+                return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            }
+
+            mbedtls_x509_crt_init(session->peer_cert);
+
+            if ((ret = mbedtls_x509_crt_parse_der(session->peer_cert,
+                                                  p, cert_len)) != 0) {
+                mbedtls_x509_crt_free(session->peer_cert);
+                mbedtls_free(session->peer_cert);
+                session->peer_cert = NULL;
+                return ret;
+            }
+        }
+#endif
+        p += cert_len;
     }
-    session->tls_version = (mbedtls_ssl_protocol_version) (0x0300 | *p++);
-    session->endpoint = *p++;
-    session->ciphersuite = MBEDTLS_GET_UINT16_BE(p, 0);
-    p += 2;
 
-    /* Dispatch according to TLS version. */
-    remaining_len = (size_t) (end - p);
-    switch (session->tls_version) {
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        case MBEDTLS_SSL_VERSION_TLS1_2:
-            return ssl_tls12_session_load(session, p, remaining_len);
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    if (flags & MBEDTLS_SSL_SESSION_COMPACT_ALPN) {
+        size_t alpn_len;
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-        case MBEDTLS_SSL_VERSION_TLS1_3:
-            return ssl_tls13_session_load(session, p, remaining_len);
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+        if (1 > (size_t) (end - p)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        alpn_len = *p++;
 
-        default:
+        if (alpn_len > (size_t) (end - p)) {
             return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_ALPN)
+        if (alpn_len != 0) {
+            session->ticket_alpn = mbedtls_calloc(alpn_len + 1, 1);
+            if (session->ticket_alpn == NULL) {
+                return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            }
+            memcpy(session->ticket_alpn, p, alpn_len);
+        }
+#endif
+        p += alpn_len;
+    }
+
+    if (p != end) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
+
+    return 0;
 }
 
 /*
- * Deserialize session: public wrapper for error cleaning
+ * Deserialize compact session: public wrapper for error cleaning
  */
-int mbedtls_ssl_session_load(mbedtls_ssl_session *session,
-                             const unsigned char *buf,
-                             size_t len)
+int mbedtls_ssl_session_load_compact(mbedtls_ssl_session *session,
+                                     const unsigned char *buf,
+                                     size_t len)
 {
-    int ret = ssl_session_load(session, 0, buf, len);
+    int ret = ssl_session_load_compact(session, buf, len);
 
     if (ret != 0) {
         mbedtls_ssl_session_free(session);
@@ -4200,6 +5063,7 @@ int mbedtls_ssl_session_load(mbedtls_ssl_session *session,
 
     return ret;
 }
+#endif /* MBEDTLS_SSL_COMPACT_SESSION */
 
 /*
  * Perform a single step of the SSL handshake
@@ -4224,6 +5088,15 @@ static int ssl_prepare_handshake_step(mbedtls_ssl_context *ssl)
      * `mbedtls_ssl_handle_pending_alert` in case an error that triggered an
      * alert occurred.
      */
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* In full-duplex mode, the only handshake steps are those of
+     * post-handshake messages, run by mbedtls_ssl_read(). The output
+     * belongs to the writing thread, and alerts are handed over to it. */
+    if (ssl->duplex) {
+        return 0;
+    }
+#endif
+
     if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
         return ret;
     }
@@ -4243,6 +5116,9 @@ static int ssl_prepare_handshake_step(mbedtls_ssl_context *ssl)
 int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+    int timed_state;
+#endif
 
     if (ssl            == NULL                       ||
         ssl->conf      == NULL                       ||
@@ -4251,9 +5127,14 @@ int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl)
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+    timed_state = ssl->state;
+    mbedtls_ssl_hs_timing_step_start(ssl);
+#endif
+
     ret = ssl_prepare_handshake_step(ssl);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
     ret = mbedtls_ssl_handle_pending_alert(ssl);
@@ -4322,7 +5203,22 @@ int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl)
         }
     }
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* From now on, mbedtls_ssl_read() and mbedtls_ssl_write() may be called
+     * concurrently, see mbedtls_ssl_conf_full_duplex(). */
+    if (ret == 0 && ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER &&
+        ssl->duplex == 0 &&
+        ssl->conf->full_duplex == MBEDTLS_SSL_FULL_DUPLEX_ENABLED &&
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("full-duplex mode"));
+        ssl->duplex = 1;
+    }
+#endif
+
 cleanup:
+#if defined(MBEDTLS_SSL_HANDSHAKE_TIMING)
+    mbedtls_ssl_hs_timing_step_end(ssl, timed_state, ret);
+#endif
     return ret;
 }
 
@@ -4425,6 +5321,7 @@ int mbedtls_ssl_start_renegotiation(mbedtls_ssl_context *ssl)
 
     ssl->state = MBEDTLS_SSL_HELLO_REQUEST;
     ssl->renego_status = MBEDTLS_SSL_RENEGOTIATION_IN_PROGRESS;
+    MBEDTLS_SSL_STATS_ADD(ssl, renegotiations, 1);
 
     if ((ret = mbedtls_ssl_handshake(ssl)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
@@ -4448,6 +5345,13 @@ int mbedtls_ssl_renegotiate(mbedtls_ssl_context *ssl)
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    /* The handshake would need both directions. */
+    if (ssl->duplex) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_SRV_C)
     /* On server, just send the request */
     if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER) {
@@ -4457,9 +5361,15 @@ int mbedtls_ssl_renegotiate(mbedtls_ssl_context *ssl)
 
         ssl->renego_status = MBEDTLS_SSL_RENEGOTIATION_PENDING;
 
-        /* Did we already try/start sending HelloRequest? */
+        /* Did we already try/start sending HelloRequest? Records packed
+         * while corked are not part of it and are sent first. */
         if (ssl->out_left != 0) {
-            return mbedtls_ssl_flush_output(ssl);
+            if (ssl->out_packed == 0) {
+                return mbedtls_ssl_flush_output(ssl);
+            }
+            if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+                return ret;
+            }
         }
 
         return ssl_write_hello_request(ssl);
@@ -5685,6 +6595,8 @@ int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
 #endif
     }
 
+    ssl_conf_tables_free(conf);
+
     /*
      * Preset-specific defaults
      */
@@ -5742,6 +6654,182 @@ int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
+/*
+ * Write the signature_algorithms extension for the algorithms of sig_alg
+ * that can be used with tls_version. ssl is only used for debug output and
+ * may be NULL.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_write_sig_alg_list_ext(const mbedtls_ssl_context *ssl,
+                                      mbedtls_ssl_protocol_version tls_version,
+                                      const uint16_t *sig_alg,
+                                      unsigned char *buf,
+                                      const unsigned char *end,
+                                      size_t *out_len)
+{
+    unsigned char *p = buf;
+    unsigned char *supported_sig_alg; /* Start of supported_signature_algorithms */
+    size_t supported_sig_alg_len = 0; /* Length of supported_signature_algorithms */
+
+    *out_len = 0;
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("adding signature_algorithms extension"));
+
+    /* Check if we have space for header and length field:
+     * - extension_type         (2 bytes)
+     * - extension_data_length  (2 bytes)
+     * - supported_signature_algorithms_length   (2 bytes)
+     */
+    MBEDTLS_SSL_CHK_BUF_PTR(p, end, 6);
+    p += 6;
+
+    /*
+     * Write supported_signature_algorithms
+     */
+    supported_sig_alg = p;
+    if (sig_alg == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+
+    for (; *sig_alg != MBEDTLS_TLS1_3_SIG_NONE; sig_alg++) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("got signature scheme [%x] %s",
+                                  *sig_alg,
+                                  mbedtls_ssl_sig_alg_to_str(*sig_alg)));
+        if (!mbedtls_ssl_sig_alg_is_supported_by_version(tls_version, *sig_alg)) {
+            continue;
+        }
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 2);
+        MBEDTLS_PUT_UINT16_BE(*sig_alg, p, 0);
+        p += 2;
+        MBEDTLS_SSL_DEBUG_MSG(3, ("sent signature scheme [%x] %s",
+                                  *sig_alg,
+                                  mbedtls_ssl_sig_alg_to_str(*sig_alg)));
+    }
+
+    /* Length of supported_signature_algorithms */
+    supported_sig_alg_len = (size_t) (p - supported_sig_alg);
+    if (supported_sig_alg_len == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("No signature algorithms defined."));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_SIG_ALG, buf, 0);
+    MBEDTLS_PUT_UINT16_BE(supported_sig_alg_len + 2, buf, 2);
+    MBEDTLS_PUT_UINT16_BE(supported_sig_alg_len, buf, 4);
+
+    *out_len = (size_t) (p - buf);
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
+
+int mbedtls_ssl_conf_finalize(mbedtls_ssl_config *conf)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_conf_tables *tables;
+    size_t n;
+
+    ssl_conf_tables_free(conf);
+
+    if (conf->ciphersuite_list == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+
+    tables = mbedtls_calloc(1, sizeof(mbedtls_ssl_conf_tables));
+    if (tables == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    conf->tables = tables;
+
+    n = 0;
+    while (conf->ciphersuite_list[n] != 0) {
+        n++;
+    }
+    tables->ciphersuites = mbedtls_calloc(n + 1, sizeof(*tables->ciphersuites));
+    if (tables->ciphersuites == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto cleanup;
+    }
+    for (size_t i = 0; i < n; i++) {
+        tables->ciphersuites[i] =
+            mbedtls_ssl_ciphersuite_from_id(conf->ciphersuite_list[i]);
+    }
+    tables->ciphersuites_len = n;
+
+    /*
+     * The extensions are written as they would be during the handshake. If
+     * that fails, for example because no configured algorithm can be used
+     * with a protocol version, no blob is kept and the handshake reports
+     * the error.
+     */
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
+    if (conf->sig_algs != NULL) {
+        /* Indexed as by mbedtls_ssl_conf_tables_version_idx() */
+        static const mbedtls_ssl_protocol_version versions[2] = {
+            MBEDTLS_SSL_VERSION_TLS1_2, MBEDTLS_SSL_VERSION_TLS1_3
+        };
+
+        n = 0;
+        while (conf->sig_algs[n] != MBEDTLS_TLS1_3_SIG_NONE) {
+            n++;
+        }
+
+        for (size_t i = 0; i < 2; i++) {
+            size_t len = 6 + 2 * n;
+            unsigned char *ext = mbedtls_calloc(1, len);
+            if (ext == NULL) {
+                ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+                goto cleanup;
+            }
+            if (ssl_write_sig_alg_list_ext(NULL, versions[i], conf->sig_algs,
+                                           ext, ext + len, &len) != 0) {
+                mbedtls_free(ext);
+                continue;
+            }
+            tables->sig_alg_ext[i] = ext;
+            tables->sig_alg_ext_len[i] = len;
+        }
+    }
+#endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
+
+#if defined(MBEDTLS_SSL_CLI_C) && \
+    (defined(MBEDTLS_SSL_TLS1_2_SOME_ECC) || \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED))
+    if (conf->endpoint == MBEDTLS_SSL_IS_CLIENT && conf->group_list != NULL) {
+        n = 0;
+        while (conf->group_list[n] != 0) {
+            n++;
+        }
+
+        for (int flags = 1; flags < 4; flags++) {
+            size_t len = 6 + 2 * n;
+            unsigned char *ext = mbedtls_calloc(1, len);
+            if (ext == NULL) {
+                ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+                goto cleanup;
+            }
+            if (mbedtls_ssl_write_supported_groups_list_ext(
+                    NULL, conf->group_list, ext, ext + len, flags, &len) != 0) {
+                mbedtls_free(ext);
+                continue;
+            }
+            tables->groups_ext[flags] = ext;
+            tables->groups_ext_len[flags] = len;
+        }
+    }
+#endif
+
+    ret = 0;
+
+cleanup:
+    if (ret != 0) {
+        ssl_conf_tables_free(conf);
+    }
+
+    return ret;
+}
+
 /*
  * Free mbedtls_ssl_config
  */
@@ -5777,6 +6865,8 @@ void mbedtls_ssl_config_free(mbedtls_ssl_config *conf)
     ssl_key_cert_free(conf->key_cert);
 #endif
 
+    ssl_conf_tables_free(conf);
+
     mbedtls_platform_zeroize(conf, sizeof(mbedtls_ssl_config));
 }
 
@@ -6761,9 +7851,11 @@ static int ssl_write_hello_request(mbedtls_ssl_context *ssl);
 int mbedtls_ssl_resend_hello_request(mbedtls_ssl_context *ssl)
 {
     /* If renegotiation is not enforced, retransmit until we would reach max
-     * timeout if we were using the usual handshake doubling scheme */
+     * timeout if we were using the usual handshake doubling scheme, starting
+     * from the same initial timeout as handshake flights */
     if (ssl->conf->renego_max_records < 0) {
-        uint32_t ratio = ssl->conf->hs_timeout_max / ssl->conf->hs_timeout_min + 1;
+        uint32_t ratio = ssl->conf->hs_timeout_max /
+                         mbedtls_ssl_dtls_initial_timeout(ssl) + 1;
         unsigned char doublings = 1;
 
         while (ratio != 0) {
@@ -7517,6 +8609,12 @@ void mbedtls_ssl_handshake_wrapup(mbedtls_ssl_context *ssl)
         }
     }
 
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+        mbedtls_ssl_session_store_capture(ssl);
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
         ssl->handshake->flight != NULL) {
@@ -7530,6 +8628,12 @@ void mbedtls_ssl_handshake_wrapup(mbedtls_ssl_context *ssl)
 #endif
     mbedtls_ssl_handshake_wrapup_free_hs_transform(ssl);
 
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        mbedtls_ssl_dtls_pmtud_start(ssl);
+    }
+#endif
+
     ssl->state = MBEDTLS_SSL_HANDSHAKE_OVER;
 
     MBEDTLS_SSL_DEBUG_MSG(3, ("<= handshake wrapup"));
@@ -8066,7 +9170,8 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
     transform->psa_alg = alg;
 
     if (alg != MBEDTLS_SSL_NULL_CIPHER) {
-        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_ENCRYPT);
+        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_ENCRYPT |
+                                mbedtls_ssl_transform_key_usage(ssl));
         psa_set_key_algorithm(&attributes, alg);
         psa_set_key_type(&attributes, key_type);
 
@@ -8080,7 +9185,8 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
             goto end;
         }
 
-        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_DECRYPT);
+        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_DECRYPT |
+                                mbedtls_ssl_transform_key_usage(ssl));
 
         if ((status = psa_import_key(&attributes,
                                      key2,
@@ -8136,6 +9242,8 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
     ((void) mac_dec);
     ((void) mac_enc);
 
+    mbedtls_ssl_transform_bind_record_ops(transform);
+
 end:
     mbedtls_platform_zeroize(keyblk, sizeof(keyblk));
     return ret;
@@ -8424,59 +9532,29 @@ int mbedtls_ssl_validate_ciphersuite(
 int mbedtls_ssl_write_sig_alg_ext(mbedtls_ssl_context *ssl, unsigned char *buf,
                                   const unsigned char *end, size_t *out_len)
 {
-    unsigned char *p = buf;
-    unsigned char *supported_sig_alg; /* Start of supported_signature_algorithms */
-    size_t supported_sig_alg_len = 0; /* Length of supported_signature_algorithms */
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const uint16_t *sig_algs = mbedtls_ssl_get_sig_algs(ssl);
+    const mbedtls_ssl_conf_tables *tables = ssl->conf->tables;
+    int idx = mbedtls_ssl_conf_tables_version_idx(ssl->tls_version);
 
     *out_len = 0;
 
-    MBEDTLS_SSL_DEBUG_MSG(3, ("adding signature_algorithms extension"));
-
-    /* Check if we have space for header and length field:
-     * - extension_type         (2 bytes)
-     * - extension_data_length  (2 bytes)
-     * - supported_signature_algorithms_length   (2 bytes)
-     */
-    MBEDTLS_SSL_CHK_BUF_PTR(p, end, 6);
-    p += 6;
-
-    /*
-     * Write supported_signature_algorithms
-     */
-    supported_sig_alg = p;
-    const uint16_t *sig_alg = mbedtls_ssl_get_sig_algs(ssl);
-    if (sig_alg == NULL) {
-        return MBEDTLS_ERR_SSL_BAD_CONFIG;
-    }
-
-    for (; *sig_alg != MBEDTLS_TLS1_3_SIG_NONE; sig_alg++) {
-        MBEDTLS_SSL_DEBUG_MSG(3, ("got signature scheme [%x] %s",
-                                  *sig_alg,
-                                  mbedtls_ssl_sig_alg_to_str(*sig_alg)));
-        if (!mbedtls_ssl_sig_alg_is_supported(ssl, *sig_alg)) {
-            continue;
+    /* The precomputed extension is only valid for the configured signature
+     * algorithms, not for those derived from the deprecated sig_hashes. */
+    if (tables != NULL && idx >= 0 && tables->sig_alg_ext[idx] != NULL &&
+        sig_algs == ssl->conf->sig_algs) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("adding precomputed signature_algorithms extension"));
+        MBEDTLS_SSL_CHK_BUF_PTR(buf, end, tables->sig_alg_ext_len[idx]);
+        memcpy(buf, tables->sig_alg_ext[idx], tables->sig_alg_ext_len[idx]);
+        *out_len = tables->sig_alg_ext_len[idx];
+    } else {
+        ret = ssl_write_sig_alg_list_ext(ssl, ssl->tls_version, sig_algs,
+                                         buf, end, out_len);
+        if (ret != 0) {
+            return ret;
         }
-        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 2);
-        MBEDTLS_PUT_UINT16_BE(*sig_alg, p, 0);
-        p += 2;
-        MBEDTLS_SSL_DEBUG_MSG(3, ("sent signature scheme [%x] %s",
-                                  *sig_alg,
-                                  mbedtls_ssl_sig_alg_to_str(*sig_alg)));
-    }
-
-    /* Length of supported_signature_algorithms */
-    supported_sig_alg_len = (size_t) (p - supported_sig_alg);
-    if (supported_sig_alg_len == 0) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("No signature algorithms defined."));
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_SIG_ALG, buf, 0);
-    MBEDTLS_PUT_UINT16_BE(supported_sig_alg_len + 2, buf, 2);
-    MBEDTLS_PUT_UINT16_BE(supported_sig_alg_len, buf, 4);
-
-    *out_len = (size_t) (p - buf);
-
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_SIG_ALG);
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
@@ -753,15 +753,13 @@ static int ssl_pick_cert(mbedtls_ssl_context *ssl,
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_ciphersuite_match(mbedtls_ssl_context *ssl, int suite_id,
+                                 const mbedtls_ssl_ciphersuite_t *suite_info,
                                  const mbedtls_ssl_ciphersuite_t **ciphersuite_info)
 {
-    const mbedtls_ssl_ciphersuite_t *suite_info;
-
 #if defined(MBEDTLS_KEY_EXCHANGE_WITH_CERT_ENABLED)
     mbedtls_pk_type_t sig_type;
 #endif
 
-    suite_info = mbedtls_ssl_ciphersuite_from_id(suite_id);
     if (suite_info == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
@@ -840,6 +838,79 @@ static int ssl_ciphersuite_match(mbedtls_ssl_context *ssl, int suite_id,
     return 0;
 }
 
+static void ssl_handle_id_based_session_resumption(mbedtls_ssl_context *ssl);
+
+/*
+ * Ask the admission control callback, if any, whether to go on with the
+ * handshake of this ClientHello. See mbedtls_ssl_conf_admission().
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_check_admission(mbedtls_ssl_context *ssl)
+{
+    int ret;
+    int flags = 0;
+
+    if (ssl->conf->f_admission == NULL) {
+        return 0;
+    }
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    if (ssl->renego_status != MBEDTLS_SSL_INITIAL_HANDSHAKE) {
+        return 0;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY)
+    /* A HelloVerifyRequest is sent whatever the callback would say: let
+     * it decide on the ClientHello that comes back with a valid cookie. */
+    if (ssl->handshake->cookie_verify_result != 0) {
+        return 0;
+    }
+#endif
+
+    if (ssl->handshake->resume == 1) {
+        flags |= MBEDTLS_SSL_ADMISSION_RESUMPTION;
+    }
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY)
+        if (ssl->conf->f_cookie_check != NULL) {
+            flags |= MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED;
+        }
+#endif
+    } else
+#endif
+    flags |= MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED;
+
+    ret = ssl->conf->f_admission(ssl->conf->p_admission,
+                                 ssl->peer_addr_len != 0 ? ssl->peer_addr : NULL,
+                                 ssl->peer_addr_len, flags);
+    if (ret < 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_admission", ret);
+        return ret;
+    }
+
+    /* Without DTLS cookies, the address cannot be verified. */
+    if (ret == MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE &&
+        (flags & MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED) == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("admission control requires a cookie"));
+        ret = MBEDTLS_SSL_ADMISSION_REJECT;
+    }
+
+    if (ret != MBEDTLS_SSL_ADMISSION_ACCEPT &&
+        ret != MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake rejected by admission control"));
+        /* Do not answer a client whose address may be spoofed */
+        if (flags & MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED) {
+            mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                           MBEDTLS_SSL_ALERT_MSG_HANDSHAKE_FAILURE);
+        }
+        return MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED;
+    }
+
+    return 0;
+}
+
 /* This function doesn't alert on errors that happen early during
    ClientHello parsing because they might indicate that the client is
    not talking SSL/TLS at all and would not understand our alert. */
@@ -982,7 +1053,8 @@ read_record_header:
                 ssl->next_record_offset = msg_len + mbedtls_ssl_in_hdr_len(ssl);
             } else
 #endif
-            ssl->in_left = 0;
+            mbedtls_ssl_done_reading_record(ssl,
+                                            msg_len + mbedtls_ssl_in_hdr_len(ssl));
         }
     }
 
@@ -1566,8 +1638,10 @@ read_record_header:
 
                 got_common_suite = 1;
 
-                if ((ret = ssl_ciphersuite_match(ssl, ciphersuites[i],
-                                                 &ciphersuite_info)) != 0) {
+                if ((ret = ssl_ciphersuite_match(
+                         ssl, ciphersuites[i],
+                         mbedtls_ssl_conf_ciphersuite_at(ssl->conf, i),
+                         &ciphersuite_info)) != 0) {
                     return ret;
                 }
 
@@ -1585,8 +1659,10 @@ read_record_header:
 
                 got_common_suite = 1;
 
-                if ((ret = ssl_ciphersuite_match(ssl, ciphersuites[i],
-                                                 &ciphersuite_info)) != 0) {
+                if ((ret = ssl_ciphersuite_match(
+                         ssl, ciphersuites[i],
+                         mbedtls_ssl_conf_ciphersuite_at(ssl->conf, i),
+                         &ciphersuite_info)) != 0) {
                     return ret;
                 }
 
@@ -1616,6 +1692,20 @@ have_ciphersuite:
     ssl->session_negotiate->ciphersuite = ciphersuites[i];
     ssl->handshake->ciphersuite_info = ciphersuite_info;
 
+    /*
+     * Look up the session ID now rather than when writing the ServerHello,
+     * so that admission control knows whether the session is resumed. This
+     * is pointless if a HelloVerifyRequest is going to be sent anyway.
+     */
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY)
+    if (ssl->handshake->cookie_verify_result == 0)
+#endif
+    ssl_handle_id_based_session_resumption(ssl);
+
+    if ((ret = ssl_check_admission(ssl)) != 0) {
+        return ret;
+    }
+
     ssl->state++;
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -2195,8 +2285,6 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_BUF(3, "server hello, random bytes", buf + 6, 32);
 
-    ssl_handle_id_based_session_resumption(ssl);
-
     if (ssl->handshake->resume == 0) {
         /*
          * New session, create a new session id,
@@ -19,6 +19,7 @@
 #include "ssl_tls13_keys.h"
 #include "ssl_debug_helpers.h"
 #include "mbedtls/psa_util.h"
+#include "mbedtls/ssl_group_hints.h"
 
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED)
 /* Define a local translating function to save code size by not using too many
@@ -208,6 +209,52 @@ static int ssl_tls13_reset_key_share(mbedtls_ssl_context *ssl)
  * Functions for writing key_share extension.
  */
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED)
+#if defined(PSA_WANT_ALG_ECDH) || defined(PSA_WANT_ALG_FFDH)
+static int ssl_tls13_group_can_be_offered(uint16_t group)
+{
+#if defined(PSA_WANT_ALG_ECDH)
+    if ((mbedtls_ssl_get_psa_curve_info_from_tls_id(
+             group, NULL, NULL) == PSA_SUCCESS) &&
+        mbedtls_ssl_tls13_named_group_is_ecdhe(group)) {
+        return 1;
+    }
+#endif
+#if defined(PSA_WANT_ALG_FFDH)
+    if (mbedtls_ssl_tls13_named_group_is_ffdh(group)) {
+        return 1;
+    }
+#endif
+    return 0;
+}
+#endif /* PSA_WANT_ALG_ECDH || PSA_WANT_ALG_FFDH */
+
+#if defined(MBEDTLS_SSL_GROUP_HINTS_C)
+/*
+ * Remember the group selected by the server, so that the next handshake
+ * with this server offers it in its first ClientHello.
+ *
+ * Only called once the server Finished message has been verified: the
+ * HelloRetryRequest and ServerHello are not authenticated, and the store
+ * is shared between connections.
+ */
+static void ssl_tls13_update_group_hint(mbedtls_ssl_context *ssl)
+{
+    int ret;
+    uint16_t group = ssl->handshake->offered_group_id;
+
+    if (ssl->group_hints == NULL || ssl->hostname == NULL ||
+        !mbedtls_ssl_tls13_key_exchange_mode_with_ephemeral(ssl)) {
+        return;
+    }
+
+    ret = mbedtls_ssl_group_hints_set(ssl->group_hints, ssl->hostname,
+                                      ssl->group_hints_port, group);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_group_hints_set", ret);
+    }
+}
+#endif /* MBEDTLS_SSL_GROUP_HINTS_C */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_get_default_group_id(mbedtls_ssl_context *ssl,
                                           uint16_t *group_id)
@@ -217,26 +264,34 @@ static int ssl_tls13_get_default_group_id(mbedtls_ssl_context *ssl,
 
 #if defined(PSA_WANT_ALG_ECDH) || defined(PSA_WANT_ALG_FFDH)
     const uint16_t *group_list = ssl->conf->group_list;
-    /* Pick first available ECDHE group compatible with TLS 1.3 */
+#if defined(MBEDTLS_SSL_GROUP_HINTS_C)
+    uint16_t hint;
+#endif
+
     if (group_list == NULL) {
         return MBEDTLS_ERR_SSL_BAD_CONFIG;
     }
 
+#if defined(MBEDTLS_SSL_GROUP_HINTS_C)
+    /* Offer the group this server selected last time, if we still may. */
+    if (ssl->group_hints != NULL && ssl->hostname != NULL &&
+        mbedtls_ssl_group_hints_get(ssl->group_hints, ssl->hostname,
+                                    ssl->group_hints_port, &hint) == 0 &&
+        mbedtls_ssl_check_curve_tls_id(ssl, hint) == 0 &&
+        ssl_tls13_group_can_be_offered(hint)) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("key share group from hint: %s",
+                                  mbedtls_ssl_named_group_to_str(hint)));
+        *group_id = hint;
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_GROUP_HINTS_C */
+
+    /* Pick first available ECDHE group compatible with TLS 1.3 */
     for (; *group_list != 0; group_list++) {
-#if defined(PSA_WANT_ALG_ECDH)
-        if ((mbedtls_ssl_get_psa_curve_info_from_tls_id(
-                 *group_list, NULL, NULL) == PSA_SUCCESS) &&
-            mbedtls_ssl_tls13_named_group_is_ecdhe(*group_list)) {
-            *group_id = *group_list;
-            return 0;
-        }
-#endif
-#if defined(PSA_WANT_ALG_FFDH)
-        if (mbedtls_ssl_tls13_named_group_is_ffdh(*group_list)) {
+        if (ssl_tls13_group_can_be_offered(*group_list)) {
             *group_id = *group_list;
             return 0;
         }
-#endif
     }
 #else
     ((void) ssl);
@@ -737,6 +792,57 @@ static int ssl_tls13_ticket_get_psk(mbedtls_ssl_context *ssl,
 
     return 0;
 }
+
+/*
+ * The early secret and the binder key of a ticket PSK only depend on the
+ * resumption key. They are derived when the ticket is received and kept in
+ * the session along with it, or on first use for a session restored with
+ * mbedtls_ssl_session_load(), which does not keep them.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_session_get_psk_secrets(mbedtls_ssl_session *session,
+                                             psa_algorithm_t hash_alg)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t hash_len = PSA_HASH_LENGTH(hash_alg);
+
+    if (session->psk_secrets_len != 0 && session->psk_secrets_len == hash_len) {
+        return 0;
+    }
+
+    if (hash_len == 0 || hash_len > sizeof(session->psk_early_secret)) {
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    ret = mbedtls_ssl_tls13_derive_psk_secrets(
+        hash_alg, session->resumption_key, session->resumption_key_len,
+        MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION,
+        session->psk_early_secret, session->psk_binder_key);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_derive_psk_secrets", ret);
+        return ret;
+    }
+    session->psk_secrets_len = (uint8_t) hash_len;
+
+    return 0;
+}
+
+/*
+ * Once the handshake PSK is set to the ticket PSK, hand its early secret
+ * over to the key schedule.
+ */
+static void ssl_tls13_ticket_set_hs_early_secret(mbedtls_ssl_context *ssl,
+                                                 psa_algorithm_t hash_alg)
+{
+    mbedtls_ssl_session *session = ssl->session_negotiate;
+
+    if (session->psk_secrets_len != 0 &&
+        session->psk_secrets_len == PSA_HASH_LENGTH(hash_alg)) {
+        memcpy(ssl->handshake->tls13_master_secrets.early,
+               session->psk_early_secret, session->psk_secrets_len);
+        ssl->handshake->tls13_psk_early_secret_alg = hash_alg;
+    }
+}
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -823,10 +929,8 @@ MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_write_binder(mbedtls_ssl_context *ssl,
                                   unsigned char *buf,
                                   unsigned char *end,
-                                  int psk_type,
                                   psa_algorithm_t hash_alg,
-                                  const unsigned char *psk,
-                                  size_t psk_len,
+                                  const unsigned char *binder_key,
                                   size_t *out_len)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -854,11 +958,12 @@ static int ssl_tls13_write_binder(mbedtls_ssl_context *ssl,
         return ret;
     }
 
-    ret = mbedtls_ssl_tls13_create_psk_binder(ssl, hash_alg,
-                                              psk, psk_len, psk_type,
-                                              transcript, buf + 1);
+    ret = mbedtls_ssl_tls13_create_psk_binder_with_key(ssl, hash_alg,
+                                                       binder_key,
+                                                       transcript, buf + 1);
     if (ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_create_psk_binder", ret);
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_create_psk_binder_with_key",
+                              ret);
         return ret;
     }
     MBEDTLS_SSL_DEBUG_BUF(4, "write binder", buf, 1 + binder_len);
@@ -1014,9 +1119,14 @@ int mbedtls_ssl_tls13_write_binders_of_pre_shared_key_ext(
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
     if (ssl_tls13_ticket_get_psk(ssl, &hash_alg, &psk, &psk_len) == 0) {
 
-        ret = ssl_tls13_write_binder(ssl, p, end,
-                                     MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION,
-                                     hash_alg, psk, psk_len,
+        ret = ssl_tls13_session_get_psk_secrets(ssl->session_negotiate,
+                                                hash_alg);
+        if (ret != 0) {
+            return ret;
+        }
+
+        ret = ssl_tls13_write_binder(ssl, p, end, hash_alg,
+                                     ssl->session_negotiate->psk_binder_key,
                                      &output_len);
         if (ret != 0) {
             return ret;
@@ -1026,11 +1136,18 @@ int mbedtls_ssl_tls13_write_binders_of_pre_shared_key_ext(
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
     if (ssl_tls13_psk_get_psk(ssl, &hash_alg, &psk, &psk_len) == 0) {
-
-        ret = ssl_tls13_write_binder(ssl, p, end,
-                                     MBEDTLS_SSL_TLS1_3_PSK_EXTERNAL,
-                                     hash_alg, psk, psk_len,
-                                     &output_len);
+        unsigned char early_secret[MBEDTLS_TLS1_3_MD_MAX_SIZE];
+        unsigned char binder_key[MBEDTLS_TLS1_3_MD_MAX_SIZE];
+
+        ret = mbedtls_ssl_tls13_derive_psk_secrets(
+            hash_alg, psk, psk_len, MBEDTLS_SSL_TLS1_3_PSK_EXTERNAL,
+            early_secret, binder_key);
+        if (ret == 0) {
+            ret = ssl_tls13_write_binder(ssl, p, end, hash_alg, binder_key,
+                                         &output_len);
+        }
+        mbedtls_platform_zeroize(early_secret, sizeof(early_secret));
+        mbedtls_platform_zeroize(binder_key, sizeof(binder_key));
         if (ret != 0) {
             return ret;
         }
@@ -1126,6 +1243,12 @@ static int ssl_tls13_parse_server_pre_shared_key_ext(mbedtls_ssl_context *ssl,
         return ret;
     }
 
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (selected_identity == 0 && ssl_tls13_has_configured_ticket(ssl)) {
+        ssl_tls13_ticket_set_hs_early_secret(ssl, hash_alg);
+    }
+#endif
+
     return 0;
 }
 #endif /* MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED */
@@ -1255,6 +1378,7 @@ int mbedtls_ssl_tls13_finalize_client_hello(mbedtls_ssl_context *ssl)
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_set_hs_psk", ret);
             return ret;
         }
+        ssl_tls13_ticket_set_hs_early_secret(ssl, hash_alg);
 
         /*
          * Early data are going to be encrypted using the ciphersuite
@@ -2718,6 +2842,10 @@ static int ssl_tls13_flush_buffers(mbedtls_ssl_context *ssl)
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_handshake_wrapup(mbedtls_ssl_context *ssl)
 {
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED) && \
+    defined(MBEDTLS_SSL_GROUP_HINTS_C)
+    ssl_tls13_update_group_hint(ssl);
+#endif
 
     mbedtls_ssl_tls13_handshake_wrapup(ssl);
 
@@ -2994,6 +3122,16 @@ static int ssl_tls13_postprocess_new_session_ticket(mbedtls_ssl_context *ssl,
                           session->resumption_key,
                           session->resumption_key_len);
 
+    session->psk_secrets_len = 0;
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
+    /* Derive the secrets of the new PSK now, rather than during the
+     * handshake that resumes the session. */
+    ret = ssl_tls13_session_get_psk_secrets(session, psa_hash_alg);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+
     /* Set ticket_flags depends on the selected key exchange modes */
     mbedtls_ssl_tls13_session_set_ticket_flags(
         session, ssl->conf->tls13_kex_modes);
@@ -3040,6 +3178,9 @@ static int ssl_tls13_process_new_session_ticket(mbedtls_ssl_context *ssl)
              * be exported now and we signal the ticket to the application.
              */
             ssl->session->exported = 0;
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+            mbedtls_ssl_session_store_capture(ssl);
+#endif
             ret = MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET;
             break;
 
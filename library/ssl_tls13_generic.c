@@ -466,6 +466,14 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
     }
 
     /* In case we tried to reuse a session but it failed */
+#if defined(MBEDTLS_SSL_CERT_STORE_C)
+    if (ssl->session_negotiate->peer_cert != NULL &&
+        ssl->session_negotiate->peer_cert_shared) {
+        mbedtls_ssl_cert_store_release(ssl->session_negotiate->peer_cert);
+        ssl->session_negotiate->peer_cert = NULL;
+        ssl->session_negotiate->peer_cert_shared = 0;
+    }
+#endif
     if (ssl->session_negotiate->peer_cert != NULL) {
         mbedtls_x509_crt_free(ssl->session_negotiate->peer_cert);
         mbedtls_free(ssl->session_negotiate->peer_cert);
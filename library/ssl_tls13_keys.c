@@ -829,23 +829,14 @@ exit:
     return ret;
 }
 
-int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
-                                        const psa_algorithm_t hash_alg,
-                                        unsigned char const *psk, size_t psk_len,
-                                        int psk_type,
-                                        unsigned char const *transcript,
-                                        unsigned char *result)
+int mbedtls_ssl_tls13_derive_psk_secrets(psa_algorithm_t hash_alg,
+                                         unsigned char const *psk, size_t psk_len,
+                                         int psk_type,
+                                         unsigned char *early_secret,
+                                         unsigned char *binder_key)
 {
     int ret = 0;
-    unsigned char binder_key[PSA_MAC_MAX_SIZE];
-    unsigned char early_secret[PSA_MAC_MAX_SIZE];
     size_t const hash_len = PSA_HASH_LENGTH(hash_alg);
-    size_t actual_len;
-
-#if !defined(MBEDTLS_DEBUG_C)
-    ssl = NULL; /* make sure we don't use it except for debug */
-    ((void) ssl);
-#endif
 
     /* We should never call this function with an unknown hash,
      * but add an assertion anyway. */
@@ -869,13 +860,9 @@ int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
                                           psk, psk_len,   /* Input      */
                                           early_secret);
     if (ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_evolve_secret", ret);
-        goto exit;
+        return ret;
     }
 
-    MBEDTLS_SSL_DEBUG_BUF(4, "mbedtls_ssl_tls13_create_psk_binder",
-                          early_secret, hash_len);
-
     if (psk_type == MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION) {
         ret = mbedtls_ssl_tls13_derive_secret(
             hash_alg,
@@ -883,7 +870,6 @@ int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
             MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(res_binder),
             NULL, 0, MBEDTLS_SSL_TLS1_3_CONTEXT_UNHASHED,
             binder_key, hash_len);
-        MBEDTLS_SSL_DEBUG_MSG(4, ("Derive Early Secret with 'res binder'"));
     } else {
         ret = mbedtls_ssl_tls13_derive_secret(
             hash_alg,
@@ -891,12 +877,27 @@ int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
             MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(ext_binder),
             NULL, 0, MBEDTLS_SSL_TLS1_3_CONTEXT_UNHASHED,
             binder_key, hash_len);
-        MBEDTLS_SSL_DEBUG_MSG(4, ("Derive Early Secret with 'ext binder'"));
     }
 
-    if (ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_derive_secret", ret);
-        goto exit;
+    return ret;
+}
+
+int mbedtls_ssl_tls13_create_psk_binder_with_key(mbedtls_ssl_context *ssl,
+                                                 const psa_algorithm_t hash_alg,
+                                                 unsigned char const *binder_key,
+                                                 unsigned char const *transcript,
+                                                 unsigned char *result)
+{
+    int ret = 0;
+    size_t actual_len;
+
+#if !defined(MBEDTLS_DEBUG_C)
+    ssl = NULL; /* make sure we don't use it except for debug */
+    ((void) ssl);
+#endif
+
+    if (!PSA_ALG_IS_HASH(hash_alg)) {
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
     /*
@@ -907,11 +908,40 @@ int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
     ret = ssl_tls13_calc_finished_core(hash_alg, binder_key, transcript,
                                        result, &actual_len);
     if (ret != 0) {
-        goto exit;
+        return ret;
     }
 
     MBEDTLS_SSL_DEBUG_BUF(3, "psk binder", result, actual_len);
 
+    return 0;
+}
+
+int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
+                                        const psa_algorithm_t hash_alg,
+                                        unsigned char const *psk, size_t psk_len,
+                                        int psk_type,
+                                        unsigned char const *transcript,
+                                        unsigned char *result)
+{
+    int ret = 0;
+    unsigned char binder_key[PSA_MAC_MAX_SIZE];
+    unsigned char early_secret[PSA_MAC_MAX_SIZE];
+
+    ret = mbedtls_ssl_tls13_derive_psk_secrets(hash_alg, psk, psk_len,
+                                               psk_type, early_secret,
+                                               binder_key);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_derive_psk_secrets", ret);
+        goto exit;
+    }
+
+    MBEDTLS_SSL_DEBUG_BUF(4, "mbedtls_ssl_tls13_create_psk_binder",
+                          early_secret, PSA_HASH_LENGTH(hash_alg));
+
+    ret = mbedtls_ssl_tls13_create_psk_binder_with_key(ssl, hash_alg,
+                                                       binder_key, transcript,
+                                                       result);
+
 exit:
 
     mbedtls_platform_zeroize(early_secret, sizeof(early_secret));
@@ -923,7 +953,7 @@ int mbedtls_ssl_tls13_populate_transform(
     mbedtls_ssl_transform *transform,
     int endpoint, int ciphersuite,
     mbedtls_ssl_key_set const *traffic_keys,
-    mbedtls_ssl_context *ssl /* DEBUG ONLY */)
+    mbedtls_ssl_context *ssl /* DEBUG AND KEY USAGE ONLY */)
 {
     const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
     unsigned char const *key_enc;
@@ -936,6 +966,7 @@ int mbedtls_ssl_tls13_populate_transform(
     psa_algorithm_t alg;
     size_t key_bits;
     psa_status_t status = PSA_SUCCESS;
+    psa_key_usage_t extra_usage = mbedtls_ssl_transform_key_usage(ssl);
 
 #if !defined(MBEDTLS_DEBUG_C)
     ssl = NULL; /* make sure we don't use it except for those cases */
@@ -1013,7 +1044,8 @@ int mbedtls_ssl_tls13_populate_transform(
     transform->psa_alg = alg;
 
     if (alg != MBEDTLS_SSL_NULL_CIPHER) {
-        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_ENCRYPT);
+        psa_set_key_usage_flags(&attributes,
+                                PSA_KEY_USAGE_ENCRYPT | extra_usage);
         psa_set_key_algorithm(&attributes, alg);
         psa_set_key_type(&attributes, key_type);
 
@@ -1026,7 +1058,8 @@ int mbedtls_ssl_tls13_populate_transform(
             return PSA_TO_MBEDTLS_ERR(status);
         }
 
-        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_DECRYPT);
+        psa_set_key_usage_flags(&attributes,
+                                PSA_KEY_USAGE_DECRYPT | extra_usage);
 
         if ((status = psa_import_key(&attributes,
                                      key_dec,
@@ -1038,6 +1071,8 @@ int mbedtls_ssl_tls13_populate_transform(
         }
     }
 
+    mbedtls_ssl_transform_bind_record_ops(transform);
+
     return 0;
 }
 
@@ -1241,6 +1276,14 @@ int mbedtls_ssl_tls13_key_schedule_stage_early(mbedtls_ssl_context *ssl)
     hash_alg = mbedtls_md_psa_alg_from_type((mbedtls_md_type_t) handshake->ciphersuite_info->mac);
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
     if (mbedtls_ssl_tls13_key_exchange_mode_with_psk(ssl)) {
+        if (handshake->tls13_psk_early_secret_alg == hash_alg) {
+            /* Already derived along with the PSK binder. */
+            MBEDTLS_SSL_DEBUG_BUF(4, "mbedtls_ssl_tls13_key_schedule_stage_early",
+                                  handshake->tls13_master_secrets.early,
+                                  PSA_HASH_LENGTH(hash_alg));
+            return 0;
+        }
+
         ret = mbedtls_ssl_tls13_export_handshake_psk(ssl, &psk, &psk_len);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_export_handshake_psk",
@@ -1483,6 +1526,10 @@ static int ssl_tls13_key_schedule_stage_handshake(mbedtls_ssl_context *ssl)
     /*
      * Compute the Handshake Secret
      */
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
+    /* It replaces the early secret in tls13_master_secrets. */
+    handshake->tls13_psk_early_secret_alg = PSA_ALG_NONE;
+#endif
     ret = mbedtls_ssl_tls13_evolve_secret(
         hash_alg, handshake->tls13_master_secrets.early,
         shared_secret, shared_secret_len,
@@ -484,6 +484,72 @@ int mbedtls_ssl_tls13_create_psk_binder(mbedtls_ssl_context *ssl,
                                         unsigned char const *transcript,
                                         unsigned char *result);
 
+/**
+ * \brief             Derive the early secret and the binder key of a
+ *                    TLS 1.3 PSK.
+ *
+ * <tt>
+ *                    0
+ *                    |
+ *                    v
+ *          PSK ->  HKDF-Extract = Early Secret
+ *                    |
+ *                    +-----> Derive-Secret(., "ext binder" | "res binder", "")
+ *                    .                     = binder_key
+ * </tt>
+ *
+ * \note              Both only depend on the PSK, so they can be derived once
+ *                    and then used for every binder computed with
+ *                    mbedtls_ssl_tls13_create_psk_binder_with_key() and for
+ *                    the early stage of the key schedule.
+ *
+ * \param hash_alg    The hash algorithm associated to the PSK \p psk.
+ * \param psk         The buffer holding the PSK.
+ * \param psk_len     The size of \p psk in bytes.
+ * \param psk_type    This indicates whether the PSK \p psk is externally
+ *                    provisioned (#MBEDTLS_SSL_TLS1_3_PSK_EXTERNAL) or a
+ *                    resumption PSK (#MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION).
+ * \param early_secret The address at which to store the early secret. This
+ *                    must be writable, and its size must be equal to the
+ *                    digest size of the hash algorithm represented by
+ *                    \p hash_alg.
+ * \param binder_key  The address at which to store the binder key, of the
+ *                    same size as \p early_secret.
+ *
+ * \returns           \c 0 on success.
+ * \returns           A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_derive_psk_secrets(psa_algorithm_t hash_alg,
+                                         unsigned char const *psk, size_t psk_len,
+                                         int psk_type,
+                                         unsigned char *early_secret,
+                                         unsigned char *binder_key);
+
+/**
+ * \brief             Calculate a TLS 1.3 PSK binder from the binder key
+ *                    derived with mbedtls_ssl_tls13_derive_psk_secrets().
+ *
+ * \param ssl         The SSL context. This is used for debugging only and may
+ *                    be \c NULL if MBEDTLS_DEBUG_C is disabled.
+ * \param hash_alg    The hash algorithm associated to the PSK.
+ * \param binder_key  The binder key of the PSK.
+ * \param transcript  The handshake transcript up to the point where the
+ *                    PSK binder calculation happens, as for
+ *                    mbedtls_ssl_tls13_create_psk_binder().
+ * \param result      The address at which to store the PSK binder on success,
+ *                    as for mbedtls_ssl_tls13_create_psk_binder().
+ *
+ * \returns           \c 0 on success.
+ * \returns           A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_create_psk_binder_with_key(mbedtls_ssl_context *ssl,
+                                                 const psa_algorithm_t hash_alg,
+                                                 unsigned char const *binder_key,
+                                                 unsigned char const *transcript,
+                                                 unsigned char *result);
+
 /**
  * \bref Setup an SSL transform structure representing the
  *       record protection mechanism used by TLS 1.3
@@ -24,12 +24,19 @@ static const mbedtls_ssl_ciphersuite_t *ssl_tls13_validate_peer_ciphersuite(
     mbedtls_ssl_context *ssl,
     unsigned int cipher_suite)
 {
-    const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
-    if (!mbedtls_ssl_tls13_cipher_suite_is_offered(ssl, cipher_suite)) {
+    const int *ciphersuite_list = ssl->conf->ciphersuite_list;
+    const mbedtls_ssl_ciphersuite_t *ciphersuite_info = NULL;
+
+    for (size_t i = 0; ciphersuite_list[i] != 0; i++) {
+        if (ciphersuite_list[i] == (int) cipher_suite) {
+            ciphersuite_info = mbedtls_ssl_conf_ciphersuite_at(ssl->conf, i);
+            break;
+        }
+    }
+    if (ciphersuite_info == NULL) {
         return NULL;
     }
 
-    ciphersuite_info = mbedtls_ssl_ciphersuite_from_id(cipher_suite);
     if ((mbedtls_ssl_validate_ciphersuite(ssl, ciphersuite_info,
                                           ssl->tls_version,
                                           ssl->tls_version) != 0)) {
@@ -308,6 +315,11 @@ static int ssl_tls13_offered_psks_check_identity_match_ticket(
                 age_diff));
         goto exit;
     }
+
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    /* Bounded by MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE */
+    ssl->handshake->early_data_age_diff = (int32_t) age_diff;
+#endif
 #endif /* MBEDTLS_HAVE_TIME */
 
     /*
@@ -413,6 +425,8 @@ static int ssl_tls13_offered_psks_check_binder_match(
     unsigned char *psk;
     size_t psk_len;
     unsigned char server_computed_binder[PSA_HASH_MAX_SIZE];
+    unsigned char early_secret[PSA_HASH_MAX_SIZE];
+    unsigned char binder_key[PSA_HASH_MAX_SIZE];
 
     if (binder_len != PSA_HASH_LENGTH(psk_hash_alg)) {
         return SSL_TLS1_3_BINDER_DOES_NOT_MATCH;
@@ -431,14 +445,18 @@ static int ssl_tls13_offered_psks_check_binder_match(
         return ret;
     }
 
-    ret = mbedtls_ssl_tls13_create_psk_binder(ssl, psk_hash_alg,
-                                              psk, psk_len, psk_type,
-                                              transcript,
-                                              server_computed_binder);
+    ret = mbedtls_ssl_tls13_derive_psk_secrets(psk_hash_alg, psk, psk_len,
+                                               psk_type, early_secret,
+                                               binder_key);
     mbedtls_free((void *) psk);
+    if (ret == 0) {
+        ret = mbedtls_ssl_tls13_create_psk_binder_with_key(
+            ssl, psk_hash_alg, binder_key, transcript, server_computed_binder);
+    }
     if (ret != 0) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("PSK binder calculation failed."));
-        return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+        ret = MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+        goto exit;
     }
 
     MBEDTLS_SSL_DEBUG_BUF(3, "psk binder ( computed ): ",
@@ -448,12 +466,23 @@ static int ssl_tls13_offered_psks_check_binder_match(
     if (mbedtls_ct_memcmp(server_computed_binder,
                           binder,
                           PSA_HASH_LENGTH(psk_hash_alg)) == 0) {
-        return SSL_TLS1_3_BINDER_MATCH;
+        /* Keep the early secret for the key schedule, which starts with
+         * this PSK. */
+        memcpy(ssl->handshake->tls13_master_secrets.early, early_secret,
+               PSA_HASH_LENGTH(psk_hash_alg));
+        ssl->handshake->tls13_psk_early_secret_alg = psk_hash_alg;
+        ret = SSL_TLS1_3_BINDER_MATCH;
+        goto exit;
     }
 
+    ret = SSL_TLS1_3_BINDER_DOES_NOT_MATCH;
+
+exit:
     mbedtls_platform_zeroize(server_computed_binder,
                              sizeof(server_computed_binder));
-    return SSL_TLS1_3_BINDER_DOES_NOT_MATCH;
+    mbedtls_platform_zeroize(early_secret, sizeof(early_secret));
+    mbedtls_platform_zeroize(binder_key, sizeof(binder_key));
+    return ret;
 }
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
@@ -681,6 +710,14 @@ static int ssl_tls13_parse_pre_shared_key_ext(
 
         matched_identity = identity_id;
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+        if (identity_id == 0 &&
+            binder_len <= sizeof(ssl->handshake->early_data_binder)) {
+            memcpy(ssl->handshake->early_data_binder, binder, binder_len);
+            ssl->handshake->early_data_binder_len = binder_len;
+        }
+#endif
+
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
         if (psk->type == MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION) {
             ret = ssl_tls13_session_copy_ticket(ssl->session_negotiate,
@@ -1098,9 +1135,74 @@ static psa_algorithm_t ssl_tls13_iana_sig_alg_to_psa_alg(uint16_t sig_alg)
     }
 }
 
+/*
+ * Check whether a certificate can be used to sign with a given TLS 1.3
+ * signature algorithm.
+ */
+static int ssl_tls13_key_cert_can_sign(mbedtls_x509_crt *cert,
+                                       uint16_t sig_alg)
+{
+    psa_algorithm_t psa_alg = ssl_tls13_iana_sig_alg_to_psa_alg(sig_alg);
+
+    return mbedtls_ssl_tls13_check_sig_alg_cert_key_match(sig_alg,
+                                                           &cert->pk) &&
+           psa_alg != PSA_ALG_NONE &&
+           mbedtls_pk_can_do_ext(&cert->pk, psa_alg,
+                                 PSA_KEY_USAGE_SIGN_HASH) == 1;
+}
+
+/*
+ * This avoids sending the client a cert it'll reject based on
+ * keyUsage or other extensions.
+ */
+static int ssl_tls13_key_cert_usage_ok(const mbedtls_x509_crt *cert)
+{
+    if (mbedtls_x509_crt_check_key_usage(
+            cert, MBEDTLS_X509_KU_DIGITAL_SIGNATURE) != 0 ||
+        mbedtls_x509_crt_check_extended_key_usage(
+            cert, MBEDTLS_OID_SERVER_AUTH,
+            MBEDTLS_OID_SIZE(MBEDTLS_OID_SERVER_AUTH)) != 0) {
+        return 0;
+    }
+
+    return 1;
+}
+
+uint32_t mbedtls_ssl_tls13_key_cert_sig_algs(mbedtls_x509_crt *cert)
+{
+    static const uint16_t candidates[] = {
+        MBEDTLS_TLS1_3_SIG_ECDSA_SECP256R1_SHA256,
+        MBEDTLS_TLS1_3_SIG_ECDSA_SECP384R1_SHA384,
+        MBEDTLS_TLS1_3_SIG_ECDSA_SECP521R1_SHA512,
+        MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA256,
+        MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA384,
+        MBEDTLS_TLS1_3_SIG_RSA_PSS_RSAE_SHA512,
+    };
+    uint32_t sig_algs = MBEDTLS_SSL_KEY_CERT_SIG_ALGS_VALID;
+    size_t i;
+
+    if (cert == NULL || !ssl_tls13_key_cert_usage_ok(cert)) {
+        return sig_algs;
+    }
+
+    for (i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++) {
+        if (mbedtls_ssl_tls13_sig_alg_for_cert_verify_is_supported(
+                candidates[i]) &&
+            ssl_tls13_key_cert_can_sign(cert, candidates[i])) {
+            sig_algs |= mbedtls_ssl_tls13_sig_alg_bit(candidates[i]);
+        }
+    }
+
+    return sig_algs;
+}
+
 /*
  * Pick best ( private key, certificate chain ) pair based on the signature
  * algorithms supported by the client.
+ *
+ * Certificates registered with a precomputed signature algorithm bitmap
+ * (see mbedtls_ssl_tls13_key_cert_sig_algs()) are matched with a single
+ * bit test instead of parsing their extensions and key again.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_pick_key_cert(mbedtls_ssl_context *ssl)
@@ -1131,50 +1233,42 @@ static int ssl_tls13_pick_key_cert(mbedtls_ssl_context *ssl)
 
         for (key_cert = key_cert_list; key_cert != NULL;
              key_cert = key_cert->next) {
-            psa_algorithm_t psa_alg = PSA_ALG_NONE;
-
             MBEDTLS_SSL_DEBUG_CRT(3, "certificate (chain) candidate",
                                   key_cert->cert);
 
-            /*
-             * This avoids sending the client a cert it'll reject based on
-             * keyUsage or other extensions.
-             */
-            if (mbedtls_x509_crt_check_key_usage(
-                    key_cert->cert, MBEDTLS_X509_KU_DIGITAL_SIGNATURE) != 0 ||
-                mbedtls_x509_crt_check_extended_key_usage(
-                    key_cert->cert, MBEDTLS_OID_SERVER_AUTH,
-                    MBEDTLS_OID_SIZE(MBEDTLS_OID_SERVER_AUTH)) != 0) {
-                MBEDTLS_SSL_DEBUG_MSG(3, ("certificate mismatch: "
-                                          "(extended) key usage extension"));
-                continue;
-            }
+            if (key_cert->sig_algs & MBEDTLS_SSL_KEY_CERT_SIG_ALGS_VALID) {
+                if ((key_cert->sig_algs &
+                     mbedtls_ssl_tls13_sig_alg_bit(*sig_alg)) == 0) {
+                    continue;
+                }
+            } else {
+                if (!ssl_tls13_key_cert_usage_ok(key_cert->cert)) {
+                    MBEDTLS_SSL_DEBUG_MSG(3, ("certificate mismatch: "
+                                              "(extended) key usage extension"));
+                    continue;
+                }
 
-            MBEDTLS_SSL_DEBUG_MSG(3,
-                                  ("ssl_tls13_pick_key_cert:"
-                                   "check signature algorithm %s [%04x]",
-                                   mbedtls_ssl_sig_alg_to_str(*sig_alg),
-                                   *sig_alg));
-            psa_alg = ssl_tls13_iana_sig_alg_to_psa_alg(*sig_alg);
-
-            if (mbedtls_ssl_tls13_check_sig_alg_cert_key_match(
-                    *sig_alg, &key_cert->cert->pk)
-                && psa_alg != PSA_ALG_NONE &&
-                mbedtls_pk_can_do_ext(&key_cert->cert->pk, psa_alg,
-                                      PSA_KEY_USAGE_SIGN_HASH) == 1
-                ) {
-                ssl->handshake->key_cert = key_cert;
                 MBEDTLS_SSL_DEBUG_MSG(3,
                                       ("ssl_tls13_pick_key_cert:"
-                                       "selected signature algorithm"
-                                       " %s [%04x]",
+                                       "check signature algorithm %s [%04x]",
                                        mbedtls_ssl_sig_alg_to_str(*sig_alg),
                                        *sig_alg));
-                MBEDTLS_SSL_DEBUG_CRT(
-                    3, "selected certificate (chain)",
-                    ssl->handshake->key_cert->cert);
-                return 0;
+                if (!ssl_tls13_key_cert_can_sign(key_cert->cert, *sig_alg)) {
+                    continue;
+                }
             }
+
+            ssl->handshake->key_cert = key_cert;
+            MBEDTLS_SSL_DEBUG_MSG(3,
+                                  ("ssl_tls13_pick_key_cert:"
+                                   "selected signature algorithm"
+                                   " %s [%04x]",
+                                   mbedtls_ssl_sig_alg_to_str(*sig_alg),
+                                   *sig_alg));
+            MBEDTLS_SSL_DEBUG_CRT(
+                3, "selected certificate (chain)",
+                ssl->handshake->key_cert->cert);
+            return 0;
         }
     }
 
@@ -1863,8 +1957,83 @@ static int ssl_tls13_check_early_data_requirements(mbedtls_ssl_context *ssl)
 
     return 0;
 }
+
+/*
+ * RFC 8446 section 8
+ *
+ * Accept early data at most once per ClientHello, and only from fresh
+ * ClientHellos. This is checked after all other requirements so that only
+ * ClientHellos whose early data would otherwise be accepted are recorded.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_check_early_data_replay(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    if (ssl->conf->f_early_data_replay == NULL) {
+        return 0;
+    }
+
+    if (handshake->early_data_binder_len == 0 ||
+        ssl->conf->f_early_data_replay(ssl->conf->p_early_data_replay,
+                                       handshake->early_data_binder,
+                                       handshake->early_data_binder_len,
+                                       handshake->early_data_age_diff) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(
+            1, ("EarlyData: rejected, replayed or stale ClientHello."));
+        return -1;
+    }
+
+    return 0;
+}
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 
+/*
+ * Ask the admission control callback, if any, whether to go on with the
+ * handshake. See mbedtls_ssl_conf_admission().
+ *
+ * TLS 1.3 is only supported over connection-oriented transports, so the
+ * address of the client is already verified and a HelloRetryRequest with a
+ * cookie would not prove anything more: a request for a cookie is treated as
+ * an acceptance.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_check_admission(mbedtls_ssl_context *ssl)
+{
+    int ret;
+    int flags = MBEDTLS_SSL_ADMISSION_ADDRESS_VERIFIED;
+
+    /* The handshake was already admitted when the first ClientHello was
+     * received. */
+    if (ssl->conf->f_admission == NULL ||
+        ssl->handshake->hello_retry_request_flag) {
+        return 0;
+    }
+
+    /* The binder of the PSK has been checked at this point */
+    if (mbedtls_ssl_tls13_key_exchange_mode_with_psk(ssl)) {
+        flags |= MBEDTLS_SSL_ADMISSION_RESUMPTION;
+    }
+
+    ret = ssl->conf->f_admission(ssl->conf->p_admission,
+                                 ssl->peer_addr_len != 0 ? ssl->peer_addr : NULL,
+                                 ssl->peer_addr_len, flags);
+    if (ret < 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_admission", ret);
+        return ret;
+    }
+
+    if (ret != MBEDTLS_SSL_ADMISSION_ACCEPT &&
+        ret != MBEDTLS_SSL_ADMISSION_REQUIRE_COOKIE) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake rejected by admission control"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_HANDSHAKE_FAILURE,
+                                     MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED);
+        return MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED;
+    }
+
+    return 0;
+}
+
 /* Update the handshake state machine */
 
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -1895,7 +2064,8 @@ static int ssl_tls13_postprocess_client_hello(mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_SSL_EARLY_DATA)
     if (ssl->handshake->received_extensions & MBEDTLS_SSL_EXT_MASK(EARLY_DATA)) {
         ssl->handshake->early_data_accepted =
-            (!hrr_required) && (ssl_tls13_check_early_data_requirements(ssl) == 0);
+            (!hrr_required) && (ssl_tls13_check_early_data_requirements(ssl) == 0) &&
+            (ssl_tls13_check_early_data_replay(ssl) == 0);
 
         if (ssl->handshake->early_data_accepted) {
             ret = mbedtls_ssl_tls13_compute_early_transform(ssl);
@@ -1967,6 +2137,8 @@ static int ssl_tls13_process_client_hello(mbedtls_ssl_context *ssl)
         return 0;
     }
 
+    MBEDTLS_SSL_PROC_CHK(ssl_tls13_check_admission(ssl));
+
     MBEDTLS_SSL_PROC_CHK(
         ssl_tls13_postprocess_client_hello(ssl, parse_client_hello_ret ==
                                            SSL_CLIENT_HELLO_HRR_REQUIRED));
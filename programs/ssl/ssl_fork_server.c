@@ -37,6 +37,10 @@ int main(void)
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/timing.h"
 
+#if defined(MBEDTLS_SSL_SHM_CACHE_C)
+#include "mbedtls/ssl_shm_cache.h"
+#endif
+
 #include <string.h>
 #include <signal.h>
 
@@ -76,6 +80,9 @@ int main(void)
     mbedtls_ssl_config conf;
     mbedtls_x509_crt srvcert;
     mbedtls_pk_context pkey;
+#if defined(MBEDTLS_SSL_SHM_CACHE_C)
+    mbedtls_ssl_shm_cache_context cache;
+#endif
 
     mbedtls_net_init(&listen_fd);
     mbedtls_net_init(&client_fd);
@@ -85,6 +92,9 @@ int main(void)
     mbedtls_pk_init(&pkey);
     mbedtls_x509_crt_init(&srvcert);
     mbedtls_ctr_drbg_init(&ctr_drbg);
+#if defined(MBEDTLS_SSL_SHM_CACHE_C)
+    mbedtls_ssl_shm_cache_init(&cache);
+#endif
 
     psa_status_t status = psa_crypto_init();
     if (status != PSA_SUCCESS) {
@@ -168,6 +178,19 @@ int main(void)
         goto exit;
     }
 
+#if defined(MBEDTLS_SSL_SHM_CACHE_C)
+    /* The cache is mapped before forking, so that all the children share
+     * it and a client can resume its session with any of them. */
+    if ((ret = mbedtls_ssl_shm_cache_setup(&cache, 0, 0)) != 0) {
+        mbedtls_printf(" failed!  mbedtls_ssl_shm_cache_setup returned %d\n\n", ret);
+        goto exit;
+    }
+
+    mbedtls_ssl_conf_session_cache(&conf, &cache,
+                                   mbedtls_ssl_shm_cache_get,
+                                   mbedtls_ssl_shm_cache_set);
+#endif
+
     mbedtls_printf(" ok\n");
 
     /*
@@ -366,6 +389,9 @@ exit:
     mbedtls_ssl_config_free(&conf);
     mbedtls_ctr_drbg_free(&ctr_drbg);
     mbedtls_entropy_free(&entropy);
+#if defined(MBEDTLS_SSL_SHM_CACHE_C)
+    mbedtls_ssl_shm_cache_free(&cache);
+#endif
     mbedtls_psa_crypto_free();
 
     mbedtls_exit(exit_code);
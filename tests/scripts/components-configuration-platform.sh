@@ -109,3 +109,22 @@ component_test_no_64bit_multiplication () {
 
 
 
+
+component_test_full_linux_modules () {
+    # These modules are excluded from the full config because they depend
+    # on Linux (or Unix) interfaces.
+    msg "build: full config + Linux-specific modules (ASan build)" # ~ 5 min
+    scripts/config.py full
+    scripts/config.py set MBEDTLS_NET_URING_C
+    scripts/config.py set MBEDTLS_SSL_KTLS_C
+    scripts/config.py set MBEDTLS_SSL_SHM_CACHE_C
+    CC=$ASAN_CC cmake -D CMAKE_BUILD_TYPE:String=Asan .
+    make
+
+    msg "test: full config + Linux-specific modules (ASan build)"
+    make test
+}
+
+support_test_full_linux_modules () {
+    [[ $(uname) == "Linux" ]]
+}
@@ -291,6 +291,16 @@ component_build_no_ssl_cli () {
     make CC=gcc CFLAGS='-Werror -Wall -Wextra -O1 -Wmissing-prototypes'
 }
 
+component_build_tls13_psk_only_group_hints () {
+    # The group hints only apply to the ephemeral key exchange modes
+    msg "build: full config with only the TLS 1.3 PSK key exchange mode, make, gcc" # ~ 30s
+    scripts/config.py full
+    scripts/config.py set MBEDTLS_SSL_GROUP_HINTS_C
+    scripts/config.py unset MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+    scripts/config.py unset MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+    make CC=gcc CFLAGS='-Werror -Wall -Wextra -O1 -Wmissing-prototypes'
+}
+
 component_test_no_max_fragment_length () {
     # Run max fragment length tests with MFL disabled
     msg "build: default config except MFL extension (ASan build)" # ~ 30s
@@ -1601,6 +1601,9 @@ int mbedtls_test_ssl_build_transforms(mbedtls_ssl_transform *t_in,
     }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
+    mbedtls_ssl_transform_bind_record_ops(t_in);
+    mbedtls_ssl_transform_bind_record_ops(t_out);
+
 cleanup:
 
     mbedtls_free(key0);